@@ -0,0 +1,177 @@
+/*
+ * Copyright(C) 2015, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef ALLOYCOMPUTEGRAPH_H_
+#define ALLOYCOMPUTEGRAPH_H_
+#include "AlloyAny.h"
+#include "AlloyCommon.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+namespace aly {
+bool SANITY_CHECK_COMPUTE_GRAPH();
+struct Packet: public AnyInterface {
+protected:
+	virtual void setValueImpl(Any const & value) = 0;
+	virtual Any getValueImpl() const = 0;
+};
+template<class T> class PacketImpl: public Packet {
+protected:
+	T value;
+	std::string name;
+	virtual void setValueImpl(Any const & val) override {
+		value = AnyCast<T>(val);
+	}
+	virtual Any getValueImpl() const override {
+		return value;
+	}
+public:
+	PacketImpl(const std::string& name, const T& value) :
+			value(value), name(name) {
+	}
+	PacketImpl(const std::string& name = "") :
+			name(name) {
+	}
+	std::string getName() const {
+		return name;
+	}
+	void setName(const std::string& name) {
+		this->name = name;
+	}
+};
+class ComputeGraph;
+/*
+ Headless node of a ComputeGraph. Each input slot is fed by at most one output slot of an upstream
+ node. The evaluation function reads inputs and writes outputs. It runs on a pool worker and must
+ only touch its own node.
+ */
+class ComputeNode {
+protected:
+	struct Source {
+		ComputeNode* node = nullptr;
+		int output = -1;
+	};
+	std::string name;
+	std::vector<std::shared_ptr<Packet>> inputs;
+	std::vector<std::shared_ptr<Packet>> outputs;
+	std::vector<Source> sources;
+	std::function<void(ComputeNode& node)> evaluateFunc;
+	bool dirty = true;
+	friend class ComputeGraph;
+public:
+	ComputeNode(const std::string& name, int inputSize, int outputSize,
+			const std::function<void(ComputeNode& node)>& func = nullptr) :
+			name(name), inputs(inputSize), outputs(outputSize), sources(inputSize), evaluateFunc(
+					func) {
+	}
+	const std::string& getName() const {
+		return name;
+	}
+	size_t getInputSize() const {
+		return inputs.size();
+	}
+	size_t getOutputSize() const {
+		return outputs.size();
+	}
+	const std::shared_ptr<Packet>& getInput(size_t i) const {
+		if (i >= inputs.size()) {
+			throw std::runtime_error(MakeString() << "Node " << name << " input index out of bounds " << i << " " << inputs.size());
+		}
+		return inputs[i];
+	}
+	const std::shared_ptr<Packet>& getOutput(size_t i) const {
+		if (i >= outputs.size()) {
+			throw std::runtime_error(MakeString() << "Node " << name << " output index out of bounds " << i << " " << outputs.size());
+		}
+		return outputs[i];
+	}
+	template<class T> T getInputValue(size_t i) const {
+		const std::shared_ptr<Packet>& packet = getInput(i);
+		if (packet.get() == nullptr) {
+			throw std::runtime_error(MakeString() << "Node " << name << " input " << i << " is empty.");
+		}
+		return packet->getValue<T>();
+	}
+	//Setting an input or output outside of evaluation marks the node, and everything downstream of it, dirty.
+	void setInput(size_t i, const std::shared_ptr<Packet>& packet);
+	void setOutput(size_t i, const std::shared_ptr<Packet>& packet);
+	template<class T> void setOutputValue(size_t i, const T& value) {
+		setOutput(i, std::shared_ptr<Packet>(new PacketImpl<T>(name, value)));
+	}
+	template<class T> void setInputValue(size_t i, const T& value) {
+		setInput(i, std::shared_ptr<Packet>(new PacketImpl<T>(name, value)));
+	}
+	void setEvaluate(const std::function<void(ComputeNode& node)>& func) {
+		evaluateFunc = func;
+		dirty = true;
+	}
+	bool isDirty() const {
+		return dirty;
+	}
+	void setDirty(bool b = true) {
+		dirty = b;
+	}
+	virtual ~ComputeNode() {
+	}
+};
+typedef std::shared_ptr<ComputeNode> ComputeNodePtr;
+/*
+ Evaluator for acyclic pipelines that needs no UI or OpenGL context. Nodes are sorted
+ topologically. A node is re-evaluated only if it is dirty or downstream of a dirty node, and
+ independent nodes run concurrently on the shared worker pool. If a node throws, it stays dirty, its
+ dependents are skipped and stay dirty, and evaluate() rethrows the first error.
+ */
+class ComputeGraph {
+protected:
+	std::vector<ComputeNodePtr> nodes;
+	std::vector<ComputeNode*> order;
+	bool orderValid = false;
+	void sort();
+public:
+	ComputeNodePtr add(const ComputeNodePtr& node);
+	ComputeNodePtr add(const std::string& name, int inputSize, int outputSize,
+			const std::function<void(ComputeNode& node)>& func = nullptr) {
+		return add(ComputeNodePtr(new ComputeNode(name, inputSize, outputSize, func)));
+	}
+	bool remove(const ComputeNodePtr& node);
+	void connect(const ComputeNodePtr& source, int output, const ComputeNodePtr& destination, int input);
+	void disconnect(const ComputeNodePtr& destination, int input);
+	ComputeNodePtr getNode(const std::string& name) const;
+	const std::vector<ComputeNodePtr>& getNodes() const {
+		return nodes;
+	}
+	const std::vector<ComputeNode*>& getTopologicalOrder();
+	size_t size() const {
+		return nodes.size();
+	}
+	void clear() {
+		nodes.clear();
+		order.clear();
+		orderValid = false;
+	}
+	void markDirty();
+	//Returns the number of nodes that were evaluated.
+	int evaluate(bool parallel = true);
+};
+}
+#endif /* ALLOYCOMPUTEGRAPH_H_ */
@@ -0,0 +1,401 @@
+/*
+ * Copyright(C) 2015, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ALLOYCONNECTEDCOMPONENTS_H_
+#define ALLOYCONNECTEDCOMPONENTS_H_
+#include "AlloyImage.h"
+#include "AlloyVolume.h"
+#include <vector>
+#include <limits>
+#include <algorithm>
+/*
+ * Connected component labeling with a block-parallel union-find. The domain is split into
+ * slabs of whole rows (images), slices (volumes) or vertex ranges (graphs) that are labeled
+ * independently. Slab boundaries are then merged pairwise in a tree, so merges that run
+ * concurrently never touch the same union-find trees. Trees are always rooted at their
+ * smallest element, which numbers components in raster order of their first element and
+ * makes labels independent of the number of threads.
+ */
+namespace aly {
+bool SANITY_CHECK_CONNECTED_COMPONENTS();
+template<int M> struct ConnectedComponent {
+	size_t size;
+	//Position is the minimum corner, dimensions the extent in pixels or voxels.
+	box<int, M> bounds;
+	ConnectedComponent() :
+			size(0) {
+	}
+};
+typedef ConnectedComponent<2> ImageComponent;
+typedef ConnectedComponent<3> VolumeComponent;
+namespace detail {
+const int MAX_COMPONENT_SLABS = 64;
+struct ComponentSlab {
+	size_t begin;
+	size_t end;
+	//Sorted slab-local roots and the component index assigned to each.
+	std::vector<int> roots;
+	std::vector<int> ids;
+	ComponentSlab(size_t begin = 0, size_t end = 0) :
+			begin(begin), end(end) {
+	}
+};
+inline int UnionFindRoot(int* parent, int i) {
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+//Joins the trees of a and b under the smaller root.
+inline void UnionFindLink(int* parent, int a, int b) {
+	a = UnionFindRoot(parent, a);
+	b = UnionFindRoot(parent, b);
+	if (a < b) {
+		parent[b] = a;
+	} else if (b < a) {
+		parent[a] = b;
+	}
+}
+inline std::vector<ComponentSlab> MakeComponentSlabs(size_t planeCount, size_t planeSize) {
+	int slabCount = (int) std::min(planeCount, (size_t) MAX_COMPONENT_SLABS);
+	std::vector<ComponentSlab> slabs(slabCount);
+	for (int s = 0; s < slabCount; s++) {
+		slabs[s] = ComponentSlab(planeSize * (planeCount * s / slabCount), planeSize * (planeCount * (s + 1) / slabCount));
+	}
+	return slabs;
+}
+//Points every element of a labeled slab directly at its slab-local root and collects the roots.
+inline void FlattenComponentSlab(int* parent, ComponentSlab& slab) {
+	slab.roots.clear();
+	for (size_t i = slab.begin; i < slab.end; i++) {
+		int p = parent[i];
+		if (p < 0)
+			continue;
+		if (p == (int) i) {
+			slab.roots.push_back(p);
+		} else {
+			parent[i] = parent[p];
+		}
+	}
+}
+/*
+ * Numbers the components after all slabs are merged. Only local roots are walked, so
+ * non-root elements keep pointing at the local root of their own slab.
+ */
+inline int NumberComponents(int* parent, std::vector<ComponentSlab>& slabs) {
+	std::vector<size_t> begins(slabs.size());
+	for (size_t s = 0; s < slabs.size(); s++) {
+		begins[s] = slabs[s].begin;
+	}
+	int count = 0;
+	for (ComponentSlab& slab : slabs) {
+		slab.ids.resize(slab.roots.size());
+		for (size_t k = 0; k < slab.roots.size(); k++) {
+			int r = slab.roots[k];
+			int g = UnionFindRoot(parent, r);
+			if (g == r) {
+				slab.ids[k] = count++;
+			} else {
+				const ComponentSlab& other = slabs[std::upper_bound(begins.begin(), begins.end(), (size_t) g) - begins.begin() - 1];
+				slab.ids[k] = other.ids[std::lower_bound(other.roots.begin(), other.roots.end(), g) - other.roots.begin()];
+			}
+		}
+	}
+	return count;
+}
+/*
+ * Replaces parent links of a slab with component indexes. visit(k,i) is called in index
+ * order for every labeled element i with the position k of its root in slab.roots.
+ */
+template<class F> void RelabelComponentSlab(int* parent, ComponentSlab& slab, const F& visit) {
+	const std::vector<int>& roots = slab.roots;
+	for (size_t k = 0; k < roots.size(); k++) {
+		parent[roots[k]] = -(int) k - 2;
+	}
+	for (size_t i = slab.begin; i < slab.end; i++) {
+		int p = parent[i];
+		if (p == -1)
+			continue;
+		int k = (p < -1) ? -p - 2 : -parent[p] - 2;
+		visit(k, i);
+		if (p >= 0)
+			parent[i] = slab.ids[k];
+	}
+	for (size_t k = 0; k < roots.size(); k++) {
+		parent[roots[k]] = slab.ids[k];
+	}
+}
+struct GridOffset {
+	int dx, dy, dz;
+	ptrdiff_t offset;
+};
+/*
+ * Labels a grid stored x fastest, then y, then z. Neighbors with equal values are connected with
+ * 6, 18 or 26 connectivity. Elements equal to background, if given, are labeled -1.
+ */
+template<class T> int LabelGridComponents(const T* values, int nx, int ny, int nz, int connectivity, const T* background,
+		int* parent, std::vector<VolumeComponent>& components) {
+	components.clear();
+	size_t N = (size_t) nx * (size_t) ny * (size_t) nz;
+	if (N == 0)
+		return 0;
+	if (N > (size_t) std::numeric_limits<int>::max() - 2)
+		throw std::runtime_error(MakeString() << "Grid with " << N << " elements is too large to label.");
+	//Neighbors that precede an element in storage order.
+	std::vector<GridOffset> offsets;
+	for (int dz = -1; dz <= 0; dz++) {
+		for (int dy = -1; dy <= 1; dy++) {
+			for (int dx = -1; dx <= 1; dx++) {
+				if (dz == 0 && (dy > 0 || (dy == 0 && dx >= 0)))
+					continue;
+				int order = std::abs(dx) + std::abs(dy) + std::abs(dz);
+				if ((connectivity == 6 && order > 1) || (connectivity == 18 && order > 2))
+					continue;
+				GridOffset off;
+				off.dx = dx;
+				off.dy = dy;
+				off.dz = dz;
+				off.offset = dx + (ptrdiff_t) nx * (dy + (ptrdiff_t) ny * dz);
+				offsets.push_back(off);
+			}
+		}
+	}
+	//Slabs are whole slices, or whole rows if there is only one slice.
+	const bool rows = (nz == 1);
+	const size_t planeSize = rows ? (size_t) nx : (size_t) nx * ny;
+	std::vector<ComponentSlab> slabs = MakeComponentSlabs(rows ? ny : nz, planeSize);
+	const int slabCount = (int) slabs.size();
+	//Unions restricted to a range of whole planes. Neighbors before 'lower' are skipped.
+	auto label = [&](size_t begin, size_t end, size_t lower, bool merge) {
+		int y = (int) ((begin / nx) % ny);
+		int z = (int) (begin / ((size_t) nx * ny));
+		int x = 0;
+		for (size_t i = begin; i < end; i++) {
+			if (merge) {
+				if (parent[i] != -1) {
+					const T v = values[i];
+					for (const GridOffset& off : offsets) {
+						int xx = x + off.dx, yy = y + off.dy, zz = z + off.dz;
+						if (xx < 0 || yy < 0 || zz < 0 || xx >= nx || yy >= ny)
+							continue;
+						size_t j = i + off.offset;
+						if (j < lower && values[j] == v)
+							UnionFindLink(parent, parent[i], parent[j]);
+					}
+				}
+			} else {
+				const T v = values[i];
+				if (background != nullptr && v == *background) {
+					parent[i] = -1;
+				} else {
+					parent[i] = (int) i;
+					for (const GridOffset& off : offsets) {
+						int xx = x + off.dx, yy = y + off.dy, zz = z + off.dz;
+						if (xx < 0 || yy < 0 || zz < 0 || xx >= nx || yy >= ny)
+							continue;
+						size_t j = i + off.offset;
+						if (j >= lower && values[j] == v)
+							UnionFindLink(parent, (int) i, (int) j);
+					}
+				}
+			}
+			if (++x == nx) {
+				x = 0;
+				if (++y == ny) {
+					y = 0;
+					z++;
+				}
+			}
+		}
+	};
+#pragma omp parallel for schedule(dynamic)
+	for (int s = 0; s < slabCount; s++) {
+		label(slabs[s].begin, slabs[s].end, slabs[s].begin, false);
+		FlattenComponentSlab(parent, slabs[s]);
+	}
+	//Only the first plane of a slab has neighbors in the previous slab.
+	for (int width = 1; width < slabCount; width *= 2) {
+		int groups = (slabCount + 2 * width - 1) / (2 * width);
+#pragma omp parallel for schedule(dynamic)
+		for (int g = 0; g < groups; g++) {
+			int t = g * 2 * width + width;
+			if (t < slabCount)
+				label(slabs[t].begin, slabs[t].begin + planeSize, slabs[t].begin, true);
+		}
+	}
+	int count = NumberComponents(parent, slabs);
+	struct Bounds {
+		size_t size;
+		int3 minPt, maxPt;
+	};
+	std::vector<std::vector<Bounds>> slabBounds(slabCount);
+#pragma omp parallel for schedule(dynamic)
+	for (int s = 0; s < slabCount; s++) {
+		ComponentSlab& slab = slabs[s];
+		std::vector<Bounds>& bounds = slabBounds[s];
+		Bounds init;
+		init.size = 0;
+		init.minPt = int3(std::numeric_limits<int>::max());
+		init.maxPt = int3(std::numeric_limits<int>::min());
+		bounds.assign(slab.roots.size(), init);
+		RelabelComponentSlab(parent, slab, [&](int k, size_t i) {
+			int3 pt((int) (i % nx), (int) ((i / nx) % ny), (int) (i / ((size_t) nx * ny)));
+			Bounds& b = bounds[k];
+			b.size++;
+			b.minPt = aly::min(b.minPt, pt);
+			b.maxPt = aly::max(b.maxPt, pt);
+		});
+	}
+	std::vector<int3> maxPts(count, int3(std::numeric_limits<int>::min()));
+	components.resize(count);
+	for (ConnectedComponent<3>& comp : components) {
+		comp.bounds.position = int3(std::numeric_limits<int>::max());
+	}
+	for (int s = 0; s < slabCount; s++) {
+		for (size_t k = 0; k < slabs[s].ids.size(); k++) {
+			int id = slabs[s].ids[k];
+			const Bounds& b = slabBounds[s][k];
+			components[id].size += b.size;
+			components[id].bounds.position = aly::min(components[id].bounds.position, b.minPt);
+			maxPts[id] = aly::max(maxPts[id], b.maxPt);
+		}
+	}
+	for (int id = 0; id < count; id++) {
+		components[id].bounds.dimensions = maxPts[id] - components[id].bounds.position + int3(1);
+	}
+	return count;
+}
+template<class T, ImageType I> int LabelImageComponents(const Image<T, 1, I>& image, const T* background, Image1i& labels,
+		std::vector<ImageComponent>& components, int connectivity) {
+	if (connectivity != 4 && connectivity != 8)
+		throw std::runtime_error(MakeString() << "Image connectivity must be 4 or 8, not " << connectivity << ".");
+	labels.resize(image.width, image.height);
+	std::vector<VolumeComponent> comps;
+	int count = LabelGridComponents(image.ptr(), image.width, image.height, 1, (connectivity == 4) ? 6 : 18, background,
+			labels.ptr(), comps);
+	components.resize(count);
+	for (int i = 0; i < count; i++) {
+		components[i].size = comps[i].size;
+		components[i].bounds = box2i(comps[i].bounds.position.xy(), comps[i].bounds.dimensions.xy());
+	}
+	return count;
+}
+template<class T, ImageType I> int LabelVolumeComponents(const Volume<T, 1, I>& volume, const T* background, Volume1i& labels,
+		std::vector<VolumeComponent>& components, int connectivity) {
+	if (connectivity != 6 && connectivity != 18 && connectivity != 26)
+		throw std::runtime_error(MakeString() << "Volume connectivity must be 6, 18 or 26, not " << connectivity << ".");
+	labels.resize(volume.rows, volume.cols, volume.slices);
+	return LabelGridComponents(volume.ptr(), volume.rows, volume.cols, volume.slices, connectivity, background, labels.ptr(),
+			components);
+}
+}
+/*
+ * Labels 4 or 8 connected regions of equal value and returns the number of components.
+ * Labels are numbered in raster order of each component's first pixel.
+ */
+template<class T, ImageType I> int LabelConnectedComponents(const Image<T, 1, I>& image, Image1i& labels,
+		std::vector<ImageComponent>& components, int connectivity = 4) {
+	return detail::LabelImageComponents(image, (const T*) nullptr, labels, components, connectivity);
+}
+//Same as above, but pixels equal to background are not part of any component and are labeled -1.
+template<class T, ImageType I> int LabelConnectedComponents(const Image<T, 1, I>& image, const T& background, Image1i& labels,
+		std::vector<ImageComponent>& components, int connectivity = 4) {
+	return detail::LabelImageComponents(image, &background, labels, components, connectivity);
+}
+//Labels 6, 18 or 26 connected regions of equal value in a volume.
+template<class T, ImageType I> int LabelConnectedComponents(const Volume<T, 1, I>& volume, Volume1i& labels,
+		std::vector<VolumeComponent>& components, int connectivity = 6) {
+	return detail::LabelVolumeComponents(volume, (const T*) nullptr, labels, components, connectivity);
+}
+template<class T, ImageType I> int LabelConnectedComponents(const Volume<T, 1, I>& volume, const T& background, Volume1i& labels,
+		std::vector<VolumeComponent>& components, int connectivity = 6) {
+	return detail::LabelVolumeComponents(volume, &background, labels, components, connectivity);
+}
+/*
+ * Labels connected vertices of a graph in compressed row form, where the neighbors of vertex i
+ * are indexes[offsets[i]] to indexes[offsets[i+1]-1]. Every edge must be listed for both of
+ * its vertices, as in MeshNeighborTable. Returns the number of components.
+ */
+template<class IndexT> int LabelConnectedComponents(const std::vector<IndexT>& offsets, const std::vector<IndexT>& indexes,
+		std::vector<int>& labels, std::vector<int>& sizes) {
+	size_t N = (offsets.size() > 0) ? offsets.size() - 1 : 0;
+	labels.resize(N);
+	sizes.clear();
+	if (N == 0)
+		return 0;
+	if (N > (size_t) std::numeric_limits<int>::max() - 2)
+		throw std::runtime_error(MakeString() << "Graph with " << N << " vertices is too large to label.");
+	int* parent = labels.data();
+	std::vector<detail::ComponentSlab> slabs = detail::MakeComponentSlabs(N, 1);
+	const int slabCount = (int) slabs.size();
+#pragma omp parallel for schedule(dynamic)
+	for (int s = 0; s < slabCount; s++) {
+		detail::ComponentSlab& slab = slabs[s];
+		for (size_t i = slab.begin; i < slab.end; i++) {
+			parent[i] = (int) i;
+			for (size_t e = offsets[i]; e < (size_t) offsets[i + 1]; e++) {
+				size_t j = indexes[e];
+				if (j < i && j >= slab.begin)
+					detail::UnionFindLink(parent, (int) i, (int) j);
+			}
+		}
+		detail::FlattenComponentSlab(parent, slab);
+	}
+	//Edges can span any number of slabs, so every level scans the right half of each group.
+	for (int width = 1; width < slabCount; width *= 2) {
+		int groups = (slabCount + 2 * width - 1) / (2 * width);
+#pragma omp parallel for schedule(dynamic)
+		for (int g = 0; g < groups; g++) {
+			int t = g * 2 * width + width;
+			if (t >= slabCount)
+				continue;
+			size_t lower = slabs[g * 2 * width].begin;
+			size_t mid = slabs[t].begin;
+			size_t upper = slabs[std::min(t + width, slabCount) - 1].end;
+			for (size_t i = mid; i < upper; i++) {
+				for (size_t e = offsets[i]; e < (size_t) offsets[i + 1]; e++) {
+					size_t j = indexes[e];
+					if (j >= lower && j < mid)
+						detail::UnionFindLink(parent, parent[i], parent[j]);
+				}
+			}
+		}
+	}
+	int count = detail::NumberComponents(parent, slabs);
+	std::vector<std::vector<int>> slabSizes(slabCount);
+#pragma omp parallel for schedule(dynamic)
+	for (int s = 0; s < slabCount; s++) {
+		std::vector<int>& counts = slabSizes[s];
+		counts.assign(slabs[s].roots.size(), 0);
+		detail::RelabelComponentSlab(parent, slabs[s], [&](int k, size_t i) {
+			counts[k]++;
+		});
+	}
+	sizes.assign(count, 0);
+	for (int s = 0; s < slabCount; s++) {
+		for (size_t k = 0; k < slabs[s].ids.size(); k++) {
+			sizes[slabs[s].ids[k]] += slabSizes[s][k];
+		}
+	}
+	return count;
+}
+}
+#endif
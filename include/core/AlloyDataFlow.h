@@ -21,6 +21,7 @@
 #ifndef ALLOYUALGRAPH_H_
 #define ALLOYUALGRAPH_H_
 #include "AlloyAny.h"
+#include "AlloyComputeGraph.h"
 #include "AlloyUI.h"
 #include "AvoidanceRouting.h"
 #include "AlloyUndoRedo.h"
@@ -127,35 +128,6 @@ template<class C, class R> std::basic_ostream<C, R> & operator <<(std::basic_ost
 	return ss;
 }
 
-struct Packet: public AnyInterface {
-protected:
-	virtual void setValueImpl(Any const & value) = 0;
-	virtual Any getValueImpl() const = 0;
-};
-template<class T> class PacketImpl: public Packet {
-protected:
-	T value;
-	std::string name;
-	virtual void setValueImpl(Any const & val) override {
-		value = AnyCast<T>(val);
-	}
-	virtual Any getValueImpl() const override {
-		return value;
-	}
-public:
-	PacketImpl(const std::string& name, const T& value) :
-			value(value), name(name) {
-	}
-	PacketImpl(const std::string& name = "") :
-			name(name) {
-	}
-	std::string getName() const {
-		return name;
-	}
-	void setName(const std::string& name) {
-		this->name = name;
-	}
-};
 class ConnectionBundle: public std::vector<std::shared_ptr<Connection>> {
 public:
 	ConnectionBundle() :
@@ -331,7 +303,9 @@ public:
 	virtual void setValue(const std::shared_ptr<Packet>& packet) override {
 		this->value = packet;
 	}
-
+	const std::shared_ptr<Packet>& getValue() const {
+		return value;
+	}
 	virtual ~InputPort() {
 	}
 	virtual void draw(AlloyContext* context) override;
@@ -361,6 +335,9 @@ public:
 	virtual void setValue(const std::shared_ptr<Packet>& packet) override {
 		this->value = packet;
 	}
+	const std::shared_ptr<Packet>& getValue() const {
+		return value;
+	}
 	virtual ~OutputPort() {
 	}
 	virtual void draw(AlloyContext* context) override;
@@ -843,6 +820,7 @@ protected:
 	virtual void setup() override;
 public:
 	static const Color COLOR;
+	std::function<void(ComputeNode& node)> onEvaluate;
 	virtual std::shared_ptr<Node> clone() const override;
 
 	virtual NodeType getType() const override {
@@ -1035,6 +1013,13 @@ public:
 	const std::vector<std::shared_ptr<Connection>>& getConnections() const;
 	const std::vector<std::shared_ptr<Relationship>>& getRelationships() const;
 	const std::vector<std::shared_ptr<Node>>& getNodes() const;
+	/*
+	 Flattens the graph, including nested groups, into a headless ComputeGraph. Compute nodes are
+	 evaluated with onEvaluate. Other nodes pass their current port values through. Node ids become
+	 ComputeNode names. Inputs are ordered as getInputPorts() followed by getInputPort(), and outputs
+	 likewise.
+	 */
+	void compile(ComputeGraph& graph) const;
 };
 class ActionDataFlow: public UndoableAction {
 protected:
@@ -0,0 +1,431 @@
+/*
+ * Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef INCLUDE_CORE_ALLOYDENSEKERNELS_H_
+#define INCLUDE_CORE_ALLOYDENSEKERNELS_H_
+#include "AlignedAllocator.h"
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+/*
+ Dense matrix product kernels. Every operand is a pointer with a row stride and a column stride,
+ so transposed operands and single channels of interleaved matrices are used in place. Products
+ are cache blocked: a KC x NC panel of B and an MC x KC block of A are packed into contiguous
+ micro-panels and multiplied by an MR x NR register tile.
+
+ Goto, K., & van de Geijn, R. A. (2008). Anatomy of high-performance matrix multiplication.
+ ACM Transactions on Mathematical Software, 34(3), 12.
+ */
+namespace aly {
+namespace detail {
+template<class T> struct GemmBlocking {
+	static const int MR = 4;
+	static const int NR = 4;
+	static const int KC = 256;
+	static const int MC = 64;
+	static const int NC = 1024;
+};
+#if defined(__AVX__)
+template<> struct GemmBlocking<float> {
+	static const int MR = 6;
+	static const int NR = 16;
+	static const int KC = 256;
+	static const int MC = 96;
+	static const int NC = 2048;
+};
+template<> struct GemmBlocking<double> {
+	static const int MR = 6;
+	static const int NR = 8;
+	static const int KC = 256;
+	static const int MC = 96;
+	static const int NC = 1024;
+};
+#endif
+//Products smaller than this many multiply-adds are not worth packing.
+static const int64_t GEMM_SMALL_SIZE = 16384;
+//Rows of A packed at once. Tiles of one row panel are distributed over threads.
+static const int GEMM_ROW_PANELS = 8;
+//Micro-tiles per thread task along the columns of C.
+static const int GEMM_COLUMN_TILES = 8;
+template<class T> void GemmMicroKernel(int kc, const T* a, const T* b, T* acc) {
+	const int MR = GemmBlocking<T>::MR;
+	const int NR = GemmBlocking<T>::NR;
+	T tile[MR * NR];
+	for (int n = 0; n < MR * NR; n++) {
+		tile[n] = T(0);
+	}
+	for (int k = 0; k < kc; k++) {
+		for (int i = 0; i < MR; i++) {
+			T ai = a[i];
+			for (int j = 0; j < NR; j++) {
+				tile[i * NR + j] += ai * b[j];
+			}
+		}
+		a += MR;
+		b += NR;
+	}
+	for (int n = 0; n < MR * NR; n++) {
+		acc[n] = tile[n];
+	}
+}
+#if defined(__AVX__)
+inline __m256 MultiplyAdd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+inline __m256d MultiplyAdd(__m256d a, __m256d b, __m256d c) {
+#if defined(__FMA__)
+	return _mm256_fmadd_pd(a, b, c);
+#else
+	return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+}
+template<> inline void GemmMicroKernel<float>(int kc, const float* a, const float* b, float* acc) {
+	__m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+	__m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+	__m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+	__m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+	__m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+	__m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+	for (int k = 0; k < kc; k++) {
+		__m256 b0 = _mm256_load_ps(b);
+		__m256 b1 = _mm256_load_ps(b + 8);
+		__m256 ai = _mm256_broadcast_ss(a);
+		c00 = MultiplyAdd(ai, b0, c00);
+		c01 = MultiplyAdd(ai, b1, c01);
+		ai = _mm256_broadcast_ss(a + 1);
+		c10 = MultiplyAdd(ai, b0, c10);
+		c11 = MultiplyAdd(ai, b1, c11);
+		ai = _mm256_broadcast_ss(a + 2);
+		c20 = MultiplyAdd(ai, b0, c20);
+		c21 = MultiplyAdd(ai, b1, c21);
+		ai = _mm256_broadcast_ss(a + 3);
+		c30 = MultiplyAdd(ai, b0, c30);
+		c31 = MultiplyAdd(ai, b1, c31);
+		ai = _mm256_broadcast_ss(a + 4);
+		c40 = MultiplyAdd(ai, b0, c40);
+		c41 = MultiplyAdd(ai, b1, c41);
+		ai = _mm256_broadcast_ss(a + 5);
+		c50 = MultiplyAdd(ai, b0, c50);
+		c51 = MultiplyAdd(ai, b1, c51);
+		a += 6;
+		b += 16;
+	}
+	_mm256_storeu_ps(acc, c00);
+	_mm256_storeu_ps(acc + 8, c01);
+	_mm256_storeu_ps(acc + 16, c10);
+	_mm256_storeu_ps(acc + 24, c11);
+	_mm256_storeu_ps(acc + 32, c20);
+	_mm256_storeu_ps(acc + 40, c21);
+	_mm256_storeu_ps(acc + 48, c30);
+	_mm256_storeu_ps(acc + 56, c31);
+	_mm256_storeu_ps(acc + 64, c40);
+	_mm256_storeu_ps(acc + 72, c41);
+	_mm256_storeu_ps(acc + 80, c50);
+	_mm256_storeu_ps(acc + 88, c51);
+}
+template<> inline void GemmMicroKernel<double>(int kc, const double* a, const double* b, double* acc) {
+	__m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+	__m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+	__m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+	__m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+	__m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+	__m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+	for (int k = 0; k < kc; k++) {
+		__m256d b0 = _mm256_load_pd(b);
+		__m256d b1 = _mm256_load_pd(b + 4);
+		__m256d ai = _mm256_broadcast_sd(a);
+		c00 = MultiplyAdd(ai, b0, c00);
+		c01 = MultiplyAdd(ai, b1, c01);
+		ai = _mm256_broadcast_sd(a + 1);
+		c10 = MultiplyAdd(ai, b0, c10);
+		c11 = MultiplyAdd(ai, b1, c11);
+		ai = _mm256_broadcast_sd(a + 2);
+		c20 = MultiplyAdd(ai, b0, c20);
+		c21 = MultiplyAdd(ai, b1, c21);
+		ai = _mm256_broadcast_sd(a + 3);
+		c30 = MultiplyAdd(ai, b0, c30);
+		c31 = MultiplyAdd(ai, b1, c31);
+		ai = _mm256_broadcast_sd(a + 4);
+		c40 = MultiplyAdd(ai, b0, c40);
+		c41 = MultiplyAdd(ai, b1, c41);
+		ai = _mm256_broadcast_sd(a + 5);
+		c50 = MultiplyAdd(ai, b0, c50);
+		c51 = MultiplyAdd(ai, b1, c51);
+		a += 6;
+		b += 8;
+	}
+	_mm256_storeu_pd(acc, c00);
+	_mm256_storeu_pd(acc + 4, c01);
+	_mm256_storeu_pd(acc + 8, c10);
+	_mm256_storeu_pd(acc + 12, c11);
+	_mm256_storeu_pd(acc + 16, c20);
+	_mm256_storeu_pd(acc + 20, c21);
+	_mm256_storeu_pd(acc + 24, c30);
+	_mm256_storeu_pd(acc + 28, c31);
+	_mm256_storeu_pd(acc + 32, c40);
+	_mm256_storeu_pd(acc + 36, c41);
+	_mm256_storeu_pd(acc + 40, c50);
+	_mm256_storeu_pd(acc + 44, c51);
+}
+#endif
+//Packs rows [0,mc) and columns [0,kc) of A into MR row micro-panels, zero padding the last one.
+template<class T> void GemmPackA(int mc, int kc, const T* A, ptrdiff_t rsA,
+		ptrdiff_t csA, T* packed) {
+	const int MR = GemmBlocking<T>::MR;
+	int panels = (mc + MR - 1) / MR;
+#pragma omp parallel for if(mc * (int64_t) kc > GEMM_SMALL_SIZE)
+	for (int p = 0; p < panels; p++) {
+		T* dst = packed + (size_t) p * MR * kc;
+		int i0 = p * MR;
+		int mr = std::min(MR, mc - i0);
+		for (int k = 0; k < kc; k++) {
+			const T* src = A + i0 * rsA + k * csA;
+			for (int i = 0; i < mr; i++) {
+				dst[i] = src[i * rsA];
+			}
+			for (int i = mr; i < MR; i++) {
+				dst[i] = T(0);
+			}
+			dst += MR;
+		}
+	}
+}
+//Packs rows [0,kc) and columns [0,nc) of B into NR column micro-panels, zero padding the last one.
+template<class T> void GemmPackB(int kc, int nc, const T* B, ptrdiff_t rsB,
+		ptrdiff_t csB, T* packed) {
+	const int NR = GemmBlocking<T>::NR;
+	int panels = (nc + NR - 1) / NR;
+#pragma omp parallel for if(nc * (int64_t) kc > GEMM_SMALL_SIZE)
+	for (int p = 0; p < panels; p++) {
+		T* dst = packed + (size_t) p * NR * kc;
+		int j0 = p * NR;
+		int nr = std::min(NR, nc - j0);
+		for (int k = 0; k < kc; k++) {
+			const T* src = B + k * rsB + j0 * csB;
+			for (int j = 0; j < nr; j++) {
+				dst[j] = src[j * csB];
+			}
+			for (int j = nr; j < NR; j++) {
+				dst[j] = T(0);
+			}
+			dst += NR;
+		}
+	}
+}
+template<class T> void GemmSmall(int M, int N, int K, T alpha, const T* A,
+		ptrdiff_t rsA, ptrdiff_t csA, const T* B, ptrdiff_t rsB, ptrdiff_t csB,
+		T beta, T* C, ptrdiff_t rsC, ptrdiff_t csC, bool upper) {
+	for (int i = 0; i < M; i++) {
+		for (int j = (upper) ? i : 0; j < N; j++) {
+			T sum(0);
+			for (int k = 0; k < K; k++) {
+				sum += A[i * rsA + k * csA] * B[k * rsB + j * csB];
+			}
+			T& c = C[i * rsC + j * csC];
+			c = (beta == T(0)) ? alpha * sum : beta * c + alpha * sum;
+		}
+	}
+}
+/*
+ C = alpha * A * B + beta * C for an M x K matrix A and a K x N matrix B. If upper is set, only
+ entries on or above the diagonal of C are computed. When beta is zero C is not read.
+ */
+template<class T> void Gemm(int M, int N, int K, T alpha, const T* A,
+		ptrdiff_t rsA, ptrdiff_t csA, const T* B, ptrdiff_t rsB, ptrdiff_t csB,
+		T beta, T* C, ptrdiff_t rsC, ptrdiff_t csC, bool upper = false) {
+	const int MR = GemmBlocking<T>::MR;
+	const int NR = GemmBlocking<T>::NR;
+	const int KC = GemmBlocking<T>::KC;
+	const int MC = GemmBlocking<T>::MC;
+	const int NC = GemmBlocking<T>::NC;
+	if (M <= 0 || N <= 0) {
+		return;
+	}
+	if (K <= 0 || (int64_t) M * N * K <= GEMM_SMALL_SIZE) {
+		GemmSmall(M, N, K, alpha, A, rsA, csA, B, rsB, csB, beta, C, rsC, csC,
+				upper);
+		return;
+	}
+	const int PANEL = MC * GEMM_ROW_PANELS;
+	const int TILE_COLUMNS = NR * GEMM_COLUMN_TILES;
+	std::vector<T, aligned_allocator<T, 64>> packedA(
+			(size_t) ((std::min(M, PANEL) + MR - 1) / MR) * MR * KC);
+	std::vector<T, aligned_allocator<T, 64>> packedB(
+			(size_t) ((std::min(N, NC) + NR - 1) / NR) * NR * KC);
+	for (int jc = 0; jc < N; jc += NC) {
+		int nc = std::min(NC, N - jc);
+		for (int pc = 0; pc < K; pc += KC) {
+			int kc = std::min(KC, K - pc);
+			//Later K blocks accumulate into the result of the first.
+			T betaBlock = (pc == 0) ? beta : T(1);
+			GemmPackB(kc, nc, B + pc * rsB + jc * csB, rsB, csB, &packedB[0]);
+			for (int ip = 0; ip < M; ip += PANEL) {
+				int mp = std::min(PANEL, M - ip);
+				if (upper && ip > jc + nc - 1) {
+					break;
+				}
+				GemmPackA(mp, kc, A + ip * rsA + pc * csA, rsA, csA, &packedA[0]);
+				int rowBlocks = (mp + MC - 1) / MC;
+				int colBlocks = (nc + TILE_COLUMNS - 1) / TILE_COLUMNS;
+				int tasks = rowBlocks * colBlocks;
+#pragma omp parallel for schedule(dynamic)
+				for (int t = 0; t < tasks; t++) {
+					T acc[GemmBlocking<T>::MR * GemmBlocking<T>::NR];
+					int ic = (t / colBlocks) * MC;
+					int jb = (t % colBlocks) * TILE_COLUMNS;
+					int mc = std::min(MC, mp - ic);
+					int nb = std::min(TILE_COLUMNS, nc - jb);
+					for (int jr = 0; jr < nb; jr += NR) {
+						int j0 = jc + jb + jr;
+						int nr = std::min(NR, nb - jr);
+						const T* b = &packedB[0] + (size_t) ((jb + jr) / NR) * NR * kc;
+						for (int ir = 0; ir < mc; ir += MR) {
+							int i0 = ip + ic + ir;
+							int mr = std::min(MR, mc - ir);
+							if (upper && i0 > j0 + nr - 1) {
+								break;
+							}
+							const T* a = &packedA[0] + (size_t) ((ic + ir) / MR) * MR * kc;
+							GemmMicroKernel<T>(kc, a, b, acc);
+							for (int i = 0; i < mr; i++) {
+								T* c = C + (i0 + i) * rsC + j0 * csC;
+								for (int j = (upper) ? std::max(0, i0 + i - j0) : 0; j < nr; j++) {
+									T val = alpha * acc[i * NR + j];
+									c[j * csC] = (betaBlock == T(0)) ? val : betaBlock * c[j * csC] + val;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+}
+/*
+ C = alpha * A^T * A + beta * C for an M x N matrix A, which produces an N x N matrix C. Only the
+ upper triangle is multiplied; the lower triangle is copied from it.
+ */
+template<class T> void Syrk(int M, int N, T alpha, const T* A, ptrdiff_t rsA,
+		ptrdiff_t csA, T beta, T* C, ptrdiff_t rsC, ptrdiff_t csC) {
+	detail::Gemm(N, N, M, alpha, A, csA, rsA, A, rsA, csA, beta, C, rsC, csC,
+			true);
+#pragma omp parallel for if(N * (int64_t) N > detail::GEMM_SMALL_SIZE)
+	for (int i = 1; i < N; i++) {
+		for (int j = 0; j < i; j++) {
+			C[i * rsC + j * csC] = C[j * rsC + i * csC];
+		}
+	}
+}
+template<class T> void Gemm(int M, int N, int K, T alpha, const T* A,
+		ptrdiff_t rsA, ptrdiff_t csA, const T* B, ptrdiff_t rsB, ptrdiff_t csB,
+		T beta, T* C, ptrdiff_t rsC, ptrdiff_t csC) {
+	detail::Gemm(M, N, K, alpha, A, rsA, csA, B, rsB, csB, beta, C, rsC, csC,
+			false);
+}
+/*
+ y = alpha * A * x + beta * y for an M x N matrix A. Row-major and column-major views of A are
+ streamed along contiguous memory; other strides fall back to a strided dot product.
+ */
+template<class T> void Gemv(int M, int N, T alpha, const T* A, ptrdiff_t rsA,
+		ptrdiff_t csA, const T* x, ptrdiff_t incx, T beta, T* y, ptrdiff_t incy) {
+	const int ROW_BLOCK = 256;
+	if (M <= 0) {
+		return;
+	}
+	bool parallel = (M * (int64_t) N > detail::GEMM_SMALL_SIZE);
+	if (rsA == 1 && csA != 1) {
+		//Columns are contiguous, so accumulate scaled columns over blocks of rows.
+		int blocks = (M + ROW_BLOCK - 1) / ROW_BLOCK;
+#pragma omp parallel for if(parallel)
+		for (int b = 0; b < blocks; b++) {
+			T sum[ROW_BLOCK];
+			int i0 = b * ROW_BLOCK;
+			int mb = std::min(ROW_BLOCK, M - i0);
+			for (int i = 0; i < mb; i++) {
+				sum[i] = T(0);
+			}
+			for (int j = 0; j < N; j++) {
+				T xj = x[j * incx];
+				const T* col = A + i0 + j * csA;
+				for (int i = 0; i < mb; i++) {
+					sum[i] += col[i] * xj;
+				}
+			}
+			for (int i = 0; i < mb; i++) {
+				T& yi = y[(i0 + i) * incy];
+				yi = (beta == T(0)) ? alpha * sum[i] : beta * yi + alpha * sum[i];
+			}
+		}
+		return;
+	}
+#pragma omp parallel for if(parallel)
+	for (int i = 0; i < M; i++) {
+		const T* row = A + i * rsA;
+		T s0(0), s1(0), s2(0), s3(0);
+		int j = 0;
+		if (csA == 1 && incx == 1) {
+			for (; j + 3 < N; j += 4) {
+				s0 += row[j] * x[j];
+				s1 += row[j + 1] * x[j + 1];
+				s2 += row[j + 2] * x[j + 2];
+				s3 += row[j + 3] * x[j + 3];
+			}
+		}
+		for (; j < N; j++) {
+			s0 += row[j * csA] * x[j * incx];
+		}
+		T sum = (s0 + s1) + (s2 + s3);
+		T& yi = y[i * incy];
+		yi = (beta == T(0)) ? alpha * sum : beta * yi + alpha * sum;
+	}
+}
+/*
+ Out of place transpose of an M x N matrix in square tiles, so both the reads and the writes stay
+ within a few cache lines per row.
+ */
+template<class T> void Transpose(int M, int N, const T* A, ptrdiff_t rsA,
+		ptrdiff_t csA, T* B, ptrdiff_t rsB, ptrdiff_t csB) {
+	const int TILE = 32;
+	int rowTiles = (M + TILE - 1) / TILE;
+	int colTiles = (N + TILE - 1) / TILE;
+#pragma omp parallel for if(M * (int64_t) N > detail::GEMM_SMALL_SIZE)
+	for (int t = 0; t < rowTiles * colTiles; t++) {
+		int i0 = (t / colTiles) * TILE;
+		int j0 = (t % colTiles) * TILE;
+		int i1 = std::min(M, i0 + TILE);
+		int j1 = std::min(N, j0 + TILE);
+		for (int i = i0; i < i1; i++) {
+			for (int j = j0; j < j1; j++) {
+				B[j * rsB + i * csB] = A[i * rsA + j * csA];
+			}
+		}
+	}
+}
+}
+#endif /* INCLUDE_CORE_ALLOYDENSEKERNELS_H_ */
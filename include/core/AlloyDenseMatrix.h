@@ -22,6 +22,7 @@
 #define ALLOYDENSEMATRIX_H_
 #include <cereal/types/list.hpp>
 #include "AlloyVector.h"
+#include "AlloyDenseKernels.h"
 #include "cereal/types/vector.hpp"
 #include "cereal/types/tuple.hpp"
 #include "cereal/types/map.hpp"
@@ -32,47 +33,50 @@
 #include <map>
 namespace aly {
 bool SANITY_CHECK_DENSE_MATRIX();
+bool SANITY_CHECK_DENSE_KERNELS();
 template<class T, int C> struct DenseMatrix {
 private:
-	std::vector<std::vector<vec<T, C>>>data;
+	//Row-major and contiguous so rows and channels can be handed to the product kernels.
+	std::vector<vec<T, C>, aligned_allocator<vec<T, C>, 64>> data;
 public:
 	int rows, cols;
 	typedef vec<T, C> ValueType;
-	typedef typename std::vector<ValueType>::iterator iterator;
-	typedef typename std::vector<ValueType>::const_iterator const_iterator;
-	typedef typename std::vector<ValueType>::reverse_iterator reverse_iterator;
+	typedef typename std::vector<ValueType, aligned_allocator<ValueType, 64>>::iterator iterator;
+	typedef typename std::vector<ValueType, aligned_allocator<ValueType, 64>>::const_iterator const_iterator;
+	typedef typename std::vector<ValueType, aligned_allocator<ValueType, 64>>::reverse_iterator reverse_iterator;
 	size_t size() const {
 		return rows*cols;
 	}
-	iterator begin(int i) const {
-		return data[i].begin();
-	}
-	iterator end(int i) const {
-		return data[i].end();
-	}
 	iterator begin(int i) {
-		return data[i].begin();
+		return data.begin() + (size_t) cols * i;
 	}
 	iterator end(int i) {
-		return data[i].end();
+		return data.begin() + (size_t) cols * (i + 1);
+	}
+	const_iterator begin(int i) const {
+		return data.cbegin() + (size_t) cols * i;
+	}
+	const_iterator end(int i) const {
+		return data.cbegin() + (size_t) cols * (i + 1);
 	}
 	const_iterator cbegin(int i) const {
-		return data[i].cbegin();
+		return data.cbegin() + (size_t) cols * i;
 	}
 	const_iterator cend(int i) const {
-		return data[i].cend();
+		return data.cbegin() + (size_t) cols * (i + 1);
 	}
 	reverse_iterator rbegin(int i) {
-		return data[i].rbegin();
+		return reverse_iterator(end(i));
 	}
 	reverse_iterator rend(int i) {
-		return data[i].rend();
+		return reverse_iterator(begin(i));
 	}
-	reverse_iterator rbegin(int i) const {
-		return data[i].rbegin();
+	//Channel c of element (i,j) is at channels()[(i * cols + j) * C + c].
+	T* channels() {
+		return (data.size() > 0) ? &data[0][0] : nullptr;
 	}
-	reverse_iterator rend(int i) const {
-		return data[i].rend();
+	const T* channels() const {
+		return (data.size() > 0) ? &data[0][0] : nullptr;
 	}
 	template<class Archive> void serialize(Archive & archive) {
 		archive(CEREAL_NVP(rows), CEREAL_NVP(cols),
@@ -80,30 +84,30 @@ public:
 						MakeString() << "matrix"<<C,
 						data));
 	}
-	std::vector<vec<T, C>>& operator[](size_t i) {
+	vec<T, C>* operator[](size_t i) {
 		if ((int)i >= rows )
 		throw std::runtime_error(
 				MakeString() << "Index (" << i
 				<< ",*) exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		return data[i];
+		return data.data() + (size_t) cols * i;
 	}
-	const std::vector<vec<T, C>>& operator[](size_t i) const {
+	const vec<T, C>* operator[](size_t i) const {
 		if ((int)i >= rows )
 		throw std::runtime_error(
 				MakeString() << "Index (" << i
 				<< ",*) exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		return data[i];
+		return data.data() + (size_t) cols * i;
 	}
 	DenseMatrix(): rows(0),cols(0) {
 	}
 	DenseMatrix(int rows, int cols) :
-	data(rows,std::vector<vec<T,C>>(cols)),rows(rows), cols(cols) {
+	data((size_t)rows*cols),rows(rows), cols(cols) {
 	}
 	void resize(int rows,int cols) {
 		if(this->rows!=rows||this->cols!=cols) {
-			data=std::vector<std::vector<vec<T,C>>>(rows,std::vector<vec<T,C>>(cols));
+			data.assign((size_t)rows*cols,vec<T,C>());
 			this->rows=rows;
 			this->cols=cols;
 		}
@@ -114,7 +118,7 @@ public:
 				MakeString() << "Index (" << i << "," << j
 				<< ") exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		data[i][j] = value;
+		data[cols * i + j] = value;
 	}
 	void set(size_t i, size_t j, const T& value) {
 		if (i >= (size_t)rows || j >= (size_t)cols || i < 0 || j < 0)
@@ -122,7 +126,7 @@ public:
 				MakeString() << "Index (" << i << "," << j
 				<< ") exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		data[i][j] = vec<T, C>(value);
+		data[cols * i + j] = vec<T, C>(value);
 	}
 	vec<T, C>& operator()(size_t i, size_t j) {
 		if (i >= (size_t)rows || j >= (size_t)cols || i < 0 || j < 0)
@@ -130,7 +134,7 @@ public:
 				MakeString() << "Index (" << i << "," << j
 				<< ") exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		return data[i][j];
+		return data[cols * i + j];
 	}
 
 	vec<T, C> get(size_t i, size_t j) const {
@@ -139,17 +143,15 @@ public:
 				MakeString() << "Index (" << i << "," << j
 				<< ") exceeds matrix bounds [" << rows << ","
 				<< cols << "]");
-		return data[i][j];
+		return data[cols * i + j];
 	}
 	const vec<T, C>& operator()(size_t i, size_t j) const {
-		return data[i][j];
+		return data[cols * i + j];
 	}
 	inline DenseMatrix<T, C> transpose() const {
 		DenseMatrix<T, C> M(cols, rows);
-		for (int i = 0; i < rows; i++) {
-			for (int j=0;j < cols;j++) {
-				M[j][i]=data[i][j];
-			}
+		for (int c = 0; c < C; c++) {
+			Transpose(rows, cols, channels() + c, cols * C, C, M.channels() + c, rows * C, C);
 		}
 		return M;
 	}
@@ -164,11 +166,7 @@ public:
 	}
 	inline static DenseMatrix<T, C> zero(size_t M, size_t N) {
 		DenseMatrix<T, C> A(M, N);
-		for (int i = 0; i < M; i++) {
-			for (int j=0;j < N;j++) {
-				A[i][j]=vec<T, C>(T(0));
-			}
-		}
+		A.data.assign(A.data.size(), vec<T, C>(T(0)));
 		return A;
 	}
 	inline static DenseMatrix<T, C> diagonal(const Vector<T, C>& v) {
@@ -189,17 +187,21 @@ public:
 	}
 	inline static DenseMatrix<T, C> rowVector(const Vector<T, C>& v) {
 		DenseMatrix<T, C> A(1, (int)v.size());
-		A.data[0] = v.data;
+		std::copy(v.data.begin(), v.data.end(), A.data.begin());
 		return A;
 	}
+	inline void setRow(int i, const vec<T, C>* row) {
+		std::copy(row, row + cols, (*this)[i]);
+	}
 	inline Vector<T, C> getRow(int i) const {
-		Vector<T, C> v(data[i]);
+		Vector<T, C> v(cols);
+		std::copy(begin(i), end(i), v.data.begin());
 		return v;
 	}
 	inline Vector<T, C> getColumn(int j) const {
 		Vector<T, C> v(rows);
 		for (int i = 0; i < rows; i++) {
-			v[i]=data[i][j];
+			v[i]=data[cols * i + j];
 		}
 		return v;
 	}
@@ -226,12 +228,12 @@ template<class A, class B, class T, int C> std::basic_ostream<A, B> & operator <
 
 template<class T, int C> Vector<T, C> operator*(const DenseMatrix<T, C>& A, const Vector<T, C>& v) {
 	Vector<T, C> out(A.rows);
-	for (int i = 0; i < A.rows; i++) {
-		vec<T, C> sum(0.0);
-		for (int j = 0; j < A.cols; j++) {
-			sum += A[i][j] * v[j];
-		}
-		out[i] = sum;
+	if (A.rows == 0) {
+		return out;
+	}
+	const T* x = (v.size() > 0) ? &v.data[0][0] : nullptr;
+	for (int c = 0; c < C; c++) {
+		Gemv(A.rows, A.cols, T(1), A.channels() + c, A.cols * C, C, x + c, C, T(0), &out.data[0][0] + c, C);
 	}
 	return out;
 }
@@ -241,14 +243,18 @@ template<class T, int C> DenseMatrix<T, C> operator*(const DenseMatrix<T, C>& A,
 				MakeString() << "Cannot multiply matrices. Inner dimensions do not match. " << "[" << A.rows << "," << A.cols << "] * [" << B.rows << ","
 						<< B.cols << "]");
 	DenseMatrix<T, C> out(A.rows, B.cols);
-	for (int i = 0; i < out.rows; i++) {
-		for (int j = 0; j < out.cols; j++) {
-			vec<T, C> sum(0.0);
-			for (int k = 0; k < A.cols; k++) {
-				sum += A[i][k] * B[k][j];
-			}
-			out[i][j] = sum;
-		}
+	//Channels are multiplied independently, each read in place from the interleaved storage.
+	for (int c = 0; c < C; c++) {
+		Gemm(A.rows, B.cols, A.cols, T(1), A.channels() + c, A.cols * C, C, B.channels() + c, B.cols * C, C, T(0), out.channels() + c,
+				out.cols * C, C);
+	}
+	return out;
+}
+//Equivalent to A.transpose() * A, but only half of the symmetric product is computed.
+template<class T, int C> DenseMatrix<T, C> Gram(const DenseMatrix<T, C>& A) {
+	DenseMatrix<T, C> out(A.cols, A.cols);
+	for (int c = 0; c < C; c++) {
+		Syrk(A.rows, A.cols, T(1), A.channels() + c, A.cols * C, C, T(0), out.channels() + c, out.cols * C, C);
 	}
 	return out;
 }
@@ -384,7 +384,7 @@ namespace aly {
 		}
 		if (A.rows != A.cols) {
 			DenseMatrix<T, C> At = A.transpose();
-			DenseMatrix<T, C> AtA = At * A;
+			DenseMatrix<T, C> AtA = Gram(A);
 			Vector<T, C> Atb = At * b;
 			return inverse(AtA) * Atb;
 		}
@@ -504,7 +504,7 @@ namespace aly {
 		}
 		if (A.rows != A.cols) {
 			DenseMatrix<T, C> At = A.transpose();
-			DenseMatrix<T, C> AtA = At * A;
+			DenseMatrix<T, C> AtA = Gram(A);
 			Vector<T, C> Atb = At * b;
 			int n = AtA.cols;
 			Vector<T, C> x(A.cols);
@@ -675,7 +675,7 @@ namespace aly {
 		}
 		if (A.rows != A.cols) {
 			DenseMatrix<T, C> At = A.transpose();
-			DenseMatrix<T, C> AtA = At * A;
+			DenseMatrix<T, C> AtA = Gram(A);
 			Vector<T, C> Atb = At * b;
 			int n = AtA.cols;
 			Vector<T, C> x(A.cols);
@@ -798,7 +798,7 @@ namespace aly {
 			bs.resize(sampleSize);
 			for (int i = 0;i < sampleSize;i++) {
 				int idx = order[(i + offset)%N];
-				As[i] = A[idx];
+				As.setRow(i, A[idx]);
 				bs[i] = b[idx];
 			}
 			X = SolveQR(As, bs);
@@ -837,7 +837,7 @@ namespace aly {
 		bs.resize((int)order.size());
 		for (int i = 0;i < (int)order.size();i++) {
 			int idx = order[i];
-			As[i] = A[idx];
+			As.setRow(i, A[idx]);
 			bs[i] = b[idx];
 		}
 		X = SolveQR(As, bs);
@@ -26,19 +26,46 @@
 #include "grid/EndlessGrid.h"
 namespace aly {
 	bool SANITY_CHECK_DISTANCE_FIELD();
+	/*
+	 FastMarching propagates distances outward from the interface in sorted order with a heap.
+	 FastSweeping runs Gauss-Seidel sweeps in alternating directions, updating each diagonal
+	 wavefront in parallel. It is preferable for large volumes or distance bands.
+	 */
+	enum class DistanceMethod {
+		FastMarching = 0, FastSweeping = 1
+	};
 	class DistanceField3f {
 		typedef Indexable<float, 3> VoxelIndex;
 		typedef vec<int, 3> Coord;
 	private:
 
 
+		DistanceMethod method;
+		int maxSweeps;
 		float march(float Nv, float Sv, float Ev, float Wv, float Fv, float Bv, int Nl, int Sl, int El, int Wl, int Fl, int Bl);
+		void solveFastMarching(const Volume1f& vol, Volume1f& out, float maxDistance);
+		void solveFastMarching(EndlessGridFloat& vol, float maxDistance);
+		void solveFastSweeping(const Volume1f& vol, Volume1f& out, float maxDistance);
+		void solveFastSweeping(EndlessGridFloat& vol, float maxDistance);
 	public:
 		static const ubyte1 ALIVE;
 		static const ubyte1 NARROW_BAND;
 		static const ubyte1 FAR_AWAY;
 		static const float DISTANCE_UNDEFINED;
-		DistanceField3f()  {}
+		DistanceField3f(DistanceMethod method = DistanceMethod::FastMarching, int maxSweeps = 32) :method(method), maxSweeps(maxSweeps) {}
+		void setMethod(DistanceMethod m) {
+			method = m;
+		}
+		DistanceMethod getMethod() const {
+			return method;
+		}
+		//Upper bound on the number of 8-direction sweep iterations. Sweeping stops early once no value changes.
+		void setMaxSweeps(int iters) {
+			maxSweeps = iters;
+		}
+		int getMaxSweeps() const {
+			return maxSweeps;
+		}
 		void solve(const Volume1f& vol, Volume1f& out,float maxDistance=2.5f);
 		void solve(EndlessGridFloat& vol,float maxDistance=2.5f);
 	};
@@ -57,6 +84,22 @@ namespace aly {
 		DistanceField2f() {}
 		void solve(const Image1f& vol, Image1f& out, float maxDistance = 2.5f);
 	};
+	/*
+	 Exact Euclidean distance transform over the full domain in linear time. Features are non-zero
+	 mask pixels, or level set samples <= 0. The unsigned output is the distance from each sample
+	 center to the nearest feature center. The signed output is also negative inside features, where
+	 its magnitude is the distance to the nearest non-feature sample. Samples with no feature to
+	 measure against are set to DISTANCE_UNDEFINED. Nearest maps hold the coordinates of the
+	 sample that determined each distance, or -1 if there is none.
+	 */
+	void DistanceTransform(const Image1ub& mask, Image1f& out, bool signedDistance = false);
+	void DistanceTransform(const Image1ub& mask, Image1f& out, Image2i& nearest, bool signedDistance = false);
+	void DistanceTransform(const Image1f& levelSet, Image1f& out, bool signedDistance = false);
+	void DistanceTransform(const Image1f& levelSet, Image1f& out, Image2i& nearest, bool signedDistance = false);
+	void DistanceTransform(const Volume1ub& mask, Volume1f& out, bool signedDistance = false);
+	void DistanceTransform(const Volume1ub& mask, Volume1f& out, Volume3i& nearest, bool signedDistance = false);
+	void DistanceTransform(const Volume1f& levelSet, Volume1f& out, bool signedDistance = false);
+	void DistanceTransform(const Volume1f& levelSet, Volume1f& out, Volume3i& nearest, bool signedDistance = false);
 } /* namespace imagesci */
 
 #endif /* DISTANCEFIELD_H_ */
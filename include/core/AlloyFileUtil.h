@@ -116,6 +116,11 @@ namespace aly {
 	void WriteTextFile(const std::string& file,const std::string& str);
 	void WriteBinaryFile(const std::string& str, const std::vector<char>& data);
 	void WriteBinaryFile(const std::string& str, const char* data, size_t size);
+	/*
+	 Deflates a byte buffer in memory (zlib format). Used to keep serialized data resident at a fraction of its size.
+	 */
+	void CompressBinaryData(const std::vector<char>& in, std::vector<char>& out, int quality = 5);
+	void DecompressBinaryData(const std::vector<char>& in, std::vector<char>& out);
 	bool FileExists(const std::string& name);
 	bool IsDirectory(const std::string& file);
 	bool IsFile(const std::string& file);
@@ -48,8 +48,9 @@ public:
 	double distanceEuclidean(const Vec<float>& pt) const;
 	double likelihood(const Vec<float>& pt) const;
 	GaussianMixture();
+	//batch_size > 0 enables stepwise mini-batch EM with one random batch of that size per iteration.
 	bool solve(const DenseMat<float>& data, int N_gaus, int km_iter,
-			int em_iter, float var_floor = 1E-16f);
+			int em_iter, float var_floor = 1E-16f, int batch_size = 0);
 	//
 	virtual ~GaussianMixture() {
 	}
@@ -96,8 +97,9 @@ public:
 	int closestMahalanobis(float3 pt) const;
 	int closestEuclidean(float3 pt) const;
 	double likelihood(float3 pt) const;
+	//batch_size > 0 enables stepwise mini-batch EM with one random batch of that size per iteration.
 	bool solve(const std::vector<float3>& data, int N_gaus, int km_iter,
-			int em_iter, float var_floor = 1E-16f);
+			int em_iter, float var_floor = 1E-16f, int batch_size = 0);
 	virtual ~GaussianMixtureRGB() {
 	}
 };
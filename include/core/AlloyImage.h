@@ -26,6 +26,7 @@
 #include "AlloyFileUtil.h"
 #include "AlloyVector.h"
 #include "MipavHeaderReaderWriter.h"
+#include "AlloyMemMappedFile.h"
 #include "cereal/types/vector.hpp"
 #include <vector>
 #include <functional>
@@ -1018,68 +1019,152 @@ template<class T, int C, ImageType I> void WriteImageToRawFile(
 	myfile << sstr.str();
 	myfile.close();
 }
-template<class T, int C, ImageType I> bool ReadImageFromRawFile(
-		const std::string& file, Image<T, C, I>& img) {
-	std::string xmlFile = GetFileWithoutExtension(file)+".xml";
-	std::string rawFile = GetFileWithoutExtension(file)+".raw";
-	MipavHeader header;
-	img.clear();
-	if(!ReadMipavHeaderFromFile(xmlFile,header)){
-		return false;
-	}
-	if(header.dimensions>3||header.dimensions<2){
-		throw std::runtime_error(MakeString() << "Channels " <<header.dimensions<<"/"<<C<< " do not match.");
-	}
-	std::string typeName = "";
-	switch (img.type) {
+inline std::string GetMipavDataTypeName(const ImageType& type) {
+	switch (type) {
 	case ImageType::BYTE:
-		typeName = "byte";
-		break;
+		return "byte";
 	case ImageType::UBYTE:
-		typeName = "unsigned byte";
-		break;
+		return "unsigned byte";
 	case ImageType::SHORT:
-		typeName = "short";
-		break;
+		return "short";
 	case ImageType::USHORT:
-		typeName = "unsigned short";
-		break;
+		return "unsigned short";
 	case ImageType::INT:
-		typeName = "integer";
-		break;
+		return "integer";
 	case ImageType::UINT:
-		typeName = "unsigned integer";
-		break;
+		return "unsigned integer";
 	case ImageType::FLOAT:
-		typeName = "float";
-		break;
+		return "float";
 	case ImageType::DOUBLE:
-		typeName = "double";
-		break;
+		return "double";
 	case ImageType::UNKNOWN:
-		typeName = "unknown";
-		break;
+		return "unknown";
 	default:
-		break;
+		return "";
 	}
-	if(ToLower(header.dataType)!=typeName){
-		throw std::runtime_error(MakeString() << "Type " <<header.dataType<<"/"<<typeName<< " do not match.");
-		return false;
+}
+/*
+ Copies channel-planar samples (the MIPAV raw layout) into interleaved pixels. Single channel
+ data has the same layout in both, so it reduces to a parallel block copy.
+ */
+template<class T, int C> void CopyPlanarToInterleaved(const T* src, vec<T, C>* dst,
+		size_t N) {
+	if (C == 1) {
+		const size_t BLOCK = 1 << 20;
+		int blocks = (int) ((N + BLOCK - 1) / BLOCK);
+#pragma omp parallel for
+		for (int b = 0; b < blocks; b++) {
+			size_t start = b * BLOCK;
+			size_t count = std::min(BLOCK, N - start);
+			std::memcpy(&dst[start], &src[start], count * sizeof(T));
+		}
+	} else {
+		for (int c = 0; c < C; c++) {
+			const T* plane = src + c * N;
+#pragma omp parallel for
+			for (int64_t i = 0; i < (int64_t) N; i++) {
+				dst[i][c] = plane[i];
+			}
+		}
 	}
-	img.resize(header.extents[0],header.extents[1]);
-	FILE* f = fopen(rawFile.c_str(), "rb");
-	if (f == NULL) {
-		throw std::runtime_error(MakeString() << "Could not open " <<rawFile<< " for reading.");
-		return false;
+}
+/*
+ Read-only view of a MIPAV raw image that is backed by a memory mapping of the .raw file.
+ Opening only parses the header, and pages are brought in by the OS as they are touched.
+ */
+template<class T, int C, ImageType I> class MappedImage {
+protected:
+	std::shared_ptr<ReadableMemMapFile> mapping;
+	const T* planes = nullptr;
+public:
+	int width = 0;
+	int height = 0;
+	const int channels = C;
+	const ImageType type = I;
+	MappedImage() {
+	}
+	MappedImage(const std::string& file) {
+		open(file);
+	}
+	bool open(const std::string& file) {
+		close();
+		std::string xmlFile = GetFileWithoutExtension(file) + ".xml";
+		std::string rawFile = GetFileWithoutExtension(file) + ".raw";
+		MipavHeader header;
+		if (!ReadMipavHeaderFromFile(xmlFile, header)) {
+			return false;
+		}
+		if (header.dimensions > 3 || header.dimensions < 2) {
+			throw std::runtime_error(
+					MakeString() << "Channels " << header.dimensions << "/" << C
+							<< " do not match.");
+		}
+		std::string typeName = GetMipavDataTypeName(I);
+		if (ToLower(header.dataType) != typeName) {
+			throw std::runtime_error(
+					MakeString() << "Type " << header.dataType << "/" << typeName
+							<< " do not match.");
+		}
+		int w = header.extents[0];
+		int h = header.extents[1];
+		size_t bytes = (size_t) w * h * C * sizeof(T);
+		std::shared_ptr<ReadableMemMapFile> mmf(new ReadableMemMapFile(rawFile));
+		if (!mmf->isOpen()) {
+			throw std::runtime_error(
+					MakeString() << "Could not open " << rawFile << " for reading.");
+		}
+		if (mmf->getFileSize() < bytes || (bytes > 0 && mmf->data() == nullptr)) {
+			throw std::runtime_error(
+					MakeString() << rawFile << " is too small (" << mmf->getFileSize()
+							<< " bytes) for " << w << "x" << h << "x" << C << " image.");
+		}
+		mapping = mmf;
+		planes = reinterpret_cast<const T*>(mapping->data());
+		width = w;
+		height = h;
+		return true;
 	}
-	for (int c = 0; c < img.channels; c++) {
-		for (int j = 0; j < img.height; j++) {
-			for (int i = 0; i < img.width; i++) {
-				fread(&img(i,j,c), sizeof(T), 1, f);
-			}
+	void close() {
+		mapping.reset();
+		planes = nullptr;
+		width = 0;
+		height = 0;
+	}
+	bool isOpen() const {
+		return (planes != nullptr);
+	}
+	size_t size() const {
+		return (size_t) width * height;
+	}
+	const T* channelPtr(int c) const {
+		return planes + c * size();
+	}
+	const T& operator()(int i, int j, int c) const {
+		return planes[i + (size_t) j * width + c * size()];
+	}
+	vec<T, C> operator()(int i, int j) const {
+		vec<T, C> v;
+		size_t offset = i + (size_t) j * width;
+		for (int c = 0; c < C; c++) {
+			v[c] = planes[offset + c * size()];
 		}
+		return v;
 	}
-	fclose(f);
+	void copyTo(Image<T, C, I>& img) const {
+		img.resize(width, height);
+		if (size() > 0) {
+			CopyPlanarToInterleaved(planes, img.vecPtr(), size());
+		}
+	}
+};
+template<class T, int C, ImageType I> bool ReadImageFromRawFile(
+		const std::string& file, Image<T, C, I>& img) {
+	MappedImage<T, C, I> mapped;
+	img.clear();
+	if (!mapped.open(file)) {
+		return false;
+	}
+	mapped.copyTo(img);
 	return true;
 }
 typedef Image<uint8_t, 4, ImageType::UBYTE> ImageRGBA;
@@ -308,33 +308,260 @@ template<class T, size_t M, size_t N> struct GaussianOperators {
 		}
 	}
 };
+/*
+ * 2D convolution kernel prepared for the tiled convolution engine. Taps are stored x fastest,
+ * kernel[i + width * j] is applied at offset (i - width / 2, j - height / 2). On construction
+ * the kernel is factored into a sum of rank one (separable) terms by cross approximation.
+ * When the rank one terms need less than half the taps of the dense kernel, convolution runs
+ * as horizontal then vertical 1D passes. Otherwise it falls back to dense rows.
+ */
+template<class K> struct ConvolutionFilter {
+	int width, height;
+	std::vector<K> kernel;
+	std::vector<std::vector<K>> horizontal;
+	std::vector<std::vector<K>> vertical;
+	ConvolutionFilter() :width(0), height(0) {
+	}
+	ConvolutionFilter(const std::vector<K>& kernel, int M, int N, double tolerance = 1E-6) {
+		set(kernel.data(), M, N, tolerance);
+	}
+	template<class T, size_t M, size_t N> ConvolutionFilter(const T (&filter)[M][N], double tolerance = 1E-6) {
+		std::vector<K> tmp(M * N);
+		for (int i = 0; i < (int) M; i++) {
+			for (int j = 0; j < (int) N; j++) {
+				tmp[i + M * j] = (K) filter[i][j];
+			}
+		}
+		set(tmp.data(), (int) M, (int) N, tolerance);
+	}
+	bool isSeparable() const {
+		return (horizontal.size() > 0);
+	}
+	int getRank() const {
+		return (int) horizontal.size();
+	}
+	void set(const K* filter, int M, int N, double tolerance = 1E-6) {
+		width = M;
+		height = N;
+		kernel.assign(filter, filter + M * N);
+		horizontal.clear();
+		vertical.clear();
+		std::vector<double> residual(kernel.begin(), kernel.end());
+		double maxValue = 0.0;
+		for (double r : residual) {
+			maxValue = std::max(maxValue, std::abs(r));
+		}
+		if (maxValue == 0.0)
+			return;
+		int maxRank = std::min(M, N);
+		for (int r = 0; r < maxRank; r++) {
+			int p = 0, q = 0;
+			double pivot = 0.0;
+			for (int j = 0; j < N; j++) {
+				for (int i = 0; i < M; i++) {
+					double val = std::abs(residual[i + M * j]);
+					if (val > pivot) {
+						pivot = val;
+						p = i;
+						q = j;
+					}
+				}
+			}
+			if (pivot <= tolerance * maxValue)
+				break;
+			double scale = 1.0 / residual[p + M * q];
+			std::vector<K> h(M), v(N);
+			std::vector<double> hd(M), vd(N);
+			for (int i = 0; i < M; i++) {
+				hd[i] = residual[i + M * q];
+				h[i] = (K) hd[i];
+			}
+			for (int j = 0; j < N; j++) {
+				vd[j] = residual[p + M * j] * scale;
+				v[j] = (K) vd[j];
+			}
+			for (int j = 0; j < N; j++) {
+				for (int i = 0; i < M; i++) {
+					residual[i + M * j] -= hd[i] * vd[j];
+				}
+			}
+			horizontal.push_back(h);
+			vertical.push_back(v);
+		}
+		if (2 * horizontal.size() * (M + N) > (size_t) (M * N)) {
+			horizontal.clear();
+			vertical.clear();
+		}
+	}
+};
+namespace detail {
+/*
+ * Accumulates n interleaved samples of every tap into a small block of registers before
+ * touching dst, so the inner loops are contiguous and vectorize on float and ubyte input.
+ */
+template<class T, int C, class A, class K> inline void ConvolveBlock(const T* const * rows, int R, int offset, const K* filter, int M, int cx, A* dst, int n) {
+	const int BLOCK = 32;
+	A acc[BLOCK];
+	for (int f0 = 0; f0 < n; f0 += BLOCK) {
+		const int nb = std::min(BLOCK, n - f0);
+		for (int f = 0; f < nb; f++) {
+			acc[f] = dst[f0 + f];
+		}
+		for (int r = 0; r < R; r++) {
+			const K* taps = filter + r * M;
+			for (int k = 0; k < M; k++) {
+				const T* s = rows[r] + offset + f0 + (k - cx) * C;
+				const A w = (A) taps[k];
+				if (nb == BLOCK) {
+#pragma omp simd
+					for (int f = 0; f < BLOCK; f++) {
+						acc[f] += w * (A) s[f];
+					}
+				} else {
+					for (int f = 0; f < nb; f++) {
+						acc[f] += w * (A) s[f];
+					}
+				}
+			}
+		}
+		for (int f = 0; f < nb; f++) {
+			dst[f0 + f] = acc[f];
+		}
+	}
+}
+/*
+ * dst[x] (+)= sum_r sum_k filter[k + M*r]*rows[r][clamp(x+k-M/2)] for x in [x0,x1) on channel
+ * interleaved rows. Clamping is only evaluated for the few pixels near the row ends.
+ */
+template<class T, int C, class A, class K> void ConvolveRows(const T* const * rows, int R, int width, int x0, int x1, const K* filter, int M, A* dst, bool accumulate) {
+	const int cx = M / 2;
+	if (!accumulate) {
+		std::fill(dst, dst + (x1 - x0) * C, A(0));
+	}
+	int xa = std::max(x0, std::min(x1, cx));
+	int xb = std::max(xa, std::min(x1, width - M + cx + 1));
+	auto border = [&](int start, int end) {
+		for (int x = start; x < end; x++) {
+			A* d = dst + (x - x0) * C;
+			for (int r = 0; r < R; r++) {
+				for (int k = 0; k < M; k++) {
+					const T* s = rows[r] + aly::clamp(x + k - cx, 0, width - 1) * C;
+					const A w = (A) filter[k + M * r];
+					for (int c = 0; c < C; c++) {
+						d[c] += w * (A) s[c];
+					}
+				}
+			}
+		}
+	};
+	border(x0, xa);
+	border(xb, x1);
+	if (xb > xa) {
+		ConvolveBlock<T, C>(rows, R, xa * C, filter, M, cx, dst + (xa - x0) * C, (xb - xa) * C);
+	}
+}
+template<class T, class A> inline T ConvertSample(const A& val) {
+	return static_cast<T>(val);
+}
+}
+/*
+ * Convolves image with several filters in one pass. The image is processed in tiles so each
+ * tile's rows stay in cache while every filter is applied, which fuses, for example, the x
+ * and y gradient passes into a single traversal of the input. Samples outside the image are
+ * clamped to the nearest edge.
+ */
+template<class T, int C, ImageType I, class K> void Convolve(const Image<T, C, I>& input,
+		const std::vector<const ConvolutionFilter<K>*>& filters,
+		const std::vector<Image<T, C, I>*>& outputs) {
+	typedef typename std::conditional<std::is_same<T, double>::value, double, float>::type A;
+	const int TILE_WIDTH = 128;
+	const int TILE_HEIGHT = 64;
+	const int w = input.width;
+	const int h = input.height;
+	Image<T, C, I> copy;
+	const Image<T, C, I>* image = &input;
+	for (Image<T, C, I>* out : outputs) {
+		if (out == &input) {
+			copy = input;
+			image = &copy;
+			break;
+		}
+	}
+	for (Image<T, C, I>* out : outputs) {
+		out->resize(w, h);
+	}
+	if (w == 0 || h == 0)
+		return;
+	const int tilesX = (w + TILE_WIDTH - 1) / TILE_WIDTH;
+	const int tilesY = (h + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	const T* src = image->ptr();
+#pragma omp parallel
+	{
+		std::vector<A> rows;
+		std::vector<A> accum(TILE_WIDTH * TILE_HEIGHT * C);
+		std::vector<const A*> tapRows;
+		std::vector<const T*> srcRows;
+#pragma omp for schedule(dynamic)
+		for (int tile = 0; tile < tilesX * tilesY; tile++) {
+			const int x0 = (tile % tilesX) * TILE_WIDTH;
+			const int y0 = (tile / tilesX) * TILE_HEIGHT;
+			const int x1 = std::min(w, x0 + TILE_WIDTH);
+			const int y1 = std::min(h, y0 + TILE_HEIGHT);
+			const size_t stride = (size_t) (x1 - x0) * C;
+			for (size_t f = 0; f < filters.size(); f++) {
+				const ConvolutionFilter<K>& filter = *filters[f];
+				std::fill(accum.begin(), accum.end(), A(0));
+				const int cy = filter.height / 2;
+				tapRows.resize(filter.height);
+				srcRows.resize(filter.height);
+				if (filter.isSeparable()) {
+					const int ry0 = y0 - cy;
+					const int ry1 = y1 + filter.height - 1 - cy;
+					rows.resize((ry1 - ry0) * stride);
+					for (int r = 0; r < filter.getRank(); r++) {
+						for (int y = ry0; y < ry1; y++) {
+							const T* row = src + (size_t) aly::clamp(y, 0, h - 1) * w * C;
+							detail::ConvolveRows<T, C>(&row, 1, w, x0, x1, filter.horizontal[r].data(), filter.width, &rows[(y - ry0) * stride], false);
+						}
+						for (int y = y0; y < y1; y++) {
+							for (int k = 0; k < filter.height; k++) {
+								tapRows[k] = &rows[(y - y0 + k) * stride];
+							}
+							detail::ConvolveRows<A, C>(tapRows.data(), filter.height, x1 - x0, 0, x1 - x0, filter.vertical[r].data(), 1, &accum[(y - y0) * stride], true);
+						}
+					}
+				} else {
+					for (int y = y0; y < y1; y++) {
+						for (int k = 0; k < filter.height; k++) {
+							srcRows[k] = src + (size_t) aly::clamp(y + k - cy, 0, h - 1) * w * C;
+						}
+						detail::ConvolveRows<T, C>(srcRows.data(), filter.height, w, x0, x1, filter.kernel.data(), filter.width, &accum[(y - y0) * stride], true);
+					}
+				}
+				T* dst = outputs[f]->ptr();
+				for (int y = y0; y < y1; y++) {
+					const A* a = &accum[(y - y0) * stride];
+					T* d = dst + ((size_t) y * w + x0) * C;
+					for (size_t k = 0; k < stride; k++) {
+						d[k] = detail::ConvertSample<T>(a[k]);
+					}
+				}
+			}
+		}
+	}
+}
+template<class T, int C, ImageType I, class K> void Convolve(const Image<T, C, I>& image,
+		Image<T, C, I>& out, const ConvolutionFilter<K>& filter) {
+	Convolve(image, std::vector<const ConvolutionFilter<K>*> { &filter }, std::vector<Image<T, C, I>*> { &out });
+}
 template<size_t M, size_t N, class T, int C, ImageType I> void Gradient(
 		const Image<T, C, I>& image, Image<T, C, I>& gX, Image<T, C, I>& gY,
 		double sigmaX = (0.607902736 * (M - 1) * 0.5),
 		double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
-
 	double filterX[M][N], filterY[M][N];
 	GaussianKernelDerivative(filterX, filterY, sigmaX, sigmaY);
-
-	gX.resize(image.width, image.height);
-	gY.resize(image.width, image.height);
-#pragma omp parallel for
-	for (int j = 0; j < image.height; j++) {
-		for (int i = 0; i < image.width; i++) {
-			vec<double, C> vsumX(0.0);
-			vec<double, C> vsumY(0.0);
-			for (int ii = 0; ii < (int) M; ii++) {
-				for (int jj = 0; jj < (int) N; jj++) {
-					vec<T, C> val = image(i + ii - (int) M / 2,
-							j + jj - (int) N / 2);
-					vsumX += filterX[ii][jj] * vec<double, C>(val);
-					vsumY += filterY[ii][jj] * vec<double, C>(val);
-				}
-			}
-			gX(i, j) = vec<T, C>(vsumX);
-			gY(i, j) = vec<T, C>(vsumY);
-		}
-	}
+	ConvolutionFilter<double> opX(filterX), opY(filterY);
+	Convolve(image, std::vector<const ConvolutionFilter<double>*> { &opX, &opY }, std::vector<Image<T, C, I>*> { &gX, &gY });
 }
 template<size_t M, size_t N, class T, int C, ImageType I> void Laplacian(
 		const Image<T, C, I>& image, Image<T, C, I>& L,
@@ -342,21 +569,7 @@ template<size_t M, size_t N, class T, int C, ImageType I> void Laplacian(
 		double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
 	float filter[M][N];
 	GaussianKernelLaplacian(filter, (float) sigmaX, (float) sigmaY);
-	L.resize(image.width, image.height);
-#pragma omp parallel for
-	for (int j = 0; j < image.height; j++) {
-		for (int i = 0; i < image.width; i++) {
-			vec<float, C> vsum(0.0);
-			for (int ii = 0; ii < (int) M; ii++) {
-				for (int jj = 0; jj < (int) N; jj++) {
-					vec<T, C> val = image(i + ii - (int) M / 2,
-							j + jj - (int) N / 2);
-					vsum += filter[ii][jj] * vec<float, C>(val);
-				}
-			}
-			L(i, j) = vec<T, C>(vsum);
-		}
-	}
+	Convolve(image, L, ConvolutionFilter<float>(filter));
 }
 
 template<int C> void ConvolveHorizontal(const Image<float, C, ImageType::FLOAT>& input,Image<float, C, ImageType::FLOAT>& output,const std::vector<float>& filter) {
@@ -430,22 +643,7 @@ template<int C> void ConvolveVertical(const Image<float, C, ImageType::FLOAT>& i
 template<int C> void Convolve(const Image<float, C, ImageType::FLOAT>& image,
 		Image<float, C, ImageType::FLOAT>& out,
 		const std::vector<float>& filter, int M, int N) {
-	int w = image.width;
-	int h = image.height;
-	out.resize(w, h);
-#pragma omp parallel for
-	for (int j = 0; j < image.height; j++) {
-		for (int i = 0; i < image.width; i++) {
-			vec<float, C> vsum(0.0);
-			for (int ii = 0; ii < (int) M; ii++) {
-				for (int jj = 0; jj < (int) N; jj++) {
-					vsum += filter[ii + M * jj]
-							* image(i + ii - (int) M / 2, j + jj - (int) N / 2);
-				}
-			}
-			out[i + j * w] = vsum;
-		}
-	}
+	Convolve(image, out, ConvolutionFilter<float>(filter, M, N));
 }
 
 template<size_t M, size_t N, class T, int C, ImageType I> void Smooth(
@@ -454,21 +652,7 @@ template<size_t M, size_t N, class T, int C, ImageType I> void Smooth(
 		double sigmaY = (0.607902736 * (N - 1) * 0.5)) {
 	float filter[M][N];
 	GaussianKernel(filter, (float) sigmaX, (float) sigmaY);
-	B.resize(image.width, image.height);
-#pragma omp parallel for
-	for (int j = 0; j < image.height; j++) {
-		for (int i = 0; i < image.width; i++) {
-			vec<float, C> vsum(0.0);
-			for (int ii = 0; ii < (int) M; ii++) {
-				for (int jj = 0; jj < (int) N; jj++) {
-					vec<T, C> val = image(i + ii - (int) M / 2,
-							j + jj - (int) N / 2);
-					vsum += filter[ii][jj] * vec<float, C>(val);
-				}
-			}
-			B(i, j) = vec<T, C>(vsum);
-		}
-	}
+	Convolve(image, B, ConvolutionFilter<float>(filter));
 }
 template<int C> void Smooth(const Image<float, C, ImageType::FLOAT>& image,
 		Image<float, C, ImageType::FLOAT>& out, float sigma) {
@@ -490,8 +674,8 @@ template<int C> void Gradient(const Image<float, C, ImageType::FLOAT>& image,
 		fsz = 3;
 	std::vector<float> filterX,filterY;
 	GaussianKernelDerivative(filterX,filterY, fsz, fsz, sigma, sigma);
-	Convolve(image, dx, filterX, fsz, fsz);
-	Convolve(image, dy, filterY, fsz, fsz);
+	ConvolutionFilter<float> opX(filterX, fsz, fsz), opY(filterY, fsz, fsz);
+	Convolve(image, std::vector<const ConvolutionFilter<float>*> { &opX, &opY }, std::vector<Image<float, C, ImageType::FLOAT>*> { &dx, &dy });
 }
 template<class T, int C, ImageType I> void Smooth(const Image<T, C, I>& image,
 		Image<T, C, I>& B, double sigmaX, double sigmaY) {
@@ -149,6 +149,9 @@ namespace aly {
 			minPoint = aly::min(aly::min(pts[0], pts[1]), pts[2]);
 			maxPoint = aly::max(aly::max(pts[0], pts[1]), pts[2]);
 		}
+		const float3& getVertex(int i) const {
+			return pts[i];
+		}
 		float3 getNormal() const {
 			return normalize(cross(pts[1] - pts[0], pts[2] - pts[0]));
 		}
@@ -192,26 +195,90 @@ namespace aly {
                     return (a.dist > b.dist);
                 }
         };
+	/*
+	 Node of the flattened bounding volume hierarchy (32 bytes). Inner nodes keep their first child
+	 at the next array index and their second child at offset. Leaves reference count consecutive
+	 triangles starting at offset.
+	 */
+	struct KDFlatNode {
+		float3 minPoint;
+		float3 maxPoint;
+		uint32_t offset;
+		uint16_t count;
+		uint16_t axis;
+		bool isLeaf() const {
+			return count != 0;
+		}
+	};
+	/*
+	 Triangle vertices in structure-of-arrays order, sorted so each leaf covers a contiguous range.
+	 */
+	struct KDTriangleSoA {
+		std::vector<float> x[3], y[3], z[3];
+		void resize(size_t sz) {
+			for (int c = 0; c < 3; c++) {
+				x[c].resize(sz);
+				y[c].resize(sz);
+				z[c].resize(sz);
+			}
+		}
+		void clear() {
+			for (int c = 0; c < 3; c++) {
+				x[c].clear();
+				y[c].clear();
+				z[c].clear();
+			}
+		}
+		size_t size() const {
+			return x[0].size();
+		}
+		void set(size_t i, const float3& p1, const float3& p2, const float3& p3) {
+			x[0][i] = p1.x; y[0][i] = p1.y; z[0][i] = p1.z;
+			x[1][i] = p2.x; y[1][i] = p2.y; z[1][i] = p2.z;
+			x[2][i] = p3.x; y[2][i] = p3.y; z[2][i] = p3.z;
+		}
+		float3 get(size_t i, int c) const {
+			return float3(x[c][i], y[c][i], z[c][i]);
+		}
+	};
 	class Intersector {
 	protected:
 		std::shared_ptr<KDBox> root;
 		std::vector<std::shared_ptr<KDBox>> storage;
+		std::vector<KDFlatNode> nodes;
+		KDTriangleSoA triangles;
+		std::vector<KDTriangle*> triangleRefs;
 		const double intersectCost = 80;
 		const double traversalCost = 1;
 		const double emptyBonus = 0.2;
-		int splitPosition(std::vector<KDBox*>& children,
-			std::vector<KDBoxEdge>& edges, KDBox* box);
+		static const int MAX_LEAF_SIZE = 4;
+		static const int MAX_TREE_DEPTH = 64;
 		void buildTree(int maxDepth);
+		double closestPoint(const float3& pt, double maxDistance, bool inclusive,
+			float3& lastPoint, KDTriangle*& lastTriangle) const;
+		double intersectDistance(const float3& p1, const float3& v, float maxT,
+			bool segment, float3& lastPoint, KDTriangle*& lastTriangle) const;
 	public:
 		void reset() {
 			root.reset();
 			storage.clear();
 			storage.shrink_to_fit();
+			nodes.clear();
+			nodes.shrink_to_fit();
+			triangles.clear();
+			triangleRefs.clear();
+			triangleRefs.shrink_to_fit();
 		}
 		KDBox* getRoot() const {
 			return root.get();
 		}
-
+		const std::vector<KDFlatNode>& getNodes() const {
+			return nodes;
+		}
+		/*
+		 Builds a bounding volume hierarchy with binned SAH splits, one tree level at a time in parallel.
+		 Depth is bounded by maxDepth and MAX_TREE_DEPTH.
+		 */
 		void build(const Mesh& mesh, int maxDepth = 16);
 		Intersector(const Mesh& mesh, int maxDepth = 16) {
 			build(mesh, maxDepth);
@@ -231,6 +298,17 @@ namespace aly {
 		double closestPointSignedDistance(const float3& r, const float& maxDistance, float3& lastPoint, KDTriangle*& lastTriangle) const;
 		double closestPointOutside(const float3& r, const float3& v,
 			float3& lastPoint, KDTriangle*& lastTriangle) const;
+		/*
+		 Batched queries, evaluated in parallel. Rays are traversed in packets of RAY_PACKET_SIZE that
+		 share one walk of the hierarchy, so coherent rays (e.g. from a camera) touch each node once.
+		 */
+		static const int RAY_PACKET_SIZE = 8;
+		void intersectRayDistance(const std::vector<float3>& origins, const std::vector<float3>& directions,
+			std::vector<double>& distances, std::vector<float3>& lastPoints) const;
+		void closestPoint(const std::vector<float3>& pts, std::vector<double>& distances,
+			std::vector<float3>& lastPoints, float maxDistance = NO_HIT_DISTANCE) const;
+		void closestPointSignedDistance(const std::vector<float3>& pts, std::vector<double>& distances,
+			float maxDistance = NO_HIT_DISTANCE) const;
 
 		double intersectRayDistance(const float3& p1, const float3& v,
 			float3& lastPoint) const {
@@ -22,6 +22,7 @@
 #include <stdint.h>
 #include <grid/EndlessGrid.h>
 namespace aly {
+bool SANITY_CHECK_ISO_SURFACE();
 struct EdgeInfo {
 	float3 point;
 	bool winding = false;
@@ -171,6 +172,7 @@ class IsoSurface {
 private:
 	float backgroundValue;
 	bool skipHidden;
+	bool slabParallel;
 	size_t triangleCount;
 	void regularize(const float* data, Mesh& mesh);
 	void regularize(const EndlessGridFloat& grid, Mesh& mesh);
@@ -231,6 +233,8 @@ private:
 	void solveTri(const EndlessGridFloat& grid,
 			Mesh& mesh,
 			const float& isoLevel = 0);
+	void solveTriSlabs(const float* data, const int& rows, const int& cols,
+			const int& slices, Mesh& mesh, const float& isoLevel = 0);
 	void findActiveVoxels(
 			const EndlessGridFloat& grid,
 			const std::list<EndlessNodeFloat*>& leafs,
@@ -239,6 +243,17 @@ private:
 public:
 	IsoSurface();
 	~IsoSurface();
+	/*
+	 When enabled, triangle meshes extracted from an entire Volume1f are built one z-slab per
+	 thread with flat edge arrays instead of a shared edge hash table. Vertex and triangle
+	 order depend only on the volume, not the number of threads.
+	 */
+	void setSlabParallel(bool b) {
+		slabParallel = b;
+	}
+	bool isSlabParallel() const {
+		return slabParallel;
+	}
 	void solve(
 			const EndlessGridFloat& grid,
 			Mesh& mesh,
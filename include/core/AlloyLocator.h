@@ -522,6 +522,317 @@ public:
 template<class T, int C> const size_t MatcherVec<T, C>::NO_POINT_FOUND =
 		std::numeric_limits<size_t>::max();
 
+/*
+ Uniform grid over a fixed point set, addressed through a spatial hash so unbounded domains need no
+ dense cell array. Rebuilding is a parallel counting sort of the points by bucket, which is cheap
+ enough to run every time step; queries only visit the cells overlapping the search radius. Works
+ best when the cell size is close to the typical search radius.
+
+ Teschner, M., Heidelberger, B., Muller, M., Pomerantes, D., & Gross, M. H. (2003). Optimized Spatial
+ Hashing for Collision Detection of Deformable Objects. VMV, 3, 47-54.
+ */
+template<class T, int C> class GridLocator {
+protected:
+	T cellSize;
+	T invCellSize;
+	uint32_t bucketMask;
+	vec<int, C> minCell;
+	vec<int, C> maxCell;
+	std::vector<vec<T, C>> points;
+	std::vector<vec<int, C>> cells;
+	std::vector<uint32_t> indexes;
+	std::vector<uint32_t> buckets;
+	std::vector<uint32_t> bucketStart;
+	std::vector<uint32_t> blockCounts;
+	std::vector<vec<int, C>> unsortedCells;
+	inline vec<int, C> getCell(const vec<T, C>& pt) const {
+		vec<int, C> cell;
+		for (int c = 0; c < C; c++) {
+			cell[c] = (int) std::floor(pt[c] * invCellSize);
+		}
+		return cell;
+	}
+	inline uint32_t getBucket(const vec<int, C>& cell) const {
+		static const uint32_t primes[4] = { 73856093u, 19349663u, 83492791u,
+				50331653u };
+		uint32_t h = 0;
+		for (int c = 0; c < C; c++) {
+			h ^= (uint32_t) cell[c] * primes[c];
+		}
+		return h & bucketMask;
+	}
+	static inline bool sameCell(const vec<int, C>& a, const vec<int, C>& b) {
+		for (int c = 0; c < C; c++) {
+			if (a[c] != b[c])
+				return false;
+		}
+		return true;
+	}
+	template<class Iter> void build(Iter begin, size_t sz) {
+		const int BLOCK_SIZE = 65536;
+		const int MAX_BLOCKS = 8;
+		int N = (int) sz;
+		uint32_t bucketCount = 16;
+		while (2 * bucketCount < (uint32_t) N) {
+			bucketCount <<= 1;
+		}
+		bucketMask = bucketCount - 1;
+		int blocks = clamp((N + BLOCK_SIZE - 1) / BLOCK_SIZE, 1, MAX_BLOCKS);
+		int blockSize = (N + blocks - 1) / blocks;
+		unsortedCells.resize(N);
+		points.resize(N);
+		cells.resize(N);
+		indexes.resize(N);
+		buckets.resize(N);
+		bucketStart.assign(bucketCount + 1, 0);
+		blockCounts.assign((size_t) blocks * bucketCount, 0);
+#pragma omp parallel for
+		for (int b = 0; b < blocks; b++) {
+			uint32_t* counts = &blockCounts[(size_t) b * bucketCount];
+			int end = std::min(N, (b + 1) * blockSize);
+			for (int n = b * blockSize; n < end; n++) {
+				unsortedCells[n] = getCell(begin[n]);
+				uint32_t bucket = getBucket(unsortedCells[n]);
+				buckets[n] = bucket;
+				counts[bucket]++;
+			}
+		}
+#pragma omp parallel for
+		for (int h = 0; h < (int) bucketCount; h++) {
+			uint32_t sum = 0;
+			for (int b = 0; b < blocks; b++) {
+				sum += blockCounts[(size_t) b * bucketCount + h];
+			}
+			bucketStart[h + 1] = sum;
+		}
+		for (uint32_t h = 0; h < bucketCount; h++) {
+			bucketStart[h + 1] += bucketStart[h];
+		}
+#pragma omp parallel for
+		for (int h = 0; h < (int) bucketCount; h++) {
+			uint32_t offset = bucketStart[h];
+			for (int b = 0; b < blocks; b++) {
+				uint32_t& count = blockCounts[(size_t) b * bucketCount + h];
+				uint32_t tmp = count;
+				count = offset;
+				offset += tmp;
+			}
+		}
+#pragma omp parallel for
+		for (int b = 0; b < blocks; b++) {
+			uint32_t* offsets = &blockCounts[(size_t) b * bucketCount];
+			int end = std::min(N, (b + 1) * blockSize);
+			for (int n = b * blockSize; n < end; n++) {
+				uint32_t k = offsets[buckets[n]]++;
+				points[k] = begin[n];
+				cells[k] = unsortedCells[n];
+				indexes[k] = (uint32_t) n;
+			}
+		}
+		if (N > 0) {
+			minCell = unsortedCells[0];
+			maxCell = unsortedCells[0];
+			for (int n = 1; n < N; n++) {
+				minCell = aly::min(minCell, unsortedCells[n]);
+				maxCell = aly::max(maxCell, unsortedCells[n]);
+			}
+		}
+	}
+	static void sortByDistance(std::vector<std::pair<size_t, T>>& matches) {
+		std::sort(matches.begin(), matches.end(),
+				[](const std::pair<size_t, T>& a, const std::pair<size_t, T>& b) {
+					return (a.second < b.second || (a.second == b.second && a.first < b.first));
+				});
+	}
+public:
+	static const size_t NO_POINT_FOUND;
+	GridLocator(T cellSize = T(1)) :
+			cellSize(cellSize), invCellSize(T(1) / cellSize), bucketMask(0), minCell(
+					0), maxCell(-1) {
+	}
+	GridLocator(const Vector<T, C>& data, T cellSize) :
+			GridLocator(cellSize) {
+		build(data);
+	}
+	GridLocator(const std::vector<vec<T, C>>& data, T cellSize) :
+			GridLocator(cellSize) {
+		build(data);
+	}
+	//Takes effect on the next build().
+	void setCellSize(T sz) {
+		cellSize = sz;
+		invCellSize = T(1) / sz;
+	}
+	T getCellSize() const {
+		return cellSize;
+	}
+	size_t size() const {
+		return points.size();
+	}
+	void clear() {
+		points.clear();
+		cells.clear();
+		indexes.clear();
+		buckets.clear();
+		bucketStart.clear();
+		unsortedCells.clear();
+		minCell = vec<int, C>(0);
+		maxCell = vec<int, C>(-1);
+	}
+	void build(const Vector<T, C>& data) {
+		build(data.data.begin(), data.size());
+	}
+	void build(const std::vector<vec<T, C>>& data) {
+		build(data.begin(), data.size());
+	}
+	//Calls func(index, distanceSqr) for every point within maxDistance of pt, in no particular order.
+	template<class F> void forEachInRange(const vec<T, C>& pt, T maxDistance,
+			const F& func) const {
+		if (points.size() == 0)
+			return;
+		vec<int, C> lo = aly::max(getCell(pt - vec<T, C>(maxDistance)), minCell);
+		vec<int, C> hi = aly::min(getCell(pt + vec<T, C>(maxDistance)), maxCell);
+		for (int c = 0; c < C; c++) {
+			if (lo[c] > hi[c])
+				return;
+		}
+		T distSqr = maxDistance * maxDistance;
+		vec<int, C> cell = lo;
+		while (true) {
+			uint32_t bucket = getBucket(cell);
+			for (uint32_t k = bucketStart[bucket]; k < bucketStart[bucket + 1]; k++) {
+				if (sameCell(cells[k], cell)) {
+					T d = distanceSqr(pt, points[k]);
+					if (d <= distSqr) {
+						func((size_t) indexes[k], d);
+					}
+				}
+			}
+			int c = 0;
+			for (; c < C; c++) {
+				if (++cell[c] <= hi[c])
+					break;
+				cell[c] = lo[c];
+			}
+			if (c == C)
+				break;
+		}
+	}
+	void closest(const vec<T, C>& pt, T maxDistance,
+			std::vector<std::pair<size_t, T>>& matches) const {
+		matches.clear();
+		forEachInRange(pt, maxDistance, [&matches](size_t idx, T d) {
+			matches.push_back(std::pair<size_t, T>(idx, std::sqrt(d)));
+		});
+		sortByDistance(matches);
+	}
+	void closest(const vec<T, C>& pt, T maxDistance,
+			std::vector<size_t>& matches) const {
+		std::vector<std::pair<size_t, T>> result;
+		closest(pt, maxDistance, result);
+		matches.clear();
+		matches.reserve(result.size());
+		for (const std::pair<size_t, T>& pr : result) {
+			matches.push_back(pr.first);
+		}
+	}
+	size_t closest(const vec<T, C>& pt, T maxDistance) const {
+		size_t best = NO_POINT_FOUND;
+		T bestDist = std::numeric_limits<T>::max();
+		forEachInRange(pt, maxDistance, [&](size_t idx, T d) {
+			if (d < bestDist || (d == bestDist && idx < best)) {
+				bestDist = d;
+				best = idx;
+			}
+		});
+		return best;
+	}
+	//Grows the search radius until it holds kNN points or covers every occupied cell.
+	void closest(const vec<T, C>& pt, int kNN,
+			std::vector<std::pair<size_t, T>>& matches) const {
+		matches.clear();
+		if (points.size() == 0 || kNN <= 0)
+			return;
+		T radius = cellSize;
+		while (true) {
+			closest(pt, radius, matches);
+			if ((int) matches.size() >= kNN) {
+				matches.resize(kNN);
+				return;
+			}
+			vec<int, C> lo = getCell(pt - vec<T, C>(radius));
+			vec<int, C> hi = getCell(pt + vec<T, C>(radius));
+			bool covered = true;
+			for (int c = 0; c < C; c++) {
+				if (lo[c] > minCell[c] || hi[c] < maxCell[c])
+					covered = false;
+			}
+			if (covered) {
+				//Every point lies within the visited cells, but possibly outside the sphere.
+				closest(pt, (radius + cellSize) * std::sqrt((T) C), matches);
+				if ((int) matches.size() > kNN) {
+					matches.resize(kNN);
+				}
+				return;
+			}
+			radius *= 2;
+		}
+	}
+	void closest(const vec<T, C>& pt, int kNN, std::vector<size_t>& matches) const {
+		std::vector<std::pair<size_t, T>> result;
+		closest(pt, kNN, result);
+		matches.clear();
+		matches.reserve(result.size());
+		for (const std::pair<size_t, T>& pr : result) {
+			matches.push_back(pr.first);
+		}
+	}
+	size_t closest(const vec<T, C>& pt) const {
+		std::vector<std::pair<size_t, T>> result;
+		closest(pt, 1, result);
+		return (result.size() > 0) ? result[0].first : NO_POINT_FOUND;
+	}
+	/*
+	 Neighbors within maxDistance of every stored point, excluding the point itself, as a compressed
+	 list: the neighbors of point i are matches[offsets[i]] through matches[offsets[i+1]-1], sorted by
+	 distance.
+	 */
+	void neighbors(T maxDistance, std::vector<uint32_t>& offsets,
+			std::vector<std::pair<size_t, T>>& matches) const {
+		int N = (int) points.size();
+		offsets.assign(N + 1, 0);
+#pragma omp parallel for
+		for (int k = 0; k < N; k++) {
+			uint32_t count = 0;
+			size_t self = indexes[k];
+			forEachInRange(points[k], maxDistance, [&](size_t idx, T d) {
+				if (idx != self)
+					count++;
+			});
+			offsets[self + 1] = count;
+		}
+		for (int n = 0; n < N; n++) {
+			offsets[n + 1] += offsets[n];
+		}
+		matches.resize(offsets[N]);
+#pragma omp parallel for
+		for (int k = 0; k < N; k++) {
+			size_t self = indexes[k];
+			uint32_t pos = offsets[self];
+			forEachInRange(points[k], maxDistance, [&](size_t idx, T d) {
+				if (idx != self)
+					matches[pos++] = std::pair<size_t, T>(idx, std::sqrt(d));
+			});
+			std::sort(matches.begin() + offsets[self], matches.begin() + pos,
+					[](const std::pair<size_t, T>& a, const std::pair<size_t, T>& b) {
+						return (a.second < b.second || (a.second == b.second && a.first < b.first));
+					});
+		}
+	}
+};
+template<class T, int C> const size_t GridLocator<T, C>::NO_POINT_FOUND =
+		std::numeric_limits<size_t>::max();
+
 typedef Locator<float, 2> Locator2f;
 typedef Locator<float, 3> Locator3f;
 typedef Locator<float, 4> Locator4f;
@@ -538,6 +849,11 @@ typedef Matcher<float, 256> Matcher256f;
 typedef Matcher<float, 512> Matcher512f;
 typedef Matcher<float, 1024> Matcher1024f;
 
+typedef GridLocator<float, 2> GridLocator2f;
+typedef GridLocator<float, 3> GridLocator3f;
+typedef GridLocator<double, 2> GridLocator2d;
+typedef GridLocator<double, 3> GridLocator3d;
+
 typedef MatcherVec<double, 2> Matcher2d;
 typedef MatcherVec<double, 3> Matcher3d;
 typedef MatcherVec<double, 4> Matcher4d;
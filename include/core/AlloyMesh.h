@@ -37,6 +37,64 @@ class Mesh;
 enum class SubDivisionScheme {
 	CatmullClark,Loop
 };
+/*
+ Compressed sparse row table. Row i holds indexes[offsets[i]] to indexes[offsets[i + 1] - 1].
+ */
+struct MeshNeighborTable {
+	struct Row {
+		const uint32_t* first;
+		const uint32_t* last;
+		const uint32_t* begin() const {
+			return first;
+		}
+		const uint32_t* end() const {
+			return last;
+		}
+		size_t size() const {
+			return last - first;
+		}
+		uint32_t operator[](size_t i) const {
+			return first[i];
+		}
+	};
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> indexes;
+	size_t size() const {
+		return (offsets.size() > 0) ? offsets.size() - 1 : 0;
+	}
+	Row operator[](size_t i) const {
+		Row row;
+		row.first = indexes.data() + offsets[i];
+		row.last = indexes.data() + offsets[i + 1];
+		return row;
+	}
+	void clear() {
+		offsets.clear();
+		indexes.clear();
+	}
+};
+/*
+ Connectivity shared by mesh processing algorithms. Faces are numbered with triangles first and
+ quads second. Edges are the unique pairs (a,b) with a<b, sorted by a and then b.
+ */
+struct MeshAdjacency {
+	size_t vertexCount = 0;
+	size_t triCount = 0;
+	size_t quadCount = 0;
+	//Faces incident to each vertex in face order.
+	MeshNeighborTable vertexFaces;
+	//Sorted vertices that share a face edge with each vertex.
+	MeshNeighborTable vertexNeighbors;
+	//Faces that share an edge with each face, if the edge has exactly two faces.
+	MeshNeighborTable faceNeighbors;
+	std::vector<uint2> edges;
+	//Index of the first edge (a,b) for each vertex a.
+	std::vector<uint32_t> edgeOffsets;
+	void build(const Mesh& mesh);
+	bool isValid(const Mesh& mesh) const;
+	//Index of edge (a,b) in either order, or -1 if there is no such edge.
+	int64_t findEdge(uint32_t a, uint32_t b) const;
+};
 struct GLMesh: public GLComponent {
 public:
 	enum class PrimitiveType {
@@ -88,6 +146,7 @@ private:
 	bool dirtyOffScreen = false;
 protected:
 	box3f boundingBox;
+	mutable std::shared_ptr<MeshAdjacency> adjacency;
 public:
 	friend struct GLMesh;
 	Vector3f vertexLocations;
@@ -145,9 +204,13 @@ public:
 	float estimateVoxelSize(int stride = 1);
 	void update(bool onScreen=true);
 	void clear();
+	//Marking the mesh dirty also drops the adjacency, since faces may have been edited in place.
 	void setDirty(bool d) {
 		this->dirtyOnScreen = d;
 		this->dirtyOffScreen = d;
+		if (d) {
+			adjacency.reset();
+		}
 	}
 	void setDirty(bool onScreen,bool d) {
 		if (onScreen) {
@@ -156,11 +219,19 @@ public:
 		else {
 			this->dirtyOffScreen = d;
 		}
+		if (d) {
+			adjacency.reset();
+		}
 	}
 	inline bool isDirty(bool onScreen) const {
 		return (onScreen)?dirtyOnScreen:dirtyOffScreen;
 	}
 	bool load(const std::string& file);
+	//Built on first use and kept until setDirty(true) or until the vertex or face counts change.
+	const MeshAdjacency& getAdjacency() const;
+	void clearAdjacency() {
+		adjacency.reset();
+	}
 	void updateVertexNormals(bool flipSign=false,int SMOOTH_ITERATIONS = 0, float DOT_TOLERANCE =
 			0.75f);
 	bool convertQuadsToTriangles();
@@ -198,6 +269,10 @@ void CreateVertexNeighborTable(const Mesh& mesh, MeshSetNeighborTable& vertNbrs)
 void CreateOrderedVertexNeighborTable(const Mesh& mesh,
 	MeshListNeighborTable& vertNbrs, bool leaveTail = false);
 void CreateFaceNeighborTable(const Mesh& mesh, MeshListNeighborTable& faceNbrs);
+void CreateVertexNeighborTable(const Mesh& mesh, MeshNeighborTable& vertNbrs);
+void CreateOrderedVertexNeighborTable(const Mesh& mesh,
+	MeshNeighborTable& vertNbrs, bool leaveTail = false);
+void CreateFaceNeighborTable(const Mesh& mesh, MeshNeighborTable& faceNbrs);
 void Subdivide(Mesh& mesh, SubDivisionScheme type= SubDivisionScheme::CatmullClark);
 }
 #endif /* MESH_H_ */
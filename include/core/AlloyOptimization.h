@@ -22,6 +22,7 @@
 #ifndef INCLUDE_CORE_ALLOYOPTIMIZATION_H_
 #define INCLUDE_CORE_ALLOYOPTIMIZATION_H_
 #include <AlloyOptimizationMath.h>
+#include <AlloySparseCholesky.h>
 #include <AlloyEnum.h>
 #include <AlloyLBFGS.h>
 namespace aly {
@@ -401,7 +402,7 @@ template<class T> Vec<T> SolveSVD(const DenseMat<T>& A, const Vec<T>& b) {
 	}
 	if (A.rows != A.cols) {
 		DenseMat<T> At = A.transpose();
-		DenseMat<T> AtA = At * A;
+		DenseMat<T> AtA = Gram(A);
 		Vec<T> Atb = At * b;
 		return inverse(AtA) * Atb;
 	} else {
@@ -514,7 +515,7 @@ template<class T> Vec<T> SolveLU(const DenseMat<T>& A, const Vec<T>& b) {
 	}
 	if (A.rows != A.cols) {
 		DenseMat<T> At = A.transpose();
-		DenseMat<T> AtA = At * A;
+		DenseMat<T> AtA = Gram(A);
 		Vec<T> Atb = At * b;
 		int n = AtA.cols;
 		Vec<T> x(A.cols);
@@ -677,7 +678,7 @@ template<class T> Vec<T> SolveQR(const DenseMat<T>& A, const Vec<T>& b) {
 	}
 	if (A.rows != A.cols) {
 		DenseMat<T> At = A.transpose();
-		DenseMat<T> AtA = At * A;
+		DenseMat<T> AtA = Gram(A);
 		Vec<T> Atb = At * b;
 		int n = AtA.cols;
 		Vec<T> x(A.cols);
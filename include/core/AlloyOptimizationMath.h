@@ -24,6 +24,7 @@
 #include <cereal/types/list.hpp>
 #include "AlloyVector.h"
 #include "AlignedAllocator.h"
+#include "AlloyDenseKernels.h"
 #include "cereal/types/vector.hpp"
 #include "cereal/types/tuple.hpp"
 #include "cereal/types/map.hpp"
@@ -662,10 +663,8 @@ public:
 	}
 	inline DenseMat<T> transpose() const {
 		DenseMat<T> M(cols, rows);
-		for (int i = 0; i < rows; i++) {
-			for (int j = 0; j < cols; j++) {
-				M(j, i) = operator()(i, j);
-			}
+		if (M.data.size() > 0) {
+			Transpose(rows, cols, &data[0], cols, 1, &M.data[0], rows, 1);
 		}
 		return M;
 	}
@@ -720,13 +719,16 @@ template<class A, class B, class T> std::basic_ostream<A, B> & operator <<(
 
 template<class T> Vec<T> operator*(const DenseMat<T>& A, const VecType<T>& v) {
 	Vec<T> out(A.rows);
-	for (int i = 0; i < A.rows; i++) {
-		T sum(0.0);
-		for (int j = 0; j < A.cols; j++) {
-			sum += A(i, j) * v[j];
-		}
-		out[i] = sum;
+	if (A.rows == 0) {
+		return out;
+	}
+	//VecType elements are behind virtual accessors, so gather them once.
+	std::vector<T> x(A.cols);
+	for (int j = 0; j < A.cols; j++) {
+		x[j] = v[j];
 	}
+	Gemv(A.rows, A.cols, T(1), A.data.data(), A.cols, 1, x.data(), 1, T(0),
+			&out[0], 1);
 	return out;
 }
 template<class T> DenseMat<T> operator*(const DenseMat<T>& A,
@@ -738,15 +740,15 @@ template<class T> DenseMat<T> operator*(const DenseMat<T>& A,
 						<< "[" << A.rows << "," << A.cols << "] * [" << B.rows
 						<< "," << B.cols << "]");
 	DenseMat<T> out(A.rows, B.cols);
-	for (int i = 0; i < out.rows; i++) {
-		for (int j = 0; j < out.cols; j++) {
-			T sum(0.0);
-			for (int k = 0; k < A.cols; k++) {
-				sum += A(i, k) * B(k, j);
-			}
-			out(i, j) = sum;
-		}
-	}
+	Gemm(A.rows, B.cols, A.cols, T(1), A.data.data(), A.cols, 1, B.data.data(),
+			B.cols, 1, T(0), out.data.data(), out.cols, 1);
+	return out;
+}
+//Equivalent to A.transpose() * A, but only half of the symmetric product is computed.
+template<class T> DenseMat<T> Gram(const DenseMat<T>& A) {
+	DenseMat<T> out(A.cols, A.cols);
+	Syrk(A.rows, A.cols, T(1), A.data.data(), A.cols, 1, T(0), out.data.data(),
+			out.cols, 1);
 	return out;
 }
 //Slight abuse of mathematics here. Vectors are always interpreted as column vectors as a convention,
@@ -32,6 +32,7 @@
 #include <fstream>
 #include <list>
 #include <stddef.h>
+#include "AlloyMemMappedFile.h"
 namespace aly
 {
 	bool SANITY_CHECK_MESH_IO();
@@ -330,6 +331,23 @@ const PlyProperty MeshFaceProps[] =
                             DataType::Uint8,
                             DataType::Uint8,
                             offsetof(plyFaceTexture, nvels)) };
+double DecodePlyScalar(const char* ptr, const DataType& type);
+/*
+ Byte layout of an element whose properties are all scalars, so that every element has the same
+ stride. Memory mapped little endian files can then be decoded in bulk, and in parallel.
+ */
+struct PlyScalarLayout
+{
+        size_t stride = 0;
+        std::vector<int> offsets;
+        std::vector<DataType> types;
+        //Returns false if the element has list properties. Names not present get offset -1.
+        bool set(const PlyElement* elem, const std::vector<std::string>& names);
+        double get(const char* ptr, int n) const
+        {
+            return DecodePlyScalar(ptr + offsets[n], types[n]);
+        }
+};
 class PLYReaderWriter
 {
     protected:
@@ -370,6 +388,23 @@ class PLYReaderWriter
                                                                         int *nelems,
                                                                         int *nprops);
         void describeProperty(PlyProperty *);
+        FileFormat getFileFormat() const
+        {
+            return plyFile->file_type;
+        }
+        /*
+         Binary files are memory mapped after the header is parsed. The cursor points at the
+         next unread element, so callers can decode fixed-size elements in bulk and then skip them.
+         */
+        bool isMemoryMapped() const
+        {
+            return (mapped.get() != nullptr);
+        }
+        const char* getMappedCursor() const
+        {
+            return mapCursor;
+        }
+        void skipMappedBytes(size_t bytes);
         std::vector<std::string> getComments();
         std::vector<std::string> getObjInfo();
         std::vector<std::string> getElementList();
@@ -383,6 +418,10 @@ class PLYReaderWriter
         static const int NAMED_PROP = 1;
         std::ofstream out;
         std::ifstream in;
+        std::unique_ptr<ReadableMemMapFile> mapped;
+        const char* mapCursor = nullptr;
+        const char* mapEnd = nullptr;
+        void readBinary(char* ptr, size_t bytes);
 
         std::unique_ptr<PlyFile> plyFile;
         void openForReading(const std::string& fileName,
@@ -22,6 +22,7 @@
 #define POISSONRECONAPI_H_
 
 #include <AlloyMesh.h>
+#include <AlloyPLY.h>
 #include <functional>
 #include <omp.h>
 #include <poisson/ArgumentParser.h>
@@ -42,6 +43,54 @@ public:
 	}
 	virtual bool nextPoint(OrientedPoint3D< float >& p, Point3D< float >& d) override;
 };
+/*
+ Point source that delivers oriented points in fixed-size chunks, so the input never has to be
+ resident in memory at once. Subclasses implement readChunk() to fill the buffers with at most
+ count points (colors may be left empty) and rewind() to start over. SurfaceReconstruct reads
+ the stream twice: once for the bounding box and once to build the oct-tree.
+ */
+class ChunkedPointStream : public OrientedPointStreamWithData<float, Point3D< float> >
+{
+protected:
+	std::vector<aly::float3> points;
+	std::vector<aly::float3> normals;
+	std::vector<aly::ubyte3> colors;
+	size_t chunkSize;
+	size_t position;
+	virtual void rewind() = 0;
+	virtual void readChunk(size_t count) = 0;
+public:
+	ChunkedPointStream(size_t chunkSize = 1 << 16) :chunkSize(chunkSize), position(0) {
+	}
+	//Total number of points if known in advance, zero otherwise. Only used to report progress.
+	virtual size_t getPointCount() const {
+		return 0;
+	}
+	virtual void reset(void) override;
+	virtual bool nextPoint(OrientedPoint3D< float >& p, Point3D< float >& d) override;
+};
+/*
+ Streams vertex positions, normals and colors from a PLY point cloud. Binary little endian files
+ are memory mapped and decoded one chunk at a time, other formats go through the PLY reader.
+ */
+class PlyPointStream : public ChunkedPointStream
+{
+protected:
+	std::string file;
+	std::unique_ptr<aly::ply::PLYReaderWriter> ply;
+	aly::ply::PlyScalarLayout layout;
+	const char* cursor;
+	size_t pointCount;
+	size_t pointsRead;
+	bool hasColors;
+	virtual void rewind() override;
+	virtual void readChunk(size_t count) override;
+public:
+	PlyPointStream(const std::string& file, size_t chunkSize = 1 << 16);
+	virtual size_t getPointCount() const override {
+		return pointCount;
+	}
+};
 
 struct ReconstructionParameters {
 	ArgumentReadable
@@ -113,5 +162,11 @@ struct ReconstructionParameters {
 };
 void SurfaceReconstruct(const ReconstructionParameters& params, const aly::Mesh& input, aly::Mesh& output,
 	const std::function<bool(const std::string& status, float progress)>& monitor=nullptr);
+//Reconstructs from a point stream in world coordinates without loading it into a mesh. Progress is reported for each phase, including both passes over the input.
+void SurfaceReconstruct(const ReconstructionParameters& params, ChunkedPointStream& input, aly::Mesh& output,
+	const std::function<bool(const std::string& status, float progress)>& monitor = nullptr);
+//Streams the oriented points of a PLY file, see PlyPointStream.
+void SurfaceReconstruct(const ReconstructionParameters& params, const std::string& plyFile, aly::Mesh& output,
+	const std::function<bool(const std::string& status, float progress)>& monitor = nullptr);
 
 #endif /* POISSONRECONAPI_H_ */
@@ -0,0 +1,447 @@
+/*
+ * Copyright(C) 2015, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef ALLOYSPARSECHOLESKY_H_
+#define ALLOYSPARSECHOLESKY_H_
+#include "AlloyOptimizationMath.h"
+#include <vector>
+#include <cmath>
+#include <algorithm>
+namespace aly {
+bool SANITY_CHECK_SPARSE_CHOLESKY();
+namespace detail {
+/*
+ * Approximate minimum degree ordering of a symmetric pattern given as adjacency lists
+ * (no self loops). Eliminated variables become elements of a quotient graph so fill is
+ * never formed explicitly. Degrees use the AMD upper bound d(i)=|A(i)|+|Lp\i|+sum|Le\Lp|
+ * and elements that become subsets of the new pivot element are absorbed. Dense rows are
+ * ordered last. Returns perm with perm[k] = variable eliminated at step k.
+ */
+inline std::vector<int> ApproximateMinimumDegree(std::vector<std::vector<int>>& vars) {
+	const int n = (int) vars.size();
+	std::vector<int> perm;
+	perm.reserve(n);
+	if (n == 0)
+		return perm;
+	enum NodeState {
+		Variable = 0, Element = 1, Absorbed = 2, Dense = 3
+	};
+	std::vector<std::vector<int>> elems(n), members(n);
+	std::vector<int> status(n, Variable), degree(n), head(n, -1), next(n, -1), prev(n, -1);
+	std::vector<int> mark(n, -1), wmark(n, -1), w(n, 0);
+	const int denseThreshold = std::max(16, (int) (10 * std::sqrt((double) n)));
+	int live = n;
+	for (int i = 0; i < n; i++) {
+		if ((int) vars[i].size() > denseThreshold) {
+			status[i] = Dense;
+			live--;
+		}
+	}
+	auto insert = [&](int i) {
+		int d = degree[i];
+		prev[i] = -1;
+		next[i] = head[d];
+		if (head[d] >= 0)prev[head[d]] = i;
+		head[d] = i;
+	};
+	auto remove = [&](int i) {
+		int d = degree[i];
+		if (prev[i] >= 0)next[prev[i]] = next[i]; else head[d] = next[i];
+		if (next[i] >= 0)prev[next[i]] = prev[i];
+	};
+	for (int i = 0; i < n; i++) {
+		if (status[i] == Dense)
+			continue;
+		std::vector<int>& adj = vars[i];
+		adj.erase(std::remove_if(adj.begin(), adj.end(), [&](int j) {return status[j]==Dense;}), adj.end());
+		degree[i] = std::min((int) adj.size(), n - 1);
+		insert(i);
+	}
+	int mindeg = 0;
+	std::vector<int> Lp;
+	for (int step = 0; step < live; step++) {
+		while (head[mindeg] < 0)
+			mindeg++;
+		int p = head[mindeg];
+		remove(p);
+		perm.push_back(p);
+		status[p] = Element;
+		//Lp = variables adjacent to p, directly or through elements absorbed into p.
+		Lp.clear();
+		mark[p] = step;
+		for (int v : vars[p]) {
+			if (status[v] == Variable && mark[v] != step) {
+				mark[v] = step;
+				Lp.push_back(v);
+			}
+		}
+		for (int e : elems[p]) {
+			if (status[e] != Element)
+				continue;
+			for (int v : members[e]) {
+				if (status[v] == Variable && mark[v] != step) {
+					mark[v] = step;
+					Lp.push_back(v);
+				}
+			}
+			status[e] = Absorbed;
+			std::vector<int>().swap(members[e]);
+		}
+		std::vector<int>().swap(vars[p]);
+		std::vector<int>().swap(elems[p]);
+		members[p] = Lp;
+		//|Le\Lp| for every element adjacent to Lp.
+		for (int i : Lp) {
+			for (int e : elems[i]) {
+				if (status[e] != Element)
+					continue;
+				if (wmark[e] != step) {
+					std::vector<int>& le = members[e];
+					le.erase(std::remove_if(le.begin(), le.end(), [&](int v) {return status[v]!=Variable;}), le.end());
+					w[e] = (int) le.size();
+					wmark[e] = step;
+				}
+				w[e]--;
+			}
+		}
+		const int remaining = live - step - 1;
+		for (int i : Lp) {
+			remove(i);
+			int d = (int) Lp.size() - 1;
+			std::vector<int>& ei = elems[i];
+			size_t k = 0;
+			for (int e : ei) {
+				if (status[e] != Element)
+					continue;
+				if (w[e] == 0) {
+					//Le is a subset of Lp.
+					status[e] = Absorbed;
+					std::vector<int>().swap(members[e]);
+					continue;
+				}
+				d += w[e];
+				ei[k++] = e;
+			}
+			ei.resize(k);
+			ei.push_back(p);
+			std::vector<int>& vi = vars[i];
+			k = 0;
+			for (int v : vi) {
+				if (status[v] == Variable && mark[v] != step) {
+					vi[k++] = v;
+				}
+			}
+			vi.resize(k);
+			d += (int) k;
+			degree[i] = std::max(0, std::min(std::min(d, degree[i] + (int) Lp.size()), remaining));
+			insert(i);
+			mindeg = std::min(mindeg, degree[i]);
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		if (status[i] == Dense)
+			perm.push_back(i);
+	}
+	return perm;
+}
+}
+/*
+ * Sparse LDL^T factorization P*A*P^T = L*D*L^T of a symmetric SparseMat with a
+ * fill-reducing approximate minimum degree ordering P. analyze() computes the ordering,
+ * elimination tree and column counts of L once; factorize() only recomputes the numeric
+ * values and may be called repeatedly while the sparsity pattern stays fixed, optionally
+ * adding a shift to the diagonal (e.g. Levenberg-Marquardt damping). Only the upper
+ * triangle of A is read. Factors are accumulated in double precision.
+ */
+template<class T> class SparseLDLT {
+protected:
+	int n = 0;
+	std::vector<int> perm, iperm;
+	//Upper triangle of P*A*P^T stored by column, with the diagonal always present.
+	std::vector<int> colOffsets, rowIndexes, diagIndexes;
+	//Upper triangle of A stored by row in SparseMat order, and its slot in rowIndexes.
+	std::vector<size_t> patternOffsets;
+	std::vector<int> patternColumns, patternSlots;
+	std::vector<int> parent, Lp, Li, Lnz, flag, pattern;
+	std::vector<double> Ax, Lx, D, Y;
+	mutable std::vector<double> work;
+	bool analyzed = false;
+	bool factored = false;
+	virtual bool acceptPivot(double d) const {
+		return d != 0.0 && std::isfinite(d);
+	}
+public:
+	SparseLDLT() {
+	}
+	SparseLDLT(const SparseMat<T>& A, T shift = T(0)) {
+		compute(A, shift);
+	}
+	virtual ~SparseLDLT() {
+	}
+	int size() const {
+		return n;
+	}
+	bool isAnalyzed() const {
+		return analyzed;
+	}
+	bool isFactored() const {
+		return factored;
+	}
+	size_t nonZeros() const {
+		return (analyzed) ? (size_t) Lp[n] : 0;
+	}
+	const std::vector<int>& permutation() const {
+		return perm;
+	}
+	const std::vector<double>& diagonal() const {
+		return D;
+	}
+	void analyze(const SparseMat<T>& A) {
+		if (A.rows != A.cols)
+			throw std::runtime_error(MakeString() << "Cannot factor non-square matrix [" << A.rows << "," << A.cols << "]");
+		n = (int) A.rows;
+		factored = false;
+		patternOffsets.assign(n + 1, 0);
+		patternColumns.clear();
+		std::vector<std::vector<int>> adj(n);
+		for (int i = 0; i < n; i++) {
+			for (const auto& pr : A[i]) {
+				int j = (int) pr.first;
+				if (j < i)
+					continue;
+				patternColumns.push_back(j);
+				if (j != i) {
+					adj[i].push_back(j);
+					adj[j].push_back(i);
+				}
+			}
+			patternOffsets[i + 1] = patternColumns.size();
+		}
+		perm = detail::ApproximateMinimumDegree(adj);
+		iperm.resize(n);
+		for (int k = 0; k < n; k++) {
+			iperm[perm[k]] = k;
+		}
+		//Count entries per column of the permuted upper triangle, then fill.
+		colOffsets.assign(n + 1, 0);
+		for (int i = 0; i < n; i++) {
+			colOffsets[iperm[i] + 1]++;
+			for (size_t k = patternOffsets[i]; k < patternOffsets[i + 1]; k++) {
+				int j = patternColumns[k];
+				if (j != i)
+					colOffsets[std::max(iperm[i], iperm[j]) + 1]++;
+			}
+		}
+		for (int k = 0; k < n; k++) {
+			colOffsets[k + 1] += colOffsets[k];
+		}
+		std::vector<int> fill(colOffsets.begin(), colOffsets.end() - 1);
+		rowIndexes.resize(colOffsets[n]);
+		diagIndexes.resize(n);
+		patternSlots.resize(patternColumns.size());
+		for (int i = 0; i < n; i++) {
+			int pi = iperm[i];
+			diagIndexes[pi] = fill[pi];
+			rowIndexes[fill[pi]++] = pi;
+		}
+		for (int i = 0; i < n; i++) {
+			for (size_t k = patternOffsets[i]; k < patternOffsets[i + 1]; k++) {
+				int j = patternColumns[k];
+				if (j == i) {
+					patternSlots[k] = diagIndexes[iperm[i]];
+				} else {
+					int a = iperm[i], b = iperm[j];
+					int c = std::max(a, b);
+					patternSlots[k] = fill[c];
+					rowIndexes[fill[c]++] = std::min(a, b);
+				}
+			}
+		}
+		//Elimination tree and column counts of L.
+		parent.assign(n, -1);
+		Lnz.assign(n, 0);
+		flag.assign(n, -1);
+		for (int k = 0; k < n; k++) {
+			flag[k] = k;
+			for (int p = colOffsets[k]; p < colOffsets[k + 1]; p++) {
+				int i = rowIndexes[p];
+				for (; flag[i] != k; i = parent[i]) {
+					if (parent[i] == -1)
+						parent[i] = k;
+					Lnz[i]++;
+					flag[i] = k;
+				}
+			}
+		}
+		Lp.assign(n + 1, 0);
+		for (int k = 0; k < n; k++) {
+			Lp[k + 1] = Lp[k] + Lnz[k];
+		}
+		Li.resize(Lp[n]);
+		Lx.resize(Lp[n]);
+		Ax.resize(rowIndexes.size());
+		D.resize(n);
+		Y.assign(n, 0.0);
+		pattern.resize(n);
+		work.resize(n);
+		analyzed = true;
+	}
+	//True if A has the same upper triangular pattern that was analyzed.
+	bool matchesPattern(const SparseMat<T>& A) const {
+		if (!analyzed || (int) A.rows != n || (int) A.cols != n)
+			return false;
+		for (int i = 0; i < n; i++) {
+			size_t k = patternOffsets[i];
+			const std::map<size_t, T>& row = A[i];
+			for (auto iter = row.lower_bound((size_t) i); iter != row.end(); iter++) {
+				if (k >= patternOffsets[i + 1] || patternColumns[k] != (int) iter->first)
+					return false;
+				k++;
+			}
+			if (k != patternOffsets[i + 1])
+				return false;
+		}
+		return true;
+	}
+	/*
+	 * Numeric factorization of A+shift*I reusing the symbolic analysis. The pattern of A must
+	 * match the analyzed pattern. Returns false if a pivot is rejected.
+	 */
+	bool factorize(const SparseMat<T>& A, T shift = T(0)) {
+		if (!analyzed)
+			analyze(A);
+		factored = false;
+		std::fill(Ax.begin(), Ax.end(), 0.0);
+		for (int i = 0; i < n; i++) {
+			size_t k = patternOffsets[i];
+			const std::map<size_t, T>& row = A[i];
+			for (auto iter = row.lower_bound((size_t) i); iter != row.end(); iter++) {
+				Ax[patternSlots[k++]] = (double) iter->second;
+			}
+		}
+		if (shift != T(0)) {
+			for (int k = 0; k < n; k++) {
+				Ax[diagIndexes[k]] += (double) shift;
+			}
+		}
+		//Up-looking factorization, row k of L is computed from the elimination tree.
+		for (int k = 0; k < n; k++) {
+			Y[k] = 0.0;
+			int top = n;
+			flag[k] = k;
+			Lnz[k] = 0;
+			for (int p = colOffsets[k]; p < colOffsets[k + 1]; p++) {
+				int i = rowIndexes[p];
+				Y[i] += Ax[p];
+				int len = 0;
+				for (; flag[i] != k; i = parent[i]) {
+					pattern[len++] = i;
+					flag[i] = k;
+				}
+				while (len > 0) {
+					pattern[--top] = pattern[--len];
+				}
+			}
+			double dk = Y[k];
+			Y[k] = 0.0;
+			for (; top < n; top++) {
+				int i = pattern[top];
+				double yi = Y[i];
+				Y[i] = 0.0;
+				int p2 = Lp[i] + Lnz[i];
+				for (int p = Lp[i]; p < p2; p++) {
+					Y[Li[p]] -= Lx[p] * yi;
+				}
+				double lki = yi / D[i];
+				dk -= lki * yi;
+				Li[p2] = k;
+				Lx[p2] = lki;
+				Lnz[i]++;
+			}
+			D[k] = dk;
+			if (!acceptPivot(dk)) {
+				std::fill(Y.begin(), Y.end(), 0.0);
+				return false;
+			}
+		}
+		factored = true;
+		return true;
+	}
+	//Analyzes only if the pattern changed since the last analysis.
+	bool compute(const SparseMat<T>& A, T shift = T(0)) {
+		if (!matchesPattern(A))
+			analyze(A);
+		return factorize(A, shift);
+	}
+	void solve(const Vec<T>& b, Vec<T>& x) const {
+		if (!factored)
+			throw std::runtime_error("Sparse factorization has not been computed.");
+		if ((int) b.size() != n)
+			throw std::runtime_error(MakeString() << "Right hand side length " << b.size() << " does not match matrix size " << n);
+		std::vector<double>& y = work;
+		for (int k = 0; k < n; k++) {
+			y[k] = (double) b[perm[k]];
+		}
+		for (int j = 0; j < n; j++) {
+			double yj = y[j];
+			for (int p = Lp[j]; p < Lp[j + 1]; p++) {
+				y[Li[p]] -= Lx[p] * yj;
+			}
+		}
+		for (int j = 0; j < n; j++) {
+			y[j] /= D[j];
+		}
+		for (int j = n - 1; j >= 0; j--) {
+			double yj = y[j];
+			for (int p = Lp[j]; p < Lp[j + 1]; p++) {
+				yj -= Lx[p] * y[Li[p]];
+			}
+			y[j] = yj;
+		}
+		x.resize(n);
+		for (int k = 0; k < n; k++) {
+			x[perm[k]] = T(y[k]);
+		}
+	}
+	Vec<T> solve(const Vec<T>& b) const {
+		Vec<T> x;
+		solve(b, x);
+		return x;
+	}
+};
+/*
+ * Sparse Cholesky factorization P*A*P^T = L*L^T, stored as L*D*L^T with D > 0 so the same
+ * symbolic analysis and triangular solves are shared. factorize() fails on matrices that
+ * are not numerically positive definite.
+ */
+template<class T> class SparseCholesky: public SparseLDLT<T> {
+protected:
+	virtual bool acceptPivot(double d) const override {
+		return d > 0.0 && std::isfinite(d);
+	}
+public:
+	SparseCholesky() {
+	}
+	SparseCholesky(const SparseMat<T>& A, T shift = T(0)) {
+		this->compute(A, shift);
+	}
+};
+}
+#endif
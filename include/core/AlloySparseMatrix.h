@@ -30,6 +30,8 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <limits>
+#include <algorithm>
 namespace aly {
 
 template<class T, int C> struct SparseMatrix {
@@ -595,6 +597,173 @@ template<class T, int C> void SubtractMultiplyVec(Vector<T, C>& out,
 		out[i] = b[i] - vec<T, C>(sum);
 	}
 }
+/*
+ * Frozen compressed row storage (CSR) for a SparseMatrix. Rows are laid out back to back
+ * in contiguous column and value arrays so matrix-vector products stream through memory
+ * instead of walking map nodes. Entries are vec<T,C>, which makes this the block (BSR)
+ * layout when C>1. Build it once from the map-based SparseMatrix and reuse it across
+ * solver iterations.
+ */
+template<class T, int C> struct CompressedSparseMatrix {
+private:
+	std::vector<size_t> rowOffsets;
+	std::vector<uint32_t> columns;
+	std::vector<vec<T, C>> values;
+public:
+	size_t rows, cols;
+	CompressedSparseMatrix() :rows(0), cols(0) {
+	}
+	CompressedSparseMatrix(const SparseMatrix<T, C>& M) :rows(0), cols(0) {
+		set(M);
+	}
+	template<class Archive> void serialize(Archive & archive)
+	{
+		archive(CEREAL_NVP(rows), CEREAL_NVP(cols), CEREAL_NVP(rowOffsets), CEREAL_NVP(columns), cereal::make_nvp(MakeString() << "values" << C, values));
+	}
+	void set(const SparseMatrix<T, C>& M) {
+		if (M.cols > (size_t)std::numeric_limits<uint32_t>::max())throw std::runtime_error(MakeString() << "Matrix has too many columns to compress [" << M.rows << "," << M.cols << "]");
+		rows = M.rows;
+		cols = M.cols;
+		rowOffsets.resize(rows + 1);
+		rowOffsets[0] = 0;
+		for (size_t i = 0;i < rows;i++) {
+			rowOffsets[i + 1] = rowOffsets[i] + M[i].size();
+		}
+		columns.resize(rowOffsets[rows]);
+		values.resize(rowOffsets[rows]);
+#pragma omp parallel for
+		for (int i = 0;i < (int)rows;i++) {
+			size_t k = rowOffsets[i];
+			for (const std::pair<size_t, vec<T, C>>& pr : M[i]) {
+				columns[k] = (uint32_t)pr.first;
+				values[k] = pr.second;
+				k++;
+			}
+		}
+	}
+	SparseMatrix<T, C> toSparseMatrix() const {
+		SparseMatrix<T, C> M(rows, cols);
+#pragma omp parallel for
+		for (int i = 0;i < (int)rows;i++) {
+			std::map<size_t, vec<T, C>>& row = M[i];
+			for (size_t k = rowOffsets[i];k < rowOffsets[i + 1];k++) {
+				row.insert(row.end(), std::pair<size_t, vec<T, C>>(columns[k], values[k]));
+			}
+		}
+		return M;
+	}
+	size_t size() const {
+		return values.size();
+	}
+	size_t rowBegin(size_t i) const {
+		return rowOffsets[i];
+	}
+	size_t rowEnd(size_t i) const {
+		return rowOffsets[i + 1];
+	}
+	const uint32_t* columnPtr() const {
+		return columns.data();
+	}
+	const vec<T, C>* valuePtr() const {
+		return values.data();
+	}
+	vec<T, C>* valuePtr() {
+		return values.data();
+	}
+	vec<T, C> get(size_t i, size_t j) const
+	{
+		if (i >= rows || j >= cols)throw std::runtime_error(MakeString() << "Index (" << i << "," << j << ") exceeds matrix bounds [" << rows << "," << cols << "]");
+		auto start = columns.begin() + rowOffsets[i];
+		auto end = columns.begin() + rowOffsets[i + 1];
+		auto pos = std::lower_bound(start, end, (uint32_t)j);
+		if (pos == end || *pos != j) {
+			return vec<T, C>(T(0));
+		}
+		return values[pos - columns.begin()];
+	}
+	vec<T, C> operator()(size_t i, size_t j) const
+	{
+		return get(i, j);
+	}
+	vec<T, C> diagonal(size_t i) const {
+		return get(i, i);
+	}
+	/*
+	 * out[i] = dot(A[i,*],v) in double precision. Accumulate is applied to each row result
+	 * so the Multiply, AddMultiply and SubtractMultiply variants share one kernel.
+	 */
+	template<int D, class F> void multiply(Vector<T, D>& out, const Vector<T, D>& v, const F& accumulate) const {
+		out.resize(rows);
+		const size_t* offsets = rowOffsets.data();
+		const uint32_t* cptr = columns.data();
+		const vec<T, C>* vptr = values.data();
+		const vec<T, D>* in = v.data.data();
+		vec<T, D>* result = out.data.data();
+#pragma omp parallel for schedule(static)
+		for (int i = 0;i < (int)rows;i++) {
+			vec<double, D> sum(0.0);
+			const size_t end = offsets[i + 1];
+			for (size_t k = offsets[i];k < end;k++) {
+				sum += multiplyEntry(vptr[k], in[cptr[k]]);
+			}
+			accumulate(result[i], (size_t)i, vec<T, D>(sum));
+		}
+	}
+private:
+	template<int D> static inline vec<double, D> multiplyEntry(const vec<T, 1>& a, const vec<T, D>& b) {
+		return vec<double, D>(b) * (double)a.x;
+	}
+	template<int D> static inline typename std::enable_if<D == C && D != 1, vec<double, D>>::type multiplyEntry(const vec<T, D>& a, const vec<T, D>& b) {
+		return vec<double, D>(b) * vec<double, D>(a);
+	}
+};
+template<class A, class B, class T, int C> std::basic_ostream<A, B> & operator <<(
+		std::basic_ostream<A, B> & ss, const CompressedSparseMatrix<T, C>& M) {
+	const uint32_t* columns = M.columnPtr();
+	const vec<T, C>* values = M.valuePtr();
+	for (int i = 0; i < (int)M.rows; i++) {
+		ss << "M[" << i << ",*]=";
+		for (size_t k = M.rowBegin(i);k < M.rowEnd(i);k++) {
+			ss << "<" << columns[k] << ":" << values[k] << "> ";
+		}
+		ss << std::endl;
+	}
+	return ss;
+}
+template<class T, int C> void Multiply(Vector<T, C>& out,
+		const CompressedSparseMatrix<T, 1>& A, const Vector<T, C>& v) {
+	A.multiply(out, v, [](vec<T, C>& o, size_t i, const vec<T, C>& val) {o = val;});
+}
+template<class T, int C> void AddMultiply(Vector<T, C>& out,
+		const Vector<T, C>& b, const CompressedSparseMatrix<T, 1>& A,
+		const Vector<T, C>& v) {
+	A.multiply(out, v, [&b](vec<T, C>& o, size_t i, const vec<T, C>& val) {o = b.data[i] + val;});
+}
+template<class T, int C> void SubtractMultiply(Vector<T, C>& out,
+		const Vector<T, C>& b, const CompressedSparseMatrix<T, 1>& A,
+		const Vector<T, C>& v) {
+	A.multiply(out, v, [&b](vec<T, C>& o, size_t i, const vec<T, C>& val) {o = b.data[i] - val;});
+}
+template<class T, int C> Vector<T, C> operator*(const CompressedSparseMatrix<T, C>& A,
+		const Vector<T, C>& v) {
+	Vector<T, C> out(A.rows);
+	A.multiply(out, v, [](vec<T, C>& o, size_t i, const vec<T, C>& val) {o = val;});
+	return out;
+}
+template<class T, int C> void MultiplyVec(Vector<T, C>& out,
+		const CompressedSparseMatrix<T, C>& A, const Vector<T, C>& v) {
+	A.multiply(out, v, [](vec<T, C>& o, size_t i, const vec<T, C>& val) {o = val;});
+}
+template<class T, int C> void AddMultiplyVec(Vector<T, C>& out,
+		const Vector<T, C>& b, const CompressedSparseMatrix<T, C>& A,
+		const Vector<T, C>& v) {
+	A.multiply(out, v, [&b](vec<T, C>& o, size_t i, const vec<T, C>& val) {o = b.data[i] + val;});
+}
+template<class T, int C> void SubtractMultiplyVec(Vector<T, C>& out,
+		const Vector<T, C>& b, const CompressedSparseMatrix<T, C>& A,
+		const Vector<T, C>& v) {
+	A.multiply(out, v, [&b](vec<T, C>& o, size_t i, const vec<T, C>& val) {o = b.data[i] - val;});
+}
 template<class T, int C> void WriteSparseMatrixToFile(const std::string& file, const SparseMatrix<T, C>& matrix) {
 	std::ofstream os(file);
 	cereal::PortableBinaryOutputArchive ar(os);
@@ -619,6 +788,21 @@ typedef SparseMatrix<double, 4> SparseMatrix4d;
 typedef SparseMatrix<double, 3> SparseMatrix3d;
 typedef SparseMatrix<double, 2> SparseMatrix2d;
 typedef SparseMatrix<double, 1> SparseMatrix1d;
+
+typedef CompressedSparseMatrix<int, 4> CompressedSparseMatrix4i;
+typedef CompressedSparseMatrix<int, 3> CompressedSparseMatrix3i;
+typedef CompressedSparseMatrix<int, 2> CompressedSparseMatrix2i;
+typedef CompressedSparseMatrix<int, 1> CompressedSparseMatrix1i;
+
+typedef CompressedSparseMatrix<float, 4> CompressedSparseMatrix4f;
+typedef CompressedSparseMatrix<float, 3> CompressedSparseMatrix3f;
+typedef CompressedSparseMatrix<float, 2> CompressedSparseMatrix2f;
+typedef CompressedSparseMatrix<float, 1> CompressedSparseMatrix1f;
+
+typedef CompressedSparseMatrix<double, 4> CompressedSparseMatrix4d;
+typedef CompressedSparseMatrix<double, 3> CompressedSparseMatrix3d;
+typedef CompressedSparseMatrix<double, 2> CompressedSparseMatrix2d;
+typedef CompressedSparseMatrix<double, 1> CompressedSparseMatrix1d;
 }
 
 #endif
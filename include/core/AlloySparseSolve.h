@@ -26,106 +26,471 @@
 namespace aly {
 bool SANITY_CHECK_ALGO();
 bool SANITY_CHECK_SPARSE_SOLVE();
-template<class T, int C> void SolveVecCG(const Vector<T, C>& b,
-		const SparseMatrix<T, C>& A, Vector<T, C>& x, int iters = 100,
-		T tolerance = 1E-6f,
-		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
-	const double ZERO_TOLERANCE = 1E-16;
-	vec<double, C> err(0.0);
-	size_t N = b.size();
-	Vector<T, C> p(N);
-	Vector<T, C> Ap(N);
-	MultiplyVec(Ap, A, x);
-	Vector<T, C> tmp1(N), tmp2(N);
-	Vector<T, C>* rcurrent = &tmp1;
-	Vector<T, C>* rnext = &tmp2;
-	Subtract(*rcurrent, b, Ap);
-	p = *rcurrent;
-	err = lengthVecSqr(*rcurrent);
-	double e = lengthL1(err) / N;
-	if (iterationMonitor) {
-		if (!iterationMonitor(0, e))return;
+template<class T, int C> inline vec<T, C> ExpandChannels(const vec<T, 1>& v) {
+	return vec<T, C>(v.x);
+}
+template<class T, int C> inline vec<T, C> ExpandChannels(const vec<T, C>& v) {
+	return v;
+}
+/*
+ * Approximate inverse M^-1 applied during preconditioned conjugate gradient. Each channel
+ * of the solution vector is preconditioned independently. Preconditioners hold scratch
+ * buffers, so one instance should not be shared between concurrent solves.
+ */
+template<class T, int C> struct Preconditioner {
+	virtual void solve(Vector<T, C>& z, const Vector<T, C>& r) const=0;
+	virtual ~Preconditioner() {
 	}
-	for (int iter = 0; iter < iters; iter++) {
-		MultiplyVec(Ap, A, p);
-		vec<double, C> denom = dotVec(p, Ap);
-		for (int c = 0; c < C; c++) {
-			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
-				denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
+};
+template<class T, int C> struct JacobiPreconditioner: public Preconditioner<T, C> {
+protected:
+	std::vector<vec<T, C>> invDiagonal;
+public:
+	template<int D> JacobiPreconditioner(const CompressedSparseMatrix<T, D>& A) {
+		invDiagonal.resize(A.rows);
+#pragma omp parallel for
+		for (int i = 0;i < (int)A.rows;i++) {
+			vec<T, C> d = ExpandChannels<T, C>(A.diagonal(i));
+			for (int c = 0;c < C;c++) {
+				invDiagonal[i][c] = (d[c] != T(0)) ? T(1) / d[c] : T(1);
 			}
 		}
-		vec<double, C> alpha = lengthVecSqr(*rcurrent) / denom;
-		ScaleAdd(x, vec<T, C>(alpha), p);
-		ScaleSubtract(*rnext, *rcurrent, vec<T, C>(alpha), Ap);
-		vec<double, C> err = lengthVecSqr(*rnext);
-		double e = lengthL1(err) / N;
-		if (iterationMonitor) {
-			if (!iterationMonitor(iter + 1, e))return;
+	}
+	template<int D> JacobiPreconditioner(const SparseMatrix<T, D>& A) :JacobiPreconditioner(CompressedSparseMatrix<T, D>(A)) {
+	}
+	virtual void solve(Vector<T, C>& z, const Vector<T, C>& r) const override {
+		z.resize(r.size());
+		const vec<T, C>* rptr = r.data.data();
+		vec<T, C>* zptr = z.data.data();
+#pragma omp parallel for
+		for (int i = 0;i < (int)invDiagonal.size();i++) {
+			zptr[i] = invDiagonal[i] * rptr[i];
 		}
-		if (e < tolerance)
-			break;
-		denom = lengthVecSqr(*rcurrent);
-		for (int c = 0; c < C; c++) {
-			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
-				denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
+	}
+};
+/*
+ * Zero fill-in incomplete Cholesky factorization A ~ L*L^T restricted to the lower
+ * triangular sparsity pattern of A. Pivots that break down are replaced by the original
+ * diagonal so the factorization always completes.
+ */
+template<class T, int C> struct IncompleteCholeskyPreconditioner: public Preconditioner<T, C> {
+protected:
+	std::vector<size_t> rowOffsets;
+	std::vector<uint32_t> columns;
+	std::vector<vec<double, C>> values;
+	std::vector<vec<double, C>> invDiagonal;
+public:
+	template<int D> IncompleteCholeskyPreconditioner(const CompressedSparseMatrix<T, D>& A) {
+		size_t N = A.rows;
+		const uint32_t* acols = A.columnPtr();
+		const vec<T, D>* avals = A.valuePtr();
+		std::vector<vec<double, C>> diagonal(N, vec<double, C>(0.0));
+		rowOffsets.resize(N + 1);
+		rowOffsets[0] = 0;
+		for (size_t i = 0;i < N;i++) {
+			size_t count = 0;
+			for (size_t k = A.rowBegin(i);k < A.rowEnd(i);k++) {
+				if (acols[k] < i)count++;
+				if (acols[k] == i)diagonal[i] = vec<double, C>(ExpandChannels<T, C>(avals[k]));
+			}
+			rowOffsets[i + 1] = rowOffsets[i] + count;
+		}
+		columns.resize(rowOffsets[N]);
+		values.resize(rowOffsets[N]);
+		invDiagonal.resize(N);
+		for (size_t i = 0;i < N;i++) {
+			size_t k = rowOffsets[i];
+			for (size_t ak = A.rowBegin(i);ak < A.rowEnd(i);ak++) {
+				if (acols[ak] < i) {
+					columns[k] = acols[ak];
+					values[k] = vec<double, C>(ExpandChannels<T, C>(avals[ak]));
+					k++;
+				}
+			}
+		}
+		std::vector<vec<double, C>> lii(N);
+		for (size_t i = 0;i < N;i++) {
+			const size_t istart = rowOffsets[i], iend = rowOffsets[i + 1];
+			for (size_t ik = istart;ik < iend;ik++) {
+				const uint32_t j = columns[ik];
+				//Sparse dot product of rows i and j over columns less than j.
+				vec<double, C> sum(0.0);
+				size_t a = istart, b = rowOffsets[j];
+				const size_t bend = rowOffsets[j + 1];
+				while (a < ik && b < bend) {
+					if (columns[a] == columns[b]) {
+						sum += values[a] * values[b];
+						a++;
+						b++;
+					} else if (columns[a] < columns[b]) {
+						a++;
+					} else {
+						b++;
+					}
+				}
+				values[ik] = (values[ik] - sum) / lii[j];
+			}
+			vec<double, C> sum(0.0);
+			for (size_t ik = istart;ik < iend;ik++) {
+				sum += values[ik] * values[ik];
+			}
+			for (int c = 0;c < C;c++) {
+				double pivot = diagonal[i][c] - sum[c];
+				if (pivot <= 0.0) {
+					pivot = (diagonal[i][c] > 0.0) ? diagonal[i][c] : 1.0;
+				}
+				lii[i][c] = std::sqrt(pivot);
+				invDiagonal[i][c] = 1.0 / lii[i][c];
 			}
 		}
-		vec<double, C> beta = err / denom;
-		ScaleAdd(p, *rnext, vec<T, C>(beta), p);
-		std::swap(rcurrent, rnext);
 	}
-}
-template<class T, int C> void SolveCG(const Vector<T, C>& b,
-		const SparseMatrix<T, 1>& A, Vector<T, C>& x, int iters = 100,
-		T tolerance = 1E-6f,
-		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	template<int D> IncompleteCholeskyPreconditioner(const SparseMatrix<T, D>& A) :IncompleteCholeskyPreconditioner(CompressedSparseMatrix<T, D>(A)) {
+	}
+	virtual void solve(Vector<T, C>& z, const Vector<T, C>& r) const override {
+		size_t N = invDiagonal.size();
+		z.resize(N);
+		const vec<T, C>* rptr = r.data.data();
+		vec<T, C>* zptr = z.data.data();
+		//Forward substitution L*y=r, y is stored in z.
+		for (size_t i = 0;i < N;i++) {
+			vec<double, C> sum(rptr[i]);
+			for (size_t k = rowOffsets[i];k < rowOffsets[i + 1];k++) {
+				sum -= values[k] * vec<double, C>(zptr[columns[k]]);
+			}
+			zptr[i] = vec<T, C>(sum * invDiagonal[i]);
+		}
+		//Backward substitution L^T*z=y by scattering each solved row.
+		for (size_t i = N;i > 0;i--) {
+			size_t row = i - 1;
+			vec<double, C> zi = vec<double, C>(zptr[row]) * invDiagonal[row];
+			zptr[row] = vec<T, C>(zi);
+			for (size_t k = rowOffsets[row];k < rowOffsets[row + 1];k++) {
+				zptr[columns[k]] = vec<T, C>(vec<double, C>(zptr[columns[k]]) - values[k] * zi);
+			}
+		}
+	}
+};
+/*
+ * Algebraic multigrid V-cycle built from greedy aggregation of strongly connected unknowns.
+ * Coarse operators are Galerkin products P^T*A*P with piecewise constant prolongation, and
+ * every level is smoothed with damped Jacobi so the cycle stays symmetric for use with CG.
+ */
+template<class T, int C> struct MultigridPreconditioner: public Preconditioner<T, C> {
+protected:
+	struct Level {
+		CompressedSparseMatrix<T, C> A;
+		std::vector<vec<T, C>> invDiagonal;
+		std::vector<uint32_t> aggregates;
+		size_t coarseSize = 0;
+		mutable Vector<T, C> x, b, r;
+	};
+	std::vector<Level> levels;
+	int smoothIterations;
+	int coarseIterations;
+	T omega;
+	void buildLevel(Level& level) {
+		size_t N = level.A.rows;
+		level.invDiagonal.resize(N);
+#pragma omp parallel for
+		for (int i = 0;i < (int)N;i++) {
+			vec<T, C> d = level.A.diagonal(i);
+			for (int c = 0;c < C;c++) {
+				level.invDiagonal[i][c] = (d[c] != T(0)) ? T(1) / d[c] : T(1);
+			}
+		}
+		level.x.resize(N);
+		level.b.resize(N);
+		level.r.resize(N);
+	}
+	size_t aggregate(Level& level, double threshold) {
+		const CompressedSparseMatrix<T, C>& A = level.A;
+		const uint32_t* cols = A.columnPtr();
+		const vec<T, C>* vals = A.valuePtr();
+		size_t N = A.rows;
+		const uint32_t UNASSIGNED = std::numeric_limits<uint32_t>::max();
+		std::vector<uint32_t>& agg = level.aggregates;
+		agg.assign(N, UNASSIGNED);
+		std::vector<double> diag(N);
+		for (size_t i = 0;i < N;i++) {
+			diag[i] = std::abs(lengthL1(vec<double, C>(A.diagonal(i))));
+		}
+		auto strong = [&](size_t i, size_t k) {
+			size_t j = cols[k];
+			return (j != i && std::abs(lengthL1(vec<double, C>(vals[k]))) >= threshold * std::sqrt(diag[i] * diag[j]));
+		};
+		uint32_t count = 0;
+		for (size_t i = 0;i < N;i++) {
+			if (agg[i] != UNASSIGNED)continue;
+			bool isolated = true;
+			for (size_t k = A.rowBegin(i);k < A.rowEnd(i);k++) {
+				if (strong(i, k) && agg[cols[k]] != UNASSIGNED) {
+					isolated = false;
+					break;
+				}
+			}
+			if (!isolated)continue;
+			agg[i] = count;
+			for (size_t k = A.rowBegin(i);k < A.rowEnd(i);k++) {
+				if (strong(i, k))agg[cols[k]] = count;
+			}
+			count++;
+		}
+		std::vector<uint32_t> firstPass = agg;
+		for (size_t i = 0;i < N;i++) {
+			if (agg[i] != UNASSIGNED)continue;
+			for (size_t k = A.rowBegin(i);k < A.rowEnd(i);k++) {
+				if (strong(i, k) && firstPass[cols[k]] != UNASSIGNED) {
+					agg[i] = firstPass[cols[k]];
+					break;
+				}
+			}
+		}
+		for (size_t i = 0;i < N;i++) {
+			if (agg[i] != UNASSIGNED)continue;
+			agg[i] = count;
+			for (size_t k = A.rowBegin(i);k < A.rowEnd(i);k++) {
+				if (strong(i, k) && agg[cols[k]] == UNASSIGNED)agg[cols[k]] = count;
+			}
+			count++;
+		}
+		return count;
+	}
+	void smooth(const Level& level, int iterations) const {
+		size_t N = level.A.rows;
+		vec<T, C>* xptr = level.x.data.data();
+		vec<T, C>* rptr = level.r.data.data();
+		for (int iter = 0;iter < iterations;iter++) {
+			SubtractMultiplyVec(level.r, level.b, level.A, level.x);
+#pragma omp parallel for
+			for (int i = 0;i < (int)N;i++) {
+				xptr[i] += omega * level.invDiagonal[i] * rptr[i];
+			}
+		}
+	}
+	void cycle(size_t l) const {
+		const Level& level = levels[l];
+		level.x.setZero();
+		if (l + 1 == levels.size()) {
+			smooth(level, coarseIterations);
+			return;
+		}
+		const Level& coarse = levels[l + 1];
+		smooth(level, smoothIterations);
+		SubtractMultiplyVec(level.r, level.b, level.A, level.x);
+		size_t N = level.A.rows;
+		coarse.b.setZero();
+		vec<T, C>* cb = coarse.b.data.data();
+		const vec<T, C>* rptr = level.r.data.data();
+		for (size_t i = 0;i < N;i++) {
+			cb[level.aggregates[i]] += rptr[i];
+		}
+		cycle(l + 1);
+		vec<T, C>* xptr = level.x.data.data();
+		const vec<T, C>* cx = coarse.x.data.data();
+#pragma omp parallel for
+		for (int i = 0;i < (int)N;i++) {
+			xptr[i] += cx[level.aggregates[i]];
+		}
+		smooth(level, smoothIterations);
+	}
+public:
+	template<int D> MultigridPreconditioner(const CompressedSparseMatrix<T, D>& A, int maxLevels = 10, size_t coarsestSize = 64, int smoothIterations = 2, int coarseIterations = 32, T omega = T(2) / T(3), double strengthThreshold = 0.08) :
+			smoothIterations(smoothIterations), coarseIterations(coarseIterations), omega(omega) {
+		levels.reserve(maxLevels);
+		{
+			SparseMatrix<T, C> M(A.rows, A.cols);
+			const uint32_t* cols = A.columnPtr();
+			const vec<T, D>* vals = A.valuePtr();
+#pragma omp parallel for
+			for (int i = 0;i < (int)A.rows;i++) {
+				std::map<size_t, vec<T, C>>& row = M[i];
+				for (size_t k = A.rowBegin(i);k < A.rowEnd(i);k++) {
+					row.insert(row.end(), std::pair<size_t, vec<T, C>>(cols[k], ExpandChannels<T, C>(vals[k])));
+				}
+			}
+			levels.push_back(Level());
+			levels.back().A.set(M);
+			buildLevel(levels.back());
+		}
+		while ((int)levels.size() < maxLevels && levels.back().A.rows > coarsestSize) {
+			Level& fine = levels.back();
+			size_t N = fine.A.rows;
+			size_t coarseSize = aggregate(fine, strengthThreshold);
+			if (coarseSize == 0 || coarseSize * 10 > N * 9) {
+				fine.aggregates.clear();
+				break;
+			}
+			fine.coarseSize = coarseSize;
+			SparseMatrix<T, C> Ac(coarseSize, coarseSize);
+			const uint32_t* cols = fine.A.columnPtr();
+			const vec<T, C>* vals = fine.A.valuePtr();
+			for (size_t i = 0;i < N;i++) {
+				std::map<size_t, vec<T, C>>& row = Ac[fine.aggregates[i]];
+				for (size_t k = fine.A.rowBegin(i);k < fine.A.rowEnd(i);k++) {
+					row[fine.aggregates[cols[k]]] += vals[k];
+				}
+			}
+			levels.push_back(Level());
+			levels.back().A.set(Ac);
+			buildLevel(levels.back());
+		}
+	}
+	template<int D> MultigridPreconditioner(const SparseMatrix<T, D>& A, int maxLevels = 10, size_t coarsestSize = 64, int smoothIterations = 2, int coarseIterations = 32, T omega = T(2) / T(3), double strengthThreshold = 0.08) :
+			MultigridPreconditioner(CompressedSparseMatrix<T, D>(A), maxLevels, coarsestSize, smoothIterations, coarseIterations, omega, strengthThreshold) {
+	}
+	size_t getLevelCount() const {
+		return levels.size();
+	}
+	virtual void solve(Vector<T, C>& z, const Vector<T, C>& r) const override {
+		const Level& top = levels.front();
+		top.b.data.assign(r.data.begin(), r.data.end());
+		cycle(0);
+		z.resize(r.size());
+		z.data.assign(top.x.data.begin(), top.x.data.end());
+	}
+};
+/*
+ * Scratch vectors for conjugate gradient. Passing the same workspace to repeated solves
+ * of equal size avoids reallocating them on every call.
+ */
+template<class T, int C> struct SolverWorkspace {
+	Vector<T, C> p, Ap, r, z;
+	void resize(size_t N) {
+		p.resize(N);
+		Ap.resize(N);
+		r.resize(N);
+		z.resize(N);
+	}
+};
+/*
+ * Solvers accept either the map-based SparseMatrix or a CompressedSparseMatrix. Convert
+ * to CompressedSparseMatrix once before solving when the system will be iterated many times.
+ */
+namespace detail {
+template<class T, int C, class F> void SolvePCG(const Vector<T, C>& b,
+		const F& multiply, Vector<T, C>& x,
+		const Preconditioner<T, C>* preconditioner,
+		SolverWorkspace<T, C>& workspace, int iters, T tolerance,
+		const std::function<bool(int, double)>& iterationMonitor) {
 	const double ZERO_TOLERANCE = 1E-16;
-	vec<double, C> err(0.0);
 	size_t N = b.size();
-	Vector<T, C> p(N);
-	Vector<T, C> Ap(N);
-	Multiply(Ap, A, x);
-	Vector<T, C> tmp1(N), tmp2(N);
-	Vector<T, C>* rcurrent = &tmp1;
-	Vector<T, C>* rnext = &tmp2;
-	Subtract(*rcurrent, b, Ap);
-	p = *rcurrent;
-	err = lengthVecSqr(*rcurrent);
+	workspace.resize(N);
+	Vector<T, C>& p = workspace.p;
+	Vector<T, C>& Ap = workspace.Ap;
+	Vector<T, C>& r = workspace.r;
+	Vector<T, C>& z = (preconditioner) ? workspace.z : workspace.r;
+	multiply(Ap, x);
+	vec<T, C>* xptr = x.data.data();
+	vec<T, C>* pptr = p.data.data();
+	vec<T, C>* rptr = r.data.data();
+	const vec<T, C>* zptr = z.data.data();
+	const vec<T, C>* Apptr = Ap.data.data();
+	const vec<T, C>* bptr = b.data.data();
+#pragma omp parallel for
+	for (int i = 0; i < (int) N; i++) {
+		rptr[i] = bptr[i] - Apptr[i];
+	}
+	if (preconditioner)
+		preconditioner->solve(z, r);
+	p.data.assign(z.data.begin(), z.data.end());
+	vec<double, C> rz = dotVec(r, z);
+	vec<double, C> err = lengthVecSqr(r);
 	double e = lengthL1(err) / N;
 	if (iterationMonitor) {
 		if (!iterationMonitor(0, e))return;
 	}
 	for (int iter = 0; iter < iters; iter++) {
-		Multiply(Ap, A, p);
+		multiply(Ap, p);
 		vec<double, C> denom = dotVec(p, Ap);
 		for (int c = 0; c < C; c++) {
 			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
 				denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
 			}
 		}
-		vec<double, C> alpha = lengthVecSqr(*rcurrent) / denom;
-		ScaleAdd(x, vec<T, C>(alpha), p);
-		ScaleSubtract(*rnext, *rcurrent, vec<T, C>(alpha), Ap);
-		vec<double, C> err = lengthVecSqr(*rnext);
-		double e = lengthL1(err) / N;
+		vec<T, C> alpha = vec<T, C>(rz / denom);
+#pragma omp parallel for
+		for (int i = 0; i < (int) N; i++) {
+			xptr[i] += alpha * pptr[i];
+			rptr[i] -= alpha * Apptr[i];
+		}
+		err = lengthVecSqr(r);
+		e = lengthL1(err) / N;
 		if (iterationMonitor) {
 			if (!iterationMonitor(iter + 1, e))return;
 		}
 		if (e < tolerance)
 			break;
-		denom = lengthVecSqr(*rcurrent);
+		if (preconditioner)
+			preconditioner->solve(z, r);
+		vec<double, C> rzNext = dotVec(r, z);
 		for (int c = 0; c < C; c++) {
-			if (std::abs(denom[c]) < ZERO_TOLERANCE) {
-				denom[c] = (denom[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
+			if (std::abs(rz[c]) < ZERO_TOLERANCE) {
+				rz[c] = (rz[c] < 0) ? -ZERO_TOLERANCE : ZERO_TOLERANCE;
 			}
 		}
-		vec<double, C> beta = err / denom;
-		ScaleAdd(p, *rnext, vec<T, C>(beta), p);
-		std::swap(rcurrent, rnext);
+		vec<T, C> beta = vec<T, C>(rzNext / rz);
+#pragma omp parallel for
+		for (int i = 0; i < (int) N; i++) {
+			pptr[i] = zptr[i] + beta * pptr[i];
+		}
+		rz = rzNext;
 	}
 }
-template<class T, int C> void SolveVecBICGStab(const Vector<T, C>& b,
-		const SparseMatrix<T, C>& A, Vector<T, C>& x, int iters = 100,
+}
+template<class T, int C, template<class, int> class MatrixType> void SolveVecCG(const Vector<T, C>& b,
+		const MatrixType<T, C>& A, Vector<T, C>& x, SolverWorkspace<T, C>& workspace, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	detail::SolvePCG(b, [&A](Vector<T, C>& out, const Vector<T, C>& in) {MultiplyVec(out, A, in);}, x, (const Preconditioner<T, C>*)nullptr, workspace, iters, tolerance, iterationMonitor);
+}
+template<class T, int C, template<class, int> class MatrixType> void SolveVecCG(const Vector<T, C>& b,
+		const MatrixType<T, C>& A, Vector<T, C>& x, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	SolverWorkspace<T, C> workspace;
+	SolveVecCG(b, A, x, workspace, iters, tolerance, iterationMonitor);
+}
+template<class T, int C, template<class, int> class MatrixType> void SolveCG(const Vector<T, C>& b,
+		const MatrixType<T, 1>& A, Vector<T, C>& x, SolverWorkspace<T, C>& workspace, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	detail::SolvePCG(b, [&A](Vector<T, C>& out, const Vector<T, C>& in) {Multiply(out, A, in);}, x, (const Preconditioner<T, C>*)nullptr, workspace, iters, tolerance, iterationMonitor);
+}
+template<class T, int C, template<class, int> class MatrixType> void SolveCG(const Vector<T, C>& b,
+		const MatrixType<T, 1>& A, Vector<T, C>& x, int iters = 100,
+		T tolerance = 1E-6f,
+		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	SolverWorkspace<T, C> workspace;
+	SolveCG(b, A, x, workspace, iters, tolerance, iterationMonitor);
+}
+template<class T, int C, template<class, int> class MatrixType> void SolveVecPCG(const Vector<T, C>& b,
+		const MatrixType<T, C>& A, Vector<T, C>& x, const Preconditioner<T, C>& preconditioner,
+		SolverWorkspace<T, C>& workspace, int iters = 100, T tolerance = 1E-6f,
+		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	detail::SolvePCG(b, [&A](Vector<T, C>& out, const Vector<T, C>& in) {MultiplyVec(out, A, in);}, x, &preconditioner, workspace, iters, tolerance, iterationMonitor);
+}
+template<class T, int C, template<class, int> class MatrixType> void SolveVecPCG(const Vector<T, C>& b,
+		const MatrixType<T, C>& A, Vector<T, C>& x, const Preconditioner<T, C>& preconditioner,
+		int iters = 100, T tolerance = 1E-6f,
+		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	SolverWorkspace<T, C> workspace;
+	SolveVecPCG(b, A, x, preconditioner, workspace, iters, tolerance, iterationMonitor);
+}
+template<class T, int C, template<class, int> class MatrixType> void SolvePCG(const Vector<T, C>& b,
+		const MatrixType<T, 1>& A, Vector<T, C>& x, const Preconditioner<T, C>& preconditioner,
+		SolverWorkspace<T, C>& workspace, int iters = 100, T tolerance = 1E-6f,
+		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	detail::SolvePCG(b, [&A](Vector<T, C>& out, const Vector<T, C>& in) {Multiply(out, A, in);}, x, &preconditioner, workspace, iters, tolerance, iterationMonitor);
+}
+template<class T, int C, template<class, int> class MatrixType> void SolvePCG(const Vector<T, C>& b,
+		const MatrixType<T, 1>& A, Vector<T, C>& x, const Preconditioner<T, C>& preconditioner,
+		int iters = 100, T tolerance = 1E-6f,
+		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
+	SolverWorkspace<T, C> workspace;
+	SolvePCG(b, A, x, preconditioner, workspace, iters, tolerance, iterationMonitor);
+}
+template<class T, int C, template<class, int> class MatrixType> void SolveVecBICGStab(const Vector<T, C>& b,
+		const MatrixType<T, C>& A, Vector<T, C>& x, int iters = 100,
 		T tolerance = 1E-6f,
 		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
 	const double ZERO_TOLERANCE = 1E-16;
@@ -186,8 +551,8 @@ template<class T, int C> void SolveVecBICGStab(const Vector<T, C>& b,
 
 	}
 }
-template<class T, int C> void SolveBICGStab(const Vector<T, C>& b,
-		const SparseMatrix<T, 1>& A, Vector<T, C>& x, int iters = 100,
+template<class T, int C, template<class, int> class MatrixType> void SolveBICGStab(const Vector<T, C>& b,
+		const MatrixType<T, 1>& A, Vector<T, C>& x, int iters = 100,
 		T tolerance = 1E-6f,
 		const std::function<bool(int, double)>& iterationMonitor = nullptr) {
 	const double ZERO_TOLERANCE = 1E-16;
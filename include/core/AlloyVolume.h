@@ -821,73 +821,102 @@ template<class T, int C, ImageType I> bool ReadImageFromRawFile(const std::strin
 			}
 		}
 	}
-	template<class T, int C, ImageType I> bool ReadImageFromRawFile(
-			const std::string& file, Volume<T, C, I>& img) {
-		std::string xmlFile = GetFileWithoutExtension(file)+".xml";
-		std::string rawFile = GetFileWithoutExtension(file)+".raw";
-		MipavHeader header;
-		img.clear();
-		if(!ReadMipavHeaderFromFile(xmlFile,header))return false;
-		if(header.dimensions==4&&header.extents[3]!=C){
-			throw std::runtime_error(MakeString() << "Channels " <<header.dimensions<<"/"<<C<< " do not match.");
-			return false;
+	/*
+	 Read-only view of a MIPAV raw volume that is backed by a memory mapping of the .raw file.
+	 Opening is O(1) in the volume size, so large CT volumes can be sampled slice by slice
+	 without first being copied into a Volume.
+	 */
+	template<class T, int C, ImageType I> class MappedVolume {
+	protected:
+		std::shared_ptr<ReadableMemMapFile> mapping;
+		const T* planes = nullptr;
+	public:
+		int rows = 0;
+		int cols = 0;
+		int slices = 0;
+		const int channels = C;
+		const ImageType type = I;
+		MappedVolume() {
+		}
+		MappedVolume(const std::string& file) {
+			open(file);
+		}
+		bool open(const std::string& file) {
+			close();
+			std::string xmlFile = GetFileWithoutExtension(file) + ".xml";
+			std::string rawFile = GetFileWithoutExtension(file) + ".raw";
+			MipavHeader header;
+			if (!ReadMipavHeaderFromFile(xmlFile, header))
+				return false;
+			if (header.dimensions == 4 && header.extents[3] != C) {
+				throw std::runtime_error(MakeString() << "Channels " << header.dimensions << "/" << C << " do not match.");
+			}
+			if (header.dimensions == 3 && C != 1) {
+				throw std::runtime_error(MakeString() << "Channels " << header.dimensions << "/" << C << " do not match.");
+			}
+			std::string typeName = GetMipavDataTypeName(I);
+			if (ToLower(header.dataType) != typeName) {
+				throw std::runtime_error(MakeString() << "Type " << header.dataType << "/" << typeName << " do not match.");
+			}
+			int r = header.extents[0];
+			int c = header.extents[1];
+			int s = header.extents[2];
+			size_t bytes = (size_t) r * c * s * C * sizeof(T);
+			std::shared_ptr<ReadableMemMapFile> mmf(new ReadableMemMapFile(rawFile));
+			if (!mmf->isOpen()) {
+				throw std::runtime_error(MakeString() << "Could not open " << rawFile << " for reading.");
+			}
+			if (mmf->getFileSize() < bytes || (bytes > 0 && mmf->data() == nullptr)) {
+				throw std::runtime_error(MakeString() << rawFile << " is too small (" << mmf->getFileSize() << " bytes) for " << r << "x" << c << "x" << s << "x" << C << " volume.");
+			}
+			mapping = mmf;
+			planes = reinterpret_cast<const T*>(mapping->data());
+			rows = r;
+			cols = c;
+			slices = s;
+			return true;
 		}
-		if(header.dimensions==3&&C!=1){
-			throw std::runtime_error(MakeString() << "Channels " <<header.dimensions<<"/"<<C<< " do not match.");
-			return false;
+		void close() {
+			mapping.reset();
+			planes = nullptr;
+			rows = 0;
+			cols = 0;
+			slices = 0;
 		}
-		std::string typeName = "";
-		switch (img.type) {
-		case ImageType::BYTE:
-			typeName = "byte";
-			break;
-		case ImageType::UBYTE:
-			typeName = "unsigned byte";
-			break;
-		case ImageType::SHORT:
-			typeName = "short";
-			break;
-		case ImageType::USHORT:
-			typeName = "unsigned short";
-			break;
-		case ImageType::INT:
-			typeName = "integer";
-			break;
-		case ImageType::UINT:
-			typeName = "unsigned integer";
-			break;
-		case ImageType::FLOAT:
-			typeName = "float";
-			break;
-		case ImageType::DOUBLE:
-			typeName = "double";
-			break;
-		case ImageType::UNKNOWN:
-			typeName = "unknown";
-			break;
-		default:
-			break;
+		bool isOpen() const {
+			return (planes != nullptr);
 		}
-		if(ToLower(header.dataType)!=typeName){
-			throw std::runtime_error(MakeString() << "Type " <<header.dataType<<"/"<<typeName<< " do not match.");
-			return false;
+		size_t size() const {
+			return (size_t) rows * cols * slices;
 		}
-		img.resize(header.extents[0],header.extents[1],header.extents[2]);
-		FILE* f = fopen(rawFile.c_str(), "rb");
-		if (f == NULL) {
-			throw std::runtime_error(MakeString() << "Could not open " <<rawFile<< " for reading.");
-			return false;
+		const T* channelPtr(int c) const {
+			return planes + c * size();
 		}
-		for (int c = 0; c < img.channels; c++) {
-			for (int k = 0; k < img.slices; k++) {
-				for (int j = 0; j < img.cols; j++) {
-					for (int i = 0; i < img.rows; i++) {
-						fread(&img(i,j,k,c), sizeof(T), 1, f);
-					}
-				}
+		const T& operator()(int i, int j, int k, int c) const {
+			return planes[i + (size_t) j * rows + (size_t) k * rows * cols + c * size()];
+		}
+		vec<T, C> operator()(int i, int j, int k) const {
+			vec<T, C> v;
+			size_t offset = i + (size_t) j * rows + (size_t) k * rows * cols;
+			for (int c = 0; c < C; c++) {
+				v[c] = planes[offset + c * size()];
 			}
+			return v;
 		}
-		fclose(f);
+		void copyTo(Volume<T, C, I>& img) const {
+			img.resize(rows, cols, slices);
+			if (size() > 0) {
+				CopyPlanarToInterleaved(planes, img.vecPtr(), size());
+			}
+		}
+	};
+	template<class T, int C, ImageType I> bool ReadImageFromRawFile(
+			const std::string& file, Volume<T, C, I>& img) {
+		MappedVolume<T, C, I> mapped;
+		img.clear();
+		if (!mapped.open(file))
+			return false;
+		mapped.copyTo(img);
 		return true;
 	}
 
@@ -25,17 +25,174 @@
 #include <functional>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <vector>
 namespace aly {
+enum class TaskPriority {
+	High = 0, Normal = 1, Low = 2
+};
+/*
+ Shared cancellation flag. Copies refer to the same flag, so one token can cancel a group of tasks
+ before they start. Running tasks observe it cooperatively through isCanceled().
+ */
+class CancellationToken {
+protected:
+	std::shared_ptr<std::atomic<bool>> flag;
+public:
+	CancellationToken() :
+			flag(std::make_shared<std::atomic<bool>>(false)) {
+	}
+	void cancel() {
+		*flag = true;
+	}
+	bool isCanceled() const {
+		return *flag;
+	}
+};
+class WorkerPool;
+struct PoolTask {
+	friend class WorkerPool;
+protected:
+	std::function<void()> func;
+	std::function<void()> cancelFunc;
+	TaskPriority priority;
+	CancellationToken token;
+	std::atomic<int> dependencies;
+	std::atomic<bool> cancelRequested;
+	std::atomic<bool> upstreamCanceled;
+	std::mutex stateLock;
+	std::condition_variable finishedCondition;
+	std::exception_ptr exception;
+	bool finished = false;
+	bool skipped = false;
+	bool delayed = false;
+	std::chrono::steady_clock::time_point dueTime;
+	std::vector<std::shared_ptr<PoolTask>> dependents;
+public:
+	PoolTask(const std::function<void()>& func,
+			const std::function<void()>& cancelFunc, TaskPriority priority,
+			const CancellationToken& token) :
+			func(func), cancelFunc(cancelFunc), priority(priority), token(
+					token), dependencies(1), cancelRequested(false), upstreamCanceled(
+					false) {
+	}
+	TaskPriority getPriority() const {
+		return priority;
+	}
+	bool isCanceled() const {
+		return cancelRequested || upstreamCanceled || token.isCanceled();
+	}
+	bool isDone();
+};
+typedef std::shared_ptr<PoolTask> TaskHandle;
+/*
+ Fixed-size work-stealing executor shared by WorkerTask, RecurrentTask and TimerTask. Each worker
+ owns one deque per priority lane. Workers pop their own deque LIFO and steal from the others
+ FIFO, always draining higher priority lanes first. Tasks can depend on other tasks, be delayed,
+ or be canceled before they start, in which case their cancel handler runs instead.
+
+ Blumofe, R. D., & Leiserson, C. E. (1999). Scheduling multithreaded computations by work
+ stealing. Journal of the ACM, 46(5), 720-748.
+ */
+class WorkerPool {
+protected:
+	struct WorkerQueue {
+		std::mutex lock;
+		std::deque<TaskHandle> lanes[3];
+	};
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::mutex sleepLock;
+	std::condition_variable sleepCondition;
+	std::atomic<int> queuedCount;
+	std::atomic<uint32_t> nextQueue;
+	bool shutdown = false;
+	std::thread timerThread;
+	std::mutex timerLock;
+	std::condition_variable timerCondition;
+	std::multimap<std::chrono::steady_clock::time_point, TaskHandle> delayedTasks;
+	bool timerShutdown = false;
+	void enqueue(const TaskHandle& task);
+	bool tryRun(int self);
+	void run(const TaskHandle& task);
+	void finish(const TaskHandle& task, bool skipped);
+	void workerLoop(int index);
+	void timerLoop();
+	int currentWorker() const;
+public:
+	WorkerPool(int threadCount = 0);
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	~WorkerPool();
+	int getThreadCount() const {
+		return (int) workers.size();
+	}
+	static TaskHandle MakeTask(const std::function<void()>& func,
+			TaskPriority priority = TaskPriority::Normal,
+			const CancellationToken& token = CancellationToken(),
+			const std::function<void()>& cancelFunc = nullptr);
+	void submit(const TaskHandle& task,
+			const std::vector<TaskHandle>& dependencies =
+					std::vector<TaskHandle>());
+	TaskHandle submit(const std::function<void()>& func,
+			TaskPriority priority = TaskPriority::Normal,
+			const std::vector<TaskHandle>& dependencies =
+					std::vector<TaskHandle>(),
+			const CancellationToken& token = CancellationToken());
+	void submitAfter(const TaskHandle& task, long milliseconds);
+	TaskHandle submitAfter(const std::function<void()>& func,
+			long milliseconds, TaskPriority priority = TaskPriority::Normal,
+			const CancellationToken& token = CancellationToken());
+	template<class F> auto async(F func, TaskPriority priority =
+			TaskPriority::Normal, const std::vector<TaskHandle>& dependencies =
+			std::vector<TaskHandle>(), TaskHandle* handle = nullptr) -> std::future<decltype(func())> {
+		typedef decltype(func()) R;
+		std::shared_ptr<std::packaged_task<R()>> packaged = std::make_shared<
+				std::packaged_task<R()>>(func);
+		std::future<R> result = packaged->get_future();
+		TaskHandle task = submit([packaged]() {(*packaged)();}, priority,
+				dependencies);
+		if (handle != nullptr)
+			*handle = task;
+		return result;
+	}
+	/*
+	 Marks the task canceled. A task that has not started runs its cancel handler instead, and a
+	 delayed task is released immediately rather than at its due time.
+	 */
+	void cancel(const TaskHandle& task);
+	/*
+	 Blocks until the task has finished. Pool workers keep executing other tasks while they wait, so
+	 nested waits do not starve the pool. An exception thrown by the task is rethrown here.
+	 */
+	void wait(const TaskHandle& task);
+	static bool IsCurrentTask(const TaskHandle& task);
+};
+WorkerPool& AlloyDefaultWorkerPool();
 class WorkerTask {
 protected:
-	std::thread workerThread;
 	std::mutex stateChange;
+	std::mutex handleLock;
+	TaskHandle handle;
+	std::thread::id blockingThread;
 	const std::function<void()> executionTask;
 	const std::function<void()> endTask;
+	TaskPriority priority = TaskPriority::Normal;
 	bool running = false;
 	bool complete = false;
 	bool requestCancel = false;
+	bool pending = false;
 	virtual void task();
+	virtual void submit();
+	void canceled();
+	void release();
+	void wait();
 	void done();
 public:
 	bool isRunning() const;
@@ -44,7 +201,12 @@ public:
 		return &requestCancel;
 	}
 	bool isComplete() const;
-
+	void setPriority(TaskPriority p) {
+		priority = p;
+	}
+	TaskPriority getPriority() const {
+		return priority;
+	}
 	WorkerTask(const std::function<void()>& func);
 	WorkerTask(const std::function<void()>& func, const std::function<void()>& end);
 	bool execute(bool block=false);
@@ -56,6 +218,9 @@ protected:
 	const std::function<bool(uint64_t iteration)> recurrentTask;
 	long timeout;
 	void step();
+	void iterate(uint64_t iteration);
+	void stop();
+	virtual void submit() override;
 public:
 	void setTimeout(long milliseconds) {
 		timeout = milliseconds;
@@ -64,12 +229,16 @@ public:
 			long milliseconds);
 	RecurrentTask(const std::function<bool(uint64_t iteration)>& func,
 			const std::function<void()>& end, long milliseconds);
+	virtual ~RecurrentTask();
 };
 class TimerTask: public WorkerTask {
 protected:
 	long timeout;
 	long samplingTime;
 	virtual void task() override;
+	virtual void submit() override;
+	void fire();
+	void expire();
 public:
 	void setTimeout(long milliseconds) {
 		timeout = milliseconds;
@@ -77,6 +246,7 @@ public:
 	TimerTask(const std::function<void()>& successFunc,
 			const std::function<void()>& failureFunc, long milliseconds,
 			long samplingTime);
+	virtual ~TimerTask();
 };
 typedef std::shared_ptr<WorkerTask> WorkerTaskPtr;
 typedef std::shared_ptr<RecurrentTask> RecurrentTaskPtr;
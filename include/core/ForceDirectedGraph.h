@@ -46,9 +46,10 @@ struct ForceItem {
 	RGBAf color;
 	std::array<float2, 4> k;
 	std::array<float2, 4> l;
+	int index;//Slot in the simulator's ForceItemStore, assigned every step.
 	ForceItem(const float2& pt = float2(0.0f)) :
 			mass(1.0f), buoyancy(1.0f), force(0.0f), velocity(0.0f), location(
-					pt), plocation(pt), shape(NodeShape::Hidden) ,color(1.0f,0.2f,0.2f,1.0f){
+					pt), plocation(pt), shape(NodeShape::Hidden) ,color(1.0f,0.2f,0.2f,1.0f),index(-1){
 	}
 	void reset() {
 		force = float2(0.0f);
@@ -80,6 +81,35 @@ struct SpringItem {
 };
 
 typedef std::shared_ptr<SpringItem> SpringItemPtr;
+/*
+ Structure-of-arrays copy of the simulated items. The simulator gathers items into the store at the
+ start of a step and scatters them back at the end, so forces and integrators stream through
+ contiguous arrays instead of chasing shared pointers.
+ */
+struct ForceItemStore {
+	std::vector<float2> location;
+	std::vector<float2> plocation;
+	std::vector<float2> velocity;
+	std::vector<float2> force;
+	std::vector<float> mass;
+	std::vector<float> buoyancy;
+	//Runge-Kutta stage increments for location (k) and velocity (l), valid within a step.
+	std::vector<std::array<float2, 4>> k;
+	std::vector<std::array<float2, 4>> l;
+	size_t size() const {
+		return location.size();
+	}
+	void resize(size_t N) {
+		location.resize(N);
+		plocation.resize(N);
+		velocity.resize(N);
+		force.resize(N);
+		mass.resize(N);
+		buoyancy.resize(N);
+		k.resize(N);
+		l.resize(N);
+	}
+};
 struct ForceParameter {
 	std::string name;
 	float value;
@@ -111,7 +141,7 @@ public:
 	size_t getParameterCount() const {
 		return params.size();
 	}
-	virtual void enforceBoundary(const std::shared_ptr<ForceItem>& forceItem){
+	virtual void enforceBoundary(float2& location){
 
 	}
 	void setEnabled(bool b) {
@@ -161,11 +191,13 @@ public:
 	virtual bool isBoundaryItem() const {
 		return false;
 	}
-	virtual void getForce(const ForceItemPtr& item) {
+	//Adds this force's contribution to store.force[i]. Called concurrently for different items.
+	virtual void getForce(ForceItemStore& store, int i) {
 		throw std::runtime_error("Get force item not implemented.");
 	}
 	;
-	virtual void getSpring(const SpringItemPtr& spring) {
+	//Returns the force on the spring's first item (i1). The second item (i2) receives the negation.
+	virtual float2 getSpring(const ForceItemStore& store, const SpringItem& spring, int i1, int i2) {
 		throw std::runtime_error("Get spring item not implemented.");
 	}
 	virtual void draw(AlloyContext* context, const pixel2& offset, float scale) {
@@ -198,6 +230,10 @@ protected:
 	std::mutex lock;
 	std::vector<ForceItemPtr> items;
 	std::vector<SpringItemPtr> springs;
+	ForceItemStore store;
+	std::vector<int2> springIndexes;
+	std::vector<float2> springForces;
+	int selectedIndex = -1;
 	std::vector<ForcePtr> iforces;
 	std::vector<ForcePtr> sforces;
 	std::vector<ForcePtr> bforces;
@@ -216,6 +252,8 @@ protected:
 	std::chrono::steady_clock::time_point lastTime;
 	bool update(uint64_t iter);
 	float runSimulator(float timestep = DEFAULT_TIME_STEP);
+	void gather();
+	void scatter();
 public:
 	static const float RADIUS;
 	static const float DEFAULT_TIME_STEP;
@@ -223,6 +261,13 @@ public:
 	static const int DEFAULT_TIME_OUT;
 	ForceItem* selected;
 	std::function<void(float)> onStep;
+	ForceItemStore& getStore() {
+		return store;
+	}
+	//Store index of the item being dragged, or -1. Integrators and boundaries leave it alone.
+	int getSelectedIndex() const {
+		return selectedIndex;
+	}
 	void accumulate();
 	void fit();
 	void erase(const SpringItemPtr& item);
@@ -320,7 +365,7 @@ struct SpringForce: public Force {
 	virtual std::string getParameterName(size_t i) const override {
 		return pnames[i];
 	}
-	virtual void getSpring(const SpringItemPtr& s) override;
+	virtual float2 getSpring(const ForceItemStore& store, const SpringItem& s, int i1, int i2) override;
 };
 typedef std::shared_ptr<SpringForce> SpringForcePtr;
 struct DragForce: public Force {
@@ -343,8 +388,8 @@ struct DragForce: public Force {
 	virtual std::string getParameterName(size_t i) const override {
 		return pnames[i];
 	}
-	virtual void getForce(const ForceItemPtr& item) override {
-		item->force -= params[DRAG_COEFF] * item->velocity;
+	virtual void getForce(ForceItemStore& store, int i) override {
+		store.force[i] -= params[DRAG_COEFF] * store.velocity[i];
 	}
 };
 typedef std::shared_ptr<DragForce> DragForcePtr;
@@ -369,13 +414,13 @@ struct BoxForce: public Force {
 	virtual bool isBoundaryItem() const override {
 		return true;
 	}
-	virtual void enforceBoundary(const std::shared_ptr<ForceItem>& forceItem) override;
+	virtual void enforceBoundary(float2& location) override;
 	void setBounds(const box2f& bounds);
 	virtual std::string getParameterName(size_t i) const override {
 		return pnames[i];
 	}
 	virtual void draw(AlloyContext* context, const pixel2& offset, float scale) override;
-	virtual void getForce(const ForceItemPtr& item) override;
+	virtual void getForce(ForceItemStore& store, int i) override;
 };
 typedef std::shared_ptr<BoxForce> BoxForcePtr;
 struct CircularWallForce: public Force {
@@ -404,11 +449,11 @@ struct CircularWallForce: public Force {
 	virtual bool isBoundaryItem() const override {
 		return true;
 	}
-	virtual void enforceBoundary(const std::shared_ptr<ForceItem>& forceItem) override;
+	virtual void enforceBoundary(float2& location) override;
 	virtual std::string getParameterName(size_t i) const override {
 		return pnames[i];
 	}
-	virtual void getForce(const ForceItemPtr& item) override;
+	virtual void getForce(ForceItemStore& store, int i) override;
 	virtual void draw(AlloyContext* context, const pixel2& offset, float scale) override;
 };
 typedef std::shared_ptr<CircularWallForce> CircularWallForcePtr;
@@ -450,7 +495,7 @@ struct GravitationalForce: public Force {
 	virtual std::string getParameterName(size_t i) const override {
 		return pnames[i];
 	}
-	virtual void getForce(const ForceItemPtr& item) override;
+	virtual void getForce(ForceItemStore& store, int i) override;
 };
 typedef std::shared_ptr<GravitationalForce> GravitationalForcePtr;
 
@@ -492,29 +537,33 @@ struct BuoyancyForce: public Force {
 	virtual std::string getParameterName(size_t i) const override {
 		return pnames[i];
 	}
-	virtual void getForce(const ForceItemPtr& item) override;
+	virtual void getForce(ForceItemStore& store, int i) override;
 };
 typedef std::shared_ptr<BuoyancyForce> BuoyancyForcePtr;
 
+/*
+ Node of the flat Barnes-Hut quadtree. Children of a node are stored contiguously, and every node
+ covers a contiguous range of the Morton-sorted items.
+ */
 struct QuadTreeNode {
 	static const int MAX_LEAFS = 8;
 	static const int MAX_DEPTH = 12;
 	float mass;
 	float2 com;
-	bool hasChildren;
 	int depth;
+	int firstChild;
+	int childCount;
+	uint32_t start;
+	uint32_t end;
 	box2f bounds;
-	std::vector<ForceItemPtr> values;
-	std::array<std::shared_ptr<QuadTreeNode>, 4> children;
-	void update();
-	QuadTreeNode(float mass = 0.0f, float2 com = float2(0.0f),int depth=-1) :
-			mass(mass), com(com), hasChildren(false),depth(depth),bounds(box2f()) {
-	}
-	void insert(const ForceItemPtr& item);
-	void draw(AlloyContext* context, const pixel2& offset, float scale);
-	void reset();
+	QuadTreeNode() :
+			mass(0.0f), com(0.0f), depth(0), firstChild(-1), childCount(0), start(
+					0), end(0) {
+	}
+	bool hasChildren() const {
+		return (childCount > 0);
+	}
 };
-typedef std::shared_ptr<QuadTreeNode> QuadTreeNodePtr;
 
 struct NBodyForce: public Force {
 	static const std::string pnames[3];
@@ -530,7 +579,17 @@ struct NBodyForce: public Force {
 	static const int GRAVITATIONAL_CONST = 0;
 	static const int MIN_DISTANCE = 1;
 	static const int BARNES_HUT_THETA = 2;
-	QuadTreeNodePtr root;
+	std::vector<QuadTreeNode> nodes;
+	std::vector<uint2> levels;
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> rank;
+	std::vector<uint32_t> codes;
+	std::vector<uint32_t> scratchCodes;
+	std::vector<uint32_t> scratchOrder;
+	std::vector<uint32_t> blockCounts;
+	std::vector<float2> sortedLocation;
+	std::vector<float> sortedMass;
+	void sortItems(const ForceItemStore& store, const box2f& bounds);
 public:
 	NBodyForce(float gravConstant, float minDistance, float theta){
 		params = {gravConstant, minDistance, theta};
@@ -555,7 +614,7 @@ public:
 	}
 	void clear();
 	virtual void init(ForceSimulator& fsim) override;
-	void getForce(const ForceItemPtr& item) override;
+	virtual void getForce(ForceItemStore& store, int i) override;
 
 };
 typedef std::shared_ptr<NBodyForce> NBodyForcePtr;
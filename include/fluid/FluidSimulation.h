@@ -27,6 +27,7 @@
 #define FLIPFLUIDSOLVER_H_
 #include "segmentation/Simulation.h"
 #include "ParticleLocator.h"
+#include "LaplaceSolver.h"
 #include "SimulationObjects.h"
 #include <AlloyDistanceField.h>
 #include <AlloyMesh.h>
@@ -69,10 +70,11 @@ protected:
 	float wallThickness;
 	std::mutex contourLock;
 	std::unique_ptr<ParticleLocator> particleLocator;
+	LaplaceSolverStatus pressureStatus;
 	std::vector<std::shared_ptr<SimulationObject>> fluidObjects;
 	std::vector<std::shared_ptr<SimulationObject>> wallObjects;
 	std::vector<std::shared_ptr<SimulationObject>> airObjects;
-	std::vector<FluidParticlePtr> particles;
+	FluidParticleStore particles;
 	void copyGridToBuffer();
 	void subtractGrid();
 	void placeObjects();
@@ -100,12 +102,9 @@ protected:
 	void shuffleCoordinates(std::vector<int2> &waters);
 	float linear(Image1f& q, float x, float y, float z);
 	void resampleParticles(float2& p, float2& u, float re);
-	void correctParticles(std::vector<FluidParticlePtr>& particle, float dt,
-			float re);
+	void correctParticles(FluidParticleStore& particles, float dt, float re);
 	bool updateContour();
 	double implicit_func(float2& p, float density);
-	double implicit_func(std::vector<FluidParticle*> &neighbors, float2& p,
-			float density, float voxelSize);
 	void mapParticlesToGrid();
 	void mapGridToParticles();
 
@@ -129,6 +128,10 @@ public:
 	inline const aly::Image1f& getPressure() const {
 		return pessureImage;
 	}
+	//Iterations and residuals of the most recent pressure projection.
+	inline const LaplaceSolverStatus& getPressureSolverStatus() const {
+		return pressureStatus;
+	}
 	inline const aly::Image1ub& getLabels() const {
 		return labelImage;
 	}
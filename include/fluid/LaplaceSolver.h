@@ -23,8 +23,24 @@
  *  Ando, R., Thurey, N., & Tsuruno, R. (2012). Preserving fluid sheets with adaptively sampled anisotropic particles.
  *  Visualization and Computer Graphics, IEEE Transactions on, 18(8), 1202-1214.
  */
+#ifndef _LAPLACE_SOLVER_H
+#define _LAPLACE_SOLVER_H
 #include "fluid/SimulationObjects.h"
 #include <AlloyImage.h>
 namespace aly {
-void SolveLaplace2d(const Image1ub& A,const Image1f& L, Image1f& x,const Image1f& b,float voxelSize);
+struct LaplaceSolverStatus {
+	int iterations = 0;
+	double initialResidual = 0.0;
+	double residual = 0.0;
+	bool converged = false;
+};
+/*
+ Solves the fluid pressure Poisson equation on cells labeled FLUID with MIC(0) preconditioned
+ conjugate gradient. The incoming x is used as the initial guess. Iteration stops when the
+ residual of the h^2 scaled system drops below tolerance*|h^2 b|. A negative maxIterations
+ means one iteration per fluid cell.
+ */
+LaplaceSolverStatus SolveLaplace2d(const Image1ub& A, const Image1f& L, Image1f& x,
+		const Image1f& b, float voxelSize, float tolerance = 1E-5f, int maxIterations = -1);
 }
+#endif
@@ -29,19 +29,64 @@
 #ifndef _PARTICLE_LOCATOR_H
 #define _PARTICLE_LOCATOR_H
 namespace aly {
-typedef std::vector<FluidParticle*> FluidCell;
+/*
+ Uniform grid over particle ids, rebuilt each step with a parallel counting sort. Particles in
+ cell c are getSortedParticles()[getCellStart(c)..getCellStart(c+1)), and because cells are
+ numbered row-major, a run of cells along one row is a single contiguous range.
+ */
 class ParticleLocator {
 protected:
 	int2 mGridSize;
 	float mVoxelSize;
-	std::vector<FluidCell> cells;
+	const FluidParticleStore* particles;
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> sortedParticles;
+	std::vector<uint32_t> particleCells;
+	std::vector<uint32_t> blockCounts;
+	inline void getRowRange(int i0, int i1, int j, uint32_t& start,
+			uint32_t& end) const {
+		start = cellStart[i0 + j * mGridSize.x];
+		end = cellStart[i1 + 1 + j * mGridSize.x];
+	}
 public:
 	ParticleLocator(int2 dims, float voxelSize);
 	~ParticleLocator();
 
-	void update(std::vector<FluidParticlePtr>& particles);
-	FluidCell getNeigboringWallParticles(int i, int j,int w = 1, int h = 1);
-	FluidCell getNeigboringCellParticles(int i, int j,int w = 1, int h = 1);
+	void update(const FluidParticleStore& particles);
+	//Reorders particles into cell order so neighbor gathers touch contiguous memory.
+	void sort(FluidParticleStore& particles);
+	//Visits particles in cells [i-w,i+w-1]x[j-h,j+h-1].
+	template<class F> void forEachNeighboringWallParticle(int i, int j, int w,
+			int h, const F& func) const {
+		int i0 = std::max(i - w, 0);
+		int i1 = std::min(i + w - 1, mGridSize.x - 1);
+		if (i0 > i1)
+			return;
+		for (int sj = std::max(j - h, 0);
+				sj <= std::min(j + h - 1, mGridSize.y - 1); sj++) {
+			uint32_t start, end;
+			getRowRange(i0, i1, sj, start, end);
+			for (uint32_t k = start; k < end; k++) {
+				func(sortedParticles[k]);
+			}
+		}
+	}
+	//Visits particles in cells [i-w,i+w]x[j-h,j+h].
+	template<class F> void forEachNeighboringCellParticle(int i, int j, int w,
+			int h, const F& func) const {
+		int i0 = std::max(i - w, 0);
+		int i1 = std::min(i + w, mGridSize.x - 1);
+		if (i0 > i1)
+			return;
+		for (int sj = std::max(j - h, 0); sj <= std::min(j + h, mGridSize.y - 1);
+				sj++) {
+			uint32_t start, end;
+			getRowRange(i0, i1, sj, start, end);
+			for (uint32_t k = start; k < end; k++) {
+				func(sortedParticles[k]);
+			}
+		}
+	}
 	float getLevelSetValue(int i, int j, Image1f& halfwall,float density);
 	const int2& getGridSize() {
 		return mGridSize;
@@ -49,15 +94,21 @@ public:
 	float getVoxelSize() {
 		return mVoxelSize;
 	}
+	inline int getCellIndex(const float2& pt) const {
+		float scale = 1.0f / mVoxelSize;
+		int i = clamp((int) (scale * pt.x), 0, mGridSize.x - 1);
+		int j = clamp((int) (scale * pt.y), 0, mGridSize.y - 1);
+		return i + j * mGridSize.x;
+	}
+	inline uint32_t getCellStart(int cell) const {
+		return cellStart[cell];
+	}
+	inline const std::vector<uint32_t>& getSortedParticles() const {
+		return sortedParticles;
+	}
 	size_t getParticleCount(int i, int j) const ;
 	void markAsWater(Image1ub& A, Image1f& halfwall,float density);
 	void deleteAllParticles();
-	inline FluidCell& getCell(int i,int j){
-		return cells[clamp(i,0,mGridSize.x-1)+clamp(j,0,mGridSize.y-1)*mGridSize.x];
-	}
-	inline const FluidCell& getCell(int i,int j) const {
-		return cells[clamp(i,0,mGridSize.x-1)+clamp(j,0,mGridSize.y-1)*mGridSize.x];
-	}
 };
 }
 #endif
@@ -28,6 +28,7 @@
 #define INCLUDE_FLUID_SIMULATIONOBJECTS_H_
 #include <AlloyMath.h>
 #include <AlloyImage.h>
+#include <vector>
 namespace aly {
 enum class ObjectType {
 	AIR = 0, FLUID = 1, WALL = 2
@@ -101,18 +102,33 @@ public:
 	virtual bool inside(float2& pt);
 	virtual bool insideShell(float2& pt);
 };
-struct FluidParticle {
-	float2 mLocation;
-	float2 mVelocity;
-	float2 mNormal;
-	ObjectType mObjectType;
-	//char mVisible;
-	bool mRemoveIndicator;
-	float2 mTmp[2];
-	float mMass;
-	float mDensity;
+/*
+ Structure-of-arrays particle container. Each attribute lives in its own contiguous array
+ indexed by particle id, so kernels that only touch positions or velocities stream through
+ memory instead of chasing one heap allocation per particle.
+ */
+struct FluidParticleStore {
+	std::vector<float2> location;
+	std::vector<float2> velocity;
+	std::vector<float2> normal;
+	std::vector<ObjectType> type;
+	std::vector<float> mass;
+	std::vector<float> density;
+	inline size_t size() const {
+		return location.size();
+	}
+	inline bool empty() const {
+		return location.empty();
+	}
+	void clear();
+	void reserve(size_t n);
+	void push_back(const float2& pt, const float2& vel, const float2& norm,
+			ObjectType t, float m, float d);
+	//Removes every particle n with remove[n]!=0, preserving the order of the rest.
+	void erase(const std::vector<char>& remove);
+	//Reorders particles so that new particle n is old particle order[n].
+	void permute(const std::vector<uint32_t>& order);
 };
 typedef std::shared_ptr<SimulationObject> SimulationObjectPtr;
-typedef std::shared_ptr<FluidParticle> FluidParticlePtr;
 }
 #endif /* INCLUDE_FLUID_SIMULATIONOBJECTS_H_ */
@@ -76,6 +76,14 @@ public:
 		nodes.clear();
 		indexes.clear();
 	}
+	inline void swap(EndlessGrid<T>& grid) {
+		levels.swap(grid.levels);
+		gridSizes.swap(grid.gridSizes);
+		cellSizes.swap(grid.cellSizes);
+		nodes.swap(grid.nodes);
+		indexes.swap(grid.indexes);
+		std::swap(backgroundValue, grid.backgroundValue);
+	}
 	void reset(const std::initializer_list<int>& l, T bgValue) {
 		indexes.clear();
 		nodes.clear();
@@ -279,7 +287,7 @@ public:
 			jjj = jjj % cdim;
 			kkk = kkk % cdim;
 			auto child = node->getChild(pos.x, pos.y, pos.z);
-			if (child.get() != nullptr) {
+			if (child != nullptr) {
 				node = child;
 			} else {
 				if (!node->hasData())
@@ -411,7 +419,7 @@ public:
 			jjj = jjj % cdim;
 			kkk = kkk % cdim;
 			auto child = node->getChild(pos.x, pos.y, pos.z);
-			if (child.get() != nullptr) {
+			if (child != nullptr) {
 				node = child;
 			} else {
 				if (node->hasData()) {
@@ -7,7 +7,6 @@
 #include "Particle.h"
 #include <map>
 #include <memory>
-#include <list>
 namespace aly {
 	namespace softbody {
 		class Body;
@@ -37,11 +36,19 @@ namespace aly {
 			float kRegionDamping;
 
 			// Elements
-			std::list<std::shared_ptr<Particle>> particles;
-			std::list<std::shared_ptr<Region>> regions;
+			std::vector<std::shared_ptr<Particle>> particles;
+			std::vector<std::shared_ptr<Region>> regions;
 			// Intermediate summations
 			std::vector<std::shared_ptr<Summation>> sums[2];	// sums[0] = bars; sums[1] = plates
 
+			// Flattened summation hierarchy: level 0 = particles, 1 = bars, 2 = plates, 3 = regions.
+			// Each level stores its SumData contiguously and addresses the neighboring levels with
+			// compressed (CSR) index lists, so every level can be summed in parallel.
+			static const int SUM_LEVELS = 4;
+			std::vector<SumData> levelSums[SUM_LEVELS];
+			std::vector<int> childStart[SUM_LEVELS], childIndex[SUM_LEVELS];		// Children of level l are in level l-1
+			std::vector<int> parentStart[SUM_LEVELS], parentIndex[SUM_LEVELS];	// Parents of level l are in level l+1
+
 												// Misc.
 			std::vector<std::shared_ptr<Cell>> cells;	// Useful for rendering - these are cubes centered at each particle with corners that deform appropriately
 			bool invariantsDirty;		// Whether the invariants need to be recalculated -- simply set this to true after changing an invariant (e.g. particle mass) and the appropriate values will be recomputed automatically next time step
@@ -68,6 +75,7 @@ namespace aly {
 			void calculateInvariants();
 			void initializeCells();
 			void rebuildRegions(std::vector<LatticeLocation*> &regen);		// Used in fracturing
+			void flatten();				// Rebuilds the flattened summation hierarchy after generation or fracturing
 			LatticeLocation* getLatticeLocation(int3 index);
 		};
 		template <class T> void Remove(std::vector<T> &vec, const T t)
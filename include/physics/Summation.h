@@ -19,15 +19,11 @@ namespace aly{
 			std::vector<Particle*> particles;
 			std::vector<Summation*> children;
 			std::vector<Summation*> parents;
-			std::vector<Summation*>* connections[2];		// Pointers to above (children, parents)
 			int minDim, maxDim;			// The range along the split dimension
-			SumData sumData;
+			int index;					// Position in the body's flattened level (see Body::flatten)
 			Summation();
 			void FindParticleRange(int dimension, int *minDim, int *maxDim);
 			std::vector<std::shared_ptr<Summation>> GenerateChildSums(int childLevel);		// Returns the child summations that were generated
-			void SumFromChildren();
-			void SumFromParents();
-			void PerformSummation(int direction);		// Generalization
 			virtual ~Summation() {}
 		};
 		Summation *FindIdenticalSummation(std::vector<Particle*> &particles, int myLevel);		// myLevel is 0 for XSums, 1 for XYSums
@@ -47,10 +47,19 @@ protected:
 
 	const float MAX_DISTANCE = 3.5f;
 	const int maxLayers = 3;
+	const int SPARSE_ROOT_SIZE = 16;
+	const int SPARSE_TILE_SIZE = 8;
 	bool requestUpdateSurface;
+	bool sparse;
+	int3 dimensions;
 	Volume1f initialLevelSet;
 	Volume1f levelSet;
 	Volume1f swapLevelSet;
+	EndlessGridFloat sparseLevelSet;
+	EndlessGridFloat sparseSwapLevelSet;
+	EndlessGridFloat sparseInitialLevelSet;
+	EndlessGridFloat sparsePressure;
+	EndlessGridFloat3 sparseVecField;
 	Volume1f pressureImage;
 	Volume3f vecFieldImage;
 	std::vector<float> deltaLevelSet;
@@ -65,6 +74,20 @@ protected:
 	void applyForces(int i, int j, int k, size_t index, float timeStep);
 	void plugLevelSet(int i, int j, int k, size_t index);
 	void updateDistanceField(int i, int j, int k, int band);
+	float getLevelSetValue(int i, int j, int k) const;
+	float getSwapLevelSetValue(int i, int j, int k) const;
+	void setLevelSetValue(int i, int j, int k, float val);
+	void setSwapLevelSetValue(int i, int j, int k, float val);
+	float getPressureValue(int i, int j, int k) const;
+	float3 getVectorFieldValue(int i, int j, int k) const;
+	bool hasPressure() const;
+	bool hasVectorField() const;
+	EndlessNodeFloat* allocateTile(EndlessGridFloat& grid, int i, int j, int k);
+	void addSparseTile(int i, int j, int k, float val);
+	void initSparseLevelSet();
+	void initSparseForces();
+	void rebuildSparseNarrowBand();
+	void pruneSparseTiles();
 	int deleteElements();
 	int addElements();
 	virtual float evolve(float maxStep);
@@ -112,9 +135,26 @@ public:
 	void setAdvection(float c) {
 		advectionParam.setValue(c);
 	}
+	/*
+	 Store the level set in EndlessGrid tiles that only cover the narrow band, so memory
+	 scales with surface area instead of volume. Must be set before init(). In sparse mode
+	 getLevelSet() is empty; use getSparseLevelSet() instead, where voxels outside the stored
+	 tiles read as the background value. init() releases the dense initial distance field and
+	 moves the pressure and vector fields into tiles, storing uniform tiles as a single value,
+	 so getPressureImage() is empty afterwards. Call setInitialDistanceField() again before
+	 switching back to dense mode.
+	 */
+	void setSparse(bool b) {
+		sparse = b;
+	}
+	bool isSparse() const {
+		return sparse;
+	}
 	Manifold3D* getSurface();
 	Volume1f& getLevelSet();
 	const Volume1f& getLevelSet() const;
+	EndlessGridFloat& getSparseLevelSet();
+	const EndlessGridFloat& getSparseLevelSet() const;
 	virtual bool init() override;
 	virtual void cleanup() override;
 	std::shared_ptr<ManifoldCache3D> getCache() const {
@@ -125,6 +165,7 @@ public:
 		initialLevelSet = img;
 	}
 };
+bool SANITY_CHECK_ACTIVE_CONTOUR_3D();
 }
 
 #endif /* INCLUDE_ACTIVEManifold2D_H_ */
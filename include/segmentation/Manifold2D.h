@@ -91,6 +91,8 @@ namespace aly {
 		void operator=(const Manifold2D &c);
 		Manifold2D(const Manifold2D& c);
 	};
+	void ReadContourFromStream(std::istream& is, const std::string& ext, Manifold2D& contour);
+	void WriteContourToStream(std::ostream& os, const std::string& ext, Manifold2D& contour);
 	void ReadContourFromFile(const std::string& file, Manifold2D& contour);
 	void WriteContourToFile(const std::string& file, Manifold2D& contour);
 
@@ -78,6 +78,8 @@ namespace aly {
 		void operator=(const Manifold3D &c);
 		Manifold3D(const Manifold3D& c);
 	};
+	void ReadContourFromStream(std::istream& is, const std::string& ext, Manifold3D& contour);
+	void WriteContourToStream(std::ostream& os, const std::string& ext, Manifold3D& contour);
 	void ReadContourFromFile(const std::string& file, Manifold3D& contour);
 	void WriteContourToFile(const std::string& file, Manifold3D& contour);
 
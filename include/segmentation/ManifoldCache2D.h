@@ -22,31 +22,55 @@
 #ifndef INCLUDE_MANIFOLDCACHE2D_H_
 #define INCLUDE_MANIFOLDCACHE2D_H_
 #include "Manifold2D.h"
+#include "AlloyWorker.h"
 #include <mutex>
 #include <map>
 #include <set>
+#include <list>
 namespace aly {
+	/*
+	 A cached frame lives in one of three tiers: loaded, compressed in memory, or on disk. Unloading
+	 serializes the contour on the calling thread and hands the file write and compression to the
+	 worker pool. Prefetched frames are decoded in the background and promoted on the next load.
+	 */
 	class CacheElement2D {
 	protected:
 		bool loaded;
 		bool writeOnce;
+		bool keepCompressed;
+		bool prefetchRequested;
+		uint64_t version;
 		std::string contourFile;
 		std::shared_ptr<Manifold2D> contour;
-
+		std::shared_ptr<Manifold2D> staged;
+		std::shared_ptr<std::string> pending;
+		std::vector<char> compressed;
+		TaskHandle writeTask;
+		TaskHandle prefetchTask;
 		std::mutex accessLock;
+		void read(const std::shared_ptr<std::string>& data,const std::vector<char>& packed,Manifold2D& out) const;
+		void prefetch();
 	public:
 		bool isLoaded() {
 			std::lock_guard<std::mutex> lockMe(accessLock);
 			return loaded;
 		}
-		CacheElement2D():loaded(false), writeOnce(true){
+		bool isCompressed() {
+			std::lock_guard<std::mutex> lockMe(accessLock);
+			return (compressed.size() > 0 || (keepCompressed && pending.get() != nullptr));
+		}
+		CacheElement2D():loaded(false), writeOnce(true),keepCompressed(false),prefetchRequested(false),version(0){
 		}
 		~CacheElement2D();
 		std::string getFile() const {
 			return contourFile;
 		}
 		void load();
-		void unload();
+		void unload(bool compress = false);
+		void releaseCompressed();
+		void requestPrefetch();
+		void cancelPrefetch();
+		void flush();
 		void set(const Manifold2D& springl);
 		std::shared_ptr<Manifold2D> getContour();
 	};
@@ -55,21 +79,37 @@ namespace aly {
 			return lhs.first < rhs.first;
 		}
 	};
+	typedef std::pair<int, std::shared_ptr<CacheElement2D>> CacheVictim2D;
 	class ManifoldCache2D {
 	protected:
 		std::map<int, std::shared_ptr<CacheElement2D>> cache;
 		std::set<std::pair<uint64_t, int>, CacheCompare2D> loadedList;
+		std::list<int> compressedList;
+		std::set<int> prefetchList;
 		std::mutex accessLock;
 		int maxElements;
+		int maxCompressedElements;
+		int prefetchRadius;
 		uint64_t counter;
+		void evict(std::vector<CacheVictim2D>& victims);
+		void release(const std::vector<CacheVictim2D>& victims);
 	public:
-		ManifoldCache2D(int elem=32):maxElements(elem),counter(0){
+		ManifoldCache2D(int elem=32):maxElements(elem),maxCompressedElements(0),prefetchRadius(2),counter(0){
 
 		}
-
+		//Number of neighboring frames on each side decoded in the background after get(). Zero disables prefetching.
+		void setPrefetchRadius(int r) {
+			prefetchRadius = r;
+		}
+		//Number of unloaded frames kept deflated in memory before falling back to disk. Zero disables the tier.
+		void setCompressedCapacity(int elem) {
+			maxCompressedElements = elem;
+		}
 		std::shared_ptr<CacheElement2D> set(int frame, const Manifold2D& springl);
 		std::shared_ptr<CacheElement2D> get(int frame);
 		int unload();
+		//Blocks until all pending write-backs have reached disk.
+		void flush();
 		void clear();
 	};
 
@@ -41,7 +41,7 @@ namespace aly {
 		static float SPRING_CONSTANT;
 		static float SHARPNESS;
 	protected:
-		std::shared_ptr<Matcher2f> matcher;
+		GridLocator2f locator;
 		aly::Vector2f oldCorrespondences;
 		std::array<Vector2f, 4> oldVelocities;
 		aly::Vector2f oldPoints;
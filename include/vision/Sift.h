@@ -234,7 +234,7 @@ protected:
 	void create(void);
 	void add(const aly::Image1f& image, float has_sigma, float target_sigma);
 	void extremaDetection(void);
-	std::size_t extremaDetection(const aly::Image1f* s[3], int oi, int si);
+	std::size_t extremaDetection(const aly::Image1f* const s[3], int oi, int si, int y0, int y1, Keypoints& result) const;
 	void keypointLocalization(void);
 
 	void descriptorGeneration(void);
@@ -254,6 +254,88 @@ private:
 	SiftDescriptors descriptors; // Final SIFT descriptors
 };
 
+/**
+ * Putative correspondence between descriptor 'query' of one set and
+ * descriptor 'train' of another, with their Euclidean descriptor distance.
+ */
+struct SiftMatch {
+	int query;
+	int train;
+	float distance;
+	template<class Archive> void serialize(Archive & archive) {
+		archive(CEREAL_NVP(query), CEREAL_NVP(train), CEREAL_NVP(distance));
+	}
+	SiftMatch(int query = -1, int train = -1, float distance = 0.0f) :
+			query(query), train(train), distance(distance) {
+	}
+};
+
+/**
+ * Descriptor matching options.
+ */
+struct SiftMatchOptions {
+	/**
+	 * Lowe's ratio test. The nearest neighbor is accepted only if its
+	 * distance is below ratio times the distance to the second nearest.
+	 * Defaults to 0.8.
+	 */
+	float ratio;
+
+	/**
+	 * Approximation factor of the kd-tree search. Returned neighbors are
+	 * within (1+epsilon) of the true nearest distance. Defaults to 0,
+	 * which is an exact search.
+	 */
+	float epsilon;
+
+	/**
+	 * Keeps only matches that are also the best match in the reverse
+	 * direction. Defaults to false.
+	 */
+	bool crossCheck;
+
+	/**
+	 * Maximum number of descriptors per kd-tree leaf. Defaults to 16.
+	 */
+	int leafSize;
+
+	SiftMatchOptions(void) :
+			ratio(0.8f), epsilon(0.0f), crossCheck(false), leafSize(16) {
+	}
+};
+
+/**
+ * kd-tree index over a set of SIFT descriptors. The index is immutable
+ * once built, so one matcher can be queried from several threads.
+ */
+class SiftMatcher {
+protected:
+	struct Index;
+	std::shared_ptr<Index> index;
+	SiftMatchOptions options;
+public:
+	SiftMatcher(const SiftDescriptors& train, const SiftMatchOptions& options = SiftMatchOptions());
+	size_t size() const;
+	/**
+	 * Finds up to k nearest train descriptors of a single query descriptor.
+	 * Returns the number of neighbors found, sorted by increasing squared distance.
+	 */
+	int nearest(const SiftDescriptor& query, int* indexes, float* distancesSq, int k = 2) const;
+	/**
+	 * Ratio-test matching of every query descriptor against the train set.
+	 * Matches are ordered by query index.
+	 */
+	void match(const SiftDescriptors& query, std::vector<SiftMatch>& matches) const;
+};
+void MatchSiftDescriptors(const SiftDescriptors& query, const SiftDescriptors& train,
+		std::vector<SiftMatch>& matches, const SiftMatchOptions& options = SiftMatchOptions());
+/**
+ * Matches many pairs of descriptor sets, where pairs[i]=(query set, train set).
+ * Every set is indexed at most once and the pairs are matched in parallel.
+ */
+void MatchSiftDescriptors(const std::vector<SiftDescriptors>& sets, const std::vector<int2>& pairs,
+		std::vector<std::vector<SiftMatch>>& matches, const SiftMatchOptions& options = SiftMatchOptions());
+
 }
 
 #endif /* SFM_SIFT_HEADER */
@@ -0,0 +1,238 @@
+/*
+ * Copyright(C) 2015, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "AlloyComputeGraph.h"
+#include "AlloyWorker.h"
+#include <map>
+#include <set>
+namespace aly {
+void ComputeNode::setInput(size_t i, const std::shared_ptr<Packet>& packet) {
+	if (i >= inputs.size()) {
+		throw std::runtime_error(MakeString() << "Node " << name << " input index out of bounds " << i << " " << inputs.size());
+	}
+	inputs[i] = packet;
+	dirty = true;
+}
+void ComputeNode::setOutput(size_t i, const std::shared_ptr<Packet>& packet) {
+	if (i >= outputs.size()) {
+		throw std::runtime_error(MakeString() << "Node " << name << " output index out of bounds " << i << " " << outputs.size());
+	}
+	outputs[i] = packet;
+	dirty = true;
+}
+ComputeNodePtr ComputeGraph::add(const ComputeNodePtr& node) {
+	nodes.push_back(node);
+	orderValid = false;
+	return node;
+}
+bool ComputeGraph::remove(const ComputeNodePtr& node) {
+	auto iter = std::find(nodes.begin(), nodes.end(), node);
+	if (iter == nodes.end()) {
+		return false;
+	}
+	nodes.erase(iter);
+	for (ComputeNodePtr& other : nodes) {
+		for (size_t i = 0; i < other->sources.size(); i++) {
+			if (other->sources[i].node == node.get()) {
+				other->sources[i] = ComputeNode::Source();
+				other->inputs[i].reset();
+				other->dirty = true;
+			}
+		}
+	}
+	orderValid = false;
+	return true;
+}
+void ComputeGraph::connect(const ComputeNodePtr& source, int output, const ComputeNodePtr& destination, int input) {
+	if (output < 0 || output >= (int) source->outputs.size()) {
+		throw std::runtime_error(MakeString() << "Node " << source->name << " output index out of bounds " << output << " " << source->outputs.size());
+	}
+	if (input < 0 || input >= (int) destination->inputs.size()) {
+		throw std::runtime_error(MakeString() << "Node " << destination->name << " input index out of bounds " << input << " " << destination->inputs.size());
+	}
+	destination->sources[input].node = source.get();
+	destination->sources[input].output = output;
+	destination->dirty = true;
+	orderValid = false;
+}
+void ComputeGraph::disconnect(const ComputeNodePtr& destination, int input) {
+	if (input < 0 || input >= (int) destination->inputs.size()) {
+		throw std::runtime_error(MakeString() << "Node " << destination->name << " input index out of bounds " << input << " " << destination->inputs.size());
+	}
+	destination->sources[input] = ComputeNode::Source();
+	destination->inputs[input].reset();
+	destination->dirty = true;
+	orderValid = false;
+}
+ComputeNodePtr ComputeGraph::getNode(const std::string& name) const {
+	for (const ComputeNodePtr& node : nodes) {
+		if (node->name == name) {
+			return node;
+		}
+	}
+	return ComputeNodePtr();
+}
+void ComputeGraph::markDirty() {
+	for (ComputeNodePtr& node : nodes) {
+		node->dirty = true;
+	}
+}
+/*
+ Kahn's algorithm. Nodes are emitted in insertion order among those that are ready, so the
+ serial evaluation order is deterministic.
+ */
+void ComputeGraph::sort() {
+	std::map<ComputeNode*, int> indexes;
+	for (int i = 0; i < (int) nodes.size(); i++) {
+		indexes[nodes[i].get()] = i;
+	}
+	std::vector<int> inDegree(nodes.size(), 0);
+	std::vector<std::vector<int>> downstream(nodes.size());
+	for (int i = 0; i < (int) nodes.size(); i++) {
+		std::set<int> upstream;
+		for (const ComputeNode::Source& src : nodes[i]->sources) {
+			if (src.node == nullptr)
+				continue;
+			auto iter = indexes.find(src.node);
+			if (iter == indexes.end()) {
+				throw std::runtime_error(MakeString() << "Node " << nodes[i]->name << " is connected to a node outside the graph.");
+			}
+			upstream.insert(iter->second);
+		}
+		for (int u : upstream) {
+			downstream[u].push_back(i);
+			inDegree[i]++;
+		}
+	}
+	std::set<int> ready;
+	for (int i = 0; i < (int) nodes.size(); i++) {
+		if (inDegree[i] == 0)
+			ready.insert(i);
+	}
+	order.clear();
+	while (ready.size() > 0) {
+		int i = *ready.begin();
+		ready.erase(ready.begin());
+		order.push_back(nodes[i].get());
+		for (int d : downstream[i]) {
+			if (--inDegree[d] == 0) {
+				ready.insert(d);
+			}
+		}
+	}
+	if (order.size() != nodes.size()) {
+		order.clear();
+		throw std::runtime_error("Compute graph contains a cycle.");
+	}
+	orderValid = true;
+}
+const std::vector<ComputeNode*>& ComputeGraph::getTopologicalOrder() {
+	if (!orderValid) {
+		sort();
+	}
+	return order;
+}
+int ComputeGraph::evaluate(bool parallel) {
+	const std::vector<ComputeNode*>& sorted = getTopologicalOrder();
+	//Dirtiness propagates downstream. Upstream nodes appear first in topological order.
+	std::set<ComputeNode*> stale;
+	std::vector<ComputeNode*> schedule;
+	for (ComputeNode* node : sorted) {
+		bool update = node->dirty;
+		for (const ComputeNode::Source& src : node->sources) {
+			if (src.node != nullptr && stale.find(src.node) != stale.end()) {
+				update = true;
+				break;
+			}
+		}
+		if (update) {
+			stale.insert(node);
+			schedule.push_back(node);
+		}
+	}
+	std::mutex errorLock;
+	std::string errorMessage;
+	std::set<ComputeNode*> failed;
+	int evaluated = 0;
+	auto evaluateNode = [&](ComputeNode* node) {
+		{
+			std::lock_guard<std::mutex> lockMe(errorLock);
+			for (const ComputeNode::Source& src : node->sources) {
+				if (src.node != nullptr && failed.find(src.node) != failed.end()) {
+					failed.insert(node);
+					node->dirty = true;
+					return;
+				}
+			}
+		}
+		for (size_t i = 0; i < node->sources.size(); i++) {
+			const ComputeNode::Source& src = node->sources[i];
+			if (src.node != nullptr) {
+				node->inputs[i] = src.node->outputs[src.output];
+			}
+		}
+		try {
+			if (node->evaluateFunc) {
+				node->evaluateFunc(*node);
+			}
+			node->dirty = false;
+			std::lock_guard<std::mutex> lockMe(errorLock);
+			evaluated++;
+		} catch (std::exception& e) {
+			std::lock_guard<std::mutex> lockMe(errorLock);
+			//A node scheduled only because of a stale source is clean, so it must be marked to run again.
+			node->dirty = true;
+			failed.insert(node);
+			if (errorMessage.size() == 0) {
+				errorMessage = MakeString() << "Node " << node->name << " failed: " << e.what();
+			}
+		}
+	};
+	if (parallel && schedule.size() > 1) {
+		WorkerPool& pool = AlloyDefaultWorkerPool();
+		std::map<ComputeNode*, TaskHandle> handles;
+		for (ComputeNode* node : schedule) {
+			std::vector<TaskHandle> dependencies;
+			for (const ComputeNode::Source& src : node->sources) {
+				auto iter = handles.find(src.node);
+				if (iter != handles.end()) {
+					dependencies.push_back(iter->second);
+				}
+			}
+			handles[node] = pool.submit([node, &evaluateNode]() {
+				evaluateNode(node);
+			}, TaskPriority::Normal, dependencies);
+		}
+		for (auto& item : handles) {
+			pool.wait(item.second);
+		}
+	} else {
+		for (ComputeNode* node : schedule) {
+			evaluateNode(node);
+		}
+	}
+	if (errorMessage.size() > 0) {
+		throw std::runtime_error(errorMessage);
+	}
+	return evaluated;
+}
+}
@@ -22,6 +22,7 @@
 #include "AlloyApplication.h"
 #include "AlloyDrawUtil.h"
 #include "ForceDirectedGraph.h"
+#include <map>
 namespace aly {
 	namespace dataflow {
 		const int MultiPort::FrontIndex = std::numeric_limits<int>::min();
@@ -1835,6 +1836,70 @@ namespace aly {
 		const std::vector<std::shared_ptr<Node>>& DataFlow::getNodes() const {
 			return data->nodes;
 		}
+		//Group output ports forward to the port they proxy inside the group.
+		static Port* ResolveSourcePort(Port* port) {
+			while (port->getNode() != nullptr && port->getNode()->getType() == NodeType::Group && port->hasProxyOut()) {
+				port = port->getProxyOut().get();
+			}
+			return port;
+		}
+		//Ports inside a group receive external connections through the group port that proxies them.
+		static void CollectSourcePorts(Port* port, std::vector<Port*>& sources) {
+			for (const ConnectionPtr& connection : port->getConnections()) {
+				if (connection->destination.get() == port) {
+					sources.push_back(ResolveSourcePort(connection->source.get()));
+				}
+			}
+			if (port->hasProxyIn()) {
+				CollectSourcePorts(port->getProxyIn().get(), sources);
+			}
+		}
+		void DataFlow::compile(ComputeGraph& graph) const {
+			graph.clear();
+			std::map<const Port*, std::pair<ComputeNodePtr, int>> outputIndex;
+			std::vector<std::pair<std::vector<InputPortPtr>, ComputeNodePtr>> compiled;
+			for (NodePtr node : data->getAllChildrenNodes()) {
+				if (node->getType() == NodeType::Group) {
+					continue;
+				}
+				std::vector<InputPortPtr> inputs = node->getInputPorts();
+				if (node->getInputPort().get() != nullptr) {
+					inputs.push_back(node->getInputPort());
+				}
+				std::vector<OutputPortPtr> outputs = node->getOutputPorts();
+				if (node->getOutputPort().get() != nullptr) {
+					outputs.push_back(node->getOutputPort());
+				}
+				std::function<void(ComputeNode& node)> func;
+				if (node->getType() == NodeType::Compute) {
+					func = std::dynamic_pointer_cast<Compute>(node)->onEvaluate;
+				}
+				ComputeNodePtr cnode = graph.add(node->getId(), (int)inputs.size(), (int)outputs.size(), func);
+				for (size_t i = 0; i < inputs.size(); i++) {
+					cnode->setInput(i, inputs[i]->getValue());
+				}
+				for (size_t i = 0; i < outputs.size(); i++) {
+					cnode->setOutput(i, outputs[i]->getValue());
+					outputIndex[outputs[i].get()] = std::pair<ComputeNodePtr, int>(cnode, (int)i);
+				}
+				compiled.push_back(std::pair<std::vector<InputPortPtr>, ComputeNodePtr>(inputs, cnode));
+			}
+			for (auto& item : compiled) {
+				for (size_t i = 0; i < item.first.size(); i++) {
+					std::vector<Port*> sources;
+					CollectSourcePorts(item.first[i].get(), sources);
+					if (sources.size() > 1) {
+						throw std::runtime_error(MakeString() << "Input port " << item.first[i]->getReferenceId() << " has more than one incoming connection.");
+					}
+					if (sources.size() == 1) {
+						auto iter = outputIndex.find(sources.front());
+						if (iter != outputIndex.end()) {
+							graph.connect(iter->second.first, iter->second.second, item.second, (int)i);
+						}
+					}
+				}
+			}
+		}
 		void DataFlow::add(const std::shared_ptr<Relationship>& relationship) {
 			addRelationshipInternal(relationship);
 		}
@@ -2397,6 +2462,7 @@ namespace aly {
 		std::shared_ptr<Node> Compute::clone() const {
 			std::shared_ptr<Compute> node = std::shared_ptr<Compute>(new Compute(getName(), getLabel(), getLocation()));
 			node->copyContentsFrom(this);
+			node->onEvaluate = onEvaluate;
 			node->parentFlow = parentFlow;
 			node->fontSize = fontSize;
 			node->textWidth = textWidth;
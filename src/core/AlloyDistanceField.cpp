@@ -22,6 +22,8 @@
 #include "AlloyDistanceField.h"
 #include "BinaryMinHeap.h"
 #include <list>
+#include <map>
+#include <tuple>
 using namespace std;
 namespace aly {
 const ubyte1 DistanceField3f::ALIVE = ubyte1((uint8_t) 1);
@@ -50,78 +52,17 @@ struct DfElem {
 
 	}
 };
-float DistanceField3f::march(float IMv, float IPv, float JMv, float JPv,
-		float KMv, float KPv, int IMl, int IPl, int JMl, int JPl, int KMl,
-		int KPl) {
-	double s, s2;
-	double tmp;
-	int count;
-	s = 0;
-	s2 = 0;
-	count = 0;
-	if (IMl == ALIVE && IPl == ALIVE) {
-		tmp = std::min(IMv, IPv);
-		s += tmp;
-		s2 += tmp * tmp;
-		count++;
-	} else if (IMl == ALIVE) {
-		s += IMv;
-		s2 += IMv * IMv;
-		count++;
-	} else if (IPl == ALIVE) {
-		s += IPv;
-		s2 += IPv * IPv;
-		count++;
-	}
-	if (JMl == ALIVE && JPl == ALIVE) {
-		tmp = std::min(JMv, JPv);
-		s += tmp;
-		s2 += tmp * tmp;
-		count++;
-	} else if (JMl == ALIVE) {
-		s += JMv;
-		s2 += JMv * JMv;
-		count++;
-	} else if (JPl == ALIVE) {
-		s += JPv;
-		s2 += JPv * JPv;
-		count++;
-	}
-	if (KMl == ALIVE && KPl == ALIVE) {
-		tmp = std::min(KMv, KPv);
-		s += tmp;
-		s2 += tmp * tmp;
-		count++;
-	} else if (KMl == ALIVE) {
-		s += KMv;
-		s2 += KMv * KMv;
-		count++;
-	} else if (KPl == ALIVE) {
-		s += KPv;
-		s2 += KPv * KPv;
-		count++;
-	}
-	tmp = (s + std::sqrt(std::max(0.0, s * s - count * (s2 - 1.0f)))) / count;
-	return (float) tmp;
-}
-void DistanceField3f::solve(const Volume1f& vol, Volume1f& distVol,
-		float maxDistance) {
+/*
+ Labels voxels adjacent to the zero crossing of vol as ALIVE and assigns their sub-voxel
+ distance to the interface. Shared by the fast marching and fast sweeping solvers.
+ */
+static size_t InitializeInterface(const Volume1f& vol, Volume1f& distVol,
+		Volume1ub& labelVol, Volume1b& signVol) {
+	const ubyte1 ALIVE = DistanceField3f::ALIVE;
+	const float DISTANCE_UNDEFINED = DistanceField3f::DISTANCE_UNDEFINED;
 	const int rows = vol.rows;
 	const int cols = vol.cols;
 	const int slices = vol.slices;
-	BinaryMinHeap<float, 3> heap;
-	distVol.resize(rows, cols, slices);
-	distVol.set(float1(DISTANCE_UNDEFINED));
-
-	static const int neighborsX[6] = { 1, 0, -1, 0, 0, 0 };
-	static const int neighborsY[6] = { 0, 1, 0, -1, 0, 0 };
-	static const int neighborsZ[6] = { 0, 0, 0, 0, 1, -1 };
-	std::list<VoxelIndex> voxelList;
-	VoxelIndex* he = nullptr;
-
-	Volume1ub labelVol(rows, cols, slices);
-	Volume1b signVol(rows, cols, slices);
-	labelVol.set(FAR_AWAY);
 	size_t countAlive = 0;
 #pragma omp parallel for
 	for (int k = 0; k < slices; k++) {
@@ -225,6 +166,211 @@ void DistanceField3f::solve(const Volume1f& vol, Volume1f& distVol,
 			}
 		}
 	}
+	return countAlive;
+}
+/*
+ Sparse counterpart of the volume initialization above for distance grids backed by an
+ EndlessGrid. Voxels whose magnitude is at least bgValue are treated as undefined.
+ */
+static size_t InitializeInterface(EndlessGridFloat& vol,
+		EndlessGrid<DfElem>& distVol, float bgValue) {
+	const ubyte ALIVE = DistanceField3f::ALIVE.x;
+	const float BG_VALUE = bgValue;
+	size_t countAlive = 0;
+	int dim;
+	int3 pos;
+
+	short NSFlag, WEFlag, FBFlag;
+	float s = 0, t = 0, w = 0;
+	float JMv = 0, JPv = 0, IMv = 0, IPv = 0, KPv = 0, KMv = 0, Cv = 0;
+	int i, j, k;
+	for (EndlessNodeFloat* leaf : vol.getLeafNodes()) {
+		dim = leaf->dim;
+		pos = leaf->location;
+		for (int kk = 0; kk < dim; kk++) {
+			for (int jj = 0; jj < dim; jj++) {
+				for (int ii = 0; ii < dim; ii++) {
+					i = pos.x + ii;
+					j = pos.y + jj;
+					k = pos.z + kk;
+					Cv = vol.getLeafValue(i, j, k, leaf);
+					if (Cv == 0) {
+						DfElem& elem = distVol.getLeafValue(i, j, k);
+						elem.dist = 0;
+						elem.sign = 0;
+						elem.label = ALIVE;
+						countAlive++;
+					} else {
+						DfElem& elem = distVol.getLeafValue(i, j, k);
+						if (std::abs(Cv) < BG_VALUE) {
+							elem.sign = (int8_t) aly::sign(Cv);
+							NSFlag = 0;
+							WEFlag = 0;
+							FBFlag = 0;
+							JMv = vol.getLeafValue(i, j - 1, k, leaf);
+							JPv = vol.getLeafValue(i, j + 1, k, leaf);
+							IMv = vol.getLeafValue(i - 1, j, k, leaf);
+							IPv = vol.getLeafValue(i + 1, j, k, leaf);
+							KPv = vol.getLeafValue(i, j, k + 1, leaf);
+							KMv = vol.getLeafValue(i, j, k - 1, leaf);
+							if (JMv * Cv < 0 && JMv != BG_VALUE) {
+								NSFlag = 1;
+								s = JMv;
+							}
+							if (JPv * Cv < 0 && JPv != BG_VALUE) {
+								if (NSFlag == 0) {
+									NSFlag = 1;
+									s = JPv;
+								} else {
+									s = (std::abs(JMv) > std::abs(JPv)) ?
+											JMv : JPv;
+								}
+							}
+							if (IMv * Cv < 0 && IMv != BG_VALUE) {
+								WEFlag = 1;
+								t = IMv;
+							}
+							if (IPv * Cv < 0 && IPv != BG_VALUE) {
+								if (WEFlag == 0) {
+									WEFlag = 1;
+									t = IPv;
+								} else {
+									t = (std::abs(IPv) > std::abs(IMv)) ?
+											IPv : IMv;
+								}
+							}
+							if (KPv * Cv < 0 && KPv != BG_VALUE) {
+								FBFlag = 1;
+								w = KPv;
+							}
+							if (KMv * Cv < 0 && KMv != BG_VALUE) {
+								if (FBFlag == 0) {
+									FBFlag = 1;
+									w = KMv;
+								} else {
+									w = (std::abs(KPv) > std::abs(KMv)) ?
+											KPv : KMv;
+								}
+							}
+							float result = 0;
+							if (NSFlag != 0) {
+								s = Cv / (Cv - s);
+								result += 1.0f / (s * s);
+							}
+							if (WEFlag != 0) {
+								t = Cv / (Cv - t);
+								result += 1.0f / (t * t);
+							}
+							if (FBFlag != 0) {
+								w = Cv / (Cv - w);
+								result += 1.0f / (w * w);
+							}
+							if (result == 0) {
+								elem.dist = 0;
+							} else {
+								countAlive++;
+								elem.label = ALIVE;
+								result = std::sqrt(result);
+								elem.dist = (float) (1.0f / result);
+							}
+						} else {
+							elem.sign = 0;
+						}
+					}
+				}
+			}
+		}
+	}
+	return countAlive;
+}
+float DistanceField3f::march(float IMv, float IPv, float JMv, float JPv,
+		float KMv, float KPv, int IMl, int IPl, int JMl, int JPl, int KMl,
+		int KPl) {
+	double s, s2;
+	double tmp;
+	int count;
+	s = 0;
+	s2 = 0;
+	count = 0;
+	if (IMl == ALIVE && IPl == ALIVE) {
+		tmp = std::min(IMv, IPv);
+		s += tmp;
+		s2 += tmp * tmp;
+		count++;
+	} else if (IMl == ALIVE) {
+		s += IMv;
+		s2 += IMv * IMv;
+		count++;
+	} else if (IPl == ALIVE) {
+		s += IPv;
+		s2 += IPv * IPv;
+		count++;
+	}
+	if (JMl == ALIVE && JPl == ALIVE) {
+		tmp = std::min(JMv, JPv);
+		s += tmp;
+		s2 += tmp * tmp;
+		count++;
+	} else if (JMl == ALIVE) {
+		s += JMv;
+		s2 += JMv * JMv;
+		count++;
+	} else if (JPl == ALIVE) {
+		s += JPv;
+		s2 += JPv * JPv;
+		count++;
+	}
+	if (KMl == ALIVE && KPl == ALIVE) {
+		tmp = std::min(KMv, KPv);
+		s += tmp;
+		s2 += tmp * tmp;
+		count++;
+	} else if (KMl == ALIVE) {
+		s += KMv;
+		s2 += KMv * KMv;
+		count++;
+	} else if (KPl == ALIVE) {
+		s += KPv;
+		s2 += KPv * KPv;
+		count++;
+	}
+	tmp = (s + std::sqrt(std::max(0.0, s * s - count * (s2 - 1.0f)))) / count;
+	return (float) tmp;
+}
+void DistanceField3f::solve(const Volume1f& vol, Volume1f& distVol,
+		float maxDistance) {
+	if (method == DistanceMethod::FastSweeping) {
+		solveFastSweeping(vol, distVol, maxDistance);
+	} else {
+		solveFastMarching(vol, distVol, maxDistance);
+	}
+}
+void DistanceField3f::solve(EndlessGridFloat& vol, float maxDistance) {
+	if (method == DistanceMethod::FastSweeping) {
+		solveFastSweeping(vol, maxDistance);
+	} else {
+		solveFastMarching(vol, maxDistance);
+	}
+}
+void DistanceField3f::solveFastMarching(const Volume1f& vol, Volume1f& distVol,
+		float maxDistance) {
+	const int rows = vol.rows;
+	const int cols = vol.cols;
+	const int slices = vol.slices;
+	BinaryMinHeap<float, 3> heap;
+	distVol.resize(rows, cols, slices);
+	distVol.set(float1(DISTANCE_UNDEFINED));
+
+	static const int neighborsX[6] = { 1, 0, -1, 0, 0, 0 };
+	static const int neighborsY[6] = { 0, 1, 0, -1, 0, 0 };
+	static const int neighborsZ[6] = { 0, 0, 0, 0, 1, -1 };
+	std::list<VoxelIndex> voxelList;
+	VoxelIndex* he = nullptr;
+
+	Volume1ub labelVol(rows, cols, slices);
+	Volume1b signVol(rows, cols, slices);
+	labelVol.set(FAR_AWAY);
+	size_t countAlive = InitializeInterface(vol, distVol, labelVol, signVol);
 	heap.reserve(countAlive);
 	{
 		int koff;
@@ -353,196 +499,96 @@ void DistanceField3f::solve(const Volume1f& vol, Volume1f& distVol,
 					JPv = distVol(ni, nj + 1, nk).x;
 					JPs = signVol(ni, nj + 1, nk).x;
 					JPl = labelVol(ni, nj + 1, nk);
-				} else {
-					JPs = 0;
-					JPl = 0;
-				}
-
-				if (nk < slices - 1) {
-					KPv = distVol(ni, nj, nk + 1).x;
-					KPs = signVol(ni, nj, nk + 1).x;
-					KPl = labelVol(ni, nj, nk + 1);
-				} else {
-					KPs = 0;
-					KPl = 0;
-				}
-
-				if (nk > 0) {
-					KMv = distVol(ni, nj, nk - 1).x;
-					KMs = signVol(ni, nj, nk - 1).x;
-					KMl = labelVol(ni, nj, nk - 1);
-				} else {
-					KMs = 0;
-					KMl = 0;
-				}
-
-				if (ni < rows - 1) {
-					IPv = distVol(ni + 1, nj, nk).x;
-					IPs = signVol(ni + 1, nj, nk).x;
-					IPl = labelVol(ni + 1, nj, nk);
-				} else {
-					IPs = 0;
-					IPl = 0;
-				}
-
-				if (ni > 0) {
-					IMv = distVol(ni - 1, nj, nk).x;
-					IMs = signVol(ni - 1, nj, nk).x;
-					IMl = labelVol(ni - 1, nj, nk);
-				} else {
-					IMs = 0;
-					IMl = 0;
-				}
-				signVol(ni, nj, nk).x = aly::sign(
-						JMs + JPs + IMs + IPs + KPs + KMs);
-				newvalue = march(JMv, JPv, KPv, KMv, IPv, IMv, JMl, JPl, KPl,
-						KMl, IPl, IMl);
-				voxelList.push_back(
-						VoxelIndex(Coord(ni, nj, nk), (float) newvalue));
-				VoxelIndex* vox = &voxelList.back();
-				if (label == NARROW_BAND) {
-					heap.change(Coord(ni, nj, nk), vox);
-				} else {
-					heap.add(vox);
-					label = NARROW_BAND;
-				}
-			}
-		}
-	}
-#pragma omp parallel for
-	for (int k = 0; k < slices; k++) {
-		for (int j = 0; j < cols; j++) {
-			for (int i = 0; i < rows; i++) {
-				int8_t s = signVol(i, j, k).x;
-				if (labelVol(i, j, k) != ALIVE) {
-					distVol(i, j, k).x = maxDistance
-							* aly::sign(vol(i, j, k).x);
-				} else {
-					distVol(i, j, k).x *= s;
-				}
-
-			}
-		}
-	}
-	heap.clear();
-}
-
-void DistanceField3f::solve(EndlessGridFloat& vol, float maxDistance) {
-	BinaryMinHeap<float, 3> heap;
-	float BG_VALUE = maxDistance + 0.5f;
-	EndlessGrid<DfElem> distVol(vol.getLevelSizes(),
-			DfElem(BG_VALUE, FAR_AWAY, 0));
-	vol.setBackgroundValue(BG_VALUE);
-	static const int neighborsX[6] = { 1, 0, -1, 0, 0, 0 };
-	static const int neighborsY[6] = { 0, 1, 0, -1, 0, 0 };
-	static const int neighborsZ[6] = { 0, 0, 0, 0, 1, -1 };
-	std::list<VoxelIndex> voxelList;
-	VoxelIndex* he = nullptr;
-	size_t countAlive = 0;
-	int dim;
-	int3 pos;
-
-	short NSFlag, WEFlag, FBFlag;
-	float s = 0, t = 0, w = 0;
-	float JMv = 0, JPv = 0, IMv = 0, IPv = 0, KPv = 0, KMv = 0, Cv = 0;
-	int i, j, k;
-	for (EndlessNodeFloat* leaf : vol.getLeafNodes()) {
-		dim = leaf->dim;
-		pos = leaf->location;
-		for (int kk = 0; kk < dim; kk++) {
-			for (int jj = 0; jj < dim; jj++) {
-				for (int ii = 0; ii < dim; ii++) {
-					i = pos.x + ii;
-					j = pos.y + jj;
-					k = pos.z + kk;
-					Cv = vol.getLeafValue(i, j, k, leaf);
-					if (Cv == 0) {
-						DfElem& elem = distVol.getLeafValue(i, j, k);
-						elem.dist = 0;
-						elem.sign = 0;
-						elem.label = ALIVE;
-						countAlive++;
-					} else {
-						DfElem& elem = distVol.getLeafValue(i, j, k);
-						if (std::abs(Cv) < BG_VALUE) {
-							elem.sign = (int8_t) aly::sign(Cv);
-							NSFlag = 0;
-							WEFlag = 0;
-							FBFlag = 0;
-							JMv = vol.getLeafValue(i, j - 1, k, leaf);
-							JPv = vol.getLeafValue(i, j + 1, k, leaf);
-							IMv = vol.getLeafValue(i - 1, j, k, leaf);
-							IPv = vol.getLeafValue(i + 1, j, k, leaf);
-							KPv = vol.getLeafValue(i, j, k + 1, leaf);
-							KMv = vol.getLeafValue(i, j, k - 1, leaf);
-							if (JMv * Cv < 0 && JMv != BG_VALUE) {
-								NSFlag = 1;
-								s = JMv;
-							}
-							if (JPv * Cv < 0 && JPv != BG_VALUE) {
-								if (NSFlag == 0) {
-									NSFlag = 1;
-									s = JPv;
-								} else {
-									s = (std::abs(JMv) > std::abs(JPv)) ?
-											JMv : JPv;
-								}
-							}
-							if (IMv * Cv < 0 && IMv != BG_VALUE) {
-								WEFlag = 1;
-								t = IMv;
-							}
-							if (IPv * Cv < 0 && IPv != BG_VALUE) {
-								if (WEFlag == 0) {
-									WEFlag = 1;
-									t = IPv;
-								} else {
-									t = (std::abs(IPv) > std::abs(IMv)) ?
-											IPv : IMv;
-								}
-							}
-							if (KPv * Cv < 0 && KPv != BG_VALUE) {
-								FBFlag = 1;
-								w = KPv;
-							}
-							if (KMv * Cv < 0 && KMv != BG_VALUE) {
-								if (FBFlag == 0) {
-									FBFlag = 1;
-									w = KMv;
-								} else {
-									w = (std::abs(KPv) > std::abs(KMv)) ?
-											KPv : KMv;
-								}
-							}
-							float result = 0;
-							if (NSFlag != 0) {
-								s = Cv / (Cv - s);
-								result += 1.0f / (s * s);
-							}
-							if (WEFlag != 0) {
-								t = Cv / (Cv - t);
-								result += 1.0f / (t * t);
-							}
-							if (FBFlag != 0) {
-								w = Cv / (Cv - w);
-								result += 1.0f / (w * w);
-							}
-							if (result == 0) {
-								elem.dist = 0;
-							} else {
-								countAlive++;
-								elem.label = ALIVE;
-								result = std::sqrt(result);
-								elem.dist = (float) (1.0f / result);
-							}
-						} else {
-							elem.sign = 0;
-						}
-					}
+				} else {
+					JPs = 0;
+					JPl = 0;
+				}
+
+				if (nk < slices - 1) {
+					KPv = distVol(ni, nj, nk + 1).x;
+					KPs = signVol(ni, nj, nk + 1).x;
+					KPl = labelVol(ni, nj, nk + 1);
+				} else {
+					KPs = 0;
+					KPl = 0;
+				}
+
+				if (nk > 0) {
+					KMv = distVol(ni, nj, nk - 1).x;
+					KMs = signVol(ni, nj, nk - 1).x;
+					KMl = labelVol(ni, nj, nk - 1);
+				} else {
+					KMs = 0;
+					KMl = 0;
+				}
+
+				if (ni < rows - 1) {
+					IPv = distVol(ni + 1, nj, nk).x;
+					IPs = signVol(ni + 1, nj, nk).x;
+					IPl = labelVol(ni + 1, nj, nk);
+				} else {
+					IPs = 0;
+					IPl = 0;
+				}
+
+				if (ni > 0) {
+					IMv = distVol(ni - 1, nj, nk).x;
+					IMs = signVol(ni - 1, nj, nk).x;
+					IMl = labelVol(ni - 1, nj, nk);
+				} else {
+					IMs = 0;
+					IMl = 0;
+				}
+				signVol(ni, nj, nk).x = aly::sign(
+						JMs + JPs + IMs + IPs + KPs + KMs);
+				newvalue = march(JMv, JPv, KPv, KMv, IPv, IMv, JMl, JPl, KPl,
+						KMl, IPl, IMl);
+				voxelList.push_back(
+						VoxelIndex(Coord(ni, nj, nk), (float) newvalue));
+				VoxelIndex* vox = &voxelList.back();
+				if (label == NARROW_BAND) {
+					heap.change(Coord(ni, nj, nk), vox);
+				} else {
+					heap.add(vox);
+					label = NARROW_BAND;
+				}
+			}
+		}
+	}
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				int8_t s = signVol(i, j, k).x;
+				if (labelVol(i, j, k) != ALIVE) {
+					distVol(i, j, k).x = maxDistance
+							* aly::sign(vol(i, j, k).x);
+				} else {
+					distVol(i, j, k).x *= s;
 				}
+
 			}
 		}
 	}
+	heap.clear();
+}
+
+void DistanceField3f::solveFastMarching(EndlessGridFloat& vol, float maxDistance) {
+	BinaryMinHeap<float, 3> heap;
+	float BG_VALUE = maxDistance + 0.5f;
+	EndlessGrid<DfElem> distVol(vol.getLevelSizes(),
+			DfElem(BG_VALUE, FAR_AWAY, 0));
+	vol.setBackgroundValue(BG_VALUE);
+	static const int neighborsX[6] = { 1, 0, -1, 0, 0, 0 };
+	static const int neighborsY[6] = { 0, 1, 0, -1, 0, 0 };
+	static const int neighborsZ[6] = { 0, 0, 0, 0, 1, -1 };
+	std::list<VoxelIndex> voxelList;
+	VoxelIndex* he = nullptr;
+	int dim;
+	int3 pos;
+	float JMv = 0, JPv = 0, IMv = 0, IPv = 0, KPv = 0, KMv = 0;
+	int i, j, k;
+	size_t countAlive = InitializeInterface(vol, distVol, BG_VALUE);
 	heap.reserve(countAlive);
 	int koff;
 	int nj, nk, ni;
@@ -714,6 +760,370 @@ void DistanceField3f::solve(EndlessGridFloat& vol, float maxDistance) {
 		}
 	}
 }
+/*
+ Godunov upwind solution of |grad u|=1 on a unit grid given the smaller neighbor value
+ along each axis.
+
+ Zhao, H. (2005). A fast sweeping method for eikonal equations. Mathematics of computation,
+ 74(250), 603-627.
+ */
+static inline float SolveEikonal(float a, float b, float c) {
+	if (a > b)
+		std::swap(a, b);
+	if (b > c)
+		std::swap(b, c);
+	if (a > b)
+		std::swap(a, b);
+	float u = a + 1.0f;
+	if (u > b) {
+		float d = a - b;
+		u = 0.5f * (a + b + std::sqrt(std::max(0.0f, 2.0f - d * d)));
+		if (u > c) {
+			float s = a + b + c;
+			u = (s
+					+ std::sqrt(
+							std::max(0.0f,
+									s * s
+											- 3.0f
+													* (a * a + b * b + c * c
+															- 1.0f)))) / 3.0f;
+		}
+	}
+	return u;
+}
+/*
+ Updates one voxel of a dense grid with stride (1, sx, sy) from its six neighbors. Voxels
+ with unknown sign inherit the sign of the neighbor they were reached from. Returns true if
+ the distance decreased.
+ */
+static inline bool SweepVoxel(float* dist, int8_t* sign, size_t idx, int i, int j,
+		int k, int sx, int sy, int sz, size_t strideY, size_t strideZ,
+		float farValue) {
+	float a = farValue, b = farValue, c = farValue;
+	size_t amin = idx, bmin = idx, cmin = idx;
+	if (i > 0 && dist[idx - 1] < a) {
+		a = dist[idx - 1];
+		amin = idx - 1;
+	}
+	if (i < sx - 1 && dist[idx + 1] < a) {
+		a = dist[idx + 1];
+		amin = idx + 1;
+	}
+	if (j > 0 && dist[idx - strideY] < b) {
+		b = dist[idx - strideY];
+		bmin = idx - strideY;
+	}
+	if (j < sy - 1 && dist[idx + strideY] < b) {
+		b = dist[idx + strideY];
+		bmin = idx + strideY;
+	}
+	if (k > 0 && dist[idx - strideZ] < c) {
+		c = dist[idx - strideZ];
+		cmin = idx - strideZ;
+	}
+	if (k < sz - 1 && dist[idx + strideZ] < c) {
+		c = dist[idx + strideZ];
+		cmin = idx + strideZ;
+	}
+	if (std::min(std::min(a, b), c) >= dist[idx]) {
+		return false;
+	}
+	float u = SolveEikonal(a, b, c);
+	if (u >= dist[idx] - 1E-5f) {
+		return false;
+	}
+	dist[idx] = u;
+	if (sign[idx] == 0) {
+		size_t nidx = (a <= b && a <= c) ? amin : ((b <= c) ? bmin : cmin);
+		sign[idx] = sign[nidx];
+	}
+	return true;
+}
+/*
+ Parallel fast sweeping. Each of the 8 sweep orderings visits the grid one diagonal plane
+ i+j+k=L at a time, and all voxels on a plane are updated concurrently.
+
+ Detrixhe, M., Gibou, F., & Min, C. (2013). A parallel fast sweeping method for the eikonal
+ equation. Journal of Computational Physics, 237, 46-55.
+ */
+void DistanceField3f::solveFastSweeping(const Volume1f& vol, Volume1f& distVol,
+		float maxDistance) {
+	const int rows = vol.rows;
+	const int cols = vol.cols;
+	const int slices = vol.slices;
+	const float FAR_VALUE = maxDistance + 0.5f;
+	const size_t strideY = rows;
+	const size_t strideZ = (size_t) rows * cols;
+	distVol.resize(rows, cols, slices);
+	distVol.set(float1(DISTANCE_UNDEFINED));
+	Volume1ub labelVol(rows, cols, slices);
+	Volume1b signVol(rows, cols, slices);
+	labelVol.set(FAR_AWAY);
+	InitializeInterface(vol, distVol, labelVol, signVol);
+	float* dist = distVol.ptr();
+	int8_t* sign = signVol.ptr();
+	const uint8_t* label = labelVol.ptr();
+	size_t N = distVol.size();
+#pragma omp parallel for
+	for (int64_t idx = 0; idx < (int64_t) N; idx++) {
+		if (label[idx] != ALIVE.x) {
+			dist[idx] = FAR_VALUE;
+		}
+	}
+	const int levels = rows + cols + slices - 2;
+	for (int iter = 0; iter < maxSweeps; iter++) {
+		int changed = 0;
+		for (int dir = 0; dir < 8; dir++) {
+			const bool flipX = (dir & 1) != 0;
+			const bool flipY = (dir & 2) != 0;
+			const bool flipZ = (dir & 4) != 0;
+			for (int L = 0; L < levels; L++) {
+				int kmin = std::max(0, L - (rows - 1) - (cols - 1));
+				int kmax = std::min(slices - 1, L);
+#pragma omp parallel for reduction(+:changed)
+				for (int kk = kmin; kk <= kmax; kk++) {
+					int k = flipZ ? slices - 1 - kk : kk;
+					int jmin = std::max(0, L - kk - (rows - 1));
+					int jmax = std::min(cols - 1, L - kk);
+					for (int jj = jmin; jj <= jmax; jj++) {
+						int ii = L - kk - jj;
+						int j = flipY ? cols - 1 - jj : jj;
+						int i = flipX ? rows - 1 - ii : ii;
+						size_t idx = i + j * strideY + k * strideZ;
+						if (label[idx] == ALIVE.x) {
+							continue;
+						}
+						if (SweepVoxel(dist, sign, idx, i, j, k, rows, cols,
+								slices, strideY, strideZ, FAR_VALUE)) {
+							changed++;
+						}
+					}
+				}
+			}
+		}
+		if (changed == 0) {
+			break;
+		}
+	}
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				size_t idx = i + j * strideY + k * strideZ;
+				int8_t s = sign[idx];
+				if (label[idx] == ALIVE.x || (dist[idx] <= maxDistance && s != 0)) {
+					dist[idx] *= s;
+				} else {
+					dist[idx] = maxDistance * aly::sign(vol(i, j, k).x);
+				}
+			}
+		}
+	}
+}
+/*
+ Block-parallel fast sweeping on an EndlessGrid. Leaves within reach of the interface are
+ allocated up front, then each pass sweeps every leaf independently against a snapshot of
+ its neighbors' faces until no leaf changes.
+ */
+void DistanceField3f::solveFastSweeping(EndlessGridFloat& vol, float maxDistance) {
+	typedef std::tuple<int, int, int> LeafKey;
+	const float BG_VALUE = maxDistance + 0.5f;
+	EndlessGrid<DfElem> distVol(vol.getLevelSizes(),
+			DfElem(BG_VALUE, FAR_AWAY, 0));
+	vol.setBackgroundValue(BG_VALUE);
+	InitializeInterface(vol, distVol, BG_VALUE);
+	std::list<EndlessNode<DfElem>*> leafList = distVol.getLeafNodes();
+	if (leafList.size() == 0) {
+		vol.clear();
+		vol.setBackgroundValue(BG_VALUE);
+		return;
+	}
+	const int dim = leafList.front()->dim;
+	const int rings = (int) std::ceil((maxDistance + 1.0f) / dim);
+	for (EndlessNode<DfElem>* leaf : leafList) {
+		bool hasAlive = false;
+		for (const DfElem& elem : leaf->data) {
+			if (elem.label == ALIVE.x) {
+				hasAlive = true;
+				break;
+			}
+		}
+		if (!hasAlive) {
+			continue;
+		}
+		int3 pos = leaf->location;
+		for (int kk = -rings; kk <= rings; kk++) {
+			for (int jj = -rings; jj <= rings; jj++) {
+				for (int ii = -rings; ii <= rings; ii++) {
+					distVol.getLeafValue(pos.x + ii * dim, pos.y + jj * dim,
+							pos.z + kk * dim);
+				}
+			}
+		}
+	}
+	leafList = distVol.getLeafNodes();
+	std::vector<EndlessNode<DfElem>*> leaves(leafList.begin(), leafList.end());
+	const int leafCount = (int) leaves.size();
+	const size_t leafSize = (size_t) dim * dim * dim;
+	std::map<LeafKey, int> leafIndex;
+	for (int n = 0; n < leafCount; n++) {
+		int3 pos = leaves[n]->location;
+		leafIndex[LeafKey(pos.x, pos.y, pos.z)] = n;
+	}
+	static const int neighborsX[6] = { 1, 0, -1, 0, 0, 0 };
+	static const int neighborsY[6] = { 0, 1, 0, -1, 0, 0 };
+	static const int neighborsZ[6] = { 0, 0, 0, 0, 1, -1 };
+	std::vector<int> neighbors(6 * leafCount, -1);
+	for (int n = 0; n < leafCount; n++) {
+		int3 pos = leaves[n]->location;
+		for (int koff = 0; koff < 6; koff++) {
+			auto iter = leafIndex.find(
+					LeafKey(pos.x + neighborsX[koff] * dim,
+							pos.y + neighborsY[koff] * dim,
+							pos.z + neighborsZ[koff] * dim));
+			if (iter != leafIndex.end()) {
+				neighbors[6 * n + koff] = iter->second;
+			}
+		}
+		for (DfElem& elem : leaves[n]->data) {
+			if (elem.label != ALIVE.x) {
+				elem.dist = BG_VALUE;
+			}
+		}
+	}
+	std::vector<float> snapshotDist(leafCount * leafSize);
+	std::vector<int8_t> snapshotSign(leafCount * leafSize);
+	const int bdim = dim + 2;
+	const size_t strideY = bdim;
+	const size_t strideZ = (size_t) bdim * bdim;
+	for (int iter = 0; iter < maxSweeps; iter++) {
+#pragma omp parallel for
+		for (int n = 0; n < leafCount; n++) {
+			const std::vector<DfElem>& data = leaves[n]->data;
+			size_t off = n * leafSize;
+			for (size_t idx = 0; idx < leafSize; idx++) {
+				snapshotDist[off + idx] = data[idx].dist;
+				snapshotSign[off + idx] = data[idx].sign;
+			}
+		}
+		int changed = 0;
+#pragma omp parallel
+		{
+			std::vector<float> dist(strideZ * bdim);
+			std::vector<int8_t> sign(strideZ * bdim);
+			std::vector<uint8_t> fixed(strideZ * bdim);
+#pragma omp for schedule(dynamic) reduction(+:changed)
+			for (int n = 0; n < leafCount; n++) {
+				std::vector<DfElem>& data = leaves[n]->data;
+				std::fill(dist.begin(), dist.end(), BG_VALUE);
+				std::fill(sign.begin(), sign.end(), 0);
+				std::fill(fixed.begin(), fixed.end(), 1);
+				for (int k = 0; k < dim; k++) {
+					for (int j = 0; j < dim; j++) {
+						for (int i = 0; i < dim; i++) {
+							const DfElem& elem = data[i + (j + k * dim) * dim];
+							size_t bidx = (i + 1) + (j + 1) * strideY
+									+ (k + 1) * strideZ;
+							dist[bidx] = elem.dist;
+							sign[bidx] = elem.sign;
+							fixed[bidx] = (elem.label == ALIVE.x) ? 1 : 0;
+						}
+					}
+				}
+				for (int koff = 0; koff < 6; koff++) {
+					int nbr = neighbors[6 * n + koff];
+					if (nbr < 0) {
+						continue;
+					}
+					const float* ndist = &snapshotDist[nbr * leafSize];
+					const int8_t* nsign = &snapshotSign[nbr * leafSize];
+					for (int b = 0; b < dim; b++) {
+						for (int a = 0; a < dim; a++) {
+							int3 src, dst;
+							int face;
+							if (neighborsX[koff] != 0) {
+								face = (neighborsX[koff] > 0) ? 0 : dim - 1;
+								src = int3(face, a, b);
+								dst = int3((neighborsX[koff] > 0) ? dim : -1, a, b);
+							} else if (neighborsY[koff] != 0) {
+								face = (neighborsY[koff] > 0) ? 0 : dim - 1;
+								src = int3(a, face, b);
+								dst = int3(a, (neighborsY[koff] > 0) ? dim : -1, b);
+							} else {
+								face = (neighborsZ[koff] > 0) ? 0 : dim - 1;
+								src = int3(a, b, face);
+								dst = int3(a, b, (neighborsZ[koff] > 0) ? dim : -1);
+							}
+							size_t sidx = src.x + (src.y + src.z * dim) * dim;
+							size_t bidx = (dst.x + 1) + (dst.y + 1) * strideY
+									+ (dst.z + 1) * strideZ;
+							dist[bidx] = ndist[sidx];
+							sign[bidx] = nsign[sidx];
+						}
+					}
+				}
+				bool leafChanged = false;
+				for (int dir = 0; dir < 8; dir++) {
+					const bool flipX = (dir & 1) != 0;
+					const bool flipY = (dir & 2) != 0;
+					const bool flipZ = (dir & 4) != 0;
+					for (int kk = 1; kk <= dim; kk++) {
+						int k = flipZ ? bdim - 1 - kk : kk;
+						for (int jj = 1; jj <= dim; jj++) {
+							int j = flipY ? bdim - 1 - jj : jj;
+							for (int ii = 1; ii <= dim; ii++) {
+								int i = flipX ? bdim - 1 - ii : ii;
+								size_t bidx = i + j * strideY + k * strideZ;
+								if (fixed[bidx]) {
+									continue;
+								}
+								if (SweepVoxel(dist.data(), sign.data(), bidx, i,
+										j, k, bdim, bdim, bdim, strideY,
+										strideZ, BG_VALUE)) {
+									leafChanged = true;
+								}
+							}
+						}
+					}
+				}
+				if (leafChanged) {
+					changed++;
+					for (int k = 0; k < dim; k++) {
+						for (int j = 0; j < dim; j++) {
+							for (int i = 0; i < dim; i++) {
+								DfElem& elem = data[i + (j + k * dim) * dim];
+								size_t bidx = (i + 1) + (j + 1) * strideY
+										+ (k + 1) * strideZ;
+								elem.dist = dist[bidx];
+								elem.sign = sign[bidx];
+							}
+						}
+					}
+				}
+			}
+		}
+		if (changed == 0) {
+			break;
+		}
+	}
+	vol.clear();
+	vol.setBackgroundValue(BG_VALUE);
+	for (EndlessNode<DfElem>* leaf : leaves) {
+		int3 pos = leaf->location;
+		for (int kk = 0; kk < dim; kk++) {
+			for (int jj = 0; jj < dim; jj++) {
+				for (int ii = 0; ii < dim; ii++) {
+					const DfElem& elem = leaf->data[ii + (jj + kk * dim) * dim];
+					if (elem.label == ALIVE.x
+							|| (elem.dist <= maxDistance && elem.sign != 0)) {
+						vol.getLeafValue(pos.x + ii, pos.y + jj, pos.z + kk) =
+								elem.dist * elem.sign;
+					}
+				}
+			}
+		}
+	}
+}
 float DistanceField2f::march(float IMv, float IPv, float JMv, float JPv,
 		int IMl, int IPl, int JMl, int JPl) {
 	double s, s2;
@@ -1007,4 +1417,231 @@ void DistanceField2f::solve(const Image1f& vol, Image1f& distVol,
 	}
 	heap.clear();
 }
+/*
+ Felzenszwalb, P. F., & Huttenlocher, D. P. (2012). Distance transforms of sampled functions.
+ Theory of computing, 8(1), 415-428.
+
+ Lower envelope of parabolas for one line of squared distances. Entries of f at or above
+ EDT_INFINITY are not sites and never become the nearest feature.
+ */
+static const float EDT_INFINITY = std::numeric_limits<float>::max();
+static void DistanceTransform1D(const float* f, const int* fidx, int n, float* d,
+		int* didx, int* v, double* z) {
+	int k = -1;
+	for (int q = 0; q < n; q++) {
+		if (f[q] >= EDT_INFINITY) {
+			continue;
+		}
+		double fq = f[q] + (double) q * q;
+		double s = -std::numeric_limits<double>::infinity();
+		while (k >= 0) {
+			int p = v[k];
+			s = (fq - (f[p] + (double) p * p)) / (2.0 * (q - p));
+			if (s <= z[k]) {
+				k--;
+				s = -std::numeric_limits<double>::infinity();
+			} else {
+				break;
+			}
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+	}
+	if (k < 0) {
+		for (int q = 0; q < n; q++) {
+			d[q] = EDT_INFINITY;
+			didx[q] = -1;
+		}
+		return;
+	}
+	z[k + 1] = std::numeric_limits<double>::infinity();
+	int j = 0;
+	for (int q = 0; q < n; q++) {
+		while (z[j + 1] < q) {
+			j++;
+		}
+		int p = v[j];
+		d[q] = (float) ((double) (q - p) * (q - p) + f[p]);
+		didx[q] = fidx[p];
+	}
+}
+/*
+ Separable exact transform of a rows x cols x slices grid of squared distances, one axis at a
+ time. Lines along each axis are independent and processed in parallel. index tracks the
+ linear offset of the nearest feature.
+ */
+static void DistanceTransformSeparable(float* sqdist, int* index, int rows,
+		int cols, int slices) {
+	const int dims[3] = { rows, cols, slices };
+	const size_t strides[3] = { 1, (size_t) rows, (size_t) rows * cols };
+	const size_t total = (size_t) rows * cols * slices;
+	for (int axis = 0; axis < 3; axis++) {
+		const int n = dims[axis];
+		if (n <= 1) {
+			continue;
+		}
+		//Consecutive lines are adjacent in memory so strided gathers share cache lines.
+		const int a1 = (axis == 0) ? 1 : 0;
+		const int a2 = (axis == 2) ? 1 : 2;
+		const size_t stride = strides[axis];
+		const int64_t lines = (int64_t) (total / n);
+#pragma omp parallel
+		{
+			std::vector<float> f(n), d(n);
+			std::vector<int> fidx(n), didx(n), v(n);
+			std::vector<double> z(n + 1);
+#pragma omp for
+			for (int64_t l = 0; l < lines; l++) {
+				size_t base = (l % dims[a1]) * strides[a1]
+						+ (l / dims[a1]) * strides[a2];
+				for (int q = 0; q < n; q++) {
+					f[q] = sqdist[base + q * stride];
+					fidx[q] = index[base + q * stride];
+				}
+				DistanceTransform1D(f.data(), fidx.data(), n, d.data(),
+						didx.data(), v.data(), z.data());
+				for (int q = 0; q < n; q++) {
+					sqdist[base + q * stride] = d[q];
+					index[base + q * stride] = didx[q];
+				}
+			}
+		}
+	}
+}
+/*
+ Shared driver for all DistanceTransform overloads. isFeature is queried by linear offset.
+ The signed variant runs a second transform against the complement of the features.
+ */
+template<class F> static void DistanceTransformGrid(int rows, int cols,
+		int slices, const F& isFeature, bool signedDistance, float* out,
+		int* nearest) {
+	const size_t N = (size_t) rows * cols * slices;
+	std::vector<float> sqdist(N);
+	std::vector<int> index(N);
+	std::vector<float> sqdistInside;
+	std::vector<int> indexInside;
+#pragma omp parallel for
+	for (int64_t i = 0; i < (int64_t) N; i++) {
+		bool feature = isFeature((size_t) i);
+		sqdist[i] = feature ? 0.0f : EDT_INFINITY;
+		index[i] = feature ? (int) i : -1;
+	}
+	DistanceTransformSeparable(sqdist.data(), index.data(), rows, cols, slices);
+	if (signedDistance) {
+		sqdistInside.resize(N);
+		indexInside.resize(N);
+#pragma omp parallel for
+		for (int64_t i = 0; i < (int64_t) N; i++) {
+			bool background = (sqdist[i] != 0.0f);
+			sqdistInside[i] = background ? 0.0f : EDT_INFINITY;
+			indexInside[i] = background ? (int) i : -1;
+		}
+		DistanceTransformSeparable(sqdistInside.data(), indexInside.data(),
+				rows, cols, slices);
+	}
+#pragma omp parallel for
+	for (int64_t i = 0; i < (int64_t) N; i++) {
+		if (signedDistance && sqdist[i] == 0.0f) {
+			out[i] = (sqdistInside[i] < EDT_INFINITY) ?
+					-std::sqrt(sqdistInside[i]) :
+					-DistanceField3f::DISTANCE_UNDEFINED;
+			nearest[i] = indexInside[i];
+		} else {
+			out[i] = (sqdist[i] < EDT_INFINITY) ?
+					std::sqrt(sqdist[i]) : DistanceField3f::DISTANCE_UNDEFINED;
+			nearest[i] = index[i];
+		}
+	}
+}
+template<class F> static void DistanceTransform(int width, int height,
+		const F& isFeature, bool signedDistance, Image1f& out, Image2i* nearest) {
+	out.resize(width, height);
+	std::vector<int> index(out.size());
+	DistanceTransformGrid(width, height, 1, isFeature, signedDistance, out.ptr(),
+			index.data());
+	if (nearest != nullptr) {
+		nearest->resize(width, height);
+#pragma omp parallel for
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
+				int idx = index[i + j * width];
+				(*nearest)(i, j) =
+						(idx >= 0) ? int2(idx % width, idx / width) : int2(-1, -1);
+			}
+		}
+	}
+}
+template<class F> static void DistanceTransform(int rows, int cols, int slices,
+		const F& isFeature, bool signedDistance, Volume1f& out,
+		Volume3i* nearest) {
+	out.resize(rows, cols, slices);
+	std::vector<int> index(out.size());
+	DistanceTransformGrid(rows, cols, slices, isFeature, signedDistance,
+			out.ptr(), index.data());
+	if (nearest != nullptr) {
+		nearest->resize(rows, cols, slices);
+		const int area = rows * cols;
+#pragma omp parallel for
+		for (int k = 0; k < slices; k++) {
+			for (int j = 0; j < cols; j++) {
+				for (int i = 0; i < rows; i++) {
+					int idx = index[i + (j + k * cols) * rows];
+					(*nearest)(i, j, k) =
+							(idx >= 0) ?
+									int3(idx % rows, (idx % area) / rows,
+											idx / area) :
+									int3(-1, -1, -1);
+				}
+			}
+		}
+	}
+}
+void DistanceTransform(const Image1ub& mask, Image1f& out, bool signedDistance) {
+	DistanceTransform(mask.width, mask.height,
+			[&mask](size_t i) {return mask.data[i].x!=0;}, signedDistance, out,
+			nullptr);
+}
+void DistanceTransform(const Image1ub& mask, Image1f& out, Image2i& nearest,
+		bool signedDistance) {
+	DistanceTransform(mask.width, mask.height,
+			[&mask](size_t i) {return mask.data[i].x!=0;}, signedDistance, out,
+			&nearest);
+}
+void DistanceTransform(const Image1f& levelSet, Image1f& out,
+		bool signedDistance) {
+	DistanceTransform(levelSet.width, levelSet.height,
+			[&levelSet](size_t i) {return levelSet.data[i].x<=0.0f;},
+			signedDistance, out, nullptr);
+}
+void DistanceTransform(const Image1f& levelSet, Image1f& out, Image2i& nearest,
+		bool signedDistance) {
+	DistanceTransform(levelSet.width, levelSet.height,
+			[&levelSet](size_t i) {return levelSet.data[i].x<=0.0f;},
+			signedDistance, out, &nearest);
+}
+void DistanceTransform(const Volume1ub& mask, Volume1f& out,
+		bool signedDistance) {
+	DistanceTransform(mask.rows, mask.cols, mask.slices,
+			[&mask](size_t i) {return mask.data[i].x!=0;}, signedDistance, out,
+			nullptr);
+}
+void DistanceTransform(const Volume1ub& mask, Volume1f& out, Volume3i& nearest,
+		bool signedDistance) {
+	DistanceTransform(mask.rows, mask.cols, mask.slices,
+			[&mask](size_t i) {return mask.data[i].x!=0;}, signedDistance, out,
+			&nearest);
+}
+void DistanceTransform(const Volume1f& levelSet, Volume1f& out,
+		bool signedDistance) {
+	DistanceTransform(levelSet.rows, levelSet.cols, levelSet.slices,
+			[&levelSet](size_t i) {return levelSet.data[i].x<=0.0f;},
+			signedDistance, out, nullptr);
+}
+void DistanceTransform(const Volume1f& levelSet, Volume1f& out,
+		Volume3i& nearest, bool signedDistance) {
+	DistanceTransform(levelSet.rows, levelSet.cols, levelSet.slices,
+			[&levelSet](size_t i) {return levelSet.data[i].x<=0.0f;},
+			signedDistance, out, &nearest);
+}
 }
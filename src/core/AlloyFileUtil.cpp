@@ -33,6 +33,8 @@
 #include "stdint.h"
 #include "AlloyFileUtil.h"
 #include "AlloyCommon.h"
+#include "stb_image.h"
+#include "stb_image_write.h"
 
 #if defined(WIN32) || defined(_WIN32)
 #define  WIN32_LEAN_AND_MEAN
@@ -257,6 +259,24 @@ void WriteBinaryFile(const std::string& str, const char* data, size_t elements)
 	} else
 		throw runtime_error(MakeString() << "Could not write " << str);
 }
+void CompressBinaryData(const std::vector<char>& in, std::vector<char>& out, int quality) {
+	int len = 0;
+	unsigned char* buffer = stbi_zlib_compress((unsigned char*) in.data(), (int) in.size(), &len, quality);
+	if (buffer == nullptr) {
+		throw runtime_error("Could not compress data.");
+	}
+	out.assign((char*) buffer, (char*) buffer + len);
+	free(buffer);
+}
+void DecompressBinaryData(const std::vector<char>& in, std::vector<char>& out) {
+	int len = 0;
+	char* buffer = stbi_zlib_decode_malloc(in.data(), (int) in.size(), &len);
+	if (buffer == nullptr) {
+		throw runtime_error("Could not decompress data.");
+	}
+	out.assign(buffer, buffer + len);
+	free(buffer);
+}
 bool FileExists(const std::string& name) {
 	try {
 		return (filesystem::internal::exists(name));
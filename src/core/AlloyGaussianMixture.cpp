@@ -97,6 +97,12 @@ void SANITY_CHECK_GMM() {
 	elapsed = std::chrono::duration<double>(currentTime - endTime).count();
 	std::cout << "Elapsed " << elapsed << std::endl;
 
+	GaussianMixtureRGB gmmBatch;
+	std::cout << "Start Mini-Batch Learning " << std::endl;
+	gmmBatch.solve(colorSamples, G, 20, 40, 0.0001f, 2000);
+	elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - currentTime).count();
+	std::cout << "Elapsed " << elapsed << std::endl;
+
 }
 void WriteGaussianMixtureToFile(const std::string& file,
 		const GaussianMixtureRGB& params) {
@@ -167,6 +173,519 @@ void ReadGaussianMixtureFromFile(const std::string& file,
 	}
 }
 
+namespace detail {
+/*
+ * Mixture samples viewed through strides so DenseMat columns and float3 arrays share the same
+ * kernels. Dimension d of sample n is data[n*sampleStride+d*dimStride].
+ */
+struct MixtureSamples {
+	const float* data;
+	ptrdiff_t sampleStride;
+	ptrdiff_t dimStride;
+	int N;
+	int D;
+	MixtureSamples(const float* data, ptrdiff_t sampleStride, ptrdiff_t dimStride, int N, int D) :
+			data(data), sampleStride(sampleStride), dimStride(dimStride), N(N), D(D) {
+	}
+	inline float operator()(int n, int d) const {
+		return data[n * sampleStride + d * dimStride];
+	}
+	inline const float* sample(int n) const {
+		return data + n * sampleStride;
+	}
+};
+/*
+ * Responsibility-weighted statistics from one EM pass. Weights are the responsibility mass of
+ * each component divided by the sample count, and means and covariances are G x D and
+ * G x D x D row-major.
+ */
+struct MixtureStatistics {
+	int G = 0;
+	int D = 0;
+	std::vector<double> weights;
+	std::vector<double> means;
+	std::vector<double> covariances;
+	double logLikelihood = 0;
+	void resize(int g, int d) {
+		G = g;
+		D = d;
+		weights.assign(G, 0.0);
+		means.assign(G * D, 0.0);
+		covariances.assign(G * D * D, 0.0);
+	}
+	//Stepwise EM update s=(1-eta)*s+eta*batch on the raw moments of each component.
+	void blend(const MixtureStatistics& batch, double eta) {
+		for (int k = 0; k < G; k++) {
+			double wa = (1.0 - eta) * weights[k];
+			double wb = eta * batch.weights[k];
+			double w = wa + wb;
+			if (w <= 0.0) {
+				continue;
+			}
+			const double* ma = &means[k * D];
+			const double* mb = &batch.means[k * D];
+			const double* ca = &covariances[k * D * D];
+			const double* cb = &batch.covariances[k * D * D];
+			std::vector<double> mean(D), second(D * D);
+			for (int i = 0; i < D; i++) {
+				mean[i] = (wa * ma[i] + wb * mb[i]) / w;
+			}
+			for (int i = 0; i < D; i++) {
+				for (int j = 0; j < D; j++) {
+					second[i * D + j] = (wa * (ca[i * D + j] + ma[i] * ma[j]) + wb * (cb[i * D + j] + mb[i] * mb[j])) / w;
+				}
+			}
+			for (int i = 0; i < D; i++) {
+				means[k * D + i] = mean[i];
+				for (int j = 0; j < D; j++) {
+					covariances[(k * D + i) * D + j] = second[i * D + j] - mean[i] * mean[j];
+				}
+			}
+			weights[k] = w;
+		}
+		logLikelihood = batch.logLikelihood;
+	}
+};
+//Samples are processed in blocks, and blocks are grouped into a bounded number of partitions that each own their accumulators.
+static const int MIXTURE_BLOCK_SIZE = 1024;
+static const int MIXTURE_PARTITIONS = 64;
+inline int MixtureBlocks(int N) {
+	return (N + MIXTURE_BLOCK_SIZE - 1) / MIXTURE_BLOCK_SIZE;
+}
+inline int MixturePartitions(int N) {
+	return std::max(1, std::min(MixtureBlocks(N), MIXTURE_PARTITIONS));
+}
+inline int MixturePartitionBegin(int p, int N) {
+	return (int) ((int64_t) p * MixtureBlocks(N) / MixturePartitions(N));
+}
+/*
+ * Squared distances from samples [start,start+count) to G means as ||x||^2-2x.m+||m||^2, with the
+ * cross terms computed as one GEMM. dist is count x G.
+ */
+inline void MixtureDistanceSqr(const MixtureSamples& X, int start, int count, const std::vector<float>& means,
+		const std::vector<float>& meanNorms, float* dist) {
+	const int G = (int) meanNorms.size();
+	const int D = X.D;
+	Gemm(count, G, D, -2.0f, X.sample(start), X.sampleStride, X.dimStride, means.data(), 1, D, 0.0f, dist, G, 1);
+	for (int n = 0; n < count; n++) {
+		float xx = 0.0f;
+		for (int d = 0; d < D; d++) {
+			float v = X(start + n, d);
+			xx += v * v;
+		}
+		float* row = dist + n * G;
+		for (int g = 0; g < G; g++) {
+			row[g] = std::max(0.0f, row[g] + xx + meanNorms[g]);
+		}
+	}
+}
+inline std::vector<float> MixtureMeanNorms(const std::vector<float>& means, int G, int D) {
+	std::vector<float> norms(G, 0.0f);
+	for (int g = 0; g < G; g++) {
+		for (int d = 0; d < D; d++) {
+			norms[g] += means[g * D + d] * means[g * D + d];
+		}
+	}
+	return norms;
+}
+//Index of the closest mean for samples [start,start+count).
+inline void MixtureNearest(const MixtureSamples& X, int start, int count, const std::vector<float>& means,
+		const std::vector<float>& meanNorms, std::vector<float>& dist, int* labels) {
+	const int G = (int) meanNorms.size();
+	MixtureDistanceSqr(X, start, count, means, meanNorms, dist.data());
+	for (int n = 0; n < count; n++) {
+		const float* row = &dist[n * G];
+		int best = 0;
+		for (int g = 1; g < G; g++) {
+			if (row[g] < row[best]) {
+				best = g;
+			}
+		}
+		labels[n] = best;
+	}
+}
+/*
+ * k-means++ seeding: each new mean is a sample drawn with probability proportional to its squared
+ * distance from the closest mean chosen so far.
+ */
+inline void SeedKMeans(const MixtureSamples& X, int G, std::vector<float>& means) {
+	const int N = X.N;
+	const int D = X.D;
+	means.assign(G * D, 0.0f);
+	if (N == 0 || G == 0) {
+		return;
+	}
+	std::vector<float> minDist(N, std::numeric_limits<float>::max());
+	int index = RandomUniform(0, N - 1);
+	for (int g = 0; g < G; g++) {
+		for (int d = 0; d < D; d++) {
+			means[g * D + d] = X(index, d);
+		}
+		if (g + 1 == G) {
+			break;
+		}
+		const float* mean = &means[g * D];
+		const int parts = MixturePartitions(N);
+		std::vector<double> partSums(parts, 0.0);
+#pragma omp parallel for
+		for (int p = 0; p < parts; p++) {
+			int end = std::min(N, MixturePartitionBegin(p + 1, N) * MIXTURE_BLOCK_SIZE);
+			double sum = 0.0;
+			for (int n = MixturePartitionBegin(p, N) * MIXTURE_BLOCK_SIZE; n < end; n++) {
+				float dist = 0.0f;
+				for (int d = 0; d < D; d++) {
+					float v = X(n, d) - mean[d];
+					dist += v * v;
+				}
+				minDist[n] = std::min(minDist[n], dist);
+				sum += minDist[n];
+			}
+			partSums[p] = sum;
+		}
+		double total = 0.0;
+		for (double s : partSums) {
+			total += s;
+		}
+		if (total <= 0.0) {
+			index = RandomUniform(0, N - 1);
+			continue;
+		}
+		double r = RandomUniform(0.0, total);
+		int p = 0;
+		while (p < parts - 1 && r >= partSums[p]) {
+			r -= partSums[p++];
+		}
+		int end = std::min(N, MixturePartitionBegin(p + 1, N) * MIXTURE_BLOCK_SIZE);
+		index = -1;
+		for (int n = MixturePartitionBegin(p, N) * MIXTURE_BLOCK_SIZE; n < end; n++) {
+			if (minDist[n] > 0.0f) {
+				index = n;
+				r -= minDist[n];
+				if (r < 0.0) {
+					break;
+				}
+			}
+		}
+		if (index < 0) {
+			index = RandomUniform(0, N - 1);
+		}
+	}
+}
+/*
+ * Lloyd iterations with blocked distance evaluation. Empty clusters are re-seeded from samples of
+ * live clusters. Returns false if clusters cannot be recovered.
+ */
+inline bool IterateKMeans(const MixtureSamples& X, int G, std::vector<float>& means, int maxIter) {
+	const double ZERO_TOLERANCE = 1E-16;
+	const int N = X.N;
+	const int D = X.D;
+	const int parts = MixturePartitions(N);
+	std::vector<double> partSums(parts * G * D);
+	std::vector<int> partCounts(parts * G), partLast(parts * G);
+	std::vector<double> accMeans(G * D);
+	std::vector<int> accHefts(G), lastIndex(G);
+	std::vector<float> newMeans(G * D);
+	for (int iter = 1; iter <= maxIter; ++iter) {
+		std::vector<float> meanNorms = MixtureMeanNorms(means, G, D);
+		partSums.assign(partSums.size(), 0.0);
+		partCounts.assign(partCounts.size(), 0);
+		partLast.assign(partLast.size(), 0);
+#pragma omp parallel for
+		for (int p = 0; p < parts; p++) {
+			std::vector<float> dist(MIXTURE_BLOCK_SIZE * G);
+			std::vector<int> labels(MIXTURE_BLOCK_SIZE);
+			double* sums = &partSums[p * G * D];
+			int* counts = &partCounts[p * G];
+			int* last = &partLast[p * G];
+			for (int b = MixturePartitionBegin(p, N); b < MixturePartitionBegin(p + 1, N); b++) {
+				int start = b * MIXTURE_BLOCK_SIZE;
+				int count = std::min(MIXTURE_BLOCK_SIZE, N - start);
+				MixtureNearest(X, start, count, means, meanNorms, dist, labels.data());
+				for (int n = 0; n < count; n++) {
+					int g = labels[n];
+					counts[g]++;
+					last[g] = start + n;
+					for (int d = 0; d < D; d++) {
+						sums[g * D + d] += X(start + n, d);
+					}
+				}
+			}
+		}
+		accMeans.assign(accMeans.size(), 0.0);
+		accHefts.assign(G, 0);
+		lastIndex.assign(G, 0);
+		for (int p = 0; p < parts; p++) {
+			for (int g = 0; g < G; g++) {
+				accHefts[g] += partCounts[p * G + g];
+				lastIndex[g] = std::max(lastIndex[g], partLast[p * G + g]);
+				for (int d = 0; d < D; d++) {
+					accMeans[g * D + d] += partSums[(p * G + g) * D + d];
+				}
+			}
+		}
+		for (int g = 0; g < G; ++g) {
+			for (int d = 0; d < D; ++d) {
+				newMeans[g * D + d] = (accHefts[g] >= 1) ? float(accMeans[g * D + d] / accHefts[g]) : 0.0f;
+			}
+		}
+		// heuristics to resurrect dead means in the event cluster centers collapse
+		std::vector<int> deadGs, liveGs;
+		for (int g = 0; g < G; g++) {
+			if (accHefts[g] == 0) {
+				deadGs.push_back(g);
+			} else if (accHefts[g] >= 2) {
+				liveGs.push_back(g);
+			}
+		}
+		if (deadGs.size() > 0) {
+			std::sort(liveGs.begin(), liveGs.end(), [=](const int& a,const int& b) {return a>b;});
+			if (liveGs.size() == 0) {
+				return false;
+			}
+			size_t liveCount = 0;
+			for (int deadG : deadGs) {
+				int proposed = 0;
+				if (liveCount < liveGs.size()) {
+					// recover by using a sample from a known good mean
+					proposed = lastIndex[liveGs[liveCount++]];
+				} else {
+					// recover by using a randomly selected sample (last resort)
+					proposed = RandomUniform(0, N - 1);
+				}
+				if (proposed >= N) {
+					return false;
+				}
+				for (int d = 0; d < D; d++) {
+					newMeans[deadG * D + d] = X(proposed, d);
+				}
+			}
+		}
+		double delta = 0;
+		for (int g = 0; g < G; ++g) {
+			double dist = 0;
+			for (int d = 0; d < D; d++) {
+				double v = means[g * D + d] - newMeans[g * D + d];
+				dist += v * v;
+			}
+			delta += std::sqrt(dist);
+		}
+		delta /= G;
+		means = newMeans;
+		if (delta <= ZERO_TOLERANCE) {
+			break;
+		}
+	}
+	return true;
+}
+/*
+ * Hard-assigns samples to the closest mean and returns the cluster means, per-dimension variances
+ * (var_floor for clusters with fewer than two members) and priors.
+ */
+inline void InitializeMixture(const MixtureSamples& X, int G, std::vector<float>& means, std::vector<double>& variances,
+		std::vector<float>& priors, float var_floor) {
+	const int N = X.N;
+	const int D = X.D;
+	const int parts = MixturePartitions(N);
+	std::vector<double> partSums(parts * G * D, 0.0), partSqrs(parts * G * D, 0.0);
+	std::vector<int> partCounts(parts * G, 0);
+	std::vector<float> meanNorms = MixtureMeanNorms(means, G, D);
+#pragma omp parallel for
+	for (int p = 0; p < parts; p++) {
+		std::vector<float> dist(MIXTURE_BLOCK_SIZE * G);
+		std::vector<int> labels(MIXTURE_BLOCK_SIZE);
+		for (int b = MixturePartitionBegin(p, N); b < MixturePartitionBegin(p + 1, N); b++) {
+			int start = b * MIXTURE_BLOCK_SIZE;
+			int count = std::min(MIXTURE_BLOCK_SIZE, N - start);
+			MixtureNearest(X, start, count, means, meanNorms, dist, labels.data());
+			for (int n = 0; n < count; n++) {
+				int g = labels[n];
+				partCounts[p * G + g]++;
+				for (int d = 0; d < D; d++) {
+					double v = X(start + n, d);
+					partSums[(p * G + g) * D + d] += v;
+					partSqrs[(p * G + g) * D + d] += v * v;
+				}
+			}
+		}
+	}
+	variances.assign(G * D, 0.0);
+	priors.assign(G, 0.0f);
+	for (int g = 0; g < G; g++) {
+		int members = 0;
+		std::vector<double> sum(D, 0.0), sqr(D, 0.0);
+		for (int p = 0; p < parts; p++) {
+			members += partCounts[p * G + g];
+			for (int d = 0; d < D; d++) {
+				sum[d] += partSums[(p * G + g) * D + d];
+				sqr[d] += partSqrs[(p * G + g) * D + d];
+			}
+		}
+		for (int d = 0; d < D; d++) {
+			double mean = sum[d] / double(members);
+			means[g * D + d] = (members >= 1) ? float(mean) : 0.0f;
+			variances[g * D + d] = (members >= 2) ? (sqr[d] / members) - mean * mean : var_floor;
+		}
+		priors[g] = members / (float) N;
+	}
+}
+/*
+ * One fused E and M step. Responsibilities are evaluated one block at a time and immediately folded
+ * into per-partition statistics, so the N x G responsibility matrix is never stored. Mahalanobis
+ * distances are computed as a GEMM of centered samples against each inverse covariance. weights
+ * are scale factors multiplied by priors.
+ */
+inline void EstimateMixture(const MixtureSamples& X, int G, const std::vector<float>& means,
+		const std::vector<float>& invSigmas, const std::vector<double>& weights, double maxSigmaDist,
+		MixtureStatistics& stats) {
+	const int N = X.N;
+	const int D = X.D;
+	const int parts = MixturePartitions(N);
+	std::vector<double> partAlpha(parts * G, 0.0), partFirst(parts * G * D, 0.0), partSecond(parts * G * D * D, 0.0);
+	std::vector<double> partLogl(parts, 0.0);
+#pragma omp parallel for
+	for (int p = 0; p < parts; p++) {
+		std::vector<float> diff(MIXTURE_BLOCK_SIZE * D), proj(MIXTURE_BLOCK_SIZE * D);
+		std::vector<double> resp(MIXTURE_BLOCK_SIZE * G);
+		double logl = 0.0;
+		for (int b = MixturePartitionBegin(p, N); b < MixturePartitionBegin(p + 1, N); b++) {
+			int start = b * MIXTURE_BLOCK_SIZE;
+			int count = std::min(MIXTURE_BLOCK_SIZE, N - start);
+			for (int k = 0; k < G; k++) {
+				const float* mean = &means[k * D];
+				for (int n = 0; n < count; n++) {
+					for (int d = 0; d < D; d++) {
+						diff[n * D + d] = X(start + n, d) - mean[d];
+					}
+				}
+				Gemm(count, D, D, 1.0f, diff.data(), D, 1, &invSigmas[k * D * D], D, 1, 0.0f, proj.data(), D, 1);
+				for (int n = 0; n < count; n++) {
+					double q = 0.0;
+					for (int d = 0; d < D; d++) {
+						q += proj[n * D + d] * diff[n * D + d];
+					}
+					resp[n * G + k] = std::exp(-0.5 * clamp(q, -maxSigmaDist, maxSigmaDist)) * weights[k];
+				}
+			}
+			for (int n = 0; n < count; n++) {
+				double* r = &resp[n * G];
+				double sum = 0.0;
+				for (int k = 0; k < G; k++) {
+					sum += r[k];
+				}
+				logl += std::log(std::max(1E-16, sum));
+				for (int k = 0; k < G; k++) {
+					r[k] /= sum;
+					if (std::isnan(r[k]) || std::isinf(r[k])) {
+						r[k] = 0.0;
+					}
+				}
+			}
+			//Moments are accumulated about the current mean to avoid cancellation.
+			for (int k = 0; k < G; k++) {
+				const float* mean = &means[k * D];
+				double* first = &partFirst[(p * G + k) * D];
+				double* second = &partSecond[(p * G + k) * D * D];
+				double alpha = 0.0;
+				for (int n = 0; n < count; n++) {
+					double w = resp[n * G + k];
+					if (w == 0.0) {
+						continue;
+					}
+					alpha += w;
+					for (int i = 0; i < D; i++) {
+						double di = X(start + n, i) - mean[i];
+						first[i] += w * di;
+						double wdi = w * di;
+						for (int j = i; j < D; j++) {
+							second[i * D + j] += wdi * (X(start + n, j) - mean[j]);
+						}
+					}
+				}
+				partAlpha[p * G + k] += alpha;
+			}
+		}
+		partLogl[p] = logl;
+	}
+	stats.resize(G, D);
+	stats.logLikelihood = 0.0;
+	for (int p = 0; p < parts; p++) {
+		stats.logLikelihood += partLogl[p];
+	}
+	stats.logLikelihood /= std::max(N, 1);
+	std::vector<double> first(D), second(D * D);
+	for (int k = 0; k < G; k++) {
+		double alpha = 0.0;
+		first.assign(D, 0.0);
+		second.assign(D * D, 0.0);
+		for (int p = 0; p < parts; p++) {
+			alpha += partAlpha[p * G + k];
+			for (int i = 0; i < D; i++) {
+				first[i] += partFirst[(p * G + k) * D + i];
+			}
+			for (int i = 0; i < D * D; i++) {
+				second[i] += partSecond[(p * G + k) * D * D + i];
+			}
+		}
+		for (int i = 0; i < D; i++) {
+			stats.means[k * D + i] = means[k * D + i];
+		}
+		if (alpha <= 0.0) {
+			continue;
+		}
+		for (int i = 0; i < D; i++) {
+			first[i] /= alpha;
+			stats.means[k * D + i] += first[i];
+		}
+		for (int i = 0; i < D; i++) {
+			for (int j = i; j < D; j++) {
+				double c = second[i * D + j] / alpha - first[i] * first[j];
+				stats.covariances[(k * D + i) * D + j] = c;
+				stats.covariances[(k * D + j) * D + i] = c;
+			}
+		}
+		stats.weights[k] = alpha / N;
+	}
+}
+inline std::vector<float> FlattenMeans(const DenseMat<float>& means) {
+	const int D = means.rows;
+	const int G = means.cols;
+	std::vector<float> flat(G * D);
+	for (int g = 0; g < G; g++) {
+		for (int d = 0; d < D; d++) {
+			flat[g * D + d] = means[d][g];
+		}
+	}
+	return flat;
+}
+inline std::vector<float> FlattenMeans(const std::vector<float3>& means) {
+	std::vector<float> flat(means.size() * 3);
+	for (size_t g = 0; g < means.size(); g++) {
+		for (int d = 0; d < 3; d++) {
+			flat[g * 3 + d] = means[g][d];
+		}
+	}
+	return flat;
+}
+inline MixtureSamples MakeMixtureSamples(const DenseMat<float>& X) {
+	return MixtureSamples(X.data.data(), 1, X.cols, X.cols, X.rows);
+}
+inline MixtureSamples MakeMixtureSamples(const std::vector<float3>& X) {
+	static_assert(sizeof(float3) == 3 * sizeof(float), "float3 must be tightly packed.");
+	return MixtureSamples((X.size() > 0) ? &X[0].x : nullptr, 3, 1, (int) X.size(), 3);
+}
+//Copies batchSize randomly chosen samples into a contiguous buffer.
+inline MixtureSamples SampleMixtureBatch(const MixtureSamples& X, int batchSize, std::vector<float>& buffer) {
+	const int D = X.D;
+	buffer.resize(batchSize * D);
+	for (int n = 0; n < batchSize; n++) {
+		int index = RandomUniform(0, X.N - 1);
+		for (int d = 0; d < D; d++) {
+			buffer[n * D + d] = X(index, d);
+		}
+	}
+	return MixtureSamples(buffer.data(), D, 1, batchSize, D);
+}
+}
 double GaussianMixture::distanceMahalanobis(const Vec<float>& pt, int g) const {
 	return std::sqrt(
 			dot(pt - means.getColumn(g),
@@ -181,197 +700,53 @@ void GaussianMixture::initializeParameters(const DenseMat<float>& X,
 		float var_floor) {
 	const int D = means.rows;
 	const int G = means.cols;
-	const int N = X.cols;
-	if (N == 0) {
+	if (X.cols == 0) {
 		return;
 	}
-	DenseMat<float> acc_means(D, G);
-	DenseMat<float> acc_dcovs(D, G);
-	acc_means.setZero();
-	acc_dcovs.setZero();
-	std::vector<int> sumMembers(G, 0);
-	for (int i = 0; i < N; ++i) {
-		VecMap<float> sample = X.getColumn(i);
-		double min_dist = 1E30;
-		int best_g = 0;
-		for (int g = 0; g < G; ++g) {
-			VecMap<float> mean = means.getColumn(g);
-			double dist = distanceSqr(sample, mean);
-
-			if (dist < min_dist) {
-				min_dist = dist;
-				best_g = g;
-			}
-		}
-		sumMembers[best_g]++;
-		VecMap<float> acc_mean = acc_means.getColumn(best_g);
-		VecMap<float> acc_dcov = acc_dcovs.getColumn(best_g);
-		for (int d = 0; d < D; ++d) {
-			float x_d = sample[d];
-			acc_mean[d] += x_d;
-			acc_dcov[d] += x_d * x_d;
-		}
-	}
-
+	std::vector<float> flatMeans = detail::FlattenMeans(means), weights;
+	std::vector<double> variances;
+	detail::InitializeMixture(detail::MakeMixtureSamples(X), G, flatMeans,
+			variances, weights, var_floor);
 	for (int g = 0; g < G; ++g) {
-		VecMap<float> acc_mean = acc_means.getColumn(g);
-		VecMap<float> acc_dcov = acc_dcovs.getColumn(g);
-		int sumMember = sumMembers[g];
-		VecMap<float> mean = means.getColumn(g);
 		DenseMat<float>& fcov = sigmas[g];
 		fcov.setZero();
 		for (int d = 0; d < D; ++d) {
-			double tmp = acc_mean[d] / double(sumMember);
-			mean[d] = (sumMember >= 1) ? tmp : (0);
-			fcov[d][d] =
-					(sumMember >= 2) ?
-							float(
-									(acc_dcov[d] / float(sumMember))
-											- (tmp * tmp)) :
-							float(var_floor);
+			means[d][g] = flatMeans[g * D + d];
+			fcov[d][d] = float(variances[g * D + d]);
 		}
-		priors[g] = sumMember / (float) N;
+		priors[g] = weights[g];
 	}
 }
 
 void GaussianMixture::initializeMeans(const DenseMat<float>& X) {
 	const int G = means.cols;
 	const int D = means.rows;
-	int N = X.cols;
-// going through all of the samples can be extremely time consuming;
-// instead, if there are enough samples, randomly choose samples with probability 0.1
-	const int stride = 10;
-	const bool use_sampling = ((N / int(stride * stride)) > G);
-	const int step = (use_sampling) ? int(stride) : int(1);
-	int start_index = RandomUniform(0, N - 1);
-	means.setColumn(X.getColumn(start_index), 0);
-	double max_dist = 0.0;
-	for (int g = 1; g < G; ++g) {
-		int best_i = int(0);
-		int start_i = int(0);
-		max_dist = 0.0;
-		for (int i = 0; i < N; i += step) {
-			bool ignore_i = false;
-			// find the average distance between sample i and the means so far
-			size_t idx = i + RandomUniform(0, step - 1);
-			VecMap<float> sample = X.getColumn(idx);
-			double sum = 0.0;
-			for (int h = 0; h < g; ++h) {
-				double dist = distanceSqr(means.getColumn(h), sample);
-				if (dist == 0.0) {
-					ignore_i = true;
-					break;
-				} else {
-					sum += dist;
-				}
-			}
-			if (!ignore_i && sum >= max_dist) {
-				max_dist = sum;
-				best_i = idx;
-			}
+	std::vector<float> flatMeans;
+	detail::SeedKMeans(detail::MakeMixtureSamples(X), G, flatMeans);
+	for (int g = 0; g < G; ++g) {
+		for (int d = 0; d < D; ++d) {
+			means[d][g] = flatMeans[g * D + d];
 		}
-		// set the mean to the sample that is the furthest away from the means so far
-		means.setColumn(X.getColumn(best_i), g);
 	}
 }
 bool GaussianMixture::iterateKMeans(const DenseMat<float>& X, int max_iter) {
-	const double ZERO_TOLERANCE = 1E-16;
-	const int N = X.cols;
-	const int D = means.rows;
 	const int G = means.cols;
-	std::vector<Vec<float>> acc_means(G, Vec<float>(D));
-	std::vector<int> acc_hefts(G, 0);
-	std::vector<int> last_indx(G, 0);
-	DenseMat<float> new_means = means;
-	for (int iter = 1; iter <= max_iter; ++iter) {
-		acc_hefts.assign(acc_hefts.size(), 0);
-		acc_means.assign(acc_means.size(), Vec<float>::zero(D));
-		//Find closest cluster
-		for (int i = 0; i < N; ++i) {
-			VecMap<float> sample = X.getColumn(i);
-			double min_dist = 1E30;
-			int best_g = 0;
-			for (int g = 0; g < G; ++g) {
-				double dist = distanceSqr(means.getColumn(g), sample);
-				if (dist < min_dist) {
-					min_dist = dist;
-					best_g = g;
-				}
-			}
-			acc_means[best_g] += sample;
-			acc_hefts[best_g]++;
-			last_indx[best_g] = i;
-		}
-		// generate new means
-		for (int g = 0; g < G; ++g) {
-			Vec<float>& acc_mean = acc_means[g];
-			int acc_heft = acc_hefts[g];
-			VecMap<float> new_mean = new_means.getColumn(g);
-			for (int d = 0; d < D; ++d) {
-				new_mean[d] =
-						(acc_heft >= 1) ?
-								(acc_mean[d] / float(acc_heft)) : float(0);
-			}
-		}
-		// heuristics to resurrect dead means in the even cluster centers collapse
-		std::vector<int> dead_gs;
-		for (int i = 0; i < acc_hefts.size(); i++) {
-			if (acc_hefts[i] == 0) {
-				dead_gs.push_back(i);
-			}
-			if (dead_gs.size() > 0) {
-				std::vector<int> live_gs;
-				for (int i = 0; i < acc_hefts.size(); i++) {
-					if (acc_hefts[i] >= 2) {
-						live_gs.push_back(i);
-					}
-				}
-				std::sort(live_gs.begin(), live_gs.end(),
-						[=](const int& a,const int& b) {return a>b;});
-
-				if (live_gs.size() == 0) {
-					return false;
-				}
-				int live_gs_count = 0;
-				for (int dead_gs_count = 0;
-						dead_gs_count < (int) dead_gs.size(); ++dead_gs_count) {
-					const int dead_g_id = dead_gs[dead_gs_count];
-					int proposed_i = 0;
-					if (live_gs_count < live_gs.size()) {
-						const int live_g_id = live_gs[live_gs_count];
-						++live_gs_count;
-						if (live_g_id == dead_g_id) {
-							return false;
-						}
-						// recover by using a sample from a known good mean
-						proposed_i = last_indx[live_g_id];
-					} else {
-						// recover by using a randomly selected sample (last resort)
-						proposed_i = RandomUniform(0, N - 1);
-					}
-					if (proposed_i >= N) {
-						return false;
-					}
-					new_means.setColumn(X.getColumn(proposed_i), dead_g_id);
-				}
-			}
-			double rs_delta = 0;
-			for (int g = 0; g < G; ++g) {
-				rs_delta += distance(means.getColumn(g),
-						new_means.getColumn(g));
-			}
-			rs_delta /= G;
-			if (rs_delta <= ZERO_TOLERANCE) {
-				break;
-			}
+	const int D = means.rows;
+	std::vector<float> flatMeans = detail::FlattenMeans(means);
+	if (!detail::IterateKMeans(detail::MakeMixtureSamples(X), G, flatMeans,
+			max_iter)) {
+		return false;
+	}
+	for (int g = 0; g < G; ++g) {
+		for (int d = 0; d < D; ++d) {
+			means[d][g] = flatMeans[g * D + d];
 		}
-		means = new_means;
 	}
 	return true;
 }
 double GaussianMixture::distanceMahalanobis(const Vec<float>& pt) const {
 	float minDist = 1E30;
-	for (int i = 0; i < (int) means.size(); i++) {
+	for (int i = 0; i < means.cols; i++) {
 		float d = distanceMahalanobis(pt, i);
 		if (d < minDist) {
 			minDist = d;
@@ -381,7 +756,7 @@ double GaussianMixture::distanceMahalanobis(const Vec<float>& pt) const {
 }
 double GaussianMixture::distanceEuclidean(const Vec<float>& pt) const {
 	float minDist = 1E30;
-	for (int i = 0; i < (int) means.size(); i++) {
+	for (int i = 0; i < means.cols; i++) {
 		float d = distanceEuclidean(pt, i);
 		if (d < minDist) {
 			minDist = d;
@@ -391,7 +766,7 @@ double GaussianMixture::distanceEuclidean(const Vec<float>& pt) const {
 }
 double GaussianMixture::likelihood(const Vec<float>& pt) const {
 	double sum = 0;
-	for (int k = 0; k < means.size(); k++) {
+	for (int k = 0; k < means.cols; k++) {
 		VecMap<float> mean = means.getColumn(k);
 		DenseMat<float> isig = invSigmas[k];
 		double dgaus = std::exp(-0.5 * dot((pt - mean), isig * (pt - mean)))
@@ -401,11 +776,10 @@ double GaussianMixture::likelihood(const Vec<float>& pt) const {
 	return std::log(sum);
 }
 bool GaussianMixture::solve(const DenseMat<float>& data, int G, int km_iter,
-		int em_iter, float var_floor) {
+		int em_iter, float var_floor, int batch_size) {
 	const float CONV_TOLERANCE = 1E-6f;
 	int D = data.rows;
 	int N = data.cols;
-	DenseMat<float> W(N, G);
 	DenseMat<float> U(D, D);
 	DenseMat<float> Diag(D, D);
 	DenseMat<float> Vt(D, D);
@@ -413,90 +787,83 @@ bool GaussianMixture::solve(const DenseMat<float>& data, int G, int km_iter,
 	priors.resize(G);
 	sigmas.resize(G, DenseMat<float>(D, D));
 	invSigmas.resize(G, DenseMat<float>(D, D));
-	initializeMeans(data);
+	const bool miniBatch = (batch_size > 0 && batch_size < N);
+	//Seeding and k-means run on a single random batch for mini-batch EM.
+	DenseMat<float> batch;
+	if (miniBatch) {
+		batch.resize(D, batch_size);
+		for (int n = 0; n < batch_size; n++) {
+			int index = RandomUniform(0, N - 1);
+			for (int d = 0; d < D; d++) {
+				batch[d][n] = data[d][index];
+			}
+		}
+	}
+	const DenseMat<float>& init = (miniBatch) ? batch : data;
+	initializeMeans(init);
 	if (km_iter > 0) {
-		if (!iterateKMeans(data, km_iter)) {
+		if (!iterateKMeans(init, km_iter)) {
 			return false;
 		}
 	}
 // initial fcovs
-	initializeParameters(data, var_floor);
+	initializeParameters(init, var_floor);
 	scaleFactors.resize(G);
 	double CORRECTION = std::pow(ALY_2_PI, data.rows * 0.5);
-	double logl = 0;
 	double lastlogl = 0;
+	const double maxSigmaDist=16*16;//16 sigmas is huge!
+	detail::MixtureSamples samples = detail::MakeMixtureSamples(data);
+	detail::MixtureStatistics stats, batchStats;
+	std::vector<float> flatInvSigmas(G * D * D), batchBuffer;
+	std::vector<double> weights(G);
 	for (int iter = 0; iter < em_iter; iter++) {
-		//std::cout << "Iteration " << iter << std::endl;
 		for (int k = 0; k < G; k++) {
 			DenseMat<float>& M = sigmas[k];
 			SVD(M, U, Diag, Vt);
 			double det = 1;
-			//std::cout << k << ") " << means.getColumn(k) << " ::" << priors[k];
 			for (int k = 0; k < D; k++) {
 				double d = std::max(0.0,(double)Diag[k][k]);
-				//std::cout << " sigma[" << k << "]=" << std::sqrt(d);
 				if (std::abs(d) > var_floor) {
 					det *= d;
 					d = 1.0 / d;
 				}
 				Diag[k][k] = d;
 			}
-			//std::cout << std::endl;
 			scaleFactors[k] = (det>0)?1.0 / (CORRECTION * std::sqrt(det)) : 1.0 / CORRECTION;
 			invSigmas[k] = (U * Diag * Vt).transpose();
-
+			std::copy(invSigmas[k].data.begin(), invSigmas[k].data.end(), flatInvSigmas.begin() + k * D * D);
+			weights[k] = scaleFactors[k] * priors[k];
 		}
-		logl = 0;
-		const double maxSigmaDist=16*16;//16 sigmas is huge!
-		for (int n = 0; n < N; n++) {
-			VecMap<float> sample = data.getColumn(n);
-			double sum = 0;
-			for (int k = 0; k < G; k++) {
-				VecMap<float> mean = means.getColumn(k);
-				DenseMat<float> isig = invSigmas[k];
-				double dgaus = std::exp(
-						-0.5 * clamp(dot((sample - mean), isig * (sample - mean)),-maxSigmaDist,maxSigmaDist))
-						* scaleFactors[k] * priors[k];
-				sum += dgaus;
-				W[n][k] = dgaus;
-			}
-			logl += std::log(sum);
-			for (int k = 0; k < G; k++) {
-				W[n][k] /= sum;
+		std::vector<float> flatMeans = detail::FlattenMeans(means);
+		if (miniBatch) {
+			detail::EstimateMixture(detail::SampleMixtureBatch(samples, batch_size, batchBuffer), G, flatMeans, flatInvSigmas, weights, maxSigmaDist, batchStats);
+			if (iter == 0) {
+				stats = batchStats;
+			} else {
+				stats.blend(batchStats, std::pow(iter + 2.0, -0.7));
 			}
+		} else {
+			detail::EstimateMixture(samples, G, flatMeans, flatInvSigmas, weights, maxSigmaDist, stats);
 		}
-		logl /= N;
-		//std::cout << "Log Likelihood= " << logl << std::endl;
 		for (int k = 0; k < G; k++) {
-			VecMap<float> mean = means.getColumn(k);
-			mean.setZero();
-			double alpha = 0;
-			for (int n = 0; n < N; n++) {
-				VecMap<float> sample = data.getColumn(n);
-				alpha += W[n][k];
-				mean += W[n][k] * sample;
-			}
-			if(alpha>0){
-				mean /= (float) alpha;
+			if (stats.weights[k] > 0) {
 				DenseMat<float>& cov = sigmas[k];
-				cov.setZero();
-				for (int n = 0; n < N; n++) {
-					VecMap<float> sample = data.getColumn(n);
-					Vec<float> diff = (sample - mean);
-					float w = W(n, k) / alpha;
-					for (int ii = 0; ii < D; ii++) {
-						for (int jj = 0; jj < D; jj++) {
-							cov[ii][jj] += w * diff[ii] * diff[jj];
-						}
+				for (int ii = 0; ii < D; ii++) {
+					means[ii][k] = float(stats.means[k * D + ii]);
+					for (int jj = 0; jj < D; jj++) {
+						cov[ii][jj] = float(stats.covariances[(k * D + ii) * D + jj]);
 					}
 				}
-				priors[k] = alpha / N;
+				priors[k] = float(stats.weights[k]);
 			}
 		}
-		if (std::abs(logl - lastlogl) < CONV_TOLERANCE) {
-			break;
+		//Batch likelihoods are too noisy to test for convergence.
+		if (!miniBatch) {
+			if (std::abs(stats.logLikelihood - lastlogl) < CONV_TOLERANCE) {
+				break;
+			}
+			lastlogl = stats.logLikelihood;
 		}
-		lastlogl = logl;
 	}
 	return true;
 }
@@ -507,183 +874,42 @@ GaussianMixtureRGB::GaussianMixtureRGB() {
 void GaussianMixtureRGB::initializeParameters(const std::vector<float3>& X,
 		float var_floor) {
 	const int G = (int) means.size();
-	const int N = (int) X.size();
-	if (N == 0) {
+	if (X.size() == 0) {
 		return;
 	}
-	std::vector<float3> acc_means(G, float3(0.0f));
-	std::vector<float3> acc_dcovs(G, float3(0.0f));
-	std::vector<int> sumMembers(G, 0);
-	for (int i = 0; i < N; ++i) {
-		float3 sample = X[i];
-		double min_dist = 1E30;
-		int best_g = 0;
-		for (int g = 0; g < G; ++g) {
-			float3 mean = means[g];
-			double dist = distanceSqr(sample, mean);
-			if (dist < min_dist) {
-				min_dist = dist;
-				best_g = g;
-			}
-		}
-		sumMembers[best_g]++;
-		float3& acc_mean = acc_means[best_g];
-		float3& acc_dcov = acc_dcovs[best_g];
-		acc_mean += sample;
-		acc_dcov += sample * sample;
-	}
+	std::vector<float> flatMeans = detail::FlattenMeans(means), weights;
+	std::vector<double> variances;
+	detail::InitializeMixture(detail::MakeMixtureSamples(X), G, flatMeans,
+			variances, weights, var_floor);
 	for (int g = 0; g < G; ++g) {
-		float3& acc_mean = acc_means[g];
-		float3& acc_dcov = acc_dcovs[g];
-		int sumMember = sumMembers[g];
-		float3& mean = means[g];
 		float3x3& fcov = sigmas[g];
 		fcov = float3x3::zero();
 		for (int d = 0; d < 3; ++d) {
-			double tmp = acc_mean[d] / double(sumMember);
-			mean[d] = (sumMember >= 1) ? tmp : (0);
-			fcov[d][d] =
-					(sumMember >= 2) ?
-							float(
-									(acc_dcov[d] / float(sumMember))
-											- (tmp * tmp)) :
-							float(var_floor);
+			means[g][d] = flatMeans[g * 3 + d];
+			fcov[d][d] = float(variances[g * 3 + d]);
 		}
-		//std::cout<<"Init Cov "<<fcov<<" SUM "<<sumMember<<" N "<<N<<std::endl;
-		priors[g] = sumMember / (float) N;
+		priors[g] = weights[g];
 	}
 }
 
 void GaussianMixtureRGB::initializeMeans(const std::vector<float3>& X) {
-	const int G = means.size();
-	int N = X.size();
-// going through all of the samples can be extremely time consuming;
-// instead, if there are enough samples, randomly choose samples with probability 0.1
-	const int stride = 10;
-	const bool use_sampling = ((N / int(stride * stride)) > G);
-	const int step = (use_sampling) ? int(stride) : int(1);
-	int start_index = RandomUniform(0, N - 1);
-	means[0] = X[start_index];
-	double max_dist = 0.0;
-	for (int g = 1; g < G; ++g) {
-		int best_i = int(0);
-		int start_i = int(0);
-		max_dist = 0.0;
-		for (int i = 0; i < N; i += step) {
-			bool ignore_i = false;
-			// find the average distance between sample i and the means so far
-			size_t idx = i + RandomUniform(0, step - 1);
-			float3 sample = X[idx];
-			double sum = 0.0;
-			for (int h = 0; h < g; ++h) {
-				double dist = distanceSqr(means[h], sample);
-				if (dist == 0.0) {
-					ignore_i = true;
-					break;
-				} else {
-					sum += dist;
-				}
-			}
-			if (!ignore_i && sum >= max_dist) {
-				max_dist = sum;
-				best_i = idx;
-			}
-		}
-		// set the mean to the sample that is the furthest away from the means so far
-		means[g] = X[best_i];
+	const int G = (int) means.size();
+	std::vector<float> flatMeans;
+	detail::SeedKMeans(detail::MakeMixtureSamples(X), G, flatMeans);
+	for (int g = 0; g < G; ++g) {
+		means[g] = float3(flatMeans[g * 3], flatMeans[g * 3 + 1], flatMeans[g * 3 + 2]);
 	}
 }
 bool GaussianMixtureRGB::iterateKMeans(const std::vector<float3>& X,
 		int max_iter) {
-	const double ZERO_TOLERANCE = 1E-16;
-	const int N = X.size();
-	const int G = means.size();
-	std::vector<float3> acc_means(G, float3(0.0f));
-	std::vector<int> acc_hefts(G, 0);
-	std::vector<int> last_indx(G, 0);
-	std::vector<float3> new_means = means;
-	for (int iter = 1; iter <= max_iter; ++iter) {
-		acc_hefts.assign(acc_hefts.size(), 0);
-		acc_means.assign(acc_means.size(), float3(0.0f));
-		//Find closest cluster
-		for (int i = 0; i < N; ++i) {
-			float3 sample = X[i];
-			double min_dist = 1E30;
-			int best_g = 0;
-			for (int g = 0; g < G; ++g) {
-				double dist = distanceSqr(means[g], sample);
-				if (dist < min_dist) {
-					min_dist = dist;
-					best_g = g;
-				}
-			}
-			acc_means[best_g] += sample;
-			acc_hefts[best_g]++;
-			last_indx[best_g] = i;
-		}
-		// generate new means
-		for (int g = 0; g < G; ++g) {
-			float3& acc_mean = acc_means[g];
-			int acc_heft = acc_hefts[g];
-			float3& new_mean = new_means[g];
-			for (int d = 0; d < 2; ++d) {
-				new_mean[d] =
-						(acc_heft >= 1) ?
-								(acc_mean[d] / float(acc_heft)) : float(0);
-			}
-		}
-		// heuristics to resurrect dead means in the even cluster centers collapse
-		std::vector<int> dead_gs;
-		for (int i = 0; i < acc_hefts.size(); i++) {
-			if (acc_hefts[i] == 0) {
-				dead_gs.push_back(i);
-			}
-			if (dead_gs.size() > 0) {
-				std::vector<int> live_gs;
-				for (int i = 0; i < acc_hefts.size(); i++) {
-					if (acc_hefts[i] >= 2) {
-						live_gs.push_back(i);
-					}
-				}
-				std::sort(live_gs.begin(), live_gs.end(),
-						[=](const int& a,const int& b) {return a>b;});
-
-				if (live_gs.size() == 0) {
-					return false;
-				}
-				int live_gs_count = 0;
-				for (int dead_gs_count = 0;
-						dead_gs_count < (int) dead_gs.size(); ++dead_gs_count) {
-					const int dead_g_id = dead_gs[dead_gs_count];
-					int proposed_i = 0;
-					if (live_gs_count < live_gs.size()) {
-						const int live_g_id = live_gs[live_gs_count];
-						++live_gs_count;
-						if (live_g_id == dead_g_id) {
-							return false;
-						}
-						// recover by using a sample from a known good mean
-						proposed_i = last_indx[live_g_id];
-					} else {
-						// recover by using a randomly selected sample (last resort)
-						proposed_i = RandomUniform(0, N - 1);
-					}
-					if (proposed_i >= N) {
-						return false;
-					}
-					new_means[dead_g_id] = X[proposed_i];
-				}
-			}
-			double rs_delta = 0;
-			for (int g = 0; g < G; ++g) {
-				rs_delta += distance(means[g], new_means[g]);
-			}
-			rs_delta /= G;
-			if (rs_delta <= ZERO_TOLERANCE) {
-				break;
-			}
-		}
-		means = new_means;
+	const int G = (int) means.size();
+	std::vector<float> flatMeans = detail::FlattenMeans(means);
+	if (!detail::IterateKMeans(detail::MakeMixtureSamples(X), G, flatMeans,
+			max_iter)) {
+		return false;
+	}
+	for (int g = 0; g < G; ++g) {
+		means[g] = float3(flatMeans[g * 3], flatMeans[g * 3 + 1], flatMeans[g * 3 + 2]);
 	}
 	return true;
 }
@@ -792,10 +1018,9 @@ double GaussianMixtureRGB::likelihood(float3 pt) const {
 	return std::log(sum);
 }
 bool GaussianMixtureRGB::solve(const std::vector<float3>& data, int G,
-		int km_iter, int em_iter, float var_floor) {
+		int km_iter, int em_iter, float var_floor, int batch_size) {
 	const float CONV_TOLERANCE = 1E-6f;
 	int N = (int) data.size();
-	DenseMat<float> W(N, G);
 	float3x3 U;
 	float3x3 Diag;
 	float3x3 Vt;
@@ -806,89 +1031,82 @@ bool GaussianMixtureRGB::solve(const std::vector<float3>& data, int G,
 	sigmas.resize(G, float3x3::zero());
 	invSigmas.resize(G, float3x3::zero());
 
-	initializeMeans(data);
+	const bool miniBatch = (batch_size > 0 && batch_size < N);
+	//Seeding and k-means run on a single random batch for mini-batch EM.
+	std::vector<float3> batch;
+	if (miniBatch) {
+		batch.resize(batch_size);
+		for (int n = 0; n < batch_size; n++) {
+			batch[n] = data[RandomUniform(0, N - 1)];
+		}
+	}
+	const std::vector<float3>& init = (miniBatch) ? batch : data;
+	initializeMeans(init);
 	if (km_iter > 0) {
-		if (!iterateKMeans(data, km_iter)) {
+		if (!iterateKMeans(init, km_iter)) {
 			return false;
 		}
 	}
-	initializeParameters(data, var_floor);
+	initializeParameters(init, var_floor);
 	double CORRECTION = std::pow(ALY_2_PI, 3 * 0.5);
-	double logl = 0;
 	double lastlogl = 0;
+	const double maxSigmaDist=10*10;//16 sigmas is huge!
+	detail::MixtureSamples samples = detail::MakeMixtureSamples(data);
+	detail::MixtureStatistics stats, batchStats;
+	std::vector<float> flatInvSigmas(G * 9), batchBuffer;
+	std::vector<double> weights(G);
 	for (int iter = 0; iter < em_iter; iter++) {
-		//std::cout << "Iteration " << iter << std::endl;
 		for (int k = 0; k < G; k++) {
 			float3x3& M = sigmas[k];
 			SVD(M, U, Diag, Vt);
 			double det = 1;
-			//std::cout << k << ") " << means[k] << " ::" << priors[k];
 			for (int k = 0; k < 3; k++) {
 				double d = std::max(0.0f,Diag[k][k]);
-				//std::cout << " sigma[" << k << "]=" <<Diag[k][k]<<" "<< std::sqrt(d);
 				if (std::abs(d) > var_floor) {
 					det *= d;
 					d = 1.0 / d;
 				}
 				Diag[k][k] = d;
 			}
-			//std::cout << std::endl;
 			scaleFactors[k] = (det>0)?1.0 / (CORRECTION * std::sqrt(det)):1.0/CORRECTION;
 			invSigmas[k] = transpose(U * Diag * Vt);
-			//std::cout<<k<<") Inverse Sigma "<<Diag[k][k]<<" "<<scaleFactors[k]<<" "<<means[k]<<std::endl;
-		}
-		logl = 0;
-		const float maxSigmaDist=10*10;//16 sigmas is huge!
-		for (int n = 0; n < N; n++) {
-			float3 sample = data[n];
-			double sum = 0;
-			for (int k = 0; k < G; k++) {
-				float3& mean = means[k];
-				float3x3 isig = invSigmas[k];
-				double dgaus = std::exp(-0.5 * aly::clamp(dot((sample - mean), isig * (sample - mean)),-maxSigmaDist,maxSigmaDist)) * scaleFactors[k] * priors[k];
-				sum += dgaus;
-				W[n][k] = dgaus;
-			}
-			logl += std::log(std::max(1E-16,sum));
-			for (int k = 0; k < G; k++) {
-				W[n][k] /= sum;
-				if(std::isnan(W[n][k])||std::isinf(W[n][k])){
-					W[n][k]=0.0f;
+			for (int ii = 0; ii < 3; ii++) {
+				for (int jj = 0; jj < 3; jj++) {
+					flatInvSigmas[k * 9 + ii * 3 + jj] = invSigmas[k](ii, jj);
 				}
 			}
+			weights[k] = scaleFactors[k] * priors[k];
+		}
+		std::vector<float> flatMeans = detail::FlattenMeans(means);
+		if (miniBatch) {
+			detail::EstimateMixture(detail::SampleMixtureBatch(samples, batch_size, batchBuffer), G, flatMeans, flatInvSigmas, weights, maxSigmaDist, batchStats);
+			if (iter == 0) {
+				stats = batchStats;
+			} else {
+				stats.blend(batchStats, std::pow(iter + 2.0, -0.7));
+			}
+		} else {
+			detail::EstimateMixture(samples, G, flatMeans, flatInvSigmas, weights, maxSigmaDist, stats);
 		}
-		logl /= N;
 		for (int k = 0; k < G; k++) {
-			float3 mean;
-			mean = float3(0.0f);
-			double alpha = 0;
-			for (int n = 0; n < N; n++) {
-				float3 sample = data[n];
-				alpha += W[n][k];
-				mean += W[n][k] * sample;
-			}
-			if(alpha>0){
-				mean /= (float) alpha;
-				means[k]=mean;
+			if (stats.weights[k] > 0) {
 				float3x3& cov = sigmas[k];
-				cov = float3x3::zero();
-				for (int n = 0; n < N; n++) {
-					float3 sample = data[n];
-					float3 diff = (sample - mean);
-					float w = W[n][k] / alpha;
-					for (int ii = 0; ii < 3; ii++) {
-						for (int jj = 0; jj < 3; jj++) {
-							cov[ii][jj] += w * diff[ii] * diff[jj];
-						}
+				for (int ii = 0; ii < 3; ii++) {
+					means[k][ii] = float(stats.means[k * 3 + ii]);
+					for (int jj = 0; jj < 3; jj++) {
+						cov(ii, jj) = float(stats.covariances[(k * 3 + ii) * 3 + jj]);
 					}
 				}
-				priors[k] = alpha / N;
+				priors[k] = float(stats.weights[k]);
 			}
 		}
-		if (std::abs(logl - lastlogl) < CONV_TOLERANCE) {
-			break;
+		//Batch likelihoods are too noisy to test for convergence.
+		if (!miniBatch) {
+			if (std::abs(stats.logLikelihood - lastlogl) < CONV_TOLERANCE) {
+				break;
+			}
+			lastlogl = stats.logLikelihood;
 		}
-		lastlogl = logl;
 	}
 	return true;
 }
@@ -712,10 +712,12 @@ float3 KDTriangle::intersectionPointRay(const float3& org,
 	}
 	return NO_HIT_POINT;
 }
-double KDTriangle::distance(const float3& p, float3& lastIntersect) const {
-	float3 p1 = pts[0];
-	float3 p2 = pts[1];
-	float3 p3 = pts[2];
+/*
+ Distance from p to triangle (p1,p2,p3). Shared by KDTriangle and the flattened hierarchy,
+ which stores triangle vertices in SoA order.
+ */
+static double DistanceToTriangle(const float3& p, const float3& p1,
+		const float3& p2, const float3& p3, float3& lastIntersect) {
 	float3 kDiff = (p1 - p);
 	float3 kEdge0 = (p2 - p1);
 	float3 kEdge1 = (p3 - p1);
@@ -887,10 +889,14 @@ double KDTriangle::distance(const float3& p, float3& lastIntersect) const {
 	if (fSqrDistance < (float) 0.0) {
 		fSqrDistance = (float) 0.0;
 	}
-	lastIntersect = pts[0] + kEdge0 * (float) fS + kEdge1 * (float) fT;
+	lastIntersect = p1 + kEdge0 * (float) fS + kEdge1 * (float) fT;
 	return std::sqrt(fSqrDistance);
 }
+double KDTriangle::distance(const float3& p, float3& lastIntersect) const {
+	return DistanceToTriangle(p, pts[0], pts[1], pts[2], lastIntersect);
+}
 void Intersector::build(const Mesh& mesh, int maxDepth) {
+	reset();
 	root = std::shared_ptr<KDBox>(new KDBox());
 	uint64_t id = 0;
 	KDTriangle* tri;
@@ -933,247 +939,216 @@ void Intersector::build(const Mesh& mesh, int maxDepth) {
 	root->update();
 	buildTree(maxDepth);
 }
-void Intersector::buildTree(int maxDepth) {
-	std::list<KDBox*> boxes;
-	boxes.push_back(root.get());
-	int sz;
-	int splitPos;
-	KDBox* leftChild;
-	KDBox* rightChild;
-	int depthCount = 0;
-	while (boxes.size() > 0) {
-		KDBox* box = boxes.front();
-		boxes.pop_front();
-		if (box->getDepth() > maxDepth)
-			continue;
-		if (box->getDepth() > depthCount) {
-			depthCount = box->getDepth();
-		}
-		std::vector<KDBox*>& children = box->getChildren();
-		if (children.size() < 2)
-			continue;
-		sz = (int) children.size() * 2;
-		std::vector<KDBoxEdge> edges;
-		splitPos = splitPosition(children, edges, box);
-		if (splitPos <= 0 || splitPos == sz - 1) {
-			continue;
-		}
-		storage.push_back(
-				std::shared_ptr<KDBox>(
-						leftChild = new KDBox(box->getDepth() + 1)));
-		storage.push_back(
-				std::shared_ptr<KDBox>(
-						rightChild = new KDBox(box->getDepth() + 1)));
-		std::vector<KDBox*>& lchildren = leftChild->getChildren();
-		std::vector<KDBox*>& rchildren = rightChild->getChildren();
-		for (int i = 0; i < splitPos; i++) {
-			if (edges[i].isMin()) {
-				edges[i].getBox()->setDepth(leftChild->getDepth() + 1);
-				lchildren.push_back(edges[i].getBox());
-
-			}
-		}
-		for (int i = splitPos + 1; i < sz; i++) {
-			if (!edges[i].isMin()) {
-				edges[i].getBox()->setDepth(rightChild->getDepth() + 1);
-				rchildren.push_back(edges[i].getBox());
-			}
-		}
-		if (lchildren.size() >= children.size()
-				|| rchildren.size() >= children.size()) {
-			continue;
-		}
-		leftChild->update();
-		rightChild->update();
-		children.clear();
-		children.push_back(leftChild);
-		children.push_back(rightChild);
-		box->update();
-		//std::cout << "Left: " << *leftChild<<std::endl;
-		//std::cout << "Right: " << *rightChild << std::endl;
-		boxes.push_back(leftChild);
-		boxes.push_back(rightChild);
-
+namespace detail {
+struct KDBuildBounds {
+	float3 minPoint;
+	float3 maxPoint;
+	KDBuildBounds() :
+			minPoint(1E30f), maxPoint(-1E30f) {
+	}
+	void add(const float3& pt) {
+		minPoint = aly::min(minPoint, pt);
+		maxPoint = aly::max(maxPoint, pt);
+	}
+	void add(const KDBuildBounds& b) {
+		minPoint = aly::min(minPoint, b.minPoint);
+		maxPoint = aly::max(maxPoint, b.maxPoint);
 	}
+	double area() const {
+		float3 d = aly::max(maxPoint - minPoint, float3(0.0f));
+		return 2.0 * ((double) d.x * d.y + (double) d.y * d.z + (double) d.z * d.x);
+	}
+};
+struct KDBuildTask {
+	int node;
+	uint32_t start;
+	uint32_t end;
+	int depth;
+};
+struct KDBuildNode {
+	KDBuildBounds bounds;
+	int left = -1, right = -1;
+	uint32_t start = 0, count = 0;
+	int axis = 0;
+};
 }
-int Intersector::splitPosition(std::vector<KDBox*>& children,
-		std::vector<KDBoxEdge>& edges, KDBox* box) {
-	int nAbove = 0;
-	int nBelow = 0;
-	double pAbove = 0;
-	double pBelow = 0;
-	double cost = 0;
-	int dim = 0;
-	int bestSplit = -1;
-	double sum = 0;
-	double prod = 0;
-	double voxel;
-	double val;
-	double minCost;
-	int sz;
-	//KDBoxEdge e1, e2;
-	float3 v = box->getMax() - box->getMin();
-	if (v.x > v.y && v.x > v.z)
-		dim = 0;
-	else if (v.y > v.z)
-		dim = 1;
-	else
-		dim = 2;
-	int retry = 3;
-	voxel = 1.0 / (v.x + v.y + v.z);
-	do {
-		bestSplit = -1;
-		switch (dim) {
-		case 0:
-			sum = v.y + v.z;
-			prod = v.y * v.z;
-			break;
-		case 1:
-			sum = v.x + v.z;
-			prod = v.x * v.z;
-			break;
-		case 2:
-			sum = v.x + v.y;
-			prod = v.x * v.y;
-			break;
-		}
-
-		sz = (int) children.size() * 2;
-		edges.resize(sz);
-		for (int i = 0; i < sz; i++) {
-			KDBox* child = children[i / 2];
-			edges[i] = KDBoxEdge(child, dim, (i % 2 == 1) ? true : false);
-		}
+/*
+ Binned SAH builder. All nodes on one level are split concurrently, and each node partitions
+ its own contiguous range of the triangle permutation.
 
-		std::sort(edges.begin(), edges.end(),
-				[](const KDBoxEdge& e1, const KDBoxEdge& e2) {
-					return (e1.getValue() < e2.getValue());
-				});
-		for (int i = 0; i < (int) edges.size() - 1; i++) {
-			KDBoxEdge& e1 = edges[i];
-			KDBoxEdge& e2 = edges[i + 1];
-			if (e1.getValue() == e2.getValue()) {
-				if (!e1.isMin() && e2.isMin()) {
-					std::swap(e1, e2);
-				}
+ Wald, I. (2007). On fast construction of SAH-based bounding volume hierarchies. IEEE
+ Symposium on Interactive Ray Tracing, 33-40.
+ */
+void Intersector::buildTree(int maxDepth) {
+	using namespace detail;
+	static const int BIN_COUNT = 16;
+	std::vector<KDBox*>& children = root->getChildren();
+	const uint32_t N = (uint32_t) children.size();
+	if (N == 0) {
+		return;
+	}
+	maxDepth = clamp(maxDepth, 1, MAX_TREE_DEPTH - 1);
+	std::vector<KDBuildBounds> primBounds(N);
+	std::vector<float3> centroids(N);
+	std::vector<uint32_t> order(N);
+#pragma omp parallel for
+	for (int i = 0; i < (int) N; i++) {
+		primBounds[i].minPoint = children[i]->getMin();
+		primBounds[i].maxPoint = children[i]->getMax();
+		centroids[i] = 0.5f * (primBounds[i].minPoint + primBounds[i].maxPoint);
+		order[i] = i;
+	}
+	std::vector<KDBuildNode> buildNodes(1);
+	std::vector<KDBuildTask> level(1);
+	level[0].node = 0;
+	level[0].start = 0;
+	level[0].end = N;
+	level[0].depth = 0;
+	while (level.size() > 0) {
+		std::vector<uint32_t> splits(level.size(), 0);
+		std::vector<KDBuildBounds> bounds(level.size());
+#pragma omp parallel for schedule(dynamic)
+		for (int t = 0; t < (int) level.size(); t++) {
+			const KDBuildTask& task = level[t];
+			KDBuildBounds box, cbox;
+			for (uint32_t i = task.start; i < task.end; i++) {
+				box.add(primBounds[order[i]]);
+				cbox.add(centroids[order[i]]);
 			}
-		}
-		nBelow = 0;
-		nAbove = (int) children.size();
-		// Do not assume prior minimum cost because the spherical
-		// orientation
-		// is in some sense optimal when rays are cast from outside the
-		// sphere.
-		// If minimum cost is assumed, then no branches in kd-tree will be
-		// generated
-		// minCost=intersectCost*nAbove;
-		minCost = 1E30;
-
-		KDBoxEdge e1(box, dim, true);
-		KDBoxEdge e2(box, dim, false);
-		for (int i = 0; i < sz; i++) {
-			if (!edges[i].isMin())
-				nAbove--;
-			val = edges[i].getValue();
-			if (val > e1.getValue() && e2.getValue() > val) {
-				pBelow = (sum * (val - e1.getValue()) + prod) * voxel;
-				pAbove = (sum * (e2.getValue() - val) + prod) * voxel;
-				cost = traversalCost
-						+ intersectCost
-								* (1
-										- ((nAbove == 0 || nBelow == 0) ?
-												emptyBonus : 0))
-								* (pBelow * nBelow + pAbove * nAbove);
-				if (cost < minCost) {
-					minCost = cost;
-					bestSplit = i;
-				}
+			bounds[t] = box;
+			uint32_t count = task.end - task.start;
+			if (count <= (uint32_t) MAX_LEAF_SIZE || task.depth >= maxDepth) {
+				continue;
 			}
-			if (edges[i].isMin())
-				nBelow++;
-		}
-		dim = (dim + 1) % 3;
-		retry--;
-	} while (bestSplit == -1 && retry > 0);
-	return bestSplit;
-}
-double Intersector::intersectRayDistance(const float3& p1, const float3& v,
-		float3& lastPoint, KDTriangle*& lastTriangle) const {
-	if (root->getChildren().size() == 0)
-		throw new std::runtime_error("KD-Tree has not been initialized.");
-	std::list<KDBox*> boxes;
-	boxes.push_back(getRoot());
-	double d;
-	double mind = 1E30;
-	KDTriangle* resultTriangle = nullptr;
-	float3 resultIntersect = NO_HIT_POINT;
-	KDTriangle* tri;
-	while (boxes.size() > 0) {
-		KDBox* box = boxes.front();
-		//std::cout << *box << std::endl;
-		boxes.pop_front();
-		if (box->intersectRayBox(p1, v)) {
-			if (box->isLeaf) {
-				tri = dynamic_cast<KDTriangle*>(box);
-				float3 intersect = tri->intersectionPointRay(p1, v);
-				if (intersect != NO_HIT_POINT) {
-					d = distance(p1, intersect);
-					if (d < mind) {
-						mind = d;
-						resultTriangle = tri;
-						resultIntersect = intersect;
+			double bestCost = 1E30;
+			int bestAxis = -1;
+			int bestBin = -1;
+			for (int axis = 0; axis < 3; axis++) {
+				float cmin = cbox.minPoint[axis];
+				float cmax = cbox.maxPoint[axis];
+				if (cmax <= cmin) {
+					continue;
+				}
+				float scale = BIN_COUNT / (cmax - cmin);
+				KDBuildBounds binBounds[BIN_COUNT];
+				uint32_t binCounts[BIN_COUNT] = { 0 };
+				for (uint32_t i = task.start; i < task.end; i++) {
+					uint32_t prim = order[i];
+					int b = std::min(BIN_COUNT - 1,
+							(int) ((centroids[prim][axis] - cmin) * scale));
+					binCounts[b]++;
+					binBounds[b].add(primBounds[prim]);
+				}
+				double rightArea[BIN_COUNT];
+				uint32_t rightCount[BIN_COUNT];
+				KDBuildBounds acc;
+				uint32_t accCount = 0;
+				for (int b = BIN_COUNT - 1; b > 0; b--) {
+					acc.add(binBounds[b]);
+					accCount += binCounts[b];
+					rightArea[b] = acc.area();
+					rightCount[b] = accCount;
+				}
+				acc = KDBuildBounds();
+				accCount = 0;
+				for (int b = 0; b < BIN_COUNT - 1; b++) {
+					acc.add(binBounds[b]);
+					accCount += binCounts[b];
+					if (accCount == 0 || rightCount[b + 1] == 0) {
+						continue;
+					}
+					double cost = acc.area() * accCount
+							+ rightArea[b + 1] * rightCount[b + 1];
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = b;
 					}
 				}
 			}
-			boxes.insert(boxes.end(), box->getChildren().begin(),
-					box->getChildren().end());
+			double area = box.area();
+			double leafCost = intersectCost * count;
+			double splitCost = traversalCost
+					+ ((area > 0) ? intersectCost * bestCost / area : leafCost);
+			if (bestAxis < 0 || splitCost >= leafCost) {
+				continue;
+			}
+			float cmin = cbox.minPoint[bestAxis];
+			float scale = BIN_COUNT / (cbox.maxPoint[bestAxis] - cmin);
+			auto mid = std::partition(order.begin() + task.start,
+					order.begin() + task.end,
+					[&](uint32_t prim) {
+						return std::min(BIN_COUNT - 1,
+								(int) ((centroids[prim][bestAxis] - cmin) * scale)) <= bestBin;
+					});
+			splits[t] = (uint32_t) (mid - order.begin());
+			buildNodes[task.node].axis = bestAxis;
 		}
+		std::vector<KDBuildTask> next;
+		for (int t = 0; t < (int) level.size(); t++) {
+			const KDBuildTask& task = level[t];
+			KDBuildNode& node = buildNodes[task.node];
+			node.bounds = bounds[t];
+			if (splits[t] == 0) {
+				node.start = task.start;
+				node.count = task.end - task.start;
+				continue;
+			}
+			KDBuildTask left, right;
+			left.node = (int) buildNodes.size();
+			right.node = left.node + 1;
+			left.start = task.start;
+			left.end = splits[t];
+			right.start = splits[t];
+			right.end = task.end;
+			left.depth = right.depth = task.depth + 1;
+			buildNodes[task.node].left = left.node;
+			buildNodes[task.node].right = right.node;
+			buildNodes.resize(buildNodes.size() + 2);
+			next.push_back(left);
+			next.push_back(right);
+		}
+		level.swap(next);
 	}
-	lastTriangle = resultTriangle;
-	lastPoint = resultIntersect;
-	if (resultTriangle == nullptr) {
-		return NO_HIT_DISTANCE;
-	} else {
-		return mind;
-	}
-}
-double Intersector::intersectSegmentDistance(const float3& p1, const float3& p2,
-		float3& lastPoint, KDTriangle*& lastTriangle) const {
-	if (root->getChildren().size() == 0)
-		throw new std::runtime_error("KD-Tree has not been initialized.");
-	std::list<KDBox*> boxes;
-	boxes.push_back(getRoot());
-	double d;
-	double mind = 1E30;
-	KDTriangle* resultTriangle = nullptr;
-	float3 resultIntersect = NO_HIT_POINT;
-	KDTriangle* tri;
-	while (boxes.size() > 0) {
-		KDBox* box = boxes.front();
-		boxes.pop_front();
-		if (box->intersectSegmentBox(p1, p2)) {
-			if (box->isLeaf) {
-				tri = dynamic_cast<KDTriangle*>(box);
-				float3 intersect = tri->intersectionPointSegment(p1, p2);
-				if (intersect != NO_HIT_POINT) {
-					d = distance(p1, intersect);
-					if (d < mind) {
-						mind = d;
-						resultTriangle = tri;
-						resultIntersect = intersect;
-					}
-				}
+	//Lay nodes out depth-first so the first child always follows its parent.
+	nodes.resize(buildNodes.size());
+	std::vector<std::pair<int, int>> stack;
+	stack.push_back(std::pair<int, int>(0, -1));
+	uint32_t index = 0;
+	while (stack.size() > 0) {
+		std::pair<int, int> item = stack.back();
+		stack.pop_back();
+		const KDBuildNode& bnode = buildNodes[item.first];
+		if (item.second >= 0) {
+			nodes[item.second].offset = index;
+		}
+		KDFlatNode& node = nodes[index];
+		node.minPoint = bnode.bounds.minPoint;
+		node.maxPoint = bnode.bounds.maxPoint;
+		node.axis = (uint16_t) bnode.axis;
+		if (bnode.left < 0) {
+			//Leaves larger than MAX_LEAF_SIZE only occur when maxDepth is reached.
+			if (bnode.count > 65535) {
+				throw std::runtime_error(
+						MakeString() << "Intersector leaf exceeds 65535 triangles ("
+								<< bnode.count << "). Increase maxDepth.");
 			}
-			boxes.insert(boxes.end(), box->getChildren().begin(),
-					box->getChildren().end());
+			node.offset = bnode.start;
+			node.count = (uint16_t) bnode.count;
+		} else {
+			node.count = 0;
+			stack.push_back(std::pair<int, int>(bnode.right, (int) index));
+			stack.push_back(std::pair<int, int>(bnode.left, -1));
 		}
+		index++;
 	}
-	lastTriangle = resultTriangle;
-	lastPoint = resultIntersect;
-	if (resultTriangle == nullptr) {
-		return NO_HIT_DISTANCE;
-	} else {
-		return mind;
+	triangles.resize(N);
+	triangleRefs.resize(N);
+#pragma omp parallel for
+	for (int i = 0; i < (int) N; i++) {
+		KDTriangle* tri = static_cast<KDTriangle*>(children[order[i]]);
+		triangleRefs[i] = tri;
+		triangles.set(i, tri->getVertex(0), tri->getVertex(1), tri->getVertex(2));
 	}
 }
 double Intersector::closestPointSignedDistance(const float3& r, float3& lastPoint,
@@ -1201,129 +1176,356 @@ double Intersector::closestPointSignedDistance(const float3& r,const float& maxD
 		return NO_HIT_DISTANCE;
 	}
 }
-double Intersector::closestPoint(const float3& pt, const float& maxDistance,
+static inline float DistanceSqrToNode(const KDFlatNode& node, const float3& pt) {
+	float dx = std::max(std::max(node.minPoint.x - pt.x, pt.x - node.maxPoint.x), 0.0f);
+	float dy = std::max(std::max(node.minPoint.y - pt.y, pt.y - node.maxPoint.y), 0.0f);
+	float dz = std::max(std::max(node.minPoint.z - pt.z, pt.z - node.maxPoint.z), 0.0f);
+	return dx * dx + dy * dy + dz * dz;
+}
+/*
+ Slab test against ray org + t * dir for t in [0, maxT]. Zero direction components are nudged so
+ the reciprocal stays finite, which avoids NaNs without branching. Returns the entry parameter or
+ a negative value on a miss.
+ */
+static inline float3 SafeInverse(const float3& v) {
+	static const float TINY = 1E-30f;
+	return float3(1.0f / ((std::abs(v.x) > TINY) ? v.x : TINY),
+			1.0f / ((std::abs(v.y) > TINY) ? v.y : TINY),
+			1.0f / ((std::abs(v.z) > TINY) ? v.z : TINY));
+}
+static inline float IntersectRayNode(const KDFlatNode& node, const float3& org,
+		const float3& inv, float maxT) {
+	float t1 = (node.minPoint.x - org.x) * inv.x;
+	float t2 = (node.maxPoint.x - org.x) * inv.x;
+	float tmin = std::min(t1, t2);
+	float tmax = std::max(t1, t2);
+	t1 = (node.minPoint.y - org.y) * inv.y;
+	t2 = (node.maxPoint.y - org.y) * inv.y;
+	tmin = std::max(tmin, std::min(t1, t2));
+	tmax = std::min(tmax, std::max(t1, t2));
+	t1 = (node.minPoint.z - org.z) * inv.z;
+	t2 = (node.maxPoint.z - org.z) * inv.z;
+	tmin = std::max(tmin, std::min(t1, t2));
+	tmax = std::min(tmax, std::max(t1, t2));
+	tmin = std::max(tmin, 0.0f);
+	return (tmin <= tmax && tmin <= maxT) ? tmin : -1.0f;
+}
+double Intersector::intersectDistance(const float3& p1, const float3& v,
+		float maxT, bool segment, float3& lastPoint,
+		KDTriangle*& lastTriangle) const {
+	if (nodes.size() == 0)
+		throw new std::runtime_error("KD-Tree has not been initialized.");
+	const float3 inv = SafeInverse(v);
+	const float vlen = length(v);
+	double mind = 1E30;
+	KDTriangle* resultTriangle = nullptr;
+	float3 resultIntersect = NO_HIT_POINT;
+	uint32_t stack[MAX_TREE_DEPTH * 2];
+	float stackT[MAX_TREE_DEPTH * 2];
+	int top = 0;
+	float t = IntersectRayNode(nodes[0], p1, inv, maxT);
+	if (t >= 0) {
+		stackT[top] = t;
+		stack[top++] = 0;
+	}
+	while (top > 0) {
+		top--;
+		if (stackT[top] * vlen > mind) {
+			continue;
+		}
+		uint32_t index = stack[top];
+		const KDFlatNode& node = nodes[index];
+		if (node.isLeaf()) {
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+				KDTriangle* tri = triangleRefs[i];
+				float3 intersect =
+						(segment) ?
+								tri->intersectionPointSegment(p1, p1 + v) :
+								tri->intersectionPointRay(p1, v);
+				if (intersect != NO_HIT_POINT) {
+					double d = distance(p1, intersect);
+					if (d < mind) {
+						mind = d;
+						resultTriangle = tri;
+						resultIntersect = intersect;
+					}
+				}
+			}
+		} else {
+			uint32_t first = index + 1;
+			uint32_t second = node.offset;
+			float t1 = IntersectRayNode(nodes[first], p1, inv, maxT);
+			float t2 = IntersectRayNode(nodes[second], p1, inv, maxT);
+			//Push the farther child first so the nearer one is visited next.
+			if (t1 >= 0 && t2 >= 0 && t1 < t2) {
+				std::swap(first, second);
+				std::swap(t1, t2);
+			}
+			if (t1 >= 0) {
+				stackT[top] = t1;
+				stack[top++] = first;
+			}
+			if (t2 >= 0) {
+				stackT[top] = t2;
+				stack[top++] = second;
+			}
+		}
+	}
+	lastTriangle = resultTriangle;
+	lastPoint = resultIntersect;
+	if (resultTriangle == nullptr) {
+		return NO_HIT_DISTANCE;
+	} else {
+		return mind;
+	}
+}
+double Intersector::intersectRayDistance(const float3& p1, const float3& v,
+		float3& lastPoint, KDTriangle*& lastTriangle) const {
+	return intersectDistance(p1, v, std::numeric_limits<float>::max(), false,
+			lastPoint, lastTriangle);
+}
+double Intersector::intersectSegmentDistance(const float3& p1, const float3& p2,
 		float3& lastPoint, KDTriangle*& lastTriangle) const {
-	if (root->getChildren().size() == 0)
+	return intersectDistance(p1, p2 - p1, 1.0f, true, lastPoint, lastTriangle);
+}
+double Intersector::closestPoint(const float3& pt, double maxDistance,
+		bool inclusive, float3& lastPoint, KDTriangle*& lastTriangle) const {
+	if (nodes.size() == 0)
 		throw new std::runtime_error("KD-Tree has not been initialized.");
-	double d;
 	double triangleDist = maxDistance;
-	std::priority_queue<KDBoxDistance,std::vector<KDBoxDistance>,CompareKDBox> queue;
-	queue.push(KDBoxDistance(pt, getRoot()));
-	lastTriangle = nullptr;
+	double triangleDistSqr = (maxDistance < 1E30) ? maxDistance * maxDistance : 1E60;
+	int bestIndex = -1;
+	float3 lastIntersect;
 	lastPoint = NO_HIT_POINT;
-	float3 lastIntersect = NO_HIT_POINT;
-	while (queue.size() > 0) {
-		KDBoxDistance boxd = queue.top();
-		queue.pop();
-		if (boxd.box->isLeaf) {
-			KDTriangle* tri = dynamic_cast<KDTriangle*>(boxd.box);
-			d = tri->distance(pt, lastIntersect);
-			if (d <= triangleDist) {
-				triangleDist = d;
-				lastTriangle = tri;
-				lastPoint = lastIntersect;
+	uint32_t stack[MAX_TREE_DEPTH * 2];
+	float stackD[MAX_TREE_DEPTH * 2];
+	int top = 0;
+	stackD[top] = DistanceSqrToNode(nodes[0], pt);
+	stack[top++] = 0;
+	while (top > 0) {
+		top--;
+		if (stackD[top] > triangleDistSqr) {
+			continue;
+		}
+		uint32_t index = stack[top];
+		const KDFlatNode& node = nodes[index];
+		if (node.isLeaf()) {
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+				double d = DistanceToTriangle(pt, triangles.get(i, 0),
+						triangles.get(i, 1), triangles.get(i, 2), lastIntersect);
+				if (d < triangleDist || (inclusive && d == triangleDist)) {
+					triangleDist = d;
+					triangleDistSqr = d * d;
+					bestIndex = (int) i;
+					lastPoint = lastIntersect;
+				}
 			}
 		} else {
-			for (KDBox* child : boxd.box->getChildren()) {
-				KDBoxDistance kdb(pt, child);
-				if (kdb.dist <= maxDistance) {
-					queue.push(kdb);
-				}
+			uint32_t first = index + 1;
+			uint32_t second = node.offset;
+			float d1 = DistanceSqrToNode(nodes[first], pt);
+			float d2 = DistanceSqrToNode(nodes[second], pt);
+			if (d1 < d2) {
+				std::swap(first, second);
+				std::swap(d1, d2);
 			}
+			stackD[top] = d1;
+			stack[top++] = first;
+			stackD[top] = d2;
+			stack[top++] = second;
 		}
 	}
-	if (lastTriangle == nullptr) {
+	if (bestIndex < 0) {
+		lastTriangle = nullptr;
 		return NO_HIT_DISTANCE;
 	} else {
+		lastTriangle = triangleRefs[bestIndex];
 		return triangleDist;
 	}
 }
+double Intersector::closestPoint(const float3& pt, const float& maxDistance,
+		float3& lastPoint, KDTriangle*& lastTriangle) const {
+	return closestPoint(pt, (double) maxDistance, true, lastPoint, lastTriangle);
+}
 double Intersector::closestPoint(const float3& pt, float3& lastPoint,
 		KDTriangle*& lastTriangle) const {
-	if (root->getChildren().size() == 0)
+	return closestPoint(pt, 1E30, false, lastPoint, lastTriangle);
+}
+double Intersector::closestPointOutside(const float3& r, const float3& v,
+		float3& lastPoint, KDTriangle*& lastTriangle) const {
+	if (nodes.size() == 0)
 		throw new std::runtime_error("KD-Tree has not been initialized.");
-	double d;
-	double mind = 1E30;
 	double triangleDist = 1E30;
-	std::priority_queue<KDBoxDistance,std::vector<KDBoxDistance>,CompareKDBox> queue;
-	queue.push(KDBoxDistance(pt, getRoot()));
-	lastTriangle = nullptr;
+	int bestIndex = -1;
+	float3 lastIntersect;
 	lastPoint = NO_HIT_POINT;
-	float3 lastIntersect = NO_HIT_POINT;
-	while (queue.size() > 0) {
-		KDBoxDistance boxd = queue.top();
-		queue.pop();
-		if (boxd.dist <= mind || boxd.box->isLeaf) {
-			if (boxd.box->isLeaf) {
-				mind = boxd.dist;
-				KDTriangle* tri = dynamic_cast<KDTriangle*>(boxd.box);
-				d = tri->distance(pt, lastIntersect);
-				if (d < triangleDist) {
+	uint32_t stack[MAX_TREE_DEPTH * 2];
+	float stackD[MAX_TREE_DEPTH * 2];
+	int top = 0;
+	stackD[top] = DistanceSqrToNode(nodes[0], r);
+	stack[top++] = 0;
+	while (top > 0) {
+		top--;
+		if (stackD[top] > triangleDist * triangleDist) {
+			continue;
+		}
+		uint32_t index = stack[top];
+		const KDFlatNode& node = nodes[index];
+		if (node.isLeaf()) {
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+				double d = DistanceToTriangle(r, triangles.get(i, 0),
+						triangles.get(i, 1), triangles.get(i, 2), lastIntersect);
+				// Test if point is on one side of plane
+				if (d < triangleDist && dot(lastIntersect - r, v) >= 0) {
 					triangleDist = d;
-					lastTriangle = tri;
+					bestIndex = (int) i;
 					lastPoint = lastIntersect;
 				}
-			} else {
-				for (KDBox* child : boxd.box->getChildren()) {
-					KDBoxDistance kdb(pt, child);
-					queue.push(kdb);
-				}
 			}
+		} else {
+			uint32_t first = index + 1;
+			uint32_t second = node.offset;
+			float d1 = DistanceSqrToNode(nodes[first], r);
+			float d2 = DistanceSqrToNode(nodes[second], r);
+			if (d1 < d2) {
+				std::swap(first, second);
+				std::swap(d1, d2);
+			}
+			stackD[top] = d1;
+			stack[top++] = first;
+			stackD[top] = d2;
+			stack[top++] = second;
 		}
 	}
-	if (lastTriangle == nullptr) {
+	if (bestIndex < 0) {
+		lastTriangle = nullptr;
 		return NO_HIT_DISTANCE;
 	} else {
+		lastTriangle = triangleRefs[bestIndex];
 		return triangleDist;
 	}
 }
-
-double Intersector::closestPointOutside(const float3& r, const float3& v,
-		float3& lastPoint, KDTriangle*& lastTriangle) const {
-	if (root->getChildren().size() == 0)
+void Intersector::intersectRayDistance(const std::vector<float3>& origins,
+		const std::vector<float3>& directions, std::vector<double>& distances,
+		std::vector<float3>& lastPoints) const {
+	if (origins.size() != directions.size()) {
+		throw std::runtime_error(
+				MakeString() << "Ray origin and direction counts differ "
+						<< origins.size() << " != " << directions.size());
+	}
+	if (nodes.size() == 0)
 		throw new std::runtime_error("KD-Tree has not been initialized.");
-
-	double d;
-	double mind = 1E30;
-	double triangleDist = 1E30;
-	std::priority_queue<KDBoxDistance,std::vector<KDBoxDistance>,CompareKDBox> queue;
-	queue.push(KDBoxDistance(r, getRoot()));
-
-	lastTriangle = nullptr;
-	lastPoint = NO_HIT_POINT;
-	float3 pt;
-	float3 testv;
-	float3 lastIntersect;
-	while (queue.size() > 0) {
-		KDBoxDistance boxd = queue.top();
-		queue.pop();
-		if (boxd.dist <= mind || boxd.box->isLeaf) {
-			if (boxd.box->isLeaf) {
-				mind = boxd.dist;
-				KDTriangle* tri = dynamic_cast<KDTriangle*>(boxd.box);
-				d = tri->distance(r, lastIntersect);
-				boxd.dist = d;
-				if (d < triangleDist) {
-					pt = lastIntersect;
-					testv = pt - r;
-					// Test if point is on one side of plane
-					if (dot(testv, v) >= 0) {
-						triangleDist = d;
-						lastTriangle = tri;
-						lastPoint = pt;
+	const int K = RAY_PACKET_SIZE;
+	const int N = (int) origins.size();
+	distances.resize(N);
+	lastPoints.resize(N);
+	const int packets = (N + K - 1) / K;
+#pragma omp parallel for schedule(dynamic)
+	for (int p = 0; p < packets; p++) {
+		const int start = p * K;
+		const int count = std::min(K, N - start);
+		float ox[K], oy[K], oz[K], ix[K], iy[K], iz[K], vlen[K], best[K];
+		float3 hits[K];
+		for (int k = 0; k < K; k++) {
+			int n = start + std::min(k, count - 1);
+			float3 inv = SafeInverse(directions[n]);
+			ox[k] = origins[n].x;
+			oy[k] = origins[n].y;
+			oz[k] = origins[n].z;
+			ix[k] = inv.x;
+			iy[k] = inv.y;
+			iz[k] = inv.z;
+			vlen[k] = length(directions[n]);
+			best[k] = (k < count) ? std::numeric_limits<float>::max() : -1.0f;
+			hits[k] = NO_HIT_POINT;
+		}
+		uint32_t stack[MAX_TREE_DEPTH * 2];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			uint32_t index = stack[--top];
+			const KDFlatNode& node = nodes[index];
+			int active[K];
+			int any = 0;
+#pragma omp simd reduction(+:any)
+			for (int k = 0; k < K; k++) {
+				float t1 = (node.minPoint.x - ox[k]) * ix[k];
+				float t2 = (node.maxPoint.x - ox[k]) * ix[k];
+				float tmin = std::min(t1, t2);
+				float tmax = std::max(t1, t2);
+				t1 = (node.minPoint.y - oy[k]) * iy[k];
+				t2 = (node.maxPoint.y - oy[k]) * iy[k];
+				tmin = std::max(tmin, std::min(t1, t2));
+				tmax = std::min(tmax, std::max(t1, t2));
+				t1 = (node.minPoint.z - oz[k]) * iz[k];
+				t2 = (node.maxPoint.z - oz[k]) * iz[k];
+				tmin = std::max(std::max(tmin, std::min(t1, t2)), 0.0f);
+				tmax = std::min(tmax, std::max(t1, t2));
+				active[k] = (tmin <= tmax && tmin * vlen[k] <= best[k]) ? 1 : 0;
+				any += active[k];
+			}
+			if (any == 0) {
+				continue;
+			}
+			if (node.isLeaf()) {
+				for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+					KDTriangle* tri = triangleRefs[i];
+					for (int k = 0; k < count; k++) {
+						if (!active[k]) {
+							continue;
+						}
+						float3 org(ox[k], oy[k], oz[k]);
+						float3 intersect = tri->intersectionPointRay(org,
+								directions[start + k]);
+						if (intersect != NO_HIT_POINT) {
+							float d = distance(org, intersect);
+							if (d < best[k]) {
+								best[k] = d;
+								hits[k] = intersect;
+							}
+						}
 					}
 				}
 			} else {
-				for (KDBox* child : boxd.box->getChildren()) {
-					queue.push(KDBoxDistance(pt, child));
+				//The first child holds the lower half along the split axis. Visit the near side first.
+				float dir = (node.axis == 0) ? ix[0] : ((node.axis == 1) ? iy[0] : iz[0]);
+				if (dir < 0) {
+					stack[top++] = index + 1;
+					stack[top++] = node.offset;
+				} else {
+					stack[top++] = node.offset;
+					stack[top++] = index + 1;
 				}
 			}
 		}
+		for (int k = 0; k < count; k++) {
+			bool hit = (hits[k] != NO_HIT_POINT);
+			distances[start + k] = hit ? (double) best[k] : NO_HIT_DISTANCE;
+			lastPoints[start + k] = hits[k];
+		}
 	}
-	if (lastTriangle == nullptr) {
-		return NO_HIT_DISTANCE;
-	} else {
-		return mind;
+}
+void Intersector::closestPoint(const std::vector<float3>& pts,
+		std::vector<double>& distances, std::vector<float3>& lastPoints,
+		float maxDistance) const {
+	distances.resize(pts.size());
+	lastPoints.resize(pts.size());
+#pragma omp parallel for schedule(dynamic,256)
+	for (int i = 0; i < (int) pts.size(); i++) {
+		KDTriangle* tri;
+		distances[i] = closestPoint(pts[i], (double) maxDistance, true,
+				lastPoints[i], tri);
+	}
+}
+void Intersector::closestPointSignedDistance(const std::vector<float3>& pts,
+		std::vector<double>& distances, float maxDistance) const {
+	distances.resize(pts.size());
+#pragma omp parallel for schedule(dynamic,256)
+	for (int i = 0; i < (int) pts.size(); i++) {
+		float3 lastPoint;
+		KDTriangle* tri;
+		distances[i] = closestPointSignedDistance(pts[i], maxDistance,
+				lastPoint, tri);
 	}
 }
 
@@ -365,8 +365,8 @@ const int IsoSurface::triangleConnectionTable[4096] = { -1, -1, -1, -1, -1, -1,
 
 IsoSurface::IsoSurface() :
 		isoLevel(0), rows(0), cols(0), slices(0), winding(Winding::Clockwise), backgroundValue(
-				std::numeric_limits<float>::infinity()), skipHidden(true), triangleCount(
-				0) {
+				std::numeric_limits<float>::infinity()), skipHidden(true), slabParallel(
+				true), triangleCount(0) {
 }
 
 IsoSurface::~IsoSurface() {
@@ -403,6 +403,16 @@ void IsoSurface::solve(const Volume1f& data, Mesh& mesh, const MeshType& type,
 		bool regularize, const float& isoLevel) {
 	std::vector<int3> narrowBandList;
 	backgroundValue = 1E30f;
+	if (slabParallel && type == MeshType::Triangle) {
+		mesh.clear();
+		solveTriSlabs(data.ptr(), data.rows, data.cols, data.slices, mesh,
+				isoLevel);
+		if (regularize) {
+			this->regularize(data.ptr(), mesh);
+		}
+		mesh.updateBoundingBox();
+		return;
+	}
 	static const std::vector<int3> nbrs={
 			int3(0,0,1),
 			int3(0,1,0),
@@ -467,8 +477,7 @@ void IsoSurface::regularize(const EndlessGridFloat& grid, Mesh& mesh) {
 	const int REGULARIZE_ITERATIONS = 3;
 	const float TRACE_THRESHOLD = 1E-5f;
 	std::vector<float3> tmpPoints(mesh.vertexLocations.size());
-	std::vector<std::unordered_set<uint32_t>> vertNbrs;
-	CreateVertexNeighborTable(mesh, vertNbrs);
+	const MeshNeighborTable& vertNbrs = mesh.getAdjacency().vertexNeighbors;
 	for (int c = 0; c < REGULARIZE_ITERATIONS; c++) {
 #pragma omp parallel for
 		for (int i = 0; i < (int) vertNbrs.size(); i++) {
@@ -513,8 +522,7 @@ void IsoSurface::regularize(const float* data, Mesh& mesh) {
 	const int REGULARIZE_ITERATIONS = 3;
 	const float TRACE_THRESHOLD = 1E-5f;
 	std::vector<float3> tmpPoints(mesh.vertexLocations.size());
-	std::vector<std::unordered_set<uint32_t>> vertNbrs;
-	CreateVertexNeighborTable(mesh, vertNbrs);
+	const MeshNeighborTable& vertNbrs = mesh.getAdjacency().vertexNeighbors;
 	for (int c = 0; c < REGULARIZE_ITERATIONS; c++) {
 #pragma omp parallel for
 		for (int i = 0; i < (int) vertNbrs.size(); i++) {
@@ -603,6 +611,152 @@ void IsoSurface::solveTri(const float* vol, const int& rows, const int& cols,
 		points[index] = pt;
 	}
 }
+/*
+ Slab-parallel marching cubes. Every grid edge is keyed by 3*(index of its lower endpoint)+axis.
+ Each z-slab of cells emits triangles as edge keys on its own thread. The keys on each grid layer
+ are then sorted and deduplicated, numbered with a prefix sum over layers, and resolved back into
+ triangle indexes. No hash tables or locks are involved.
+ */
+void IsoSurface::solveTriSlabs(const float* vol, const int& rows,
+		const int& cols, const int& slices, Mesh& mesh, const float& isoLevel) {
+	this->rows = rows;
+	this->cols = cols;
+	this->slices = slices;
+	this->isoLevel = isoLevel;
+	triangleCount = 0;
+	if (rows < 3 || cols < 3 || slices < 3) {
+		return;
+	}
+	const size_t area = (size_t) rows * cols;
+	uint64_t edgeKeys[12];
+	for (int iEdge = 0; iEdge < 12; iEdge++) {
+		const int* v1 = vertexOffset[edgeConnection[iEdge][0]];
+		const int* v2 = vertexOffset[edgeConnection[iEdge][1]];
+		int axis = (v1[0] != v2[0]) ? 0 : ((v1[1] != v2[1]) ? 1 : 2);
+		int3 lower(std::min(v1[0], v2[0]), std::min(v1[1], v2[1]),
+				std::min(v1[2], v2[2]));
+		edgeKeys[iEdge] = 3 * (lower.x + lower.y * (uint64_t) rows
+				+ lower.z * (uint64_t) area) + axis;
+	}
+	//Cell slabs are z=1..slices-2, matching the range triangulated by solveTri().
+	const int slabCount = slices - 2;
+	std::vector<std::vector<uint64_t>> slabTriangles(slabCount);
+	std::vector<std::vector<uint64_t>> slabKeys(slabCount);
+#pragma omp parallel for schedule(dynamic)
+	for (int s = 0; s < slabCount; s++) {
+		const int z = s + 1;
+		std::vector<uint64_t>& tris = slabTriangles[s];
+		for (int y = 1; y < cols - 1; y++) {
+			for (int x = 1; x < rows - 1; x++) {
+				const uint64_t base = 3 * (x + y * (uint64_t) rows + z * (uint64_t) area);
+				int iFlagIndex = 0;
+				bool background = false;
+				for (int iVertex = 0; iVertex < 8; ++iVertex) {
+					float val = vol[(x + vertexOffset[iVertex][0])
+							+ (y + vertexOffset[iVertex][1]) * (size_t) rows
+							+ (z + vertexOffset[iVertex][2]) * area];
+					if (val == backgroundValue) {
+						background = true;
+						break;
+					}
+					if (val < isoLevel)
+						iFlagIndex |= 1 << iVertex;
+				}
+				if (background || cubeEdgeFlagsCC626[iFlagIndex] == 0) {
+					continue;
+				}
+				for (int iTriangle = 0; iTriangle < 5; iTriangle++) {
+					if (triangleConnectionTable[16 * iFlagIndex + 3 * iTriangle]
+							< 0)
+						break;
+					for (int iCorner = 0; iCorner < 3; ++iCorner) {
+						int iEdge = triangleConnectionTable[16 * iFlagIndex
+								+ 3 * iTriangle + iCorner];
+						tris.push_back(base + edgeKeys[iEdge]);
+					}
+				}
+			}
+		}
+		std::vector<uint64_t>& keys = slabKeys[s];
+		keys = tris;
+		std::sort(keys.begin(), keys.end());
+		keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	}
+	//Layer z holds edges whose lower endpoint lies on grid plane z. Slab s triangulates cells z=s+1,
+	//whose edges lie on layers z and z+1, so layer z is referenced by slabs z-2 and z-1.
+	const uint64_t layerStride = 3 * (uint64_t) area;
+	const int layerCount = slices;
+	std::vector<std::vector<uint64_t>> layerKeys(layerCount);
+#pragma omp parallel for
+	for (int z = 1; z < layerCount; z++) {
+		std::vector<uint64_t>& keys = layerKeys[z];
+		uint64_t start = z * layerStride;
+		uint64_t end = start + layerStride;
+		if (z - 2 >= 0) {
+			const std::vector<uint64_t>& lower = slabKeys[z - 2];
+			keys.insert(keys.end(),
+					std::lower_bound(lower.begin(), lower.end(), start),
+					std::lower_bound(lower.begin(), lower.end(), end));
+		}
+		size_t mid = keys.size();
+		if (z - 1 < slabCount) {
+			const std::vector<uint64_t>& upper = slabKeys[z - 1];
+			keys.insert(keys.end(),
+					std::lower_bound(upper.begin(), upper.end(), start),
+					std::lower_bound(upper.begin(), upper.end(), end));
+		}
+		std::inplace_merge(keys.begin(), keys.begin() + mid, keys.end());
+		keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+	}
+	std::vector<size_t> layerOffsets(layerCount + 1, 0);
+	for (int z = 0; z < layerCount; z++) {
+		layerOffsets[z + 1] = layerOffsets[z] + layerKeys[z].size();
+	}
+	std::vector<size_t> slabOffsets(slabCount + 1, 0);
+	for (int s = 0; s < slabCount; s++) {
+		slabOffsets[s + 1] = slabOffsets[s] + slabTriangles[s].size() / 3;
+	}
+	triangleCount = slabOffsets[slabCount];
+	std::vector<float3> &points = mesh.vertexLocations.data;
+	std::vector<float3> &normals = mesh.vertexNormals.data;
+	std::vector<uint3> &indexes = mesh.triIndexes.data;
+	points.resize(layerOffsets[layerCount]);
+	normals.resize(layerOffsets[layerCount]);
+	indexes.resize(triangleCount);
+#pragma omp parallel for schedule(dynamic)
+	for (int z = 0; z < layerCount; z++) {
+		const std::vector<uint64_t>& keys = layerKeys[z];
+		size_t offset = layerOffsets[z];
+		for (size_t n = 0; n < keys.size(); n++) {
+			uint64_t v = keys[n] / 3;
+			int axis = (int) (keys[n] % 3);
+			int3 v1((int) (v % rows), (int) ((v / rows) % cols), (int) (v / area));
+			int3 v2 = v1 + AXIS_OFFSET[axis];
+			float fOffset = getOffset(vol, v1, v2);
+			float3 pt = float3(v1) + fOffset * float3(AXIS_OFFSET[axis]);
+			float3 norm = interpolateNormal(vol, pt.x, pt.y, pt.z);
+			points[offset + n] = pt;
+			normals[offset + n] = norm / length(norm);
+		}
+	}
+#pragma omp parallel for schedule(dynamic)
+	for (int s = 0; s < slabCount; s++) {
+		const std::vector<uint64_t>& tris = slabTriangles[s];
+		size_t offset = slabOffsets[s];
+		for (size_t t = 0; t < tris.size() / 3; t++) {
+			uint3 tri;
+			for (int iCorner = 0; iCorner < 3; iCorner++) {
+				uint64_t key = tris[3 * t + iCorner];
+				int z = (int) (key / layerStride);
+				const std::vector<uint64_t>& keys = layerKeys[z];
+				tri[iCorner] = (uint32_t) (layerOffsets[z]
+						+ (std::lower_bound(keys.begin(), keys.end(), key)
+								- keys.begin()));
+			}
+			indexes[offset + t] = tri;
+		}
+	}
+}
 void IsoSurface::solveQuad(const EndlessGridFloat& grid, Mesh& mesh,
 		const float& isoLevel) {
 	auto leafs = grid.getLeafNodes();
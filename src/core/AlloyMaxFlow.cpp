@@ -36,6 +36,7 @@ const float FastMaxFlow::ZERO_TOLERANCE = 1E-8f;
 const float FastMaxFlow::INF_FLOW = std::numeric_limits<float>::max();
 const size_t FastMaxFlow::OUT_OF_BOUNDS = std::numeric_limits<size_t>::max();
 const int FastMaxFlow::INF_DISTANCE = std::numeric_limits<int>::max();
+const int GridMaxFlow::INF_HEIGHT = std::numeric_limits<int>::max();
 MaxFlow::Node* MaxFlow::Node::getParent() {
 	if (parent != nullptr && parent != MaxFlow::ROOT
 			&& parent != MaxFlow::ORPHAN) {
@@ -553,15 +554,12 @@ bool MaxFlow::step() {
 	}
 	const int UPDATE_INTERVAL = 256;
 	if (iterationCount % UPDATE_INTERVAL == 0) {
-		for (auto iter = activeList.begin(); iter != activeList.end(); iter++) {
+		for (auto iter = activeList.begin(); iter != activeList.end();) {
 			Node* node = *iter;
 			if (!node->active) {
-				activeList.erase(iter);
-				if (!activeList.empty()) {
-					iter--;
-				} else {
-					break;
-				}
+				iter = activeList.erase(iter);
+			} else {
+				iter++;
 			}
 		}
 	}
@@ -904,5 +902,448 @@ void FastMaxFlow::setEdgeCapacity(int i, int j, int dir, float w1, float w2) {
 	edgeCapacity[reverse[dir]][index(i, j, dir)] = w2;
 }
 
+GridMaxFlow::GridMaxFlow(int w, int h, int conn) :
+		rows(0), cols(0), slices(0), connectivity(0), neighbors(0), totalFlow(0.0) {
+	resize(w, h, conn);
+}
+GridMaxFlow::GridMaxFlow(int r, int c, int s, int conn) :
+		rows(0), cols(0), slices(0), connectivity(0), neighbors(0), totalFlow(0.0) {
+	resize(r, c, s, conn);
+}
+void GridMaxFlow::resize(int w, int h, int conn) {
+	if (conn != 4 && conn != 8) {
+		throw std::runtime_error(
+				MakeString() << "Image max-flow connectivity must be 4 or 8, not " << conn << ".");
+	}
+	rows = w;
+	cols = h;
+	slices = 1;
+	setConnectivity(conn);
+	blockSize = int3(64, 64, 1);
+	reset();
+}
+void GridMaxFlow::resize(int r, int c, int s, int conn) {
+	if (conn != 6 && conn != 26) {
+		throw std::runtime_error(
+				MakeString() << "Volume max-flow connectivity must be 6 or 26, not " << conn << ".");
+	}
+	rows = r;
+	cols = c;
+	slices = s;
+	setConnectivity(conn);
+	blockSize = int3(16, 16, 16);
+	reset();
+}
+void GridMaxFlow::setConnectivity(int conn) {
+	connectivity = conn;
+	offsets.clear();
+	int dims = (conn == 4 || conn == 8) ? 2 : 3;
+	//Axis aligned neighbors first, then diagonals. Each direction is followed by its reverse.
+	for (int a = 0; a < dims; a++) {
+		int3 d(0, 0, 0);
+		d[a] = 1;
+		offsets.push_back(d);
+		offsets.push_back(-d);
+	}
+	if (conn == 8 || conn == 26) {
+		for (int k = (dims == 3) ? -1 : 0; k <= ((dims == 3) ? 1 : 0); k++) {
+			for (int j = -1; j <= 1; j++) {
+				for (int i = -1; i <= 1; i++) {
+					int3 d(i, j, k);
+					int nonzero = std::abs(i) + std::abs(j) + std::abs(k);
+					int lead = (i != 0) ? i : ((j != 0) ? j : k);
+					if (nonzero > 1 && lead > 0) {
+						offsets.push_back(d);
+						offsets.push_back(-d);
+					}
+				}
+			}
+		}
+	}
+	neighbors = (int) offsets.size();
+	linearOffsets.resize(neighbors);
+	lengths.resize(neighbors);
+	for (int n = 0; n < neighbors; n++) {
+		int3 d = offsets[n];
+		linearOffsets[n] = d.x + (int64_t) d.y * rows + (int64_t) d.z * rows * cols;
+		lengths[n] = std::sqrt((float) (d.x * d.x + d.y * d.y + d.z * d.z));
+	}
+}
+void GridMaxFlow::reset() {
+	size_t N = size();
+	capacity.assign(N * neighbors, 0.0f);
+	excess.assign(N, 0.0f);
+	sinkCapacity.assign(N, 0.0f);
+	height.assign(N, INF_HEIGHT);
+	labels.assign(N, 0);
+	blockDims = int3((rows + blockSize.x - 1) / blockSize.x,
+			(cols + blockSize.y - 1) / blockSize.y,
+			(slices + blockSize.z - 1) / blockSize.z);
+	totalFlow = 0.0;
+}
+void GridMaxFlow::setEdgeCapacity(int i, int j, int k, int dir, float w1,
+		float w2) {
+	int3 d = offsets[dir];
+	if (!inside(i + d.x, j + d.y, k + d.z)) {
+		return;
+	}
+	size_t idx = index(i, j, k);
+	capacity[idx * neighbors + dir] = w1;
+	capacity[(idx + linearOffsets[dir]) * neighbors + (dir ^ 1)] = w2;
+}
+void GridMaxFlow::setTerminalCapacities(const Image1f& source,
+		const Image1f& sink) {
+	if (slices != 1 || source.width != rows || source.height != cols
+			|| sink.width != rows || sink.height != cols) {
+		throw std::runtime_error(
+				MakeString() << "Terminal capacity images must be " << rows << "x" << cols << ".");
+	}
+	size_t N = size();
+#pragma omp parallel for
+	for (int n = 0; n < (int) N; n++) {
+		excess[n] = source[n].x;
+		sinkCapacity[n] = sink[n].x;
+	}
+}
+void GridMaxFlow::setTerminalCapacities(const Volume1f& source,
+		const Volume1f& sink) {
+	if (source.rows != rows || source.cols != cols || source.slices != slices
+			|| sink.rows != rows || sink.cols != cols || sink.slices != slices) {
+		throw std::runtime_error(
+				MakeString() << "Terminal capacity volumes must be " << rows << "x" << cols << "x" << slices << ".");
+	}
+	size_t N = size();
+#pragma omp parallel for
+	for (int n = 0; n < (int) N; n++) {
+		excess[n] = source[n].x;
+		sinkCapacity[n] = sink[n].x;
+	}
+}
+void GridMaxFlow::setEdgeCapacities(int dir, const Image1f& weights) {
+	if (slices != 1 || weights.width != rows || weights.height != cols) {
+		throw std::runtime_error(
+				MakeString() << "Edge capacity image must be " << rows << "x" << cols << ".");
+	}
+#pragma omp parallel for
+	for (int j = 0; j < cols; j++) {
+		for (int i = 0; i < rows; i++) {
+			float w = weights(i, j).x;
+			setEdgeCapacity(i, j, 0, dir, w, w);
+		}
+	}
+}
+void GridMaxFlow::setEdgeCapacities(int dir, const Volume1f& weights) {
+	if (weights.rows != rows || weights.cols != cols || weights.slices != slices) {
+		throw std::runtime_error(
+				MakeString() << "Edge capacity volume must be " << rows << "x" << cols << "x" << slices << ".");
+	}
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				float w = weights(i, j, k).x;
+				setEdgeCapacity(i, j, k, dir, w, w);
+			}
+		}
+	}
+}
+void GridMaxFlow::setPairwiseCapacities(const Image1f& weights, float lambda) {
+	if (slices != 1 || weights.width != rows || weights.height != cols) {
+		throw std::runtime_error(
+				MakeString() << "Pairwise weight image must be " << rows << "x" << cols << ".");
+	}
+#pragma omp parallel for
+	for (int j = 0; j < cols; j++) {
+		for (int i = 0; i < rows; i++) {
+			float w1 = weights(i, j).x;
+			for (int dir = 0; dir < neighbors; dir += 2) {
+				int3 d = offsets[dir];
+				if (inside(i + d.x, j + d.y, 0)) {
+					float w = 0.5f * lambda * (w1 + weights(i + d.x, j + d.y).x) / lengths[dir];
+					setEdgeCapacity(i, j, 0, dir, w, w);
+				}
+			}
+		}
+	}
+}
+void GridMaxFlow::setPairwiseCapacities(const Volume1f& weights, float lambda) {
+	if (weights.rows != rows || weights.cols != cols || weights.slices != slices) {
+		throw std::runtime_error(
+				MakeString() << "Pairwise weight volume must be " << rows << "x" << cols << "x" << slices << ".");
+	}
+#pragma omp parallel for
+	for (int k = 0; k < slices; k++) {
+		for (int j = 0; j < cols; j++) {
+			for (int i = 0; i < rows; i++) {
+				float w1 = weights(i, j, k).x;
+				for (int dir = 0; dir < neighbors; dir += 2) {
+					int3 d = offsets[dir];
+					if (inside(i + d.x, j + d.y, k + d.z)) {
+						float w = 0.5f * lambda
+								* (w1 + weights(i + d.x, j + d.y, k + d.z).x)
+								/ lengths[dir];
+						setEdgeCapacity(i, j, k, dir, w, w);
+					}
+				}
+			}
+		}
+	}
+}
+/*
+ Exact distances to the sink in the residual graph, computed with a breadth first search. Small
+ frontiers are expanded top-down from fixed size chunks and claimed serially. Large frontiers are
+ expanded bottom-up, where every unvisited voxel checks its own edges for a neighbor on the frontier.
+
+ Beamer, S., Asanovic, K., & Patterson, D. (2012). Direction-optimizing breadth-first search. SC.
+ */
+void GridMaxFlow::globalRelabel() {
+	const int CHUNK_SIZE = 4096;
+	const int BOTTOM_UP_RATIO = 16;
+	size_t N = size();
+#pragma omp parallel for
+	for (int n = 0; n < (int) N; n++) {
+		height[n] = (sinkCapacity[n] > 0) ? 1 : INF_HEIGHT;
+	}
+	frontier.clear();
+	for (size_t n = 0; n < N; n++) {
+		if (height[n] == 1) {
+			frontier.push_back(n);
+		}
+	}
+	marks.resize(N);
+	size_t unvisited = N - frontier.size();
+	int d = 1;
+	while (frontier.size() > 0) {
+		if (frontier.size() * BOTTOM_UP_RATIO > unvisited) {
+			//Residual capacity is zero for edges that leave the grid, so no bounds checks are needed.
+#pragma omp parallel for
+			for (int n = 0; n < (int) N; n++) {
+				uint8_t mark = 0;
+				if (height[n] == INF_HEIGHT) {
+					const float* cap = &capacity[(size_t) n * neighbors];
+					for (int dir = 0; dir < neighbors; dir++) {
+						if (cap[dir] > 0 && height[(size_t) ((int64_t) n + linearOffsets[dir])] == d) {
+							mark = 1;
+							break;
+						}
+					}
+				}
+				marks[n] = mark;
+			}
+			d++;
+			frontier.clear();
+			for (size_t n = 0; n < N; n++) {
+				if (marks[n]) {
+					height[n] = d;
+					frontier.push_back(n);
+				}
+			}
+		} else {
+			int chunks = (int) ((frontier.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+			if ((int) candidates.size() < chunks) {
+				candidates.resize(chunks);
+			}
+#pragma omp parallel for
+			for (int c = 0; c < chunks; c++) {
+				std::vector<size_t>& list = candidates[c];
+				list.clear();
+				size_t end = std::min(frontier.size(), (size_t) (c + 1) * CHUNK_SIZE);
+				for (size_t n = (size_t) c * CHUNK_SIZE; n < end; n++) {
+					size_t u = frontier[n];
+					int3 pos = position(u);
+					for (int dir = 0; dir < neighbors; dir++) {
+						int3 q = pos + offsets[dir];
+						if (!inside(q.x, q.y, q.z))
+							continue;
+						size_t v = (size_t) ((int64_t) u + linearOffsets[dir]);
+						if (height[v] == INF_HEIGHT
+								&& capacity[v * neighbors + (dir ^ 1)] > 0) {
+							list.push_back(v);
+						}
+					}
+				}
+			}
+			d++;
+			frontier.clear();
+			for (int c = 0; c < chunks; c++) {
+				for (size_t v : candidates[c]) {
+					if (height[v] == INF_HEIGHT) {
+						height[v] = d;
+						frontier.push_back(v);
+					}
+				}
+			}
+		}
+		unvisited -= frontier.size();
+	}
+}
+/*
+ Push-relabel on the voxels of one block. Flow may be pushed into the neighboring blocks, which are
+ idle while this block runs. Returns the number of relabels.
+ */
+size_t GridMaxFlow::discharge(int b, size_t budget, double& flow) {
+	int3 minPt = blockSize
+			* int3(b % blockDims.x, (b / blockDims.x) % blockDims.y,
+					b / (blockDims.x * blockDims.y));
+	int3 maxPt = aly::min(minPt + blockSize, int3(rows, cols, slices));
+	//Heights at or above the number of voxels can no longer reach the sink.
+	const int maxHeight = (int) std::min(size(), (size_t) INF_HEIGHT - 1);
+	std::vector<size_t> queue;
+	for (int k = minPt.z; k < maxPt.z; k++) {
+		for (int j = minPt.y; j < maxPt.y; j++) {
+			for (int i = minPt.x; i < maxPt.x; i++) {
+				size_t idx = index(i, j, k);
+				if (excess[idx] > 0 && height[idx] < INF_HEIGHT) {
+					queue.push_back(idx);
+				}
+			}
+		}
+	}
+	size_t work = 0;
+	for (size_t head = 0; head < queue.size() && work < budget; head++) {
+		size_t u = queue[head];
+		float e = excess[u];
+		float& sc = sinkCapacity[u];
+		if (sc > 0) {
+			float d = std::min(e, sc);
+			sc -= d;
+			e -= d;
+			flow += d;
+		}
+		int h = height[u];
+		float* cap = &capacity[u * neighbors];
+		int3 pos = position(u);
+		while (e > 0) {
+			int minH = INF_HEIGHT;
+			for (int dir = 0; dir < neighbors && e > 0; dir++) {
+				float c = cap[dir];
+				if (c <= 0)
+					continue;
+				size_t v = (size_t) ((int64_t) u + linearOffsets[dir]);
+				int hv = height[v];
+				if (hv == h - 1) {
+					float d = std::min(e, c);
+					cap[dir] = c - d;
+					capacity[v * neighbors + (dir ^ 1)] += d;
+					e -= d;
+					bool activated = (excess[v] <= 0);
+					excess[v] += d;
+					int3 q = pos + offsets[dir];
+					if (activated && q.x >= minPt.x && q.y >= minPt.y
+							&& q.z >= minPt.z && q.x < maxPt.x && q.y < maxPt.y
+							&& q.z < maxPt.z) {
+						queue.push_back(v);
+					}
+				} else {
+					minH = std::min(minH, hv);
+				}
+			}
+			if (e > 0) {
+				work++;
+				if (minH >= maxHeight) {
+					h = INF_HEIGHT;
+					break;
+				}
+				h = minH + 1;
+			}
+		}
+		excess[u] = e;
+		height[u] = h;
+	}
+	return work;
+}
+double GridMaxFlow::solve(
+		const std::function<bool(const std::string& message, float progress)>& monitor) {
+	//Relabels allowed per voxel of a block before it yields to the others.
+	const int BLOCK_WORK = 8;
+	//Sweeps between global relabels when little local work is done.
+	const int RELABEL_SWEEPS = 4;
+	size_t N = size();
+	double flow = 0.0;
+	//Flow that goes straight from source to sink through a single voxel.
+#pragma omp parallel for reduction(+:flow)
+	for (int n = 0; n < (int) N; n++) {
+		float m = std::min(excess[n], sinkCapacity[n]);
+		if (m > 0) {
+			excess[n] -= m;
+			sinkCapacity[n] -= m;
+			flow += m;
+		}
+	}
+	totalFlow = flow;
+	int colorCount = (slices > 1) ? 8 : 4;
+	std::vector<std::vector<int>> colors(colorCount);
+	int blockCount = blockDims.x * blockDims.y * blockDims.z;
+	for (int b = 0; b < blockCount; b++) {
+		int3 pos(b % blockDims.x, (b / blockDims.x) % blockDims.y,
+				b / (blockDims.x * blockDims.y));
+		colors[(pos.x & 1) + 2 * (pos.y & 1) + 4 * (pos.z & 1)].push_back(b);
+	}
+	size_t budget = (size_t) BLOCK_WORK * blockSize.x * blockSize.y * blockSize.z;
+	if (monitor) {
+		if (!monitor("Solving Max-Flow ...", 0.0f))
+			return totalFlow;
+	}
+	globalRelabel();
+	size_t relabels = 0;
+	int sweeps = 0;
+	while (true) {
+		flow = 0.0;
+		for (int c = 0; c < colorCount; c++) {
+			const std::vector<int>& blocks = colors[c];
+			double colorFlow = 0.0;
+			int colorWork = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:colorFlow,colorWork)
+			for (int n = 0; n < (int) blocks.size(); n++) {
+				double blockFlow = 0.0;
+				colorWork += (int) discharge(blocks[n], budget, blockFlow);
+				colorFlow += blockFlow;
+			}
+			flow += colorFlow;
+			relabels += colorWork;
+		}
+		totalFlow += flow;
+		int active = 0;
+#pragma omp parallel for reduction(+:active)
+		for (int n = 0; n < (int) N; n++) {
+			if (excess[n] > 0 && height[n] < INF_HEIGHT) {
+				active++;
+			}
+		}
+		if (active == 0)
+			break;
+		//Local relabels drift from the true distances, so they are recomputed once the work adds up.
+		sweeps++;
+		if (relabels > N / 2 || sweeps >= RELABEL_SWEEPS) {
+			globalRelabel();
+			relabels = 0;
+			sweeps = 0;
+		}
+		if (monitor) {
+			if (!monitor(MakeString() << "Solving Max-Flow [" << totalFlow << "]",
+					1.0f - active / (float) N))
+				break;
+		}
+	}
+	globalRelabel();
+#pragma omp parallel for
+	for (int n = 0; n < (int) N; n++) {
+		labels[n] = (height[n] == INF_HEIGHT) ? 0 : 1;
+	}
+	return totalFlow;
+}
+void GridMaxFlow::getLabels(Image1ub& out) const {
+	out.resize(rows, cols);
+	for (size_t n = 0; n < size(); n++) {
+		out[n].x = labels[n];
+	}
+}
+void GridMaxFlow::getLabels(Volume1ub& out) const {
+	out.resize(rows, cols, slices);
+	for (size_t n = 0; n < size(); n++) {
+		out[n].x = labels[n];
+	}
+}
+
 }
 
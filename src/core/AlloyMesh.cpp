@@ -29,6 +29,8 @@
 #include <string.h>
 #include <stddef.h>
 #include <set>
+#include <deque>
+#include <algorithm>
 #include "AlloyPLY.h"
 #include "tiny_obj_loader.h"
 #ifndef ALY_WINDOWS
@@ -1015,39 +1017,13 @@ void Mesh::updateVertexNormals(bool flipSign, int SMOOTH_ITERATIONS,
 	if (SMOOTH_ITERATIONS > 0) {
 		int vertCount = (int) vertexLocations.size();
 		std::vector<float3> tmp(vertCount);
-		std::vector<std::list<int>> vertNbrs(vertCount);
-		int indexCount = (int) quadIndexes.size();
-		for (int i = 0; i < indexCount; i++) {
-			uint4 verts = quadIndexes[i];
-			int v1 = verts.x;
-			int v2 = verts.y;
-			int v3 = verts.z;
-			int v4 = verts.w;
-
-			vertNbrs[v1].push_back(v2);
-			vertNbrs[v2].push_back(v3);
-			vertNbrs[v3].push_back(v1);
-
-			vertNbrs[v3].push_back(v4);
-			vertNbrs[v4].push_back(v1);
-			vertNbrs[v1].push_back(v3);
-		}
-		indexCount = (int) triIndexes.size();
-		for (int i = 0; i < indexCount; i++) {
-			uint3 verts = triIndexes[i];
-			int v1 = verts.x;
-			int v2 = verts.y;
-			int v3 = verts.z;
-			vertNbrs[v1].push_back(v2);
-			vertNbrs[v2].push_back(v3);
-			vertNbrs[v3].push_back(v1);
-		}
+		const MeshNeighborTable& vertNbrs = getAdjacency().vertexNeighbors;
 		for (int iter = 0; iter < SMOOTH_ITERATIONS; iter++) {
 #pragma omp parallel for
 			for (int i = 0; i < vertCount; i++) {
 				float3 norm = vertexNormals[i];
 				float3 avg = float3(0.0f);
-				for (int nbr : vertNbrs[i]) {
+				for (uint32_t nbr : vertNbrs[i]) {
 					float3 nnorm = vertexNormals[nbr];
 					;
 					if (dot(norm, nnorm) > DOT_TOLERANCE) {
@@ -1417,6 +1393,44 @@ void ReadMeshFromFile(const std::string& file, Mesh &mesh) {
 		throw std::runtime_error(
 				MakeString() << "Could not read file " << file);
 }
+/*
+ Decodes the vertex block of a memory mapped little endian PLY file directly, in parallel.
+ Only applies when every vertex property is a scalar, so that each vertex has a fixed stride.
+ */
+static bool ReadPlyVerticesMapped(PLYReaderWriter& ply, int numPts,
+		bool hasNormals, bool hasColors, Mesh& mesh) {
+	PlyElement* elem = ply.findElement("vertex");
+	if (!ply.isMemoryMapped() || ply.getFileFormat() != FileFormat::BINARY_LE
+			|| elem == nullptr) {
+		return false;
+	}
+	PlyScalarLayout layout;
+	if (!layout.set(elem, { "x", "y", "z", "nx", "ny", "nz", "red", "green",
+			"blue" })) {
+		return false;
+	}
+	const size_t stride = layout.stride;
+	const char* start = ply.getMappedCursor();
+	ply.skipMappedBytes(stride * numPts);
+#pragma omp parallel for
+	for (int j = 0; j < numPts; j++) {
+		const char* ptr = start + stride * j;
+		mesh.vertexLocations[j] = float3((float) layout.get(ptr, 0),
+				(float) layout.get(ptr, 1), (float) layout.get(ptr, 2));
+		if (hasNormals) {
+			mesh.vertexNormals[j] = float3((float) layout.get(ptr, 3),
+					(float) layout.get(ptr, 4), (float) layout.get(ptr, 5));
+		}
+		if (hasColors) {
+			mesh.vertexColors[j] = float4(
+					(unsigned char) layout.get(ptr, 6) / 255.0f,
+					(unsigned char) layout.get(ptr, 7) / 255.0f,
+					(unsigned char) layout.get(ptr, 8) / 255.0f,
+					1.0f);
+		}
+	}
+	return true;
+}
 void ReadPlyMeshFromFile(const std::string& file, Mesh &mesh) {
 	int i, j;
 	int numPts = 0, numPolys = 0;
@@ -1509,18 +1523,26 @@ void ReadPlyMeshFromFile(const std::string& file, Mesh &mesh) {
 			// Create a list of points
 			numPts = numElems;
 			mesh.vertexLocations.resize(numPts, float3(0.0f));
+			if (hasNormals) {
+				mesh.vertexNormals.resize(numPts);
+			}
+			if (RGBPointsAvailable) {
+				mesh.vertexColors.resize(numPts);
+			}
+			if (ReadPlyVerticesMapped(ply, numPts, hasNormals,
+					RGBPointsAvailable, mesh)) {
+				continue;
+			}
 			// Setup to read the PLY elements
 			ply.getProperty(elemName, &MeshVertProps[0]);
 			ply.getProperty(elemName, &MeshVertProps[1]);
 			ply.getProperty(elemName, &MeshVertProps[2]);
 			if (hasNormals) {
-				mesh.vertexNormals.resize(numPts);
 				ply.getProperty(elemName, &MeshVertProps[3]);
 				ply.getProperty(elemName, &MeshVertProps[4]);
 				ply.getProperty(elemName, &MeshVertProps[5]);
 			}
 			if (RGBPointsAvailable) {
-				mesh.vertexColors.resize(numPts);
 				ply.getProperty(elemName, &MeshVertProps[9]);
 				ply.getProperty(elemName, &MeshVertProps[10]);
 				ply.getProperty(elemName, &MeshVertProps[11]);
@@ -1602,138 +1624,439 @@ void ReadPlyMeshFromFile(const std::string& file, Mesh &mesh) {
 	mesh.setDirty(true);
 }
 
-void CreateVertexNeighborTable(const Mesh& mesh,
-		std::vector<std::unordered_set<uint32_t>>& vertNbrs) {
-	vertNbrs.resize(mesh.vertexLocations.size());
-	for (const uint3& face : mesh.triIndexes.data) {
-		vertNbrs[face.x].insert(face.y);
-		vertNbrs[face.y].insert(face.z);
-		vertNbrs[face.z].insert(face.x);
-		vertNbrs[face.z].insert(face.y);
-		vertNbrs[face.y].insert(face.x);
-		vertNbrs[face.x].insert(face.z);
-	}
-	for (const uint4& face : mesh.quadIndexes.data) {
-		vertNbrs[face.x].insert(face.y);
-		vertNbrs[face.y].insert(face.z);
-		vertNbrs[face.z].insert(face.w);
-		vertNbrs[face.w].insert(face.x);
-		vertNbrs[face.w].insert(face.z);
-		vertNbrs[face.z].insert(face.y);
-		vertNbrs[face.y].insert(face.x);
-		vertNbrs[face.x].insert(face.w);
+namespace detail {
+//Vertices of face f. Faces are numbered with triangles first, then quads.
+inline int FaceVertices(const Mesh& mesh, size_t f, uint32_t* verts) {
+	size_t T = mesh.triIndexes.size();
+	if (f < T) {
+		const uint3& face = mesh.triIndexes[f];
+		verts[0] = face.x;
+		verts[1] = face.y;
+		verts[2] = face.z;
+		return 3;
+	} else {
+		const uint4& face = mesh.quadIndexes[f - T];
+		verts[0] = face.x;
+		verts[1] = face.y;
+		verts[2] = face.z;
+		verts[3] = face.w;
+		return 4;
 	}
 }
-inline uint64_t faceHashCode(const uint2& val) {
-	return ((uint64_t) val.y) << 32 | ((uint64_t) val.x);
+inline bool FaceHasEdge(const Mesh& mesh, size_t f, uint32_t a, uint32_t b) {
+	uint32_t verts[4];
+	int n = FaceVertices(mesh, f, verts);
+	for (int k = 0; k < n; k++) {
+		uint32_t v1 = verts[k];
+		uint32_t v2 = verts[(k + 1) % n];
+		if ((v1 == a && v2 == b) || (v1 == b && v2 == a))
+			return true;
+	}
+	return false;
 }
-void CreateOrderedVertexNeighborTable(const Mesh& mesh,
-		std::vector<std::list<uint32_t>>& vertNbrsOut, bool leaveTail) {
-	//Leave tail means to not remove the duplicate vertex neighbor at the end of the neighbor list.
-	//Non-manifold vertexes will not have a tail, so the tail can be used to detect them in simple (common) cases.
-	vertNbrsOut.resize(mesh.vertexLocations.size());
-	std::vector<std::vector<uint32_t>> vertNbrs(mesh.vertexLocations.size());
-	for (const uint3& face : mesh.triIndexes.data) {
-		vertNbrs[face.x].push_back(face.z);
-		vertNbrs[face.x].push_back(face.y);
-
-		vertNbrs[face.y].push_back(face.x);
-		vertNbrs[face.y].push_back(face.z);
-
-		vertNbrs[face.z].push_back(face.y);
-		vertNbrs[face.z].push_back(face.x);
+/*
+ Calls func for each face on edge (a,b) in face order. Rows of vertexFaces are sorted, so the
+ candidates are the faces common to both rows.
+ */
+template<class F> void ForEachEdgeFace(const Mesh& mesh,
+		const MeshNeighborTable& vertexFaces, uint32_t a, uint32_t b, F func) {
+	MeshNeighborTable::Row rowA = vertexFaces[a];
+	MeshNeighborTable::Row rowB = vertexFaces[b];
+	const uint32_t* i = rowA.begin();
+	const uint32_t* j = rowB.begin();
+	uint32_t last = (uint32_t) -1;
+	while (i != rowA.end() && j != rowB.end()) {
+		if (*i < *j) {
+			i++;
+		} else if (*j < *i) {
+			j++;
+		} else {
+			if (*i != last && FaceHasEdge(mesh, *i, a, b)) {
+				func(*i);
+			}
+			last = *i;
+			i++;
+			j++;
+		}
 	}
-	for (const uint4& face : mesh.quadIndexes.data) {
-		vertNbrs[face.x].push_back(face.w);
-		vertNbrs[face.x].push_back(face.y);
-
-		vertNbrs[face.y].push_back(face.x);
-		vertNbrs[face.y].push_back(face.z);
-
-		vertNbrs[face.z].push_back(face.y);
-		vertNbrs[face.z].push_back(face.w);
-
-		vertNbrs[face.w].push_back(face.z);
-		vertNbrs[face.w].push_back(face.x);
-	}
-	int N = (int) vertNbrs.size();
-	for (int n = 0; n < N; n++) {
-		std::vector<uint32_t>& nbrs = vertNbrs[n];
-		if (nbrs.size() > 0) {
-			vertNbrsOut[n].clear();
-			bool found;
-			std::list<uint32_t> chain;
-			chain.push_back(nbrs[0]);
-			chain.push_back(nbrs[1]);
-			nbrs[0] = -1;
-			nbrs[1] = -1;
-			do {
-				uint32_t front = chain.front();
-				uint32_t back = chain.back();
-				found = false;
-				for (int i = 0; i < (int) nbrs.size(); i += 2) {
-					if (nbrs[i] == back) {
-						chain.push_back(nbrs[i + 1]);
-						nbrs[i + 1] = -1;
-						found = true;
-						break;
-					}
-				}
-				if (!found) {
-					for (int i = 1; i < (int) nbrs.size(); i += 2) {
-						if (nbrs[i] == front) {
-							chain.push_front(nbrs[i - 1]);
-							nbrs[i - 1] = -1;
-							found = true;
-							break;
-						}
-					}
-				}
-				if (!found) {
-					if (chain.size() > 0) {
-						if (!leaveTail && chain.front() == chain.back())
-							chain.pop_back();
-						vertNbrsOut[n].insert(vertNbrsOut[n].end(),
-								chain.begin(), chain.end());
-						chain.clear();
-					}
-					for (int i = 0; i < (int) nbrs.size(); i += 2) {
-						if (nbrs[i] != (uint32_t) -1
-								&& nbrs[i + 1] != (uint32_t) -1) {
-							chain.push_back(nbrs[i]);
-							chain.push_back(nbrs[i + 1]);
-							found = true;
-							break;
-						}
-					}
+}
+//Counts the faces on edge (a,b) and returns the first and last of them.
+inline int EdgeFaces(const Mesh& mesh, const MeshAdjacency& adj, uint32_t a,
+		uint32_t b, uint32_t& front, uint32_t& back) {
+	int count = 0;
+	ForEachEdgeFace(mesh, adj.vertexFaces, a, b, [&](uint32_t f) {
+		if (count == 0)
+			front = f;
+		back = f;
+		count++;
+	});
+	return count;
+}
+/*
+ Transposes the face list into vertex to face rows, keeping faces in order. Corners are first
+ distributed to ranges of vertices with a blocked counting sort, then each range of vertices is
+ counted and filled on its own.
+ */
+void BuildVertexFaces(const Mesh& mesh, MeshNeighborTable& table) {
+	const size_t BLOCK_SIZE = 65536;
+	const size_t MAX_RANGES = 4096;
+	size_t V = mesh.vertexLocations.size();
+	size_t T = mesh.triIndexes.size();
+	size_t C = 3 * T + 4 * mesh.quadIndexes.size();
+	if (C >= (size_t) std::numeric_limits<uint32_t>::max()) {
+		throw std::runtime_error(
+				MakeString() << "Mesh has too many face corners (" << C << ") for adjacency table.");
+	}
+	auto cornerVertex = [&](size_t c) {
+		return (c < 3 * T) ?
+				mesh.triIndexes[c / 3][c % 3] :
+				mesh.quadIndexes[(c - 3 * T) / 4][(c - 3 * T) % 4];
+	};
+	table.offsets.assign(V + 1, 0);
+	table.indexes.resize(C);
+	if (V == 0 || C == 0) {
+		return;
+	}
+	int shift = 0;
+	while ((V >> shift) >= MAX_RANGES) {
+		shift++;
+	}
+	int R = (int) ((V - 1) >> shift) + 1;
+	int blocks = (int) ((C + BLOCK_SIZE - 1) / BLOCK_SIZE);
+	std::vector<uint32_t> blockCounts((size_t) blocks * R, 0);
+	std::vector<uint32_t> corners(C);
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++) {
+		uint32_t* counts = &blockCounts[(size_t) b * R];
+		size_t end = std::min(C, (b + 1) * BLOCK_SIZE);
+		for (size_t c = b * BLOCK_SIZE; c < end; c++) {
+			counts[cornerVertex(c) >> shift]++;
+		}
+	}
+	std::vector<uint32_t> rangeStart(R + 1);
+	uint32_t offset = 0;
+	for (int r = 0; r < R; r++) {
+		rangeStart[r] = offset;
+		for (int b = 0; b < blocks; b++) {
+			uint32_t& count = blockCounts[(size_t) b * R + r];
+			uint32_t tmp = count;
+			count = offset;
+			offset += tmp;
+		}
+	}
+	rangeStart[R] = offset;
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++) {
+		uint32_t* offsets = &blockCounts[(size_t) b * R];
+		size_t end = std::min(C, (b + 1) * BLOCK_SIZE);
+		for (size_t c = b * BLOCK_SIZE; c < end; c++) {
+			corners[offsets[cornerVertex(c) >> shift]++] = (uint32_t) c;
+		}
+	}
+#pragma omp parallel for schedule(dynamic)
+	for (int r = 0; r < R; r++) {
+		size_t first = (size_t) r << shift;
+		size_t last = std::min(V, (size_t) (r + 1) << shift);
+		std::vector<uint32_t> starts(last - first + 1, 0);
+		for (uint32_t k = rangeStart[r]; k < rangeStart[r + 1]; k++) {
+			starts[cornerVertex(corners[k]) - first + 1]++;
+		}
+		starts[0] = rangeStart[r];
+		for (size_t v = 1; v < starts.size(); v++) {
+			starts[v] += starts[v - 1];
+		}
+		for (size_t v = first; v < last; v++) {
+			table.offsets[v] = starts[v - first];
+		}
+		for (uint32_t k = rangeStart[r]; k < rangeStart[r + 1]; k++) {
+			uint32_t c = corners[k];
+			uint32_t f = (uint32_t) ((c < 3 * T) ? c / 3 : T + (c - 3 * T) / 4);
+			table.indexes[starts[cornerVertex(c) - first]++] = f;
+		}
+	}
+	table.offsets[V] = (uint32_t) C;
+}
+//Sorted unique vertices that share a face edge with v.
+void GatherOneRing(const Mesh& mesh, const MeshNeighborTable& vertexFaces,
+		uint32_t v, std::vector<uint32_t>& ring) {
+	ring.clear();
+	uint32_t last = (uint32_t) -1;
+	uint32_t verts[4];
+	for (uint32_t f : vertexFaces[v]) {
+		if (f == last)
+			continue;
+		last = f;
+		int n = FaceVertices(mesh, f, verts);
+		for (int k = 0; k < n; k++) {
+			if (verts[k] == v) {
+				ring.push_back(verts[(k + n - 1) % n]);
+				ring.push_back(verts[(k + 1) % n]);
+			}
+		}
+	}
+	std::sort(ring.begin(), ring.end());
+	ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+	auto self = std::lower_bound(ring.begin(), ring.end(), v);
+	if (self != ring.end() && *self == v)
+		ring.erase(self);
+}
+//Calls func for every face that shares an edge of f, if that edge belongs to exactly two faces.
+template<class F> void ForEachFaceNeighbor(const Mesh& mesh,
+		const MeshNeighborTable& vertexFaces, uint32_t f, F func) {
+	uint32_t verts[4];
+	int n = FaceVertices(mesh, f, verts);
+	for (int k = 0; k < n; k++) {
+		uint32_t a = verts[k];
+		uint32_t b = verts[(k + 1) % n];
+		int count = 0;
+		uint32_t other = f;
+		ForEachEdgeFace(mesh, vertexFaces, a, b, [&](uint32_t g) {
+			count++;
+			if (g != f)
+				other = g;
+		});
+		if (count == 2 && other != f) {
+			func(other);
+		}
+	}
+}
+/*
+ Chains the (previous, next) corner pairs around v into an ordered ring. Boundary and non-manifold
+ vertices produce several chains back to back. A corner pair is only used once, so fans of more
+ than two faces on one edge cannot cycle. Leave tail means to not remove the duplicate vertex
+ neighbor at the end of the neighbor list. Non-manifold vertexes will not have a tail, so the tail
+ can be used to detect them in simple (common) cases.
+ */
+void OrderOneRing(const Mesh& mesh, const MeshNeighborTable& vertexFaces,
+		uint32_t v, bool leaveTail, std::vector<uint32_t>& nbrs,
+		std::deque<uint32_t>& chain, std::vector<uint32_t>& out) {
+	out.clear();
+	nbrs.clear();
+	chain.clear();
+	uint32_t last = (uint32_t) -1;
+	uint32_t verts[4];
+	for (uint32_t f : vertexFaces[v]) {
+		if (f == last)
+			continue;
+		last = f;
+		int n = FaceVertices(mesh, f, verts);
+		for (int k = 0; k < n; k++) {
+			if (verts[k] == v) {
+				nbrs.push_back(verts[(k + n - 1) % n]);
+				nbrs.push_back(verts[(k + 1) % n]);
+			}
+		}
+	}
+	if (nbrs.size() == 0)
+		return;
+	bool found;
+	chain.push_back(nbrs[0]);
+	chain.push_back(nbrs[1]);
+	nbrs[0] = -1;
+	nbrs[1] = -1;
+	do {
+		uint32_t front = chain.front();
+		uint32_t back = chain.back();
+		found = false;
+		for (int i = 0; i < (int) nbrs.size(); i += 2) {
+			if (nbrs[i] == back && nbrs[i + 1] != (uint32_t) -1) {
+				chain.push_back(nbrs[i + 1]);
+				nbrs[i + 1] = -1;
+				found = true;
+				break;
+			}
+		}
+		if (!found) {
+			for (int i = 1; i < (int) nbrs.size(); i += 2) {
+				if (nbrs[i] == front && nbrs[i - 1] != (uint32_t) -1) {
+					chain.push_front(nbrs[i - 1]);
+					nbrs[i - 1] = -1;
+					found = true;
+					break;
 				}
-			} while (found);
-
+			}
+		}
+		if (!found) {
 			if (chain.size() > 0) {
 				if (!leaveTail && chain.front() == chain.back())
 					chain.pop_back();
-				vertNbrsOut[n].insert(vertNbrsOut[n].end(), chain.begin(),
-						chain.end());
-				/*
-				 nbrs=vertNbrs[n];
-				 std::cout << "in " << n << ": ";
-				 for (int i = 0; i < nbrs.size(); i += 2) {
-				 std::cout << "(" << nbrs[i] << "," << nbrs[i + 1] << ") ";
-				 }
-				 std::cout << std::endl;
-
-				 std::cout << "out " << n << ": ";
-				 for (uint32_t elem : vertNbrsOut[n]) {
-				 std::cout << elem << " ";
-				 }
-
-				 std::cout << std::endl;
-				 */
+				out.insert(out.end(), chain.begin(), chain.end());
+				chain.clear();
 			}
-
+			for (int i = 0; i < (int) nbrs.size(); i += 2) {
+				if (nbrs[i] != (uint32_t) -1 && nbrs[i + 1] != (uint32_t) -1) {
+					chain.push_back(nbrs[i]);
+					chain.push_back(nbrs[i + 1]);
+					nbrs[i] = -1;
+					nbrs[i + 1] = -1;
+					found = true;
+					break;
+				}
+			}
+		}
+	} while (found);
+	if (chain.size() > 0) {
+		if (!leaveTail && chain.front() == chain.back())
+			chain.pop_back();
+		out.insert(out.end(), chain.begin(), chain.end());
+	}
+}
+}
+void MeshAdjacency::build(const Mesh& mesh) {
+	vertexCount = mesh.vertexLocations.size();
+	triCount = mesh.triIndexes.size();
+	quadCount = mesh.quadIndexes.size();
+	detail::BuildVertexFaces(mesh, vertexFaces);
+	int V = (int) vertexCount;
+	int F = (int) (triCount + quadCount);
+	vertexNeighbors.offsets.assign(V + 1, 0);
+	edgeOffsets.assign(V + 1, 0);
+	//Rings are gathered twice, once to count and once to fill, so no per-vertex storage is needed.
+#pragma omp parallel
+	{
+		std::vector<uint32_t> ring;
+#pragma omp for
+		for (int v = 0; v < V; v++) {
+			detail::GatherOneRing(mesh, vertexFaces, v, ring);
+			vertexNeighbors.offsets[v + 1] = (uint32_t) ring.size();
+			edgeOffsets[v + 1] = (uint32_t) (ring.end()
+					- std::upper_bound(ring.begin(), ring.end(), (uint32_t) v));
+		}
+	}
+	for (int v = 0; v < V; v++) {
+		vertexNeighbors.offsets[v + 1] += vertexNeighbors.offsets[v];
+		edgeOffsets[v + 1] += edgeOffsets[v];
+	}
+	vertexNeighbors.indexes.resize(vertexNeighbors.offsets[V]);
+	edges.resize(edgeOffsets[V]);
+#pragma omp parallel
+	{
+		std::vector<uint32_t> ring;
+#pragma omp for
+		for (int v = 0; v < V; v++) {
+			detail::GatherOneRing(mesh, vertexFaces, v, ring);
+			std::copy(ring.begin(), ring.end(),
+					vertexNeighbors.indexes.begin() + vertexNeighbors.offsets[v]);
+			uint32_t e = edgeOffsets[v];
+			for (uint32_t nbr : ring) {
+				if (nbr > (uint32_t) v) {
+					edges[e++] = uint2((uint32_t) v, nbr);
+				}
+			}
+		}
+	}
+	faceNeighbors.offsets.assign(F + 1, 0);
+#pragma omp parallel for
+	for (int f = 0; f < F; f++) {
+		uint32_t count = 0;
+		detail::ForEachFaceNeighbor(mesh, vertexFaces, f, [&](uint32_t g) {
+			count++;
+		});
+		faceNeighbors.offsets[f + 1] = count;
+	}
+	for (int f = 0; f < F; f++) {
+		faceNeighbors.offsets[f + 1] += faceNeighbors.offsets[f];
+	}
+	faceNeighbors.indexes.resize(faceNeighbors.offsets[F]);
+#pragma omp parallel for
+	for (int f = 0; f < F; f++) {
+		uint32_t index = faceNeighbors.offsets[f];
+		detail::ForEachFaceNeighbor(mesh, vertexFaces, f, [&](uint32_t g) {
+			faceNeighbors.indexes[index++] = g;
+		});
+	}
+}
+bool MeshAdjacency::isValid(const Mesh& mesh) const {
+	return (vertexCount == mesh.vertexLocations.size()
+			&& triCount == mesh.triIndexes.size()
+			&& quadCount == mesh.quadIndexes.size());
+}
+int64_t MeshAdjacency::findEdge(uint32_t a, uint32_t b) const {
+	if (a > b)
+		std::swap(a, b);
+	if (b >= vertexCount)
+		return -1;
+	MeshNeighborTable::Row row = vertexNeighbors[a];
+	const uint32_t* upper = std::upper_bound(row.begin(), row.end(), a);
+	const uint32_t* pos = std::lower_bound(upper, row.end(), b);
+	if (pos == row.end() || *pos != b)
+		return -1;
+	return (int64_t) edgeOffsets[a] + (pos - upper);
+}
+const MeshAdjacency& Mesh::getAdjacency() const {
+	if (adjacency.get() == nullptr || !adjacency->isValid(*this)) {
+		//Replaced rather than rebuilt, since copies of this mesh may share it.
+		adjacency.reset(new MeshAdjacency());
+		adjacency->build(*this);
+	}
+	return *adjacency;
+}
+void CreateVertexNeighborTable(const Mesh& mesh, MeshNeighborTable& vertNbrs) {
+	vertNbrs = mesh.getAdjacency().vertexNeighbors;
+}
+void CreateFaceNeighborTable(const Mesh& mesh, MeshNeighborTable& faceNbrs) {
+	faceNbrs = mesh.getAdjacency().faceNeighbors;
+}
+void CreateOrderedVertexNeighborTable(const Mesh& mesh,
+		MeshNeighborTable& vertNbrs, bool leaveTail) {
+	const MeshNeighborTable& vertexFaces = mesh.getAdjacency().vertexFaces;
+	int V = (int) mesh.vertexLocations.size();
+	vertNbrs.offsets.assign(V + 1, 0);
+#pragma omp parallel
+	{
+		std::vector<uint32_t> nbrs, ring;
+		std::deque<uint32_t> chain;
+#pragma omp for
+		for (int v = 0; v < V; v++) {
+			detail::OrderOneRing(mesh, vertexFaces, v, leaveTail, nbrs, chain, ring);
+			vertNbrs.offsets[v + 1] = (uint32_t) ring.size();
+		}
+	}
+	for (int v = 0; v < V; v++) {
+		vertNbrs.offsets[v + 1] += vertNbrs.offsets[v];
+	}
+	vertNbrs.indexes.resize(vertNbrs.offsets[V]);
+#pragma omp parallel
+	{
+		std::vector<uint32_t> nbrs, ring;
+		std::deque<uint32_t> chain;
+#pragma omp for
+		for (int v = 0; v < V; v++) {
+			detail::OrderOneRing(mesh, vertexFaces, v, leaveTail, nbrs, chain, ring);
+			std::copy(ring.begin(), ring.end(),
+					vertNbrs.indexes.begin() + vertNbrs.offsets[v]);
 		}
 	}
 }
+void CreateVertexNeighborTable(const Mesh& mesh,
+		std::vector<std::unordered_set<uint32_t>>& vertNbrs) {
+	const MeshNeighborTable& table = mesh.getAdjacency().vertexNeighbors;
+	vertNbrs.resize(table.size());
+#pragma omp parallel for
+	for (int v = 0; v < (int) table.size(); v++) {
+		MeshNeighborTable::Row row = table[v];
+		vertNbrs[v] = std::unordered_set<uint32_t>(row.begin(), row.end());
+	}
+}
+void CreateOrderedVertexNeighborTable(const Mesh& mesh,
+		std::vector<std::list<uint32_t>>& vertNbrsOut, bool leaveTail) {
+	MeshNeighborTable table;
+	CreateOrderedVertexNeighborTable(mesh, table, leaveTail);
+	vertNbrsOut.resize(table.size());
+	for (size_t v = 0; v < table.size(); v++) {
+		MeshNeighborTable::Row row = table[v];
+		vertNbrsOut[v].assign(row.begin(), row.end());
+	}
+}
+void CreateFaceNeighborTable(const Mesh& mesh,
+		std::vector<std::list<uint32_t>>& faceNbrs) {
+	const MeshNeighborTable& table = mesh.getAdjacency().faceNeighbors;
+	faceNbrs.resize(table.size());
+	for (size_t f = 0; f < table.size(); f++) {
+		MeshNeighborTable::Row row = table[f];
+		faceNbrs[f].assign(row.begin(), row.end());
+	}
+}
 
 bool Mesh::convertQuadsToTriangles() {
 	bool ret = (quadIndexes.size() > 0);
@@ -1795,420 +2118,191 @@ bool Mesh::convertQuadsToTriangles() {
 			}
 		}
 	}
-	if (quadIndexes.size() > 0)
+	if (quadIndexes.size() > 0) {
 		setDirty(true);
+	}
 	quadIndexes.clear();
 	if (ret&&vertexNormals.size() > 0) {
 		updateVertexNormals();
 	}
 	return ret;
 }
-void CreateFaceNeighborTable(const Mesh& mesh,
-		std::vector<std::list<uint32_t>>& faceNbrs) {
-	faceNbrs.resize(mesh.triIndexes.size() + mesh.quadIndexes.size());
-	std::map<uint64_t, std::list<uint>> edgeTable;
-	uint2 edge;
-	uint fid = 0;
-	for (const uint3& face : mesh.triIndexes.data) {
-		edge = (face.x < face.y) ?
-				uint2(face.x, face.y) : uint2(face.y, face.x);
-		edgeTable[faceHashCode(edge)].push_back(fid);
-		edge = (face.y < face.z) ?
-				uint2(face.y, face.z) : uint2(face.z, face.y);
-		edgeTable[faceHashCode(edge)].push_back(fid);
-		edge = (face.z < face.x) ?
-				uint2(face.z, face.x) : uint2(face.x, face.z);
-		edgeTable[faceHashCode(edge)].push_back(fid);
-		fid++;
-	}
-	for (const uint4& face : mesh.quadIndexes.data) {
-		edge = (face.x < face.y) ?
-				uint2(face.x, face.y) : uint2(face.y, face.x);
-		edgeTable[faceHashCode(edge)].push_back(fid);
-		edge = (face.y < face.z) ?
-				uint2(face.y, face.z) : uint2(face.z, face.y);
-		edgeTable[faceHashCode(edge)].push_back(fid);
-		edge = (face.z < face.w) ?
-				uint2(face.z, face.w) : uint2(face.w, face.z);
-		edgeTable[faceHashCode(edge)].push_back(fid);
-		edge = (face.w < face.x) ?
-				uint2(face.w, face.x) : uint2(face.x, face.w);
-		edgeTable[faceHashCode(edge)].push_back(fid);
-		fid++;
-	}
-	for (std::pair<const uint64_t, std::list<uint>>& edgeList : edgeTable) {
-		if (edgeList.second.size() == 2) {
-			uint fid1 = edgeList.second.front();
-			uint fid2 = edgeList.second.back();
-			if (fid1 != fid2) {
-				faceNbrs[fid1].push_back(fid2);
-				faceNbrs[fid2].push_back(fid1);
-			}
-		}
-	}
-}
-struct FaceEdge {
-	std::list<uint> faces;
-	size_t edgePointIndex;
-};
 void SubdivideCatmullClark(Mesh& mesh) {
-	std::vector<std::list<uint32_t>> faceFaceNbrs;
-	faceFaceNbrs.resize(mesh.triIndexes.size() + mesh.quadIndexes.size());
-	std::map<uint64_t, FaceEdge> edgeTable;
-	std::set<uint2> edges;
+	const MeshAdjacency& adj = mesh.getAdjacency();
 	bool hasUVs = mesh.textureMap.size() > 0;
 	bool hasColor = mesh.vertexColors.size() > 0;
-	std::vector<std::pair<int, float3>> faceVerts(mesh.vertexLocations.size(),
-			std::pair<int, float3>(0, float3(0.0f)));
-	std::vector<std::pair<int, float3>> edgeVerts(mesh.vertexLocations.size(),
-			std::pair<int, float3>(0, float3(0.0f)));
-	uint2 edge;
-	uint fid = 0;
-	for (const uint3& face : mesh.triIndexes.data) {
-		edge = (face.x < face.y) ?
-				uint2(face.x, face.y) : uint2(face.y, face.x);
-		edges.insert(edge);
-		edgeTable[faceHashCode(edge)].faces.push_back(fid);
-
-		edge = (face.y < face.z) ?
-				uint2(face.y, face.z) : uint2(face.z, face.y);
-		edges.insert(edge);
-		edgeTable[faceHashCode(edge)].faces.push_back(fid);
-
-		edge = (face.z < face.x) ?
-				uint2(face.z, face.x) : uint2(face.x, face.z);
-		edges.insert(edge);
-		edgeTable[faceHashCode(edge)].faces.push_back(fid);
-		fid++;
-	}
-	for (const uint4& face : mesh.quadIndexes.data) {
-		edge = (face.x < face.y) ?
-				uint2(face.x, face.y) : uint2(face.y, face.x);
-		edges.insert(edge);
-		edgeTable[faceHashCode(edge)].faces.push_back(fid);
-
-		edge = (face.y < face.z) ?
-				uint2(face.y, face.z) : uint2(face.z, face.y);
-		edges.insert(edge);
-		edgeTable[faceHashCode(edge)].faces.push_back(fid);
-
-		edge = (face.z < face.w) ?
-				uint2(face.z, face.w) : uint2(face.w, face.z);
-		edges.insert(edge);
-		edgeTable[faceHashCode(edge)].faces.push_back(fid);
-
-		edge = (face.w < face.x) ?
-				uint2(face.w, face.x) : uint2(face.x, face.w);
-		edges.insert(edge);
-		edgeTable[faceHashCode(edge)].faces.push_back(fid);
-		fid++;
-	}
-	for (std::pair<const uint64_t, FaceEdge>& edgeList : edgeTable) {
-		if (edgeList.second.faces.size() == 2) {
-			uint fid1 = edgeList.second.faces.front();
-			uint fid2 = edgeList.second.faces.back();
-			if (fid1 != fid2) {
-				faceFaceNbrs[fid1].push_back(fid2);
-				faceFaceNbrs[fid2].push_back(fid1);
-			}
-		}
-	}
-	size_t backIndex = mesh.vertexLocations.size();
-	size_t endIndex = backIndex;
-	mesh.vertexLocations.resize(
-			endIndex + mesh.quadIndexes.size() + mesh.triIndexes.size()
-					+ edges.size());
+	int T = (int) mesh.triIndexes.size();
+	int Q = (int) mesh.quadIndexes.size();
+	int E = (int) adj.edges.size();
+	int V = (int) mesh.vertexLocations.size();
+	//Face points follow the original vertices, then edge points.
+	size_t backIndex = V;
+	size_t edgeIndex = backIndex + T + Q;
+	mesh.vertexLocations.resize(edgeIndex + E);
 	if (hasColor) {
-		mesh.vertexColors.resize(
-				endIndex + mesh.quadIndexes.size() + mesh.triIndexes.size()
-						+ edges.size());
-	}
-	for (const uint3& face : mesh.triIndexes.data) {
-		float3 pt1 = mesh.vertexLocations[face.x];
-		float3 pt2 = mesh.vertexLocations[face.y];
-		float3 pt3 = mesh.vertexLocations[face.z];
-		float3 avg = 0.33333333f * (pt1 + pt2 + pt3);
-		for (int k = 0; k < 3; k++) {
-			std::pair<int, float3>& pr = faceVerts[face[k]];
-			pr.first++;
-			pr.second += avg;
-		}
-		if (hasColor) {
-			mesh.vertexColors[endIndex] = 0.3333333f
-					* (mesh.vertexColors[face.x] + mesh.vertexColors[face.y]
-							+ mesh.vertexColors[face.z]);
-		}
-		mesh.vertexLocations[endIndex++] = avg;
-	}
-	for (const uint4& face : mesh.quadIndexes.data) {
-		float3 pt1 = mesh.vertexLocations[face.x];
-		float3 pt2 = mesh.vertexLocations[face.y];
-		float3 pt3 = mesh.vertexLocations[face.z];
-		float3 pt4 = mesh.vertexLocations[face.w];
-		float3 avg = 0.25f * (pt1 + pt2 + pt3 + pt4);
-		for (int k = 0; k < 4; k++) {
-			std::pair<int, float3>& pr = faceVerts[face[k]];
-			pr.first++;
-			pr.second += avg;
-		}
+		mesh.vertexColors.resize(edgeIndex + E);
+	}
+#pragma omp parallel for
+	for (int f = 0; f < T + Q; f++) {
+		uint32_t verts[4];
+		int n = detail::FaceVertices(mesh, f, verts);
+		float3 avg(0.0f);
+		float4 color(0.0f);
+		for (int k = 0; k < n; k++) {
+			avg += mesh.vertexLocations[verts[k]];
+			if (hasColor)
+				color += mesh.vertexColors[verts[k]];
+		}
+		mesh.vertexLocations[backIndex + f] = avg * (1.0f / n);
 		if (hasColor) {
-			mesh.vertexColors[endIndex] = 0.25f
-					* (mesh.vertexColors[face.x] + mesh.vertexColors[face.y]
-							+ mesh.vertexColors[face.z]
-							+ mesh.vertexColors[face.w]);
+			mesh.vertexColors[backIndex + f] = color * (1.0f / n);
 		}
-		mesh.vertexLocations[endIndex++] = avg;
 	}
-	for (uint2 edge : edges) {
+#pragma omp parallel for
+	for (int e = 0; e < E; e++) {
+		uint2 edge = adj.edges[e];
 		float3 pt1 = mesh.vertexLocations[edge.x];
 		float3 pt2 = mesh.vertexLocations[edge.y];
-		FaceEdge& fe = edgeTable[faceHashCode(edge)];
-		fe.edgePointIndex = endIndex;
+		uint32_t front = 0, back = 0;
 		float3 avg;
-		if (fe.faces.size() < 2) {
+		if (detail::EdgeFaces(mesh, adj, edge.x, edge.y, front, back) < 2) {
 			avg = 0.5f * (pt1 + pt2);
 		} else {
-			avg =
-					0.25f
-							* (pt1 + pt2
-									+ mesh.vertexLocations[fe.faces.front()
-											+ backIndex]
-									+ mesh.vertexLocations[fe.faces.back()
-											+ backIndex]);
-		}
-		for (int k = 0; k < 2; k++) {
-			std::pair<int, float3>& pr = edgeVerts[edge[k]];
-			pr.first++;
-			pr.second += avg;
+			avg = 0.25f
+					* (pt1 + pt2 + mesh.vertexLocations[front + backIndex]
+							+ mesh.vertexLocations[back + backIndex]);
 		}
 		if (hasColor) {
-			mesh.vertexColors[endIndex] = 0.5f
+			mesh.vertexColors[edgeIndex + e] = 0.5f
 					* (mesh.vertexColors[edge.x] + mesh.vertexColors[edge.y]);
 		}
-		mesh.vertexLocations[endIndex++] = avg;
-
+		mesh.vertexLocations[edgeIndex + e] = avg;
 	}
-	std::vector<uint4> newQuads(
-			4 * mesh.quadIndexes.size() + 3 * mesh.triIndexes.size());
-	std::vector<float2> uvs(newQuads.size() * 4);
-	size_t faceIndex = 0;
-	size_t uvIndex = 0;
-	fid = 0;
-	endIndex = backIndex;
-	for (const uint3& face : mesh.triIndexes.data) {
-		edge = (face.x < face.y) ?
-				uint2(face.x, face.y) : uint2(face.y, face.x);
-		size_t ept1 = edgeTable[faceHashCode(edge)].edgePointIndex;
-		edge = (face.y < face.z) ?
-				uint2(face.y, face.z) : uint2(face.z, face.y);
-		size_t ept2 = edgeTable[faceHashCode(edge)].edgePointIndex;
-		edge = (face.z < face.x) ?
-				uint2(face.z, face.x) : uint2(face.x, face.z);
-		size_t ept3 = edgeTable[faceHashCode(edge)].edgePointIndex;
-
-		if (hasUVs) {
-			float2 uv1 = mesh.textureMap[fid];
-			float2 uv2 = mesh.textureMap[fid + 1];
-			float2 uv3 = mesh.textureMap[fid + 2];
-			float2 uva = 0.33333333f * (uv1 + uv2 + uv3);
-			float2 upt1 = 0.5f * (uv1 + uv2);
-			float2 upt2 = 0.5f * (uv2 + uv3);
-			float2 upt3 = 0.5f * (uv3 + uv1);
-
-			uvs[uvIndex++] = uv1;
-			uvs[uvIndex++] = upt1;
-			uvs[uvIndex++] = uva;
-			uvs[uvIndex++] = upt3;
-
-			uvs[uvIndex++] = uv2;
-			uvs[uvIndex++] = upt2;
-			uvs[uvIndex++] = uva;
-			uvs[uvIndex++] = upt1;
-
-			uvs[uvIndex++] = uv3;
-			uvs[uvIndex++] = upt3;
-			uvs[uvIndex++] = uva;
-			uvs[uvIndex++] = upt2;
-			fid += 3;
-		}
-		newQuads[faceIndex++] = uint4(face.x, (uint32_t) ept1,
-				(uint32_t) endIndex, (uint32_t) ept3);
-		newQuads[faceIndex++] = uint4(face.y, (uint32_t) ept2,
-				(uint32_t) endIndex, (uint32_t) ept1);
-		newQuads[faceIndex++] = uint4(face.z, (uint32_t) ept3,
-				(uint32_t) endIndex, (uint32_t) ept2);
-		endIndex++;
-	}
-	for (const uint4& face : mesh.quadIndexes.data) {
-		edge = (face.x < face.y) ?
-				uint2(face.x, face.y) : uint2(face.y, face.x);
-		size_t ept1 = edgeTable[faceHashCode(edge)].edgePointIndex;
-		edge = (face.y < face.z) ?
-				uint2(face.y, face.z) : uint2(face.z, face.y);
-		size_t ept2 = edgeTable[faceHashCode(edge)].edgePointIndex;
-		edge = (face.z < face.w) ?
-				uint2(face.z, face.w) : uint2(face.w, face.z);
-		size_t ept3 = edgeTable[faceHashCode(edge)].edgePointIndex;
-		edge = (face.w < face.x) ?
-				uint2(face.w, face.x) : uint2(face.x, face.w);
-		size_t ept4 = edgeTable[faceHashCode(edge)].edgePointIndex;
+	std::vector<uint4> newQuads(4 * Q + 3 * T);
+	std::vector<float2> uvs(hasUVs ? newQuads.size() * 4 : 0);
+#pragma omp parallel for
+	for (int f = 0; f < T + Q; f++) {
+		uint32_t verts[4];
+		uint32_t ept[4];
+		float2 uv[4];
+		float2 upt[4];
+		int n = detail::FaceVertices(mesh, f, verts);
+		size_t faceIndex = (f < T) ? 3 * f : 3 * T + 4 * (f - T);
+		size_t fid = faceIndex;
+		uint32_t facePoint = (uint32_t) (backIndex + f);
+		for (int k = 0; k < n; k++) {
+			ept[k] = (uint32_t) (edgeIndex + adj.findEdge(verts[k], verts[(k + 1) % n]));
+		}
 		if (hasUVs) {
-			float2 uv1 = mesh.textureMap[fid];
-			float2 uv2 = mesh.textureMap[fid + 1];
-			float2 uv3 = mesh.textureMap[fid + 2];
-			float2 uv4 = mesh.textureMap[fid + 3];
-			float2 uva = 0.25f * (uv1 + uv2 + uv3 + uv4);
-			float2 upt1 = 0.5f * (uv1 + uv2);
-			float2 upt2 = 0.5f * (uv2 + uv3);
-			float2 upt3 = 0.5f * (uv3 + uv4);
-			float2 upt4 = 0.5f * (uv4 + uv1);
-
-			uvs[uvIndex++] = uv1;
-			uvs[uvIndex++] = upt1;
-			uvs[uvIndex++] = uva;
-			uvs[uvIndex++] = upt4;
-
-			uvs[uvIndex++] = uv2;
-			uvs[uvIndex++] = upt2;
-			uvs[uvIndex++] = uva;
-			uvs[uvIndex++] = upt1;
-
-			uvs[uvIndex++] = uv3;
-			uvs[uvIndex++] = upt3;
-			uvs[uvIndex++] = uva;
-			uvs[uvIndex++] = upt2;
-
-			uvs[uvIndex++] = uv4;
-			uvs[uvIndex++] = upt4;
-			uvs[uvIndex++] = uva;
-			uvs[uvIndex++] = upt3;
-			fid += 4;
-		}
-		newQuads[faceIndex++] = uint4(face.x, (uint32_t) ept1,
-				(uint32_t) endIndex, (uint32_t) ept4);
-		newQuads[faceIndex++] = uint4(face.y, (uint32_t) ept2,
-				(uint32_t) endIndex, (uint32_t) ept1);
-		newQuads[faceIndex++] = uint4(face.z, (uint32_t) ept3,
-				(uint32_t) endIndex, (uint32_t) ept2);
-		newQuads[faceIndex++] = uint4(face.w, (uint32_t) ept4,
-				(uint32_t) endIndex, (uint32_t) ept3);
-
-		endIndex++;
+			float2 uva(0.0f);
+			for (int k = 0; k < n; k++) {
+				uv[k] = mesh.textureMap[fid + k];
+				uva += uv[k];
+			}
+			uva *= (1.0f / n);
+			for (int k = 0; k < n; k++) {
+				upt[k] = 0.5f * (uv[k] + uv[(k + 1) % n]);
+			}
+			size_t uvIndex = 4 * faceIndex;
+			for (int k = 0; k < n; k++) {
+				uvs[uvIndex++] = uv[k];
+				uvs[uvIndex++] = upt[k];
+				uvs[uvIndex++] = uva;
+				uvs[uvIndex++] = upt[(k + n - 1) % n];
+			}
+		}
+		for (int k = 0; k < n; k++) {
+			newQuads[faceIndex + k] = uint4(verts[k], ept[k], facePoint,
+					ept[(k + n - 1) % n]);
+		}
 	}
-	for (int n = 0; n < (int) faceVerts.size(); n++) {
-		float3 P = mesh.vertexLocations[n];
-		int fcount = faceVerts[n].first;
-		int ecount = edgeVerts[n].first;
-
-		float3 F = faceVerts[n].second / (float) fcount;
-		float3 R = edgeVerts[n].second / (float) ecount;
-
-		mesh.vertexLocations[n] = (F + 2.0f * R + (ecount - 3.0f) * P)
+#pragma omp parallel for
+	for (int v = 0; v < V; v++) {
+		MeshNeighborTable::Row faces = adj.vertexFaces[v];
+		MeshNeighborTable::Row nbrs = adj.vertexNeighbors[v];
+		int fcount = (int) faces.size();
+		int ecount = (int) nbrs.size();
+		//Isolated vertices stay where they are.
+		if (fcount == 0 || ecount == 0)
+			continue;
+		float3 F(0.0f), R(0.0f);
+		for (uint32_t f : faces) {
+			F += mesh.vertexLocations[backIndex + f];
+		}
+		for (uint32_t nbr : nbrs) {
+			R += mesh.vertexLocations[edgeIndex + adj.findEdge(v, nbr)];
+		}
+		F /= (float) fcount;
+		R /= (float) ecount;
+		float3 P = mesh.vertexLocations[v];
+		mesh.vertexLocations[v] = (F + 2.0f * R + (ecount - 3.0f) * P)
 				/ (float) ecount;
 	}
 	if (hasUVs)
 		mesh.textureMap = uvs;
 	mesh.quadIndexes = newQuads;
 	mesh.triIndexes.clear();
+	mesh.clearAdjacency();
 	if (mesh.vertexNormals.size() > 0)
 		mesh.updateVertexNormals();
 	mesh.setDirty(true);
 }
 void SubdivideLoop(Mesh& mesh) {
 	mesh.convertQuadsToTriangles();
-	std::map<uint64_t, FaceEdge> edgeTable;
-	std::set<uint2> edges;
-	uint2 edge;
-	uint fid = 0;
+	const MeshAdjacency& adj = mesh.getAdjacency();
 	bool hasUVs = mesh.textureMap.size() > 0;
 	bool hasColor = mesh.vertexColors.size() > 0;
-	for (const uint3& face : mesh.triIndexes.data) {
-		edge = (face.x < face.y) ?
-				uint2(face.x, face.y) : uint2(face.y, face.x);
-		edges.insert(edge);
-		edgeTable[faceHashCode(edge)].faces.push_back(fid);
-
-		edge = (face.y < face.z) ?
-				uint2(face.y, face.z) : uint2(face.z, face.y);
-		edges.insert(edge);
-		edgeTable[faceHashCode(edge)].faces.push_back(fid);
-
-		edge = (face.z < face.x) ?
-				uint2(face.z, face.x) : uint2(face.x, face.z);
-		edges.insert(edge);
-		edgeTable[faceHashCode(edge)].faces.push_back(fid);
-		fid++;
-	}
-
-	size_t backIndex = mesh.vertexLocations.size();
-	size_t endIndex = backIndex;
-	mesh.vertexLocations.resize(endIndex + edges.size());
+	int T = (int) mesh.triIndexes.size();
+	int E = (int) adj.edges.size();
+	int V = (int) mesh.vertexLocations.size();
+	size_t backIndex = V;
+	std::vector<float3> oldLocations(mesh.vertexLocations.data.begin(),
+			mesh.vertexLocations.data.end());
+	mesh.vertexLocations.resize(backIndex + E);
 	if (hasColor)
 		mesh.vertexColors.resize(mesh.vertexLocations.size());
-	for (uint2 edge : edges) {
-		float3 pt1 = mesh.vertexLocations[edge.x];
-		float3 pt2 = mesh.vertexLocations[edge.y];
-		FaceEdge& fe = edgeTable[faceHashCode(edge)];
-		fe.edgePointIndex = endIndex;
-		float3 avg;
-		if (fe.faces.size() < 2) {
-			avg = 0.5f * (pt1 + pt2);
-		} else {
-			uint3 face = mesh.triIndexes[fe.faces.front()];
-			int other1 = -1, other2 = -1;
-			if ((face.x == edge.x && face.y == edge.y)
-					|| (face.y == edge.x && face.x == edge.y)) {
-				other1 = face.z;
-			} else if ((face.y == edge.x && face.z == edge.y)
-					|| (face.z == edge.x && face.y == edge.y)) {
-				other1 = face.x;
-			} else if ((face.x == edge.x && face.z == edge.y)
-					|| (face.z == edge.x && face.x == edge.y)) {
-				other1 = face.y;
-			}
-			face = mesh.triIndexes[fe.faces.back()];
-			if ((face.x == edge.x && face.y == edge.y)
-					|| (face.y == edge.x && face.x == edge.y)) {
-				other2 = face.z;
-			} else if ((face.y == edge.x && face.z == edge.y)
-					|| (face.z == edge.x && face.y == edge.y)) {
-				other2 = face.x;
-			} else if ((face.x == edge.x && face.z == edge.y)
-					|| (face.z == edge.x && face.x == edge.y)) {
-				other2 = face.y;
-			}
-			if (other1 >= 0 && other2 >= 0) {
+#pragma omp parallel for
+	for (int e = 0; e < E; e++) {
+		uint2 edge = adj.edges[e];
+		float3 pt1 = oldLocations[edge.x];
+		float3 pt2 = oldLocations[edge.y];
+		uint32_t front = 0, back = 0;
+		float3 avg = 0.5f * (pt1 + pt2);
+		if (detail::EdgeFaces(mesh, adj, edge.x, edge.y, front, back) >= 2) {
+			//Vertices opposite the edge in its first and last face.
+			int other[2] = { -1, -1 };
+			uint32_t faces[2] = { front, back };
+			for (int n = 0; n < 2; n++) {
+				uint3 face = mesh.triIndexes[faces[n]];
+				for (int k = 0; k < 3; k++) {
+					if (face[k] != edge.x && face[k] != edge.y) {
+						other[n] = face[k];
+					}
+				}
+			}
+			if (other[0] >= 0 && other[1] >= 0) {
 				avg = 0.125f
-						* (3.0f * pt1 + 3.0f * pt2
-								+ mesh.vertexLocations[other1]
-								+ mesh.vertexLocations[other2]);
-			} else {
-				avg = 0.5f * (pt1 + pt2);
+						* (3.0f * pt1 + 3.0f * pt2 + oldLocations[other[0]]
+								+ oldLocations[other[1]]);
 			}
 		}
 		if (hasColor) {
-			mesh.vertexColors[endIndex] = 0.5f
+			mesh.vertexColors[backIndex + e] = 0.5f
 					* (mesh.vertexColors[edge.x] + mesh.vertexColors[edge.y]);
 		}
-		mesh.vertexLocations[endIndex++] = avg;
-	}
-	std::vector<uint3> newTris(4 * mesh.triIndexes.size());
-	size_t faceIndex = 0;
-	endIndex = backIndex;
-	fid = 0;
-	std::vector<float2> uvs(newTris.size() * 3);
-	size_t uvIndex = 0;
-	for (const uint3& face : mesh.triIndexes.data) {
-		edge = (face.x < face.y) ?
-				uint2(face.x, face.y) : uint2(face.y, face.x);
-		size_t ept1 = edgeTable[faceHashCode(edge)].edgePointIndex;
-		edge = (face.y < face.z) ?
-				uint2(face.y, face.z) : uint2(face.z, face.y);
-		size_t ept2 = edgeTable[faceHashCode(edge)].edgePointIndex;
-		edge = (face.z < face.x) ?
-				uint2(face.z, face.x) : uint2(face.x, face.z);
-		size_t ept3 = edgeTable[faceHashCode(edge)].edgePointIndex;
+		mesh.vertexLocations[backIndex + e] = avg;
+	}
+	std::vector<uint3> newTris(4 * T);
+	std::vector<float2> uvs(hasUVs ? newTris.size() * 3 : 0);
+#pragma omp parallel for
+	for (int f = 0; f < T; f++) {
+		const uint3& face = mesh.triIndexes[f];
+		uint32_t ept1 = (uint32_t) (backIndex + adj.findEdge(face.x, face.y));
+		uint32_t ept2 = (uint32_t) (backIndex + adj.findEdge(face.y, face.z));
+		uint32_t ept3 = (uint32_t) (backIndex + adj.findEdge(face.z, face.x));
 		if (hasUVs) {
+			size_t fid = 3 * (size_t) f;
+			size_t uvIndex = 12 * (size_t) f;
 			float2 uv1 = mesh.textureMap[fid];
 			float2 uv2 = mesh.textureMap[fid + 1];
 			float2 uv3 = mesh.textureMap[fid + 2];
@@ -2230,25 +2324,13 @@ void SubdivideLoop(Mesh& mesh) {
 			uvs[uvIndex++] = upt1;
 			uvs[uvIndex++] = upt2;
 			uvs[uvIndex++] = upt3;
-
-			fid += 3;
-		}
-		newTris[faceIndex++] = uint3(face.x, (uint32_t) ept1, (uint32_t) ept3);
-		newTris[faceIndex++] = uint3(face.y, (uint32_t) ept2, (uint32_t) ept1);
-		newTris[faceIndex++] = uint3(face.z, (uint32_t) ept3, (uint32_t) ept2);
-		newTris[faceIndex++] = uint3((uint32_t) ept1, (uint32_t) ept2,
-				(uint32_t) ept3);
-	}
-	std::vector<std::set<uint32_t>> vertNbrs(mesh.vertexLocations.size());
-	for (const uint3& face : mesh.triIndexes.data) {
-		vertNbrs[face.x].insert(face.y);
-		vertNbrs[face.y].insert(face.z);
-		vertNbrs[face.z].insert(face.x);
-		vertNbrs[face.z].insert(face.y);
-		vertNbrs[face.y].insert(face.x);
-		vertNbrs[face.x].insert(face.z);
+		}
+		size_t faceIndex = 4 * (size_t) f;
+		newTris[faceIndex++] = uint3(face.x, ept1, ept3);
+		newTris[faceIndex++] = uint3(face.y, ept2, ept1);
+		newTris[faceIndex++] = uint3(face.z, ept3, ept2);
+		newTris[faceIndex++] = uint3(ept1, ept2, ept3);
 	}
-	mesh.triIndexes = newTris;
 	const int MAX_VALENCE = 32;
 	static std::vector<float> valenceWeights;
 	if (valenceWeights.size() == 0) {
@@ -2259,19 +2341,22 @@ void SubdivideLoop(Mesh& mesh) {
 			valenceWeights[i] = beta;
 		}
 	}
-
-	for (int n = 0; n < (int) backIndex; n++) {
-		int N = (int) vertNbrs[n].size();
+#pragma omp parallel for
+	for (int n = 0; n < V; n++) {
+		MeshNeighborTable::Row nbrs = adj.vertexNeighbors[n];
+		int N = (int) nbrs.size();
 		if (N > 0 && N < MAX_VALENCE) {
 			float beta = valenceWeights[N];
 			float alpha = (1 - N * beta);
-			float3 pt = alpha * mesh.vertexLocations[n];
-			for (uint32_t nbr : vertNbrs[n]) {
-				pt += beta * mesh.vertexLocations[nbr];
+			float3 pt = alpha * oldLocations[n];
+			for (uint32_t nbr : nbrs) {
+				pt += beta * oldLocations[nbr];
 			}
 			mesh.vertexLocations[n] = pt;
 		}
 	}
+	mesh.triIndexes = newTris;
+	mesh.clearAdjacency();
 	if (hasUVs)
 		mesh.textureMap = uvs;
 	if (mesh.vertexNormals.size() > 0)
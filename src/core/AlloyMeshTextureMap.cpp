@@ -23,6 +23,7 @@
 #include "AlloySparseMatrix.h"
 #include "AlloySparseSolve.h"
 #include "AlloyOptimization.h"
+#include "AlloyConnectedComponents.h"
 #include <algorithm>
 #include <random>
 namespace aly {
@@ -145,66 +146,8 @@ namespace aly {
 			return (int)cclist.size();
 		}
 	int GetConnectedVertexComponents(const aly::Mesh& mesh, std::vector<int>& cclist, std::vector<int>& labels) {
-		int vertexCount = (int)mesh.vertexLocations.size();
-		int faceCount = (int)mesh.triIndexes.size();
-		std::vector<std::list<int>> vertNbrs(vertexCount);
-
-		for (int i = 0; i < faceCount; i++) {
-			uint3 face = mesh.triIndexes[i];
-			int v1 = face.x;
-			int v2 = face.y;
-			int v3 = face.z;
-			vertNbrs[v1].push_back(v2);
-			vertNbrs[v1].push_back(v3);
-			vertNbrs[v2].push_back(v3);
-			vertNbrs[v2].push_back(v1);
-			vertNbrs[v3].push_back(v1);
-			vertNbrs[v3].push_back(v2);
-		}
-		labels.resize(vertexCount, -1);
-		int pivot = 0;
-		int cc = 0;
-		std::list<int> queue;
-
-		cclist.clear();
-		int masked = 0;
-		int ccCount = 0;
-		std::vector<int> nbrs;
-		cclist.clear();
-		do {
-			ccCount = 0;
-			queue.clear();
-			labels[pivot] = cc;
-			ccCount++;
-			queue.push_back(pivot);
-			masked++;
-			int iter = 0;
-			while (queue.size() > 0) {
-				int v = queue.front();
-				queue.pop_front();
-				nbrs.clear();
-				iter++;
-				for (int nbr : vertNbrs[v]) {
-					if (labels[nbr] < 0) {
-						labels[nbr] = cc;
-						ccCount++;
-						masked++;
-						queue.push_back(nbr);
-					}
-				}
-			}
-			cclist.push_back(ccCount);
-			int lastPivot = pivot;
-			pivot = -1;
-			for (int i = lastPivot + 1; i < vertexCount; i++) {
-				if (labels[i] < 0) {
-					pivot = i;
-					break;
-				}
-			}
-			cc++;
-		} while (pivot >= 0);
-		return (int)cclist.size();
+		const MeshNeighborTable& vertNbrs = mesh.getAdjacency().vertexNeighbors;
+		return LabelConnectedComponents(vertNbrs.offsets, vertNbrs.indexes, labels, cclist);
 	}
 	int ColorizeMeshTextureRegions(Mesh& mesh){
 		std::vector<int> indexes;
@@ -1173,25 +1116,22 @@ namespace aly {
 	}
 	void MeshTextureMap::smooth(aly::Mesh& mesh,  int iters, float errorTolerance){
 
-		MeshSetNeighborTable nbrTable;
-		CreateVertexNeighborTable(mesh, nbrTable);
+		const MeshNeighborTable& nbrTable = mesh.getAdjacency().vertexNeighbors;
 		int index = 0;
 		int N =  (int)mesh.vertexLocations.size();
 		SparseMatrix1f A(N, N);
 		Vector3f b(N);
 
-		for (std::unordered_set<uint32_t>& nbrs : nbrTable) {
+		for (size_t v = 0; v < nbrTable.size(); v++) {
+			MeshNeighborTable::Row nbrs = nbrTable[v];
 			int K = (int)nbrs.size() - 1;
 			if(K>0){
 				float3 pt = mesh.vertexLocations[index];
 				{
-					auto nbrIter = nbrs.begin();
-					nbrIter++;
 					for (int k = 0; k < K; k++) {
 						float w = -smoothness / K;
-						int offset = *nbrIter;
+						int offset = nbrs[k + 1];
 						A.set(index, offset, w);
-						nbrIter++;
 					}
 				}
 				A.set(index, index, smoothness + 1);
@@ -135,6 +135,8 @@ namespace aly {
 		Vec<T> delta, pnew;
 		Vec<T> eps = problem.residual(p);
 		SparseMat<T> J, Jt, JtJ, A, Astar;
+		//The pattern of J^T*J is fixed, so the ordering and symbolic factorization are reused.
+		SparseCholesky<T> cholesky;
 		problem.differentiate(p, J);
 		Jt = J.transpose();
 		Vec<T> g = Jt * eps;
@@ -151,17 +153,21 @@ namespace aly {
 		while (err > errorTolerance && iter < maxIterations && !stop) {
 			T rho = 0;
 			do {
-				Astar = A;
-				for (size_t r = 0; r < A.rows; r++) {
-					Astar(r, r) += mu;
-				}
 				if (monitor) {
 					if (!monitor(iter, err)) {
 						stop = true;
 						break;
 					}
 				}
-				SolveBICGStab(g, Astar, delta, maxIterations, errorTolerance);
+				if (cholesky.compute(A, mu)) {
+					cholesky.solve(g, delta);
+				} else {
+					Astar = A;
+					for (size_t r = 0; r < A.rows; r++) {
+						Astar(r, r) += mu;
+					}
+					SolveBICGStab(g, Astar, delta, maxIterations, errorTolerance);
+				}
 				if (monitor) {
 					if (!monitor(iter, err)) {
 						stop = true;
@@ -178,8 +184,8 @@ namespace aly {
 						problem.differentiate(p, J);
 						Jt = J.transpose();
 						A = Jt * J;
-						g = Jt * eps;
 						eps = problem.residual(p);
+						g = Jt * eps;
 						err = lengthInf(g);
 						if (monitor) {
 							if (!monitor(iter, err)) {
@@ -206,6 +212,7 @@ namespace aly {
 			const std::function<bool(int, double)>& monitor) {
 		//Implementation not tested yet! Use at your own risk!
 		SparseMat<T> J, Jt, JtJ, A;
+		SparseCholesky<T> cholesky;
 		problem.differentiate(p, J);
 		Jt = J.transpose();
 		A = Jt * J;
@@ -233,7 +240,12 @@ namespace aly {
 						}
 					}
 					if (!GNcomputed) {
-						SolveBICGStab(g, A, delta_gn);
+						if (cholesky.compute(A)) {
+							cholesky.solve(g, delta_gn);
+						} else {
+							delta_gn.resize(p.size(), T(0));
+							SolveBICGStab(g, A, delta_gn);
+						}
 						GNcomputed = true;
 					}
 					if (monitor) {
@@ -265,8 +277,8 @@ namespace aly {
 						problem.differentiate(p, J);
 						Jt = J.transpose();
 						A = Jt * J;
-						g = Jt * eps;
 						eps = problem.residual(p);
+						g = Jt * eps;
 						err = lengthInf(g);
 						if (monitor) {
 							if (!monitor(iter, err)) {
@@ -28,6 +28,7 @@
 #include <iostream>
 #include <stddef.h>
 #include <memory>
+#include <cstring>
 using namespace std;
 namespace aly {
 namespace ply {
@@ -583,6 +584,17 @@ void PLYReaderWriter::openForReading(const std::string& fileName,
 		elem->other_offset = NO_OTHER_PROPS; /* no "other" props by default */
 	}
 
+	/* map binary payload so elements are decoded from memory instead of the stream */
+	if (plyFile->file_type != FileFormat::ASCII) {
+		std::streamoff offset = in.tellg();
+		std::unique_ptr<ReadableMemMapFile> mmf(new ReadableMemMapFile(fileName));
+		if (offset >= 0 && mmf->isOpen() && mmf->data() != nullptr
+				&& (size_t) offset <= mmf->getFileSize()) {
+			mapCursor = mmf->data() + offset;
+			mapEnd = mmf->data() + mmf->getFileSize();
+			mapped = std::move(mmf);
+		}
+	}
 	/* set return values about the elements */
 	elem_names->resize(plyFile->elems.size());
 	for (i = 0; i < (int) plyFile->elems.size(); i++)
@@ -983,9 +995,9 @@ void PLYReaderWriter::binaryGetElement(char *elem_ptr) {
 
 		} else if (prop->is_list == SectionType::String) { /* string */
 			int len;
-			in.read((char*) &len, sizeof(int));
+			readBinary((char*) &len, sizeof(int));
 			std::vector<char> buff(len);
-			in.read(buff.data(), buff.size());
+			readBinary(buff.data(), buff.size());
 			std::string str = std::string(buff.begin(), buff.end());
 			if (store_it) {
 				item = elem_data + prop->offset;
@@ -1321,49 +1333,49 @@ void PLYReaderWriter::getBinaryItem(const DataType& type, int *int_val,
 	ptr = (char *) c;
 	switch (type) {
 	case DataType::Int8:
-		in.read(ptr, 1);
+		readBinary(ptr, 1);
 		*int_val = *((char *) ptr);
 		*uint_val = *int_val;
 		*double_val = *int_val;
 		break;
 	case DataType::Uint8:
-		in.read(ptr, 1);
+		readBinary(ptr, 1);
 		*uint_val = *((unsigned char *) ptr);
 		*int_val = *uint_val;
 		*double_val = *uint_val;
 		break;
 	case DataType::Int16:
-		in.read(ptr, 2);
+		readBinary(ptr, 2);
 		*int_val = *((short int *) ptr);
 		*uint_val = *int_val;
 		*double_val = *int_val;
 		break;
 	case DataType::Uint16:
-		in.read(ptr, 2);
+		readBinary(ptr, 2);
 		*uint_val = *((unsigned short int *) ptr);
 		*int_val = *uint_val;
 		*double_val = *uint_val;
 		break;
 	case DataType::Int32:
-		in.read(ptr, 4);
+		readBinary(ptr, 4);
 		*int_val = *((int *) ptr);
 		*uint_val = *int_val;
 		*double_val = *int_val;
 		break;
 	case DataType::Uint32:
-		in.read(ptr, 4);
+		readBinary(ptr, 4);
 		*uint_val = *((unsigned int *) ptr);
 		*int_val = (int)*uint_val;
 		*double_val = (double)*uint_val;
 		break;
 	case DataType::Float32:
-		in.read(ptr, 4);
+		readBinary(ptr, 4);
 		*double_val = *((float *) ptr);
 		*int_val = (int)*double_val;
 		*uint_val = (unsigned int)*double_val;
 		break;
 	case DataType::Float64:
-		in.read(ptr, 8);
+		readBinary(ptr, 8);
 		*double_val = *((double *) ptr);
 		*int_val = (int)*double_val;
 		*uint_val = (unsigned int)*double_val;
@@ -1374,6 +1386,25 @@ void PLYReaderWriter::getBinaryItem(const DataType& type, int *int_val,
 	}
 }
 
+void PLYReaderWriter::readBinary(char* ptr, size_t bytes) {
+	if (mapped.get() != nullptr) {
+		if (bytes > (size_t) (mapEnd - mapCursor)) {
+			throw std::runtime_error(
+					MakeString() << "Unexpected end of PLY data.");
+		}
+		std::memcpy(ptr, mapCursor, bytes);
+		mapCursor += bytes;
+	} else {
+		in.read(ptr, bytes);
+	}
+}
+void PLYReaderWriter::skipMappedBytes(size_t bytes) {
+	if (mapped.get() == nullptr || bytes > (size_t) (mapEnd - mapCursor)) {
+		throw std::runtime_error(
+				MakeString() << "Unexpected end of PLY data.");
+	}
+	mapCursor += bytes;
+}
 /******************************************************************************
  Extract the value of an item from an ascii word, and place the result
  into an integer, an unsigned integer and a double.
@@ -1630,5 +1661,71 @@ void PLYReaderWriter::describeProperty(PlyProperty *prop) {
 	*elem_prop = *prop;
 }
 
+double DecodePlyScalar(const char* ptr, const DataType& type) {
+	switch (type) {
+	case DataType::Int8: {
+		int8_t val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	case DataType::Uint8: {
+		uint8_t val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	case DataType::Int16: {
+		int16_t val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	case DataType::Uint16: {
+		uint16_t val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	case DataType::Int32: {
+		int32_t val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	case DataType::Uint32: {
+		uint32_t val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	case DataType::Float32: {
+		float val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	case DataType::Float64: {
+		double val;
+		std::memcpy(&val, ptr, sizeof(val));
+		return val;
+	}
+	default:
+		throw std::runtime_error(
+				MakeString() << "Bad PLY type = " << type);
+	}
+}
+bool PlyScalarLayout::set(const PlyElement* elem,
+		const std::vector<std::string>& names) {
+	stride = 0;
+	offsets.assign(names.size(), -1);
+	types.assign(names.size(), DataType::StartType);
+	for (const std::shared_ptr<PlyProperty>& prop : elem->props) {
+		if (prop->is_list != SectionType::Scalar) {
+			return false;
+		}
+		for (size_t n = 0; n < names.size(); n++) {
+			if (prop->name == names[n]) {
+				offsets[n] = (int) stride;
+				types[n] = prop->external_type;
+			}
+		}
+		stride += ply_type_size[static_cast<int>(prop->external_type)];
+	}
+	return true;
+}
 }
 }
@@ -46,19 +46,82 @@
 #define DEFAULT_FULL_DEPTH 5
 int echoStdout = 0;
 using namespace aly;
-template<class Real, int Degree, class Vertex, BoundaryType BType> bool ExecuteInternal(const ReconstructionParameters& params, const aly::Mesh& input, aly::Mesh& output,
-	const std::function<bool(const std::string& status, float progress)>& monitor)
+typedef OrientedPointStreamWithData<float, Point3D<float> > ReconstructionInputStream;
+typedef std::function<bool(const std::string& status, float progress)> ReconstructionMonitor;
+/*
+ Maps input points into the unit cube used by the oct-tree. While the input is streamed, the
+ fraction read so far is reported as progress within the current phase.
+ */
+class ReconstructionPointStream : public ReconstructionInputStream
+{
+protected:
+	static const size_t PROGRESS_INTERVAL = 1 << 18;
+	ReconstructionInputStream& stream;
+	float4x4 M;
+	size_t pointCount;
+	size_t counter;
+	std::string status;
+	float2 range;
+	const ReconstructionMonitor& monitor;
+public:
+	ReconstructionPointStream(ReconstructionInputStream& stream, const float4x4& M, size_t pointCount, const std::string& status, const float2& range, const ReconstructionMonitor& monitor)
+		:stream(stream), M(M), pointCount(pointCount), counter(0), status(status), range(range), monitor(monitor) {
+		if (monitor)monitor(status, range.x);
+	}
+	void reset(void) override {
+		stream.reset();
+		counter = 0;
+	}
+	bool nextPoint(OrientedPoint3D<float>& p, Point3D<float>& d) override {
+		if (!stream.nextPoint(p, d)) {
+			return false;
+		}
+		float3 v = Transform(M, float3(p.p[0], p.p[1], p.p[2]));
+		p.p = Point3D<float>(v.x, v.y, v.z);
+		counter++;
+		if (monitor && counter % PROGRESS_INTERVAL == 0) {
+			if (pointCount > 0) {
+				monitor(status, range.x + (range.y - range.x) * std::min(1.0f, counter / (float)pointCount));
+			}
+			else {
+				monitor(MakeString() << status << " (" << counter << " points)", range.x);
+			}
+		}
+		return true;
+	}
+};
+static box3f StreamBoundingBox(ReconstructionInputStream& input, size_t pointCount, const ReconstructionMonitor& monitor) {
+	ReconstructionPointStream stream(input, float4x4::identity(), pointCount, "Computing Bounding Box", float2(0.0f, 0.05f), monitor);
+	OrientedPoint3D<float> p;
+	Point3D<float> d;
+	float3 minPt(std::numeric_limits<float>::max());
+	float3 maxPt(-std::numeric_limits<float>::max());
+	size_t count = 0;
+	while (stream.nextPoint(p, d)) {
+		float3 v(p.p[0], p.p[1], p.p[2]);
+		minPt = aly::min(minPt, v);
+		maxPt = aly::max(maxPt, v);
+		count++;
+	}
+	stream.reset();
+	if (count == 0) {
+		throw std::runtime_error("Point stream is empty.");
+	}
+	return box3f(minPt, maxPt - minPt);
+}
+template<class Real, int Degree, class Vertex, BoundaryType BType> bool ExecuteInternal(const ReconstructionParameters& params, ReconstructionInputStream& input, size_t inputCount, const box3f& inputBounds, aly::Mesh& output,
+	const ReconstructionMonitor& monitor)
 {
 	Reset<Real>();
 	Octree<Real> tree;
 	const Real targetValue = (Real)0.5;
 	Real isoValue = 0;
 	const box3f bbox(float3(0.01f, 0.01f, 0.01f), float3(0.99f, 0.99f, 0.99f));
-	float4x4 M = MakeTransform(input.getBoundingBox(), bbox);
+	float4x4 M = MakeTransform(inputBounds, bbox);
 	float4x4 Minv = inverse(M);	
 	int solveDepth = params.MaxSolveDepth.value;
 	tree.threads = params.Threads.value;
-	if (monitor)monitor("Initializing", 0.01f);
+	if (monitor)monitor("Initializing", 0.05f);
 	OctNode<TreeNodeData>::SetAllocator(MEMORY_ALLOCATOR_BLOCK_SIZE);
 	int kernelDepth = params.KernelDepth.set ? params.KernelDepth.value : params.Depth.value - 2;
 	if (kernelDepth > params.Depth.value)
@@ -79,8 +142,7 @@ template<class Real, int Degree, class Vertex, BoundaryType BType> bool ExecuteI
 		DenseNodeData< Real, Degree > constraints;
 		int pointCount = 0;
 		{
-			if (monitor)monitor("Building Oct-Tree", 0.1f);
-			AlloyPointStream pointStream(M,input);
+			ReconstructionPointStream pointStream(input, M, inputCount, "Building Oct-Tree", float2(0.1f, 0.2f), monitor);
 			pointCount = tree.template init< Point3D< Real > >(pointStream, params.Depth.value, params.Confidence.set, samples, &sampleData);
 
 		}
@@ -334,7 +396,7 @@ bool AlloyPointStream::nextPoint(OrientedPoint3D<float>& p, Point3D<float>& d)
 		return false;
 	float3 v = mesh->vertexLocations[counter];
 	float3 n = mesh->vertexNormals[counter];
-	float4 c = mesh->vertexColors[counter];
+	float4 c = (counter < mesh->vertexColors.size()) ? mesh->vertexColors[counter] : float4(1.0f);
 	v = Transform(M, v);
 	p.p = Point3D<float>(v.x, v.y, v.z);
 	p.n = Point3D<float>(n.x, n.y, n.z);
@@ -342,45 +404,190 @@ bool AlloyPointStream::nextPoint(OrientedPoint3D<float>& p, Point3D<float>& d)
 	counter++;
 	return true;
 }
-template<class Real, int Degree, class Vertex> bool ExecuteInternal(const ReconstructionParameters& params, const aly::Mesh& input, aly::Mesh& output, const BoundaryType& BType, const std::function<bool(const std::string& status, float progress)>& monitor)
+void ChunkedPointStream::reset(void)
+{
+	rewind();
+	points.clear();
+	normals.clear();
+	colors.clear();
+	position = 0;
+}
+bool ChunkedPointStream::nextPoint(OrientedPoint3D<float>& p, Point3D<float>& d)
+{
+	if (position >= points.size())
+	{
+		points.clear();
+		normals.clear();
+		colors.clear();
+		position = 0;
+		readChunk(chunkSize);
+		if (points.size() == 0)
+			return false;
+	}
+	const float3& v = points[position];
+	const float3& n = normals[position];
+	p.p = Point3D<float>(v.x, v.y, v.z);
+	p.n = Point3D<float>(n.x, n.y, n.z);
+	if (position < colors.size())
+	{
+		const ubyte3& c = colors[position];
+		d = Point3D<float>(c.x, c.y, c.z);
+	}
+	else
+	{
+		d = Point3D<float>(255.0f, 255.0f, 255.0f);
+	}
+	position++;
+	return true;
+}
+PlyPointStream::PlyPointStream(const std::string& file, size_t chunkSize) :ChunkedPointStream(chunkSize), file(file), cursor(nullptr), pointCount(0), pointsRead(0), hasColors(false)
+{
+	rewind();
+}
+void PlyPointStream::rewind()
+{
+	using namespace aly::ply;
+	ply.reset(new PLYReaderWriter());
+	ply->openForReading(file);
+	int index;
+	PlyElement* elem = ply->findElement("vertex");
+	std::vector<std::string> elemNames = ply->getElementNames();
+	if (elem == nullptr || elemNames.size() == 0 || elemNames[0] != "vertex"
+		|| ply->findProperty(elem, "x", &index) == nullptr
+		|| ply->findProperty(elem, "y", &index) == nullptr
+		|| ply->findProperty(elem, "z", &index) == nullptr
+		|| ply->findProperty(elem, "nx", &index) == nullptr
+		|| ply->findProperty(elem, "ny", &index) == nullptr
+		|| ply->findProperty(elem, "nz", &index) == nullptr)
+	{
+		throw std::runtime_error(MakeString() << "Could not read oriented points [" << file << "]");
+	}
+	hasColors = (ply->findProperty(elem, "red", &index) != nullptr
+		&& ply->findProperty(elem, "green", &index) != nullptr
+		&& ply->findProperty(elem, "blue", &index) != nullptr);
+	int numElems, nprops;
+	ply->getElementDescription("vertex", &numElems, &nprops);
+	pointCount = (size_t)std::max(numElems, 0);
+	pointsRead = 0;
+	cursor = nullptr;
+	if (ply->isMemoryMapped() && ply->getFileFormat() == FileFormat::BINARY_LE
+		&& layout.set(elem, { "x", "y", "z", "nx", "ny", "nz", "red", "green", "blue" }))
+	{
+		cursor = ply->getMappedCursor();
+		//Validates that the whole vertex block is present.
+		ply->skipMappedBytes(layout.stride * pointCount);
+	}
+	else
+	{
+		ply->getProperty("vertex", &MeshVertProps[0]);
+		ply->getProperty("vertex", &MeshVertProps[1]);
+		ply->getProperty("vertex", &MeshVertProps[2]);
+		ply->getProperty("vertex", &MeshVertProps[3]);
+		ply->getProperty("vertex", &MeshVertProps[4]);
+		ply->getProperty("vertex", &MeshVertProps[5]);
+		if (hasColors)
+		{
+			ply->getProperty("vertex", &MeshVertProps[9]);
+			ply->getProperty("vertex", &MeshVertProps[10]);
+			ply->getProperty("vertex", &MeshVertProps[11]);
+		}
+	}
+}
+void PlyPointStream::readChunk(size_t count)
+{
+	size_t N = std::min(count, pointCount - pointsRead);
+	points.resize(N);
+	normals.resize(N);
+	colors.resize(hasColors ? N : 0);
+	if (cursor != nullptr)
+	{
+		const char* start = cursor + layout.stride * pointsRead;
+#pragma omp parallel for
+		for (int j = 0; j < (int)N; j++)
+		{
+			const char* ptr = start + layout.stride * j;
+			points[j] = float3((float)layout.get(ptr, 0), (float)layout.get(ptr, 1), (float)layout.get(ptr, 2));
+			normals[j] = float3((float)layout.get(ptr, 3), (float)layout.get(ptr, 4), (float)layout.get(ptr, 5));
+			if (hasColors)
+			{
+				colors[j] = ubyte3((uint8_t)layout.get(ptr, 6), (uint8_t)layout.get(ptr, 7), (uint8_t)layout.get(ptr, 8));
+			}
+		}
+	}
+	else
+	{
+		aly::ply::plyVertex vertex;
+		for (size_t j = 0; j < N; j++)
+		{
+			ply->getElement(&vertex);
+			points[j] = float3(vertex.x[0], vertex.x[1], vertex.x[2]);
+			normals[j] = float3(vertex.n[0], vertex.n[1], vertex.n[2]);
+			if (hasColors)
+			{
+				colors[j] = ubyte3(vertex.red, vertex.green, vertex.blue);
+			}
+		}
+	}
+	pointsRead += N;
+}
+template<class Real, int Degree, class Vertex> bool ExecuteInternal(const ReconstructionParameters& params, ReconstructionInputStream& input, size_t inputCount, const box3f& inputBounds, aly::Mesh& output, const BoundaryType& BType, const ReconstructionMonitor& monitor)
 {
 	switch (params.BType.value)
 	{
 	case BoundaryType::BOUNDARY_FREE:
-		return ExecuteInternal<float, 1, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_FREE>(params, input, output, monitor);
+		return ExecuteInternal<float, 1, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_FREE>(params, input, inputCount, inputBounds, output, monitor);
 		break;
 	case BoundaryType::BOUNDARY_DIRICHLET:
-		return ExecuteInternal<float, 2, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_DIRICHLET>(params, input, output, monitor);
+		return ExecuteInternal<float, 2, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_DIRICHLET>(params, input, inputCount, inputBounds, output, monitor);
 		break;
 	case BoundaryType::BOUNDARY_NEUMANN:
-		return ExecuteInternal<float, 3, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_NEUMANN>(params, input, output, monitor);
+		return ExecuteInternal<float, 3, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_NEUMANN>(params, input, inputCount, inputBounds, output, monitor);
 		break;
 	case BoundaryType::BOUNDARY_COUNT:
-		return ExecuteInternal<float, 4, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_COUNT>(params, input, output, monitor);
+		return ExecuteInternal<float, 4, PlyColorAndValueVertex<float>, BoundaryType::BOUNDARY_COUNT>(params, input, inputCount, inputBounds, output, monitor);
 		break;
 	default:
 		throw std::runtime_error("Boundary type not supported.");
 	}
 	return false;
 }
-void SurfaceReconstruct(const ReconstructionParameters& params, const aly::Mesh& input, aly::Mesh& output, const std::function<bool(const std::string& status, float progress)>& monitor)
+static void SurfaceReconstructInternal(const ReconstructionParameters& params, ReconstructionInputStream& input, size_t inputCount, const box3f& inputBounds, aly::Mesh& output, const ReconstructionMonitor& monitor)
 {
 	BoundaryType BType = static_cast<BoundaryType>(params.BType.value);
 	switch (params.Degree.value)
 	{
 	case 1:
-		ExecuteInternal<float, 1,PlyColorAndValueVertex<float> >(params, input, output, BType, monitor);
+		ExecuteInternal<float, 1,PlyColorAndValueVertex<float> >(params, input, inputCount, inputBounds, output, BType, monitor);
 		break;
 	case 2:
-		ExecuteInternal<float, 2, PlyColorAndValueVertex<float> >(params, input, output, BType, monitor);
+		ExecuteInternal<float, 2, PlyColorAndValueVertex<float> >(params, input, inputCount, inputBounds, output, BType, monitor);
 		break;
 	case 3:
-		ExecuteInternal<float, 3, PlyColorAndValueVertex<float> >(params, input, output, BType, monitor);
+		ExecuteInternal<float, 3, PlyColorAndValueVertex<float> >(params, input, inputCount, inputBounds, output, BType, monitor);
 		break;
 	case 4:
-		ExecuteInternal<float, 4, PlyColorAndValueVertex<float> >(params, input, output, BType, monitor);
+		ExecuteInternal<float, 4, PlyColorAndValueVertex<float> >(params, input, inputCount, inputBounds, output, BType, monitor);
 		break;
 	default:
 		throw std::runtime_error("Degree not supported.");
 	}
+}
+void SurfaceReconstruct(const ReconstructionParameters& params, const aly::Mesh& input, aly::Mesh& output, const std::function<bool(const std::string& status, float progress)>& monitor)
+{
+	if (input.vertexNormals.size() != input.vertexLocations.size())
+	{
+		throw std::runtime_error("Surface reconstruction requires vertex normals.");
+	}
+	AlloyPointStream pointStream(float4x4::identity(), input);
+	SurfaceReconstructInternal(params, pointStream, input.vertexLocations.size(), input.getBoundingBox(), output, monitor);
+}
+void SurfaceReconstruct(const ReconstructionParameters& params, ChunkedPointStream& input, aly::Mesh& output, const std::function<bool(const std::string& status, float progress)>& monitor)
+{
+	box3f bounds = StreamBoundingBox(input, input.getPointCount(), monitor);
+	SurfaceReconstructInternal(params, input, input.getPointCount(), bounds, output, monitor);
+}
+void SurfaceReconstruct(const ReconstructionParameters& params, const std::string& plyFile, aly::Mesh& output, const std::function<bool(const std::string& status, float progress)>& monitor)
+{
+	PlyPointStream pointStream(plyFile);
+	SurfaceReconstruct(params, pointStream, output, monitor);
 }
\ No newline at end of file
@@ -21,7 +21,278 @@
 
 #include "AlloyMath.h"
 #include "AlloyWorker.h"
+#include <algorithm>
 namespace aly {
+static thread_local WorkerPool* CurrentPool = nullptr;
+static thread_local int CurrentWorkerIndex = -1;
+static thread_local std::vector<PoolTask*> CurrentTasks;
+bool PoolTask::isDone() {
+	std::lock_guard<std::mutex> lockMe(stateLock);
+	return finished;
+}
+WorkerPool& AlloyDefaultWorkerPool() {
+	static WorkerPool pool;
+	return pool;
+}
+WorkerPool::WorkerPool(int threadCount) :
+		queuedCount(0), nextQueue(0) {
+	if (threadCount <= 0) {
+		//Keep a few workers even on small machines, since UI timers may block while they wait.
+		//Cancels and task destructors also wait for a queued task to be picked up by a worker.
+		threadCount = std::max(4, (int) std::thread::hardware_concurrency());
+	}
+	for (int i = 0; i < threadCount; i++) {
+		queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+	}
+	for (int i = 0; i < threadCount; i++) {
+		workers.push_back(std::thread(&WorkerPool::workerLoop, this, i));
+	}
+	timerThread = std::thread(&WorkerPool::timerLoop, this);
+}
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lockMe(timerLock);
+		timerShutdown = true;
+	}
+	timerCondition.notify_all();
+	timerThread.join();
+	{
+		std::lock_guard<std::mutex> lockMe(sleepLock);
+		shutdown = true;
+	}
+	sleepCondition.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+int WorkerPool::currentWorker() const {
+	return (CurrentPool == this) ? CurrentWorkerIndex : -1;
+}
+bool WorkerPool::IsCurrentTask(const TaskHandle& task) {
+	return std::find(CurrentTasks.begin(), CurrentTasks.end(), task.get())
+			!= CurrentTasks.end();
+}
+TaskHandle WorkerPool::MakeTask(const std::function<void()>& func,
+		TaskPriority priority, const CancellationToken& token,
+		const std::function<void()>& cancelFunc) {
+	return TaskHandle(new PoolTask(func, cancelFunc, priority, token));
+}
+void WorkerPool::enqueue(const TaskHandle& task) {
+	int self = currentWorker();
+	int q = (self >= 0) ? self : (int) (nextQueue++ % queues.size());
+	{
+		std::lock_guard<std::mutex> lockMe(queues[q]->lock);
+		queues[q]->lanes[(int) task->priority].push_back(task);
+	}
+	{
+		std::lock_guard<std::mutex> lockMe(sleepLock);
+		queuedCount++;
+	}
+	sleepCondition.notify_one();
+}
+bool WorkerPool::tryRun(int self) {
+	TaskHandle task;
+	int N = (int) queues.size();
+	for (int lane = 0; lane < 3 && !task; lane++) {
+		if (self >= 0) {
+			WorkerQueue& own = *queues[self];
+			std::lock_guard<std::mutex> lockMe(own.lock);
+			if (!own.lanes[lane].empty()) {
+				task = own.lanes[lane].back();
+				own.lanes[lane].pop_back();
+			}
+		}
+		for (int n = 1; n <= N && !task; n++) {
+			int q = (self + n + N) % N;
+			if (q == self)
+				continue;
+			WorkerQueue& victim = *queues[q];
+			std::lock_guard<std::mutex> lockMe(victim.lock);
+			if (!victim.lanes[lane].empty()) {
+				task = victim.lanes[lane].front();
+				victim.lanes[lane].pop_front();
+			}
+		}
+	}
+	if (!task) {
+		return false;
+	}
+	queuedCount--;
+	run(task);
+	return true;
+}
+void WorkerPool::run(const TaskHandle& task) {
+	bool skipped = task->isCanceled();
+	CurrentTasks.push_back(task.get());
+	try {
+		if (skipped) {
+			if (task->cancelFunc)
+				task->cancelFunc();
+		} else if (task->func) {
+			task->func();
+		}
+	} catch (...) {
+		task->exception = std::current_exception();
+	}
+	CurrentTasks.pop_back();
+	finish(task, skipped);
+}
+void WorkerPool::finish(const TaskHandle& task, bool skipped) {
+	std::vector<TaskHandle> dependents;
+	task->func = nullptr;
+	task->cancelFunc = nullptr;
+	{
+		std::lock_guard<std::mutex> lockMe(task->stateLock);
+		task->finished = true;
+		task->skipped = skipped;
+		dependents.swap(task->dependents);
+	}
+	task->finishedCondition.notify_all();
+	for (TaskHandle& dependent : dependents) {
+		if (skipped) {
+			dependent->upstreamCanceled = true;
+		}
+		if (--dependent->dependencies == 0) {
+			enqueue(dependent);
+		}
+	}
+}
+void WorkerPool::workerLoop(int index) {
+	CurrentPool = this;
+	CurrentWorkerIndex = index;
+	while (true) {
+		if (tryRun(index)) {
+			continue;
+		}
+		std::unique_lock<std::mutex> lockMe(sleepLock);
+		sleepCondition.wait(lockMe,
+				[this] {return shutdown || queuedCount > 0;});
+		if (shutdown && queuedCount <= 0) {
+			break;
+		}
+	}
+	CurrentPool = nullptr;
+	CurrentWorkerIndex = -1;
+}
+void WorkerPool::timerLoop() {
+	std::unique_lock<std::mutex> lockMe(timerLock);
+	while (!timerShutdown) {
+		if (delayedTasks.empty()) {
+			timerCondition.wait(lockMe);
+			continue;
+		}
+		auto first = delayedTasks.begin();
+		if (first->first <= std::chrono::steady_clock::now()) {
+			TaskHandle task = first->second;
+			delayedTasks.erase(first);
+			task->delayed = false;
+			lockMe.unlock();
+			enqueue(task);
+			lockMe.lock();
+		} else {
+			timerCondition.wait_until(lockMe, first->first);
+		}
+	}
+	//Outstanding timers are released as canceled so their cancel handlers still run.
+	std::vector<TaskHandle> remaining;
+	for (auto& item : delayedTasks) {
+		item.second->cancelRequested = true;
+		item.second->delayed = false;
+		remaining.push_back(item.second);
+	}
+	delayedTasks.clear();
+	lockMe.unlock();
+	for (TaskHandle& task : remaining) {
+		enqueue(task);
+	}
+}
+void WorkerPool::submit(const TaskHandle& task,
+		const std::vector<TaskHandle>& dependencies) {
+	for (const TaskHandle& dep : dependencies) {
+		if (!dep)
+			continue;
+		std::lock_guard<std::mutex> lockMe(dep->stateLock);
+		if (!dep->finished) {
+			task->dependencies++;
+			dep->dependents.push_back(task);
+		} else if (dep->skipped) {
+			task->upstreamCanceled = true;
+		}
+	}
+	if (--task->dependencies == 0) {
+		enqueue(task);
+	}
+}
+TaskHandle WorkerPool::submit(const std::function<void()>& func,
+		TaskPriority priority, const std::vector<TaskHandle>& dependencies,
+		const CancellationToken& token) {
+	TaskHandle task = MakeTask(func, priority, token);
+	submit(task, dependencies);
+	return task;
+}
+void WorkerPool::submitAfter(const TaskHandle& task, long milliseconds) {
+	task->dueTime = std::chrono::steady_clock::now()
+			+ std::chrono::milliseconds(std::max(0L, milliseconds));
+	{
+		std::lock_guard<std::mutex> lockMe(timerLock);
+		task->delayed = true;
+		delayedTasks.insert(
+				std::pair<std::chrono::steady_clock::time_point, TaskHandle>(
+						task->dueTime, task));
+	}
+	timerCondition.notify_one();
+}
+TaskHandle WorkerPool::submitAfter(const std::function<void()>& func,
+		long milliseconds, TaskPriority priority,
+		const CancellationToken& token) {
+	TaskHandle task = MakeTask(func, priority, token);
+	submitAfter(task, milliseconds);
+	return task;
+}
+void WorkerPool::cancel(const TaskHandle& task) {
+	if (!task)
+		return;
+	task->cancelRequested = true;
+	bool release = false;
+	{
+		std::lock_guard<std::mutex> lockMe(timerLock);
+		if (task->delayed) {
+			auto range = delayedTasks.equal_range(task->dueTime);
+			for (auto iter = range.first; iter != range.second; iter++) {
+				if (iter->second == task) {
+					delayedTasks.erase(iter);
+					break;
+				}
+			}
+			task->delayed = false;
+			release = true;
+		}
+	}
+	if (release) {
+		enqueue(task);
+	}
+}
+void WorkerPool::wait(const TaskHandle& task) {
+	if (!task || IsCurrentTask(task))
+		return;
+	int self = currentWorker();
+	if (self >= 0) {
+		while (!task->isDone()) {
+			if (!tryRun(self)) {
+				std::unique_lock<std::mutex> lockMe(task->stateLock);
+				task->finishedCondition.wait_for(lockMe,
+						std::chrono::milliseconds(1),
+						[&task] {return task->finished;});
+			}
+		}
+	} else {
+		std::unique_lock<std::mutex> lockMe(task->stateLock);
+		task->finishedCondition.wait(lockMe, [&task] {return task->finished;});
+	}
+	if (task->exception) {
+		std::rethrow_exception(task->exception);
+	}
+}
 WorkerTask::WorkerTask(const std::function<void()>& func) :
 		executionTask(func), endTask() {
 
@@ -62,16 +333,71 @@ void WorkerTask::done() {
 	if (endTask)
 		endTask();
 }
+void WorkerTask::submit() {
+	TaskHandle task = WorkerPool::MakeTask([this]() {
+		this->task();
+		this->release();
+	}, priority, CancellationToken(), [this]() {this->canceled();});
+	{
+		std::lock_guard<std::mutex> lockMe(handleLock);
+		handle = task;
+	}
+	AlloyDefaultWorkerPool().submit(task);
+}
+void WorkerTask::canceled() {
+	running = false;
+	requestCancel = false;
+	release();
+}
+void WorkerTask::release() {
+	std::lock_guard<std::mutex> lockMe(handleLock);
+	pending = false;
+	handle.reset();
+}
+void WorkerTask::wait() {
+	WorkerPool& pool = AlloyDefaultWorkerPool();
+	while (true) {
+		TaskHandle current;
+		{
+			std::lock_guard<std::mutex> lockMe(handleLock);
+			if (!pending)
+				return;
+			current = handle;
+		}
+		if (!current) {
+			std::this_thread::yield();
+			continue;
+		}
+		//A task that cancels itself cannot wait for its own completion.
+		if (WorkerPool::IsCurrentTask(current))
+			return;
+		pool.wait(current);
+	}
+}
 bool WorkerTask::execute(bool block) {
 	if (stateChange.try_lock()) {
 		if (block) {
+			{
+				std::lock_guard<std::mutex> lockMe(handleLock);
+				blockingThread = std::this_thread::get_id();
+			}
 			task();
+			{
+				std::lock_guard<std::mutex> lockMe(handleLock);
+				blockingThread = std::thread::id();
+			}
 		} else {
-			if (workerThread.joinable()) {
-				stateChange.unlock();
-				return false;
+			{
+				std::lock_guard<std::mutex> lockMe(handleLock);
+				if (pending) {
+					stateChange.unlock();
+					return false;
+				}
+				pending = true;
+				running = true;
+				requestCancel = false;
 			}
-			workerThread = std::thread(&WorkerTask::task, this);
+			submit();
 		}
 		stateChange.unlock();
 		return true;
@@ -82,26 +408,29 @@ bool WorkerTask::execute(bool block) {
 WorkerTask::~WorkerTask() {
 	cancel();
 }
+//Blocks until a running or queued task has finished, unless it is called from the task itself.
 bool WorkerTask::cancel(bool block) {
-	if (stateChange.try_lock()) {
-		if (block) {
-			if (workerThread.joinable()) {
-				if (!requestCancel) {
-					requestCancel = true;
-					workerThread.join();
-				}
-			} else {
-				stateChange.unlock();
-				return true;
-			}
-		} else {
+	TaskHandle current;
+	bool self;
+	{
+		std::lock_guard<std::mutex> lockMe(handleLock);
+		if (pending || running) {
 			requestCancel = true;
 		}
-		stateChange.unlock();
-		return true;
-	} else {
-		return false;
+		current = handle;
+		self = (blockingThread == std::this_thread::get_id());
+	}
+	if (current) {
+		AlloyDefaultWorkerPool().cancel(current);
 	}
+	if (block) {
+		wait();
+		//A blocking execute() and the submission of a pool task both hold stateChange.
+		if (!self) {
+			std::lock_guard<std::mutex> lockMe(stateChange);
+		}
+	}
+	return true;
 }
 RecurrentTask::RecurrentTask(const std::function<bool(uint64_t)>& func,
 		long timeout) :
@@ -115,7 +444,10 @@ RecurrentTask::RecurrentTask(const std::function<bool(uint64_t)>& func,
 				timeout) {
 
 }
-
+RecurrentTask::~RecurrentTask() {
+	cancel();
+}
+//Blocking execution keeps the calling thread for the whole loop.
 void RecurrentTask::step() {
 	uint64_t iter = 0;
 	while (!requestCancel) {
@@ -138,7 +470,51 @@ void RecurrentTask::step() {
 				std::chrono::milliseconds(aly::max(0, (int) (timeout - ms))));
 	}
 }
-
+void RecurrentTask::submit() {
+	TaskHandle task = WorkerPool::MakeTask([this]() {this->iterate(0);},
+			priority, CancellationToken(), [this]() {this->stop();});
+	{
+		std::lock_guard<std::mutex> lockMe(handleLock);
+		handle = task;
+	}
+	AlloyDefaultWorkerPool().submit(task);
+}
+//Each iteration is a separate pool task, so idle time between iterations does not hold a worker.
+void RecurrentTask::iterate(uint64_t iteration) {
+	auto currentTime = std::chrono::steady_clock::now();
+	bool more = !requestCancel;
+	if (more && recurrentTask) {
+		try {
+			more = recurrentTask(iteration);
+		} catch (std::exception&) {
+			more = false;
+		}
+	}
+	if (more) {
+		auto nextTime = std::chrono::steady_clock::now();
+		long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+				nextTime - currentTime).count();
+		std::lock_guard<std::mutex> lockMe(handleLock);
+		if (!requestCancel) {
+			handle = WorkerPool::MakeTask(
+					[this, iteration]() {this->iterate(iteration + 1);},
+					priority, CancellationToken(), [this]() {this->stop();});
+			AlloyDefaultWorkerPool().submitAfter(handle,
+					aly::max(0L, (long) (timeout - ms)));
+			return;
+		}
+	}
+	stop();
+}
+void RecurrentTask::stop() {
+	if (!requestCancel) {
+		done();
+	}
+	running = false;
+	requestCancel = false;
+	complete = true;
+	release();
+}
 TimerTask::TimerTask(const std::function<void()>& successFunc,
 		const std::function<void()>& failureFunc, long timeout,
 		long samplingTime) :
@@ -146,7 +522,10 @@ TimerTask::TimerTask(const std::function<void()>& successFunc,
 				samplingTime) {
 
 }
-
+TimerTask::~TimerTask() {
+	cancel();
+}
+//Blocking execution polls for cancellation every samplingTime milliseconds.
 void TimerTask::task() {
 	running = true;
 	requestCancel = false;
@@ -176,5 +555,39 @@ void TimerTask::task() {
 	running = false;
 	requestCancel = false;
 }
+//Pooled execution waits on the pool's timer thread, and cancel() releases the timer immediately.
+void TimerTask::submit() {
+	complete = false;
+	TaskHandle task = WorkerPool::MakeTask([this]() {this->fire();}, priority,
+			CancellationToken(), [this]() {this->expire();});
+	{
+		std::lock_guard<std::mutex> lockMe(handleLock);
+		handle = task;
+	}
+	AlloyDefaultWorkerPool().submitAfter(task, timeout);
 }
+void TimerTask::fire() {
+	if (requestCancel) {
+		expire();
+		return;
+	}
+	try {
+		if (executionTask)
+			executionTask();
+		complete = true;
+	} catch (std::exception&) {
 
+	}
+	running = false;
+	requestCancel = false;
+	release();
+}
+void TimerTask::expire() {
+	if (endTask)
+		endTask();
+	complete = false;
+	running = false;
+	requestCancel = false;
+	release();
+}
+}
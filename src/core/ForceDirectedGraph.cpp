@@ -479,6 +479,55 @@ void ForceSimulator::draw(AlloyContext* context) {
 	popScissor(nvg);
 }
 
+void ForceSimulator::gather() {
+	int N = (int) items.size();
+	store.resize(N);
+#pragma omp parallel for num_threads(NUM_THREADS)
+	for (int i = 0; i < N; i++) {
+		ForceItem* item = items[i].get();
+		item->index = i;
+		store.location[i] = item->location;
+		store.plocation[i] = item->plocation;
+		store.velocity[i] = item->velocity;
+		store.force[i] = item->force;
+		store.mass[i] = item->mass;
+		store.buoyancy[i] = item->buoyancy;
+	}
+	selectedIndex = -1;
+	if (selected != nullptr && selected->index >= 0 && selected->index < N
+			&& items[selected->index].get() == selected) {
+		selectedIndex = selected->index;
+	}
+	int S = (int) springs.size();
+	springIndexes.resize(S);
+	springForces.resize(S);
+#pragma omp parallel for num_threads(NUM_THREADS)
+	for (int k = 0; k < S; k++) {
+		const SpringItem& spring = *springs[k];
+		int i1 = spring.item1->index;
+		int i2 = spring.item2->index;
+		//Springs attached to items that are not simulated are skipped.
+		if (i1 < 0 || i1 >= N || items[i1] != spring.item1 || i2 < 0 || i2 >= N
+				|| items[i2] != spring.item2) {
+			i1 = i2 = -1;
+		}
+		springIndexes[k] = int2(i1, i2);
+	}
+}
+void ForceSimulator::scatter() {
+	int N = (int) items.size();
+#pragma omp parallel for num_threads(NUM_THREADS)
+	for (int i = 0; i < N; i++) {
+		//The dragged item is owned by the UI while the step runs.
+		if (i == selectedIndex)
+			continue;
+		ForceItem* item = items[i].get();
+		item->location = store.location[i];
+		item->plocation = store.plocation[i];
+		item->velocity = store.velocity[i];
+		item->force = store.force[i];
+	}
+}
 void ForceSimulator::accumulate() {
 	for (int i = 0; i < (int) iforces.size(); i++) {
 		if (iforces[i]->isEnabled())
@@ -490,29 +539,40 @@ void ForceSimulator::accumulate() {
 			sforces[i]->init(*this);
 	}
 #pragma omp parallel for num_threads(NUM_THREADS)
-	for (int i = 0; i < (int) items.size(); i++) {
-
-		items[i]->force = float2(0.0f);
-		for (ForcePtr f : iforces) {
+	for (int i = 0; i < (int) store.size(); i++) {
+		store.force[i] = float2(0.0f);
+		for (const ForcePtr& f : iforces) {
 			if (f->isEnabled())
-				f->getForce(items[i]);
+				f->getForce(store, i);
 		}
 	}
 #pragma omp parallel for num_threads(NUM_THREADS)
-	for (int i = 0; i < (int) springs.size(); i++) {
-		for (ForcePtr f : sforces) {
-			if (f->isEnabled())
-				f->getSpring(springs[i]);
+	for (int k = 0; k < (int) springs.size(); k++) {
+		int2 ids = springIndexes[k];
+		float2 f1(0.0f);
+		if (ids.x >= 0) {
+			for (const ForcePtr& f : sforces) {
+				if (f->isEnabled())
+					f1 += f->getSpring(store, *springs[k], ids.x, ids.y);
+			}
+		}
+		springForces[k] = f1;
+	}
+	//Springs share items, so their forces are applied in order after the parallel pass.
+	for (int k = 0; k < (int) springs.size(); k++) {
+		int2 ids = springIndexes[k];
+		if (ids.x >= 0) {
+			store.force[ids.x] += springForces[k];
+			store.force[ids.y] -= springForces[k];
 		}
 	}
-
 }
 float ForceSimulator::runSimulator(float timestep) {
 	std::lock_guard<std::mutex> lockMe(lock);
+	gather();
 	float2 p1(1E30f);
 	float2 p2(-1E30f);
-	for (ForceItemPtr item : getForceItems()) {
-		float2 p = item->location;
+	for (const float2& p : store.location) {
 		p1 = aly::min(p, p1);
 		p2 = aly::max(p, p2);
 	}
@@ -521,11 +581,10 @@ float ForceSimulator::runSimulator(float timestep) {
 	integrator->integrate(*this, timestep);
 	enforceBoundaries();
 	float maxDisplacement = 0.0f;
-	for (ForceItemPtr item : getForceItems()) {
-		float2 p1 = item->location;
-		float2 p2 = item->plocation;
-		maxDisplacement = std::max(distanceSqr(p1, p2), maxDisplacement);
+	for (int i = 0; i < (int) store.size(); i++) {
+		maxDisplacement = std::max(distanceSqr(store.location[i], store.plocation[i]), maxDisplacement);
 	}
+	scatter();
 	return std::sqrt(maxDisplacement);
 }
 void ForceSimulator::optimize(float tolerance, int maxIterations,
@@ -539,135 +598,127 @@ void ForceSimulator::optimize(float tolerance, int maxIterations,
 }
 void ForceSimulator::enforceBoundaries() {
 #pragma omp parallel for num_threads(NUM_THREADS)
-	for (int i = 0; i < (int) items.size(); i++) {
-		if (items[i].get() == selected)
+	for (int i = 0; i < (int) store.size(); i++) {
+		if (i == selectedIndex)
 			continue;
-		for (ForcePtr f : bforces) {
+		for (const ForcePtr& f : bforces) {
 			if (f->isEnabled())
-				f->enforceBoundary(items[i]);
+				f->enforceBoundary(store.location[i]);
 		}
 	}
 }
 void EulerIntegrator::integrate(ForceSimulator& sim, float timestep) const {
 	float speedLimit = sim.getSpeedLimit();
-	std::vector<ForceItemPtr>& items = sim.getForceItems();
+	ForceItemStore& store = sim.getStore();
+	int selected = sim.getSelectedIndex();
 #pragma omp parallel for num_threads(NUM_THREADS)
-	for (int i = 0; i < (int) items.size(); i++) {
+	for (int i = 0; i < (int) store.size(); i++) {
 		float coeff, len;
-		ForceItemPtr item = items[i];
-		if (item.get() == sim.selected)
+		if (i == selected)
 			continue;
-		item->plocation = item->location;
-		item->location = item->plocation + timestep * item->velocity;
-		coeff = timestep / item->mass;
-		item->velocity += coeff * item->force;
-		float2 vel = item->velocity;
+		store.plocation[i] = store.location[i];
+		store.location[i] = store.plocation[i] + timestep * store.velocity[i];
+		coeff = timestep / store.mass[i];
+		store.velocity[i] += coeff * store.force[i];
+		float2 vel = store.velocity[i];
 		len = length(vel);
 		if (len > speedLimit) {
-			item->velocity = speedLimit * vel / len;
+			store.velocity[i] = speedLimit * vel / len;
 		}
 	}
 }
 void RungeKuttaIntegrator::integrate(ForceSimulator& sim,
 		float timestep) const {
 	float speedLimit = sim.getSpeedLimit();
-
-	std::vector<ForceItemPtr>& items = sim.getForceItems();
+	ForceItemStore& store = sim.getStore();
+	int selected = sim.getSelectedIndex();
 #pragma omp parallel for num_threads(NUM_THREADS)
-	for (int i = 0; i < (int) items.size(); i++) {
+	for (int i = 0; i < (int) store.size(); i++) {
 		float coeff;
-		std::array<float2, 4> k, l;
-		ForceItemPtr item = items[i];
-		if (item.get() == sim.selected)
+		if (i == selected)
 			continue;
-		coeff = timestep / item->mass;
-		k = item->k;
-		l = item->l;
-		item->plocation = item->location;
-		k[0] = timestep * item->velocity;
-		l[0] = coeff * item->force;
-		item->location += 0.5f * k[0];
+		std::array<float2, 4>& k = store.k[i];
+		std::array<float2, 4>& l = store.l[i];
+		coeff = timestep / store.mass[i];
+		store.plocation[i] = store.location[i];
+		k[0] = timestep * store.velocity[i];
+		l[0] = coeff * store.force[i];
+		store.location[i] += 0.5f * k[0];
 	}
 	sim.accumulate();
 #pragma omp parallel for num_threads(NUM_THREADS)
-	for (int i = 0; i < (int) items.size(); i++) {
+	for (int i = 0; i < (int) store.size(); i++) {
 		float coeff;
 		float len;
-		std::array<float2, 4> k, l;
-		ForceItemPtr item = items[i];
-		if (item.get() == sim.selected)
+		if (i == selected)
 			continue;
-		coeff = timestep / item->mass;
-		k = item->k;
-		l = item->l;
-		float2 vel = item->velocity + 0.5f * l[0];
+		std::array<float2, 4>& k = store.k[i];
+		std::array<float2, 4>& l = store.l[i];
+		coeff = timestep / store.mass[i];
+		float2 vel = store.velocity[i] + 0.5f * l[0];
 		len = length(vel);
 		if (len > speedLimit) {
 			vel = speedLimit * vel / len;
 		}
 		k[1] = timestep * vel;
-		l[1] = coeff * item->force;
+		l[1] = coeff * store.force[i];
 		// Set the position to the new predicted position
-		item->location = item->plocation + 0.5f * k[1];
+		store.location[i] = store.plocation[i] + 0.5f * k[1];
 	}
 	// recalculate forces
 	sim.accumulate();
 #pragma omp parallel for num_threads(NUM_THREADS)
-	for (int i = 0; i < (int) items.size(); i++) {
+	for (int i = 0; i < (int) store.size(); i++) {
 		float coeff;
 		float len;
-		std::array<float2, 4> k, l;
-		ForceItemPtr item = items[i];
-		if (item.get() == sim.selected)
+		if (i == selected)
 			continue;
-		coeff = timestep / item->mass;
-		k = item->k;
-		l = item->l;
-		float2 vel = item->velocity + 0.5f * l[1];
+		std::array<float2, 4>& k = store.k[i];
+		std::array<float2, 4>& l = store.l[i];
+		coeff = timestep / store.mass[i];
+		float2 vel = store.velocity[i] + 0.5f * l[1];
 		len = length(vel);
 		if (len > speedLimit) {
 			vel = speedLimit * vel / len;
 		}
 		k[2] = timestep * vel;
-		l[2] = coeff * item->force;
-		item->location = item->plocation + 0.5f * k[2];
+		l[2] = coeff * store.force[i];
+		// The last stage is evaluated at the end of the full step
+		store.location[i] = store.plocation[i] + k[2];
 	}
 	// recalculate forces
 	sim.accumulate();
 #pragma omp parallel for num_threads(NUM_THREADS)
-	for (int i = 0; i < (int) items.size(); i++) {
+	for (int i = 0; i < (int) store.size(); i++) {
 		float coeff;
 		float len;
-		std::array<float2, 4> k, l;
-		ForceItemPtr item = items[i];
-		if (item.get() == sim.selected)
+		if (i == selected)
 			continue;
-		coeff = timestep / item->mass;
-		k = item->k;
-		l = item->l;
-		float2 p = item->plocation;
-		float2 vel = item->velocity + 0.5f * l[1];
+		std::array<float2, 4>& k = store.k[i];
+		std::array<float2, 4>& l = store.l[i];
+		coeff = timestep / store.mass[i];
+		float2 p = store.plocation[i];
+		float2 vel = store.velocity[i] + l[2];
 		len = length(vel);
 		if (len > speedLimit) {
 			vel = speedLimit * vel / len;
 		}
 		k[3] = timestep * vel;
-		l[3] = coeff * item->force;
-		item->location = p + (k[0] + k[3]) / 6.0f + (k[1] + k[2]) / 3.0f;
+		l[3] = coeff * store.force[i];
+		store.location[i] = p + (k[0] + k[3]) / 6.0f + (k[1] + k[2]) / 3.0f;
 		vel = (l[0] + l[3]) / 6.0f + (l[1] + l[2]) / 3.0f;
 		len = length(vel);
 		if (len > speedLimit) {
 			vel = speedLimit * vel / len;
 		}
-		item->velocity += vel;
+		store.velocity[i] += vel;
 	}
 }
-void SpringForce::getSpring(const SpringItemPtr& s) {
-	ForceItemPtr item1 = s->item1;
-	ForceItemPtr item2 = s->item2;
-	float len = (s->length < 0 ? params[SPRING_LENGTH] : s->length);
-	float2 p1 = item1->location;
-	float2 p2 = item2->location;
+float2 SpringForce::getSpring(const ForceItemStore& store, const SpringItem& s,
+		int i1, int i2) {
+	float len = (s.length < 0 ? params[SPRING_LENGTH] : s.length);
+	float2 p1 = store.location[i1];
+	float2 p2 = store.location[i2];
 	float2 dxy = p2 - p1;
 	float r = aly::length(dxy);
 	if (r == 0.0f) {
@@ -676,21 +727,18 @@ void SpringForce::getSpring(const SpringItemPtr& s) {
 		r = aly::length(dxy);
 	}
 	float d = r - len;
-	float coeff = (s->kappa < 0 ? params[SPRING_COEFF] : s->kappa) * d / r;
-
-	item1->force += coeff * dxy;
-	item2->force -= coeff * dxy;
-
-	float2 dir = s->direction;
-	if (s->gamma > 0.0f) {
+	float coeff = (s.kappa < 0 ? params[SPRING_COEFF] : s.kappa) * d / r;
+	float2 force = coeff * dxy;
+	float2 dir = s.direction;
+	if (s.gamma > 0.0f) {
 		float2 pivot = 0.5f * (p1 + p2);
 		dxy = normalize(dxy);
 		float2 ortho = float2(-dxy.y, dxy.x);
-		float2 arm = s->gamma * crossMag(normalize(p2 - pivot), dir) * ortho
+		float2 arm = s.gamma * crossMag(normalize(p2 - pivot), dir) * ortho
 				/ r;
-		item1->force -= arm;
-		item2->force += arm;
+		force -= arm;
 	}
+	return force;
 }
 int relativeCCW(float x1, float y1, float x2, float y2, float px, float py) {
 	x2 -= x1;
@@ -758,9 +806,9 @@ void BoxForce::setBounds(const box2f& box) {
 		this->dxy[k] = dxy;
 	}
 }
-void BoxForce::enforceBoundary(const std::shared_ptr<ForceItem>& forceItem) {
+void BoxForce::enforceBoundary(float2& location) {
 	box2f box(pts[0], pts[2] - pts[0]);
-	forceItem->location = box.clamp(forceItem->location);
+	location = box.clamp(location);
 }
 BoxForce::BoxForce(float gravConst, const box2f& box) {
 	params = std::vector<float> { gravConst };
@@ -786,13 +834,14 @@ void BoxForce::draw(AlloyContext* context, const pixel2& offset, float scale) {
 	nvgClosePath(nvg);
 	nvgStroke(nvg);
 }
-void BoxForce::getForce(const ForceItemPtr& item) {
-	float2 n = item->location;
+void BoxForce::getForce(ForceItemStore& store, int i) {
+	float2 n = store.location[i];
+	float2& force = store.force[i];
 	box2f box(pts[0], pts[2] - pts[0]);
 	if (!box.contains(n)) {
 		float2 dxy = float2(RandomUniform(-0.5f, 0.5f) / 50.0f,
 				RandomUniform(-0.5f, 0.5f) / 50.0f);
-		item->force += dxy * distance(item->location, item->plocation);
+		force += dxy * distance(store.location[i], store.plocation[i]);
 	}
 	for (int k = 0; k < 4; k++) {
 		float2 p1 = pts[k];
@@ -803,234 +852,332 @@ void BoxForce::getForce(const ForceItemPtr& item) {
 				ptSegDistSq(p1.x, p1.y, p2.x, p2.y, n.x, n.y));
 		if (r < 1E-5f)
 			r = (float) RandomUniform(1E-5f, 0.01f);
-		float v = params[GRAVITATIONAL_CONST] * item->mass / (r * r * r);
+		float v = params[GRAVITATIONAL_CONST] * store.mass[i] / (r * r * r);
 		if (n.x >= std::min(p1.x, p2.x) && n.x <= std::max(p1.x, p2.x))
-			item->force.y += ccw * v * dxy.x;
+			force.y += ccw * v * dxy.x;
 		if (n.y >= std::min(p1.y, p2.y) && n.y <= std::max(p1.y, p2.y))
-			item->force.x += -1.0f * ccw * v * dxy.y;
+			force.x += -1.0f * ccw * v * dxy.y;
 	}
 }
-void CircularWallForce::getForce(const ForceItemPtr& item) {
-	float2 n = item->location;
+void CircularWallForce::getForce(ForceItemStore& store, int i) {
+	float2 n = store.location[i];
 	float2 dxy = p - n;
 	float d = length(dxy);
 	float dr = r - d;
 	float c = (dr > 0) ? -1.0f : 1.0f;
-	float v = c * params[GRAVITATIONAL_CONST] * item->mass / (dr * dr);
+	float v = c * params[GRAVITATIONAL_CONST] * store.mass[i] / (dr * dr);
 	if (d < 1E-5f || d > r) {
 		dxy = float2(RandomUniform(-0.5f, 0.5f) / 50.0f,
 				RandomUniform(-0.5f, 0.5f) / 50.0f);
 		d = length(dxy);
 	}
-	item->force += v * dxy / d;
+	store.force[i] += v * dxy / d;
 }
-void CircularWallForce::enforceBoundary(
-		const std::shared_ptr<ForceItem>& forceItem) {
-	float2 n = forceItem->location;
-	float2 dxy = n - p;
+void CircularWallForce::enforceBoundary(float2& location) {
+	float2 dxy = location - p;
 	float d = length(dxy);
 	if (d > r) {
-		forceItem->location = p + dxy * r / d;
+		location = p + dxy * r / d;
 	}
 }
-void GravitationalForce::getForce(const ForceItemPtr& item) {
-	float coeff = params[GRAVITATIONAL_CONST] * item->mass;
-	item->force += gDirection * coeff;
+void GravitationalForce::getForce(ForceItemStore& store, int i) {
+	float coeff = params[GRAVITATIONAL_CONST] * store.mass[i];
+	store.force[i] += gDirection * coeff;
 }
-void BuoyancyForce::getForce(const ForceItemPtr& item) {
+void BuoyancyForce::getForce(ForceItemStore& store, int i) {
 	//1 means it sinks, 0 neutrally buoyant, -1 it floats
-	float coeff = params[GRAVITATIONAL_CONST] * item->mass * item->buoyancy;
-	item->force += gDirection * coeff;
+	float coeff = params[GRAVITATIONAL_CONST] * store.mass[i] * store.buoyancy[i];
+	store.force[i] += gDirection * coeff;
 }
-void QuadTreeNode::reset() {
-	com = float2(0.0f);
-	mass = 0;
-	hasChildren = false;
-	values.clear();
-	for (QuadTreeNodePtr& child : children) {
-		child.reset();
-	}
+namespace detail {
+//Spreads the low 16 bits of v to the even bit positions.
+inline uint32_t SpreadBits(uint32_t v) {
+	v &= 0x0000FFFF;
+	v = (v | (v << 8)) & 0x00FF00FF;
+	v = (v | (v << 4)) & 0x0F0F0F0F;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
 }
-void QuadTreeNode::insert(const ForceItemPtr& p) {
-	if (values.size() < MAX_LEAFS && !hasChildren) {
-		values.push_back(p);
-	} else {
-		if (depth >= MAX_DEPTH) {
-			values.push_back(p);
-		} else {
-			if (!hasChildren) {
-				//move items from leafs into one of the children.
-				values.push_back(p);
-				for (ForceItemPtr& item : values) {
-					float2 pt = item->location;
-					float2 split = bounds.center();
-					int i = (pt.x >= split.x ? 1 : 0)
-							+ (pt.y >= split.y ? 2 : 0);
-					if (children[i].get() == nullptr) {
-						children[i] = QuadTreeNodePtr(new QuadTreeNode());
-						float2 pt1 = bounds.position;
-						float2 pt2 = bounds.position + bounds.dimensions;
-						if (i == 1 || i == 3)
-							pt1.x = split.x;
-						else
-							pt2.x = split.x;
-						if (i > 1)
-							pt1.y = split.y;
-						else
-							pt2.y = split.y;
-						children[i]->bounds = box2f(pt1, pt2 - pt1);
-						children[i]->depth = depth + 1;
-					}
-					children[i]->insert(item);
-				}
-				values.clear();
-				hasChildren = true;
-			} else {
-				float2 pt = p->location;
-				float2 split = bounds.center();
-				int i = (pt.x >= split.x ? 1 : 0) + (pt.y >= split.y ? 2 : 0);
-				if (children[i].get() == nullptr) {
-					children[i] = QuadTreeNodePtr(new QuadTreeNode());
-					float2 pt1 = bounds.position;
-					float2 pt2 = bounds.position + bounds.dimensions;
-					if (i == 1 || i == 3)
-						pt1.x = split.x;
-					else
-						pt2.x = split.x;
-					if (i > 1)
-						pt1.y = split.y;
-					else
-						pt2.y = split.y;
-					children[i]->bounds = box2f(pt1, pt2 - pt1);
-					children[i]->depth = depth + 1;
-				}
-				children[i]->insert(p);
+}
+/*
+ Quantizes items to a 2^MAX_DEPTH grid over the root square and sorts them by Morton code with an
+ LSD radix sort. Each pass is a blocked parallel counting sort, so the order is stable and does not
+ depend on the thread count.
+ */
+void NBodyForce::sortItems(const ForceItemStore& store, const box2f& bounds) {
+	const int BLOCK_SIZE = 8192;
+	const int RADIX_BITS = 8;
+	const int RADIX = 1 << RADIX_BITS;
+	const int CODE_BITS = 2 * QuadTreeNode::MAX_DEPTH;
+	const float cells = (float) (1 << QuadTreeNode::MAX_DEPTH);
+	int N = (int) store.size();
+	int blocks = std::max(1, (N + BLOCK_SIZE - 1) / BLOCK_SIZE);
+	codes.resize(N);
+	order.resize(N);
+	scratchCodes.resize(N);
+	scratchOrder.resize(N);
+	float2 minPt = bounds.position;
+	float scale = cells / std::max(bounds.dimensions.x, 1E-6f);
+#pragma omp parallel for num_threads(NUM_THREADS)
+	for (int i = 0; i < N; i++) {
+		float2 q = (store.location[i] - minPt) * scale;
+		uint32_t qx = (uint32_t) clamp((int) q.x, 0, (int) cells - 1);
+		uint32_t qy = (uint32_t) clamp((int) q.y, 0, (int) cells - 1);
+		codes[i] = detail::SpreadBits(qx) | (detail::SpreadBits(qy) << 1);
+		order[i] = (uint32_t) i;
+	}
+	for (int shift = 0; shift < CODE_BITS; shift += RADIX_BITS) {
+		blockCounts.assign((size_t) blocks * RADIX, 0);
+#pragma omp parallel for num_threads(NUM_THREADS)
+		for (int b = 0; b < blocks; b++) {
+			uint32_t* counts = &blockCounts[(size_t) b * RADIX];
+			int end = std::min(N, (b + 1) * BLOCK_SIZE);
+			for (int n = b * BLOCK_SIZE; n < end; n++) {
+				counts[(codes[n] >> shift) & (RADIX - 1)]++;
+			}
+		}
+		uint32_t offset = 0;
+		for (int d = 0; d < RADIX; d++) {
+			for (int b = 0; b < blocks; b++) {
+				uint32_t& count = blockCounts[(size_t) b * RADIX + d];
+				uint32_t tmp = count;
+				count = offset;
+				offset += tmp;
 			}
 		}
+#pragma omp parallel for num_threads(NUM_THREADS)
+		for (int b = 0; b < blocks; b++) {
+			uint32_t* offsets = &blockCounts[(size_t) b * RADIX];
+			int end = std::min(N, (b + 1) * BLOCK_SIZE);
+			for (int n = b * BLOCK_SIZE; n < end; n++) {
+				uint32_t k = offsets[(codes[n] >> shift) & (RADIX - 1)]++;
+				scratchCodes[k] = codes[n];
+				scratchOrder[k] = order[n];
+			}
+		}
+		codes.swap(scratchCodes);
+		order.swap(scratchOrder);
+	}
+	rank.resize(N);
+	sortedLocation.resize(N);
+	sortedMass.resize(N);
+#pragma omp parallel for num_threads(NUM_THREADS)
+	for (int k = 0; k < N; k++) {
+		uint32_t i = order[k];
+		rank[i] = (uint32_t) k;
+		sortedLocation[k] = store.location[i];
+		sortedMass[k] = store.mass[i];
 	}
 }
 void NBodyForce::clear() {
-	root = QuadTreeNodePtr(new QuadTreeNode());
+	nodes.clear();
+	levels.clear();
 }
+/*
+ Builds the quadtree one level at a time. A node's items share a Morton prefix, so its quadrants are
+ contiguous sub-ranges found by binary search, and all nodes on a level are split concurrently.
+ Mass and center of mass are then accumulated bottom-up, again one level at a time.
+ */
 void NBodyForce::init(ForceSimulator& fsim) {
-	root.reset(new QuadTreeNode());
+	const ForceItemStore& store = fsim.getStore();
+	nodes.clear();
+	levels.clear();
+	int N = (int) store.size();
+	if (N == 0) {
+		return;
+	}
 	box2f bounds = fsim.getForceItemBounds();
 	float2 dxy = bounds.dimensions;
 	float2 center = bounds.center();
 	float maxDim = std::max(dxy.x, dxy.y);
-	root->bounds = box2f(center - float2(maxDim * 0.5f), float2(maxDim));
-	root->depth = 0;
-	for (ForceItemPtr item : fsim.getForceItems()) {
-		root->insert(item);
-	}
-	root->update();
-}
-void QuadTreeNode::update() {
-	com = float2(0.0f);
-	mass = 0;
-	for (QuadTreeNodePtr child : children) {
-		if (child.get() != nullptr) {
-			child->update();
-			mass += child->mass;
-			com += child->mass * child->com;
+	QuadTreeNode root;
+	root.bounds = box2f(center - float2(maxDim * 0.5f), float2(maxDim));
+	root.end = (uint32_t) N;
+	sortItems(store, root.bounds);
+	nodes.push_back(root);
+	uint32_t levelStart = 0;
+	uint32_t levelEnd = 1;
+	std::vector<std::array<uint32_t, 5>> splits;
+	std::vector<int> childOffsets;
+	while (levelStart < levelEnd) {
+		levels.push_back(uint2(levelStart, levelEnd));
+		int L = (int) (levelEnd - levelStart);
+		splits.resize(L);
+		childOffsets.resize(L + 1);
+#pragma omp parallel for num_threads(NUM_THREADS)
+		for (int t = 0; t < L; t++) {
+			const QuadTreeNode& node = nodes[levelStart + t];
+			std::array<uint32_t, 5>& split = splits[t];
+			int count = 0;
+			if (node.end - node.start > (uint32_t) QuadTreeNode::MAX_LEAFS
+					&& node.depth < QuadTreeNode::MAX_DEPTH) {
+				int shift = 2 * (QuadTreeNode::MAX_DEPTH - 1 - node.depth);
+				split[0] = node.start;
+				split[4] = node.end;
+				for (uint32_t q = 1; q < 4; q++) {
+					split[q] = (uint32_t) (std::partition_point(
+							codes.begin() + node.start, codes.begin() + node.end,
+							[=](uint32_t code) {
+								return ((code >> shift) & 3) < q;
+							}) - codes.begin());
+				}
+				for (int q = 0; q < 4; q++) {
+					if (split[q + 1] > split[q])
+						count++;
+				}
+			}
+			childOffsets[t + 1] = count;
 		}
+		childOffsets[0] = (int) levelEnd;
+		for (int t = 0; t < L; t++) {
+			childOffsets[t + 1] += childOffsets[t];
+		}
+		nodes.resize(childOffsets[L]);
+#pragma omp parallel for num_threads(NUM_THREADS)
+		for (int t = 0; t < L; t++) {
+			QuadTreeNode& node = nodes[levelStart + t];
+			int c = childOffsets[t];
+			node.childCount = childOffsets[t + 1] - c;
+			if (node.childCount == 0)
+				continue;
+			node.firstChild = c;
+			const std::array<uint32_t, 5>& split = splits[t];
+			float2 split2 = node.bounds.center();
+			for (int q = 0; q < 4; q++) {
+				if (split[q + 1] == split[q])
+					continue;
+				QuadTreeNode& child = nodes[c++];
+				float2 pt1 = node.bounds.position;
+				float2 pt2 = node.bounds.position + node.bounds.dimensions;
+				if (q == 1 || q == 3)
+					pt1.x = split2.x;
+				else
+					pt2.x = split2.x;
+				if (q > 1)
+					pt1.y = split2.y;
+				else
+					pt2.y = split2.y;
+				child.bounds = box2f(pt1, pt2 - pt1);
+				child.depth = node.depth + 1;
+				child.start = split[q];
+				child.end = split[q + 1];
+			}
+		}
+		levelStart = levelEnd;
+		levelEnd = (uint32_t) nodes.size();
 	}
-	for (ForceItemPtr item : values) {
-		mass += item->mass;
-		com += item->mass * item->location;
-	}
-	if (mass > 0) {
-		com = com / mass;
+	for (int lev = (int) levels.size() - 1; lev >= 0; lev--) {
+		uint2 range = levels[lev];
+#pragma omp parallel for num_threads(NUM_THREADS)
+		for (int n = (int) range.x; n < (int) range.y; n++) {
+			QuadTreeNode& node = nodes[n];
+			float2 com(0.0f);
+			float mass = 0.0f;
+			if (node.hasChildren()) {
+				for (int c = node.firstChild; c < node.firstChild + node.childCount; c++) {
+					mass += nodes[c].mass;
+					com += nodes[c].mass * nodes[c].com;
+				}
+			} else {
+				for (uint32_t k = node.start; k < node.end; k++) {
+					mass += sortedMass[k];
+					com += sortedMass[k] * sortedLocation[k];
+				}
+			}
+			if (mass > 0) {
+				com = com / mass;
+			}
+			node.mass = mass;
+			node.com = com;
+		}
 	}
 }
-void NBodyForce::getForce(const ForceItemPtr& item) {
-	std::queue<QuadTreeNode*> q;
-	q.push(root.get());
+void NBodyForce::getForce(ForceItemStore& store, int i) {
+	if (nodes.size() == 0 || i >= (int) rank.size())
+		return;
+	const int STACK_SIZE = 4 * (QuadTreeNode::MAX_DEPTH + 2);
+	int stack[STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
 	double2 forceTotal = double2(0.0f);
 	const float ZERO_TOL = 1E-6f;
-	//if (item->group != nullptr)return;
-	while (q.size() > 0) {
-		QuadTreeNode* n = q.front();
-		q.pop();
-		box2f box = n->bounds;
+	float2 location = store.location[i];
+	float itemMass = store.mass[i];
+	uint32_t self = rank[i];
+	while (stackSize > 0) {
+		const QuadTreeNode& n = nodes[stack[--stackSize]];
+		const box2f& box = n.bounds;
 		float d = std::max(box.dimensions.x, box.dimensions.y);
-		float2 dxy = n->com - item->location;
+		float2 dxy = n.com - location;
 		double r = length(dxy);
 		//True if distance to center of mass is grater than threshold and thresholding enabled
 		bool minDist = params[MIN_DISTANCE] > 0.0f && r > params[MIN_DISTANCE];
-		if (r > ZERO_TOL && d < params[BARNES_HUT_THETA] * r
-				&& !box.contains(item->location)) {
-			//Make sure box does not contain location or else we'll accumulate force twice
+		//Nodes that hold the item itself are always opened, or else its own mass would be counted.
+		bool contains = (self >= n.start && self < n.end);
+		if (r > ZERO_TOL && d < params[BARNES_HUT_THETA] * r && !contains) {
 			if (!minDist) {
-				forceTotal += double2(dxy * n->mass * item->mass) / (r * r * r);
+				forceTotal += double2(dxy * n.mass * itemMass) / (r * r * r);
 			}
-		} else {
-			for (QuadTreeNodePtr child : n->children) {
-				if (child.get() != nullptr) {
-					q.push(child.get());
-				}
+		} else if (n.hasChildren()) {
+			for (int c = n.firstChild; c < n.firstChild + n.childCount; c++) {
+				stack[stackSize++] = c;
 			}
-			if (!minDist) {
-				//Add up forces from leaf nodes.
-				for (ForceItemPtr& leaf : n->values) {
-					if (leaf.get() != item.get()) {
-						dxy = leaf->location - item->location;
-						r = length(dxy);
-						if (r > ZERO_TOL) {
-							forceTotal += double2(dxy * leaf->mass * item->mass)
-									/ (r * r * r);
-						}
+		} else if (!minDist) {
+			//Add up forces from leaf nodes.
+			for (uint32_t k = n.start; k < n.end; k++) {
+				if (k != self) {
+					dxy = sortedLocation[k] - location;
+					r = length(dxy);
+					if (r > ZERO_TOL) {
+						forceTotal += double2(dxy * sortedMass[k] * itemMass)
+								/ (r * r * r);
 					}
 				}
 			}
 		}
 	}
 	//apply update to item force
-	item->force += float2(forceTotal * (double) params[GRAVITATIONAL_CONST]);
+	store.force[i] += float2(forceTotal * (double) params[GRAVITATIONAL_CONST]);
 }
-void QuadTreeNode::draw(AlloyContext* context, const pixel2& offset,
+void NBodyForce::draw(AlloyContext* context, const pixel2& offset,
 		float scale) {
+	if (!enabled || !visible)
+		return;
 	static std::vector<Color> colors;
 	if (colors.size() == 0) {
-		colors.resize(QuadTreeNode::MAX_DEPTH);
+		colors.resize(QuadTreeNode::MAX_DEPTH + 1);
 		std::srand(123181);
-		for (int i = 0; i < MAX_DEPTH; i++) {
+		for (int i = 0; i <= QuadTreeNode::MAX_DEPTH; i++) {
 			colors[i] = HSVAtoColor(
 					HSVA((std::rand() % 256) / 255.0f, 0.8f, 0.7f, 1.0f));
 		}
 	}
-	Color c = colors[depth];
 	NVGcontext* nvg = context->nvgContext;
-	nvgFillColor(nvg, c);
 	nvgStrokeColor(nvg, Color(255, 255, 255));
 	nvgStrokeWidth(nvg, scale * 2.0f);
-	nvgBeginPath(nvg);
-	nvgRect(nvg, scale * (bounds.position.x + offset.x),
-			scale * (bounds.position.y + offset.y), scale * bounds.dimensions.x,
-			scale * bounds.dimensions.y);
-	nvgFill(nvg);
-	nvgStroke(nvg);
-	for (QuadTreeNodePtr& child : children) {
-		if (child.get() != nullptr) {
-			child->draw(context, offset, scale);
-		}
-	}
-	nvgFillColor(nvg, c);
-	nvgStrokeColor(nvg, Color(255, 255, 255));
-	if (hasChildren) {
+	//Parents precede children, so boxes nest correctly. Centers of mass go on top.
+	for (const QuadTreeNode& node : nodes) {
+		const box2f& bounds = node.bounds;
+		nvgFillColor(nvg, colors[node.depth]);
 		nvgBeginPath(nvg);
-		nvgCircle(nvg, scale * (com.x + offset.x), scale * (com.y + offset.y),
-				scale * 6.0f);
+		nvgRect(nvg, scale * (bounds.position.x + offset.x),
+				scale * (bounds.position.y + offset.y), scale * bounds.dimensions.x,
+				scale * bounds.dimensions.y);
 		nvgFill(nvg);
 		nvgStroke(nvg);
 	}
-}
-void NBodyForce::draw(AlloyContext* context, const pixel2& offset,
-		float scale) {
-	if (!enabled || !visible)
-		return;
-	if (root.get() != nullptr)
-		root->draw(context, offset, scale);
+	for (int n = (int) nodes.size() - 1; n >= 0; n--) {
+		const QuadTreeNode& node = nodes[n];
+		if (node.hasChildren()) {
+			nvgFillColor(nvg, colors[node.depth]);
+			nvgBeginPath(nvg);
+			nvgCircle(nvg, scale * (node.com.x + offset.x),
+					scale * (node.com.y + offset.y), scale * 6.0f);
+			nvgFill(nvg);
+			nvgStroke(nvg);
+		}
+	}
 }
 
 void CircularWallForce::draw(AlloyContext* context, const pixel2& offset,
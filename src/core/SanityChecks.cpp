@@ -25,22 +25,31 @@
 #include "AlloyLocator.h"
 #include "AlloyDistanceField.h"
 #include "AlloySparseSolve.h"
+#include "AlloySparseCholesky.h"
 #include "AlloyMath.h"
 #include "AlloyImage.h"
 #include "AlloyVector.h"
 #include "AlloyFileUtil.h"
 #include "AlloyUI.h"
 #include "AlloyMesh.h"
+#include "AlloyIsoSurface.h"
 #include "AlloyDenseSolve.h"
 #include "AlloyImageProcessing.h"
+#include "AlloyConnectedComponents.h"
 #include "AlloySparseMatrix.h"
 #include "AlloyDenseMatrix.h"
 #include "AlloyArray.h"
 #include "AlloySpline.h"
+#include "AlloyMaxFlow.h"
+#include "AlloyComputeGraph.h"
 #include "cereal/archives/json.hpp"
 #include <iostream>
 #include <fstream>
 #include <random>
+#include <array>
+#include <tuple>
+#include <set>
+#include <iterator>
 #ifndef ALY_WINDOWS
 #pragma GCC diagnostic ignored "-Wunused-variable"
 #pragma GCC diagnostic ignored "-Wunused-but-set-variable"
@@ -71,6 +80,78 @@ namespace aly {
 		std::cout << "Curve Points\n" << pts << std::endl;
 		return true;
 	}
+	//Radius matches may only differ by points that lie on the search sphere, where float rounding decides.
+	template<int C> void CompareMatches(const Vector<float, C>& samples, const vec<float, C>& q, float radius,
+			const std::vector<std::pair<size_t, float>>& gridPair, const std::vector<std::pair<size_t, float>>& hitPair, size_t skip) {
+		std::set<size_t> gridSet, hitSet;
+		for (const std::pair<size_t, float>& pr : gridPair) {
+			if (std::abs(pr.second - distance(q, samples[pr.first])) > 1E-5f) {
+				throw std::runtime_error(MakeString() << "GridLocator reported distance " << pr.second << " for point " << pr.first);
+			}
+			gridSet.insert(pr.first);
+		}
+		for (const std::pair<size_t, float>& pr : hitPair) {
+			if (pr.first != skip) {
+				hitSet.insert(pr.first);
+			}
+		}
+		for (int k = 1; k < (int) gridPair.size(); k++) {
+			if (gridPair[k].second < gridPair[k - 1].second) {
+				throw std::runtime_error("GridLocator matches are not sorted by distance.");
+			}
+		}
+		std::vector<size_t> diff;
+		std::set_symmetric_difference(gridSet.begin(), gridSet.end(), hitSet.begin(), hitSet.end(), std::back_inserter(diff));
+		for (size_t idx : diff) {
+			if (std::abs(distance(q, samples[idx]) - radius) > 1E-5f) {
+				throw std::runtime_error(
+						MakeString() << "GridLocator and Matcher disagree on point " << idx << " at " << q << " radius " << radius << ": " << gridSet.size() << " vs "
+								<< hitSet.size() << " matches.");
+			}
+		}
+	}
+	template<int C> void CompareGridLocator(const Vector<float, C>& samples, const std::vector<vec<float, C>>& queries, float cellSize) {
+		MatcherVec<float, C> matcher(samples);
+		GridLocator<float, C> grid(samples, cellSize);
+		const size_t none = GridLocator<float, C>::NO_POINT_FOUND;
+		std::vector<std::pair<size_t, float>> gridPair, hitPair;
+		for (const vec<float, C>& q : queries) {
+			for (float radius : { 0.5f * cellSize, cellSize, 2.5f * cellSize }) {
+				grid.closest(q, radius, gridPair);
+				matcher.closest(q, radius, hitPair);
+				CompareMatches(samples, q, radius, gridPair, hitPair, none);
+				size_t best = grid.closest(q, radius);
+				if (best != ((gridPair.size() > 0) ? gridPair[0].first : none)) {
+					throw std::runtime_error(MakeString() << "GridLocator closest in radius " << radius << " disagrees with its radius search at " << q);
+				}
+			}
+			for (int kNN : { 1, 7, 40 }) {
+				grid.closest(q, kNN, gridPair);
+				matcher.closest(q, kNN, hitPair);
+				if (gridPair.size() != hitPair.size()) {
+					throw std::runtime_error(MakeString() << "GridLocator found " << gridPair.size() << " of " << kNN << " nearest neighbors at " << q);
+				}
+				for (int k = 0; k < (int) gridPair.size(); k++) {
+					if (std::abs(gridPair[k].second - hitPair[k].second) > 1E-5f) {
+						throw std::runtime_error(
+								MakeString() << "GridLocator neighbor " << k << " of " << kNN << " at " << q << " is " << gridPair[k].second << " away, Matcher found "
+										<< hitPair[k].second);
+					}
+				}
+			}
+			if (grid.closest(q) != gridPair[0].first) {
+				throw std::runtime_error(MakeString() << "GridLocator closest point disagrees with its kNN search at " << q);
+			}
+		}
+		std::vector<uint32_t> offsets;
+		std::vector<std::pair<size_t, float>> neighbors;
+		grid.neighbors(cellSize, offsets, neighbors);
+		for (size_t n = 0; n < samples.size(); n++) {
+			gridPair.assign(neighbors.begin() + offsets[n], neighbors.begin() + offsets[n + 1]);
+			matcher.closest(samples[n], cellSize, hitPair);
+			CompareMatches(samples, samples[n], cellSize, gridPair, hitPair, n);
+		}
+	}
 	bool SANITY_CHECK_LOCATOR() {
 
 		{
@@ -238,6 +319,40 @@ namespace aly {
 					<< distance(pivot, samples[hitPair[k].first]) << std::endl;
 			}
 		}
+		{
+			//Samples leave a hole so some queries land in empty cells, and some queries sit on or outside the boundary.
+			const float cellSize = 0.05f;
+			Vector3f samples;
+			while (samples.size() < 5000) {
+				float3 pt(RandomUniform(0.0f, 1.0f), RandomUniform(0.0f, 1.0f), RandomUniform(0.0f, 1.0f));
+				if (distance(pt, float3(0.7f, 0.7f, 0.7f)) > 0.2f) {
+					samples.push_back(pt);
+				}
+			}
+			std::vector<float3> queries = { float3(0.7f, 0.7f, 0.7f), float3(0.0f), float3(1.0f), float3(1.03f, 0.5f, -0.02f), float3(3.0f, 3.0f, 3.0f),
+					float3(-0.5f, 0.2f, 0.4f), samples[17] };
+			for (int n = 0; n < 20; n++) {
+				queries.push_back(float3(RandomUniform(-0.1f, 1.1f), RandomUniform(-0.1f, 1.1f), RandomUniform(-0.1f, 1.1f)));
+			}
+			CompareGridLocator(samples, queries, cellSize);
+			std::cout << "[GridLocator3f] Matches Matcher3f for " << queries.size() << " queries." << std::endl;
+		}
+		{
+			const float cellSize = 0.05f;
+			Vector2f samples;
+			while (samples.size() < 2000) {
+				float2 pt(RandomUniform(0.0f, 1.0f), RandomUniform(0.0f, 1.0f));
+				if (distance(pt, float2(0.3f, 0.6f)) > 0.15f) {
+					samples.push_back(pt);
+				}
+			}
+			std::vector<float2> queries = { float2(0.3f, 0.6f), float2(0.0f), float2(1.0f), float2(1.02f, -0.01f), float2(-2.0f, 5.0f), samples[3] };
+			for (int n = 0; n < 20; n++) {
+				queries.push_back(float2(RandomUniform(-0.1f, 1.1f), RandomUniform(-0.1f, 1.1f)));
+			}
+			CompareGridLocator(samples, queries, cellSize);
+			std::cout << "[GridLocator2f] Matches Matcher2f for " << queries.size() << " queries." << std::endl;
+		}
 		return true;
 	}
 	bool SANITY_CHECK_SUBDIVIDE() {
@@ -404,6 +519,147 @@ namespace aly {
 
 		return true;
 	}
+	//Compares Gemm, Syrk and Gemv against naive double precision loops. Each entry may differ by the rounding of its sum.
+	template<class T> void CompareDenseKernels(const std::string& type) {
+		std::mt19937 rng(71237);
+		std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+		const T eps = std::numeric_limits<T>::epsilon();
+		const T nan = std::numeric_limits<T>::quiet_NaN();
+		auto check = [&](const std::string& name, double val, double ref, double mag, int K) {
+			if (!(std::abs(val - ref) <= 4.0 * (K + 2) * eps * mag + 1E-30)) {
+				throw std::runtime_error(MakeString() << type << " " << name << " is " << val << " but should be " << ref);
+			}
+		};
+		auto random = [&](size_t n) {
+			std::vector<T> data(n);
+			for (T& val : data) {
+				val = (T) uniform(rng);
+			}
+			return data;
+		};
+		//M,N,K. The first is below the packing threshold, the others are packed with ragged edge tiles,
+		//several K blocks, several row panels and several column panels.
+		const int gemmSizes[][3] = { { 5, 7, 3 }, { 37, 29, 41 }, { 131, 67, 300 }, { 801, 9, 5 }, { 7, 2053, 3 } };
+		for (auto size : gemmSizes) {
+			int M = size[0], N = size[1], K = size[2];
+			for (int layout = 0; layout < 4; layout++) {
+				bool transA = (layout & 1) != 0;
+				bool transB = (layout & 2) != 0;
+				//Operands are stored as the second channel of two interleaved channels, so C has a column stride of 2.
+				std::vector<T> A = random((size_t) M * K);
+				std::vector<T> B = random((size_t) K * N);
+				std::vector<T> C = random((size_t) M * N * 2);
+				ptrdiff_t rsA = transA ? 1 : K, csA = transA ? M : 1;
+				ptrdiff_t rsB = transB ? 1 : N, csB = transB ? K : 1;
+				for (int pass = 0; pass < 2; pass++) {
+					T alpha = (T) 0.75, beta = (pass == 0) ? T(0) : (T) -0.5;
+					std::vector<T> C0 = C;
+					if (pass == 0) {
+						for (int n = 1; n < M * N * 2; n += 2) {
+							C[n] = nan;
+						}
+					}
+					Gemm(M, N, K, alpha, A.data(), rsA, csA, B.data(), rsB, csB, beta, C.data() + 1, 2 * N, 2);
+					for (int i = 0; i < M; i++) {
+						for (int j = 0; j < N; j++) {
+							double sum = 0.0, mag = 0.0;
+							for (int k = 0; k < K; k++) {
+								double prod = (double) A[i * rsA + k * csA] * B[k * rsB + j * csB];
+								sum += prod;
+								mag += std::abs(prod);
+							}
+							double c0 = (beta == T(0)) ? 0.0 : (double) C0[(i * N + j) * 2 + 1];
+							double ref = alpha * sum + beta * c0;
+							check(MakeString() << "Gemm " << M << "x" << N << "x" << K << " [" << layout << "] (" << i << "," << j << ")", C[(i * N + j) * 2 + 1], ref,
+								std::abs(alpha) * mag + std::abs(beta * c0), K);
+							if (C[(i * N + j) * 2] != C0[(i * N + j) * 2]) {
+								throw std::runtime_error(MakeString() << type << " Gemm wrote to an interleaved channel it does not own at (" << i << "," << j << ")");
+							}
+						}
+					}
+				}
+			}
+		}
+		//M,N for an M x N matrix A and an N x N product. N crosses row panels and column panels in the packed path.
+		const int syrkSizes[][2] = { { 6, 5 }, { 300, 37 }, { 3, 801 }, { 2, 1100 } };
+		for (auto size : syrkSizes) {
+			int M = size[0], N = size[1];
+			std::vector<T> A = random((size_t) M * N);
+			for (int pass = 0; pass < 2; pass++) {
+				T alpha = (T) 1.25, beta = (pass == 0) ? T(0) : (T) 0.5;
+				//The input C is symmetric, as it is for the callers that accumulate into it.
+				std::vector<T> C((size_t) N * N * 2, nan);
+				if (pass == 1) {
+					for (int i = 0; i < N; i++) {
+						for (int j = i; j < N; j++) {
+							C[(i * N + j) * 2 + 1] = C[(j * N + i) * 2 + 1] = (T) uniform(rng);
+						}
+					}
+				}
+				std::vector<T> C0 = C;
+				Syrk(M, N, alpha, A.data(), (ptrdiff_t) N, (ptrdiff_t) 1, beta, C.data() + 1, 2 * N, 2);
+				for (int i = 0; i < N; i++) {
+					for (int j = 0; j < N; j++) {
+						double sum = 0.0, mag = 0.0;
+						for (int k = 0; k < M; k++) {
+							double prod = (double) A[k * N + i] * A[k * N + j];
+							sum += prod;
+							mag += std::abs(prod);
+						}
+						double c0 = (beta == T(0)) ? 0.0 : (double) C0[(i * N + j) * 2 + 1];
+						check(MakeString() << "Syrk " << M << "x" << N << " (" << i << "," << j << ")", C[(i * N + j) * 2 + 1], alpha * sum + beta * c0,
+							std::abs(alpha) * mag + std::abs(beta * c0), M);
+						if (C[(i * N + j) * 2 + 1] != C[(j * N + i) * 2 + 1]) {
+							throw std::runtime_error(MakeString() << type << " Syrk lower triangle is not a mirror of the upper triangle at (" << i << "," << j << ")");
+						}
+					}
+				}
+			}
+		}
+		//Column-major A takes the blocked column path, row-major A the unrolled row path and strided A the generic path.
+		const int gemvSizes[][2] = { { 3, 5 }, { 613, 7 }, { 257, 129 }, { 9, 2049 } };
+		for (auto size : gemvSizes) {
+			int M = size[0], N = size[1];
+			std::vector<T> A = random((size_t) M * N * 2);
+			std::vector<T> x = random((size_t) N * 2);
+			for (int layout = 0; layout < 3; layout++) {
+				ptrdiff_t rsA = (layout == 0) ? 1 : ((layout == 1) ? N : 2 * N);
+				ptrdiff_t csA = (layout == 0) ? M : ((layout == 1) ? 1 : 2);
+				ptrdiff_t incx = (layout == 2) ? 2 : 1;
+				for (int pass = 0; pass < 2; pass++) {
+					T alpha = (T) -1.5, beta = (pass == 0) ? T(0) : (T) 2.0;
+					std::vector<T> y = random((size_t) M * 2);
+					std::vector<T> y0 = y;
+					if (pass == 0) {
+						for (int i = 0; i < M; i++) {
+							y[i * 2] = nan;
+						}
+					}
+					Gemv(M, N, alpha, A.data(), rsA, csA, x.data(), incx, beta, y.data(), 2);
+					for (int i = 0; i < M; i++) {
+						double sum = 0.0, mag = 0.0;
+						for (int j = 0; j < N; j++) {
+							double prod = (double) A[i * rsA + j * csA] * x[j * incx];
+							sum += prod;
+							mag += std::abs(prod);
+						}
+						double c0 = (beta == T(0)) ? 0.0 : (double) y0[i * 2];
+						check(MakeString() << "Gemv " << M << "x" << N << " [" << layout << "] (" << i << ")", y[i * 2], alpha * sum + beta * c0,
+							std::abs(alpha) * mag + std::abs(beta * c0), N);
+						if (y[i * 2 + 1] != y0[i * 2 + 1]) {
+							throw std::runtime_error(MakeString() << type << " Gemv wrote past its output stride at " << i);
+						}
+					}
+				}
+			}
+		}
+	}
+	bool SANITY_CHECK_DENSE_KERNELS() {
+		CompareDenseKernels<float>("float");
+		CompareDenseKernels<double>("double");
+		std::cout << "Dense kernels match naive loops." << std::endl;
+		return true;
+	}
 	bool SANITY_CHECK_ALGO() {
 		SparseMatrix4f A(128, 128);
 		SparseMatrix1f A1(128, 128);
@@ -424,6 +680,23 @@ namespace aly {
 		SolveCG(b1, A1, x1);
 		SolveVecBICGStab(b, A, x);
 		SolveBICGStab(b1, A1, x1);
+		CompressedSparseMatrix4f Ac(A);
+		CompressedSparseMatrix1f A1c(A1);
+		Vector4f y, yc;
+		MultiplyVec(y, A, x);
+		MultiplyVec(yc, Ac, x);
+		std::cout << "Compressed SpMV error " << lengthL1(y - yc) << std::endl;
+		SolveVecCG(b, Ac, x);
+		SolveCG(b1, A1c, x1);
+		SolveVecBICGStab(b, Ac, x);
+		SolveBICGStab(b1, A1c, x1);
+		SolverWorkspace<float, 1> workspace;
+		JacobiPreconditioner<float, 1> jacobi(A1c);
+		IncompleteCholeskyPreconditioner<float, 1> ichol(A1c);
+		MultigridPreconditioner<float, 1> multigrid(A1c);
+		SolvePCG(b1, A1c, x1, jacobi, workspace);
+		SolvePCG(b1, A1c, x1, ichol, workspace);
+		SolvePCG(b1, A1c, x1, multigrid, workspace);
 		std::ofstream os("matrix.json");
 		cereal::JSONOutputArchive archiver(os);
 		archiver(A);
@@ -475,10 +748,18 @@ namespace aly {
 		DistanceField3f df3;
 		df3.solve(vol, distVol,10.0f);
 		distVol.writeToXML("vol_df.xml");
+		df3.setMethod(DistanceMethod::FastSweeping);
+		df3.solve(vol, distVol, 10.0f);
+		distVol.writeToXML("vol_df_sweep.xml");
+		DistanceTransform(vol, distVol, true);
+		distVol.writeToXML("vol_edt.xml");
 		img.writeToXML("img_closest.xml");
 		DistanceField2f df2;
 		df2.solve(img, distImg, 10.0f);
 		distImg.writeToXML("img_df.xml");
+		Image2i nearest;
+		DistanceTransform(img, distImg, nearest, true);
+		distImg.writeToXML("img_edt.xml");
 		return true;
 	}
 	bool SANITY_CHECK_KDTREE() {
@@ -553,6 +834,36 @@ namespace aly {
 			}
 		}
 		rgba.writeToXML("closest_clamped.xml");
+
+		std::vector<float3> origins(rgba.width * rgba.height);
+		std::vector<float3> directions(origins.size());
+		for (int j = 0; j < rgba.height; j++) {
+			for (int i = 0; i < rgba.width; i++) {
+				float3 pt1 = camera.transformImageToWorld(
+					float3((float)i, (float)j, 0.0f), rgba.width,
+					rgba.height);
+				float3 pt2 = camera.transformImageToWorld(
+					float3((float)i, (float)j, 1.0f), rgba.width,
+					rgba.height);
+				origins[i + j * rgba.width] = pt1;
+				directions[i + j * rgba.width] = normalize(pt2 - pt1);
+			}
+		}
+		std::vector<double> distances;
+		std::vector<float3> lastPoints;
+		kdTree.intersectRayDistance(origins, directions, distances, lastPoints);
+		for (int j = 0; j < rgba.height; j++) {
+			for (int i = 0; i < rgba.width; i++) {
+				size_t idx = i + j * rgba.width;
+				if (distances[idx] != NO_HIT_DISTANCE) {
+					rgba(i, j) = float4(lastPoints[idx], (float)distances[idx]);
+				}
+				else {
+					rgba(i, j) = float4(0, 0, 0, 0);
+				}
+			}
+		}
+		rgba.writeToXML("depth_packet.xml");
 		return true;
 	}
 	bool SANITY_CHECK_IMAGE_PROCESSING() {
@@ -622,6 +933,168 @@ namespace aly {
 
 		return true;
 	}
+	//Reference labeling by breadth first search from each unlabeled element in storage order.
+	template<class T> int FloodFillComponents(const T* values, int nx, int ny, int nz, int connectivity, const T* background,
+			std::vector<int>& labels, std::vector<VolumeComponent>& components) {
+		size_t N = (size_t) nx * ny * nz;
+		labels.assign(N, -1);
+		components.clear();
+		std::vector<size_t> queue;
+		for (size_t seed = 0; seed < N; seed++) {
+			if (labels[seed] != -1 || (background != nullptr && values[seed] == *background))
+				continue;
+			int id = (int) components.size();
+			int3 minPt(std::numeric_limits<int>::max()), maxPt(std::numeric_limits<int>::min());
+			queue.assign(1, seed);
+			labels[seed] = id;
+			for (size_t q = 0; q < queue.size(); q++) {
+				size_t i = queue[q];
+				int3 pt((int) (i % nx), (int) ((i / nx) % ny), (int) (i / ((size_t) nx * ny)));
+				minPt = aly::min(minPt, pt);
+				maxPt = aly::max(maxPt, pt);
+				for (int dz = -1; dz <= 1; dz++) {
+					for (int dy = -1; dy <= 1; dy++) {
+						for (int dx = -1; dx <= 1; dx++) {
+							int order = std::abs(dx) + std::abs(dy) + std::abs(dz);
+							if (order == 0 || (connectivity == 6 && order > 1) || (connectivity == 18 && order > 2))
+								continue;
+							int3 nbr = pt + int3(dx, dy, dz);
+							if (nbr.x < 0 || nbr.y < 0 || nbr.z < 0 || nbr.x >= nx || nbr.y >= ny || nbr.z >= nz)
+								continue;
+							size_t j = nbr.x + (size_t) nx * (nbr.y + (size_t) ny * nbr.z);
+							if (labels[j] == -1 && values[j] == values[i]) {
+								labels[j] = id;
+								queue.push_back(j);
+							}
+						}
+					}
+				}
+			}
+			VolumeComponent comp;
+			comp.size = queue.size();
+			comp.bounds = box3i(minPt, maxPt - minPt + int3(1));
+			components.push_back(comp);
+		}
+		return (int) components.size();
+	}
+	template<class T> void CompareComponents(const std::string& name, const T* values, int nx, int ny, int nz, int connectivity,
+			const T* background, const int* labels, const std::vector<VolumeComponent>& components) {
+		std::vector<int> refLabels;
+		std::vector<VolumeComponent> refComponents;
+		int count = FloodFillComponents(values, nx, ny, nz, connectivity, background, refLabels, refComponents);
+		std::cout << name << " " << nx << "x" << ny << "x" << nz << " [" << connectivity << "] components=" << count << std::endl;
+		if (components.size() != (size_t) count) {
+			throw std::runtime_error(MakeString() << name << " found " << components.size() << " components instead of " << count);
+		}
+		for (size_t i = 0; i < refLabels.size(); i++) {
+			if (labels[i] != refLabels[i]) {
+				throw std::runtime_error(MakeString() << name << " label " << labels[i] << " at " << i << " should be " << refLabels[i]);
+			}
+		}
+		for (int c = 0; c < count; c++) {
+			if (components[c].size != refComponents[c].size || components[c].bounds.position != refComponents[c].bounds.position
+					|| components[c].bounds.dimensions != refComponents[c].bounds.dimensions) {
+				throw std::runtime_error(MakeString() << name << " component " << c << " has size " << components[c].size << " and bounds "
+						<< components[c].bounds << " instead of " << refComponents[c].size << " and " << refComponents[c].bounds);
+			}
+		}
+	}
+	bool SANITY_CHECK_CONNECTED_COMPONENTS() {
+		std::mt19937 rng(51817);
+		//Values are 0 or 1, with 1 near the percolation threshold so components wind across many slabs.
+		//Heights below MAX_COMPONENT_SLABS give one row per slab, taller grids several rows per slab.
+		auto randomize = [&](uint8_t* values, size_t N, int levels) {
+			for (size_t i = 0; i < N; i++) {
+				values[i] = (levels == 2) ? ((rng() % 100 < 60) ? 1 : 0) : (uint8_t) (rng() % levels);
+			}
+		};
+		const uint8_t background = 0;
+		const int imageSizes[][2] = { { 37, 23 }, { 41, 150 }, { 200, 1 }, { 1, 90 }, { 64, 64 } };
+		for (auto size : imageSizes) {
+			for (int levels = 2; levels <= 3; levels++) {
+				Image1ub image(size[0], size[1]);
+				randomize(image.ptr(), image.size(), levels);
+				for (int connectivity = 4; connectivity <= 8; connectivity += 4) {
+					for (int bg = 0; bg < 2; bg++) {
+						Image1i labels;
+						std::vector<ImageComponent> components;
+						int count = (bg == 0) ?
+								LabelConnectedComponents(image, labels, components, connectivity) :
+								LabelConnectedComponents(image, background, labels, components, connectivity);
+						std::vector<VolumeComponent> comps(count);
+						for (int c = 0; c < count; c++) {
+							comps[c].size = components[c].size;
+							comps[c].bounds = box3i(int3(components[c].bounds.position, 0), int3(components[c].bounds.dimensions, 1));
+						}
+						CompareComponents("Image components", image.ptr(), image.width, image.height, 1, (connectivity == 4) ? 6 : 18,
+								(bg == 0) ? nullptr : &background, labels.ptr(), comps);
+					}
+				}
+			}
+		}
+		const int volumeSizes[][3] = { { 9, 7, 5 }, { 6, 5, 130 }, { 17, 1, 70 }, { 1, 1, 100 } };
+		for (auto size : volumeSizes) {
+			for (int levels = 2; levels <= 3; levels++) {
+				Volume1ub volume(size[0], size[1], size[2]);
+				randomize(volume.ptr(), volume.size(), levels);
+				for (int connectivity : { 6, 18, 26 }) {
+					for (int bg = 0; bg < 2; bg++) {
+						Volume1i labels;
+						std::vector<VolumeComponent> components;
+						if (bg == 0) {
+							LabelConnectedComponents(volume, labels, components, connectivity);
+						} else {
+							LabelConnectedComponents(volume, background, labels, components, connectivity);
+						}
+						CompareComponents("Volume components", volume.ptr(), volume.rows, volume.cols, volume.slices, connectivity,
+								(bg == 0) ? nullptr : &background, labels.ptr(), components);
+					}
+				}
+			}
+		}
+		//Graphs with local and long range edges, so unions span any number of vertex slabs. Some vertices stay isolated.
+		for (int N : { 1, 40, 1000 }) {
+			std::vector<std::vector<uint32_t>> adj(N);
+			for (int e = 0; e < N / 2; e++) {
+				int i = (int) (rng() % N);
+				int j = (rng() % 2 == 0) ? std::min(N - 1, i + 1 + (int) (rng() % 3)) : (int) (rng() % N);
+				if (i != j) {
+					adj[i].push_back(j);
+					adj[j].push_back(i);
+				}
+			}
+			std::vector<uint32_t> offsets(1, 0), indexes;
+			for (int i = 0; i < N; i++) {
+				indexes.insert(indexes.end(), adj[i].begin(), adj[i].end());
+				offsets.push_back((uint32_t) indexes.size());
+			}
+			std::vector<int> labels, sizes;
+			int count = LabelConnectedComponents(offsets, indexes, labels, sizes);
+			std::vector<int> refLabels(N, -1), refSizes;
+			for (int seed = 0; seed < N; seed++) {
+				if (refLabels[seed] != -1)
+					continue;
+				int id = (int) refSizes.size();
+				std::vector<int> queue(1, seed);
+				refLabels[seed] = id;
+				for (size_t q = 0; q < queue.size(); q++) {
+					for (uint32_t j : adj[queue[q]]) {
+						if (refLabels[j] == -1) {
+							refLabels[j] = id;
+							queue.push_back(j);
+						}
+					}
+				}
+				refSizes.push_back((int) queue.size());
+			}
+			std::cout << "Graph components " << N << " components=" << count << std::endl;
+			if (count != (int) refSizes.size() || labels != refLabels || sizes != refSizes) {
+				throw std::runtime_error(MakeString() << "Graph with " << N << " vertices has " << count << " components instead of " << refSizes.size()
+						<< " or labels and sizes that do not match a flood fill.");
+			}
+		}
+		return true;
+	}
 	bool SANITY_CHECK_ROBUST_SOLVE() {
 		int N = 1000;
 		DenseMatrix1f A(N, 5);
@@ -638,7 +1111,7 @@ namespace aly {
 				sum += row[j] * Y[j];
 				row[j] += float1(0.1f * ((rand() % 1000) / 1000.0f - 0.5f));
 			}
-			A[i] = row;
+			A.setRow(i, row.data());
 			b[i] = sum;
 		}
 		std::vector<int> order(N);
@@ -853,7 +1326,7 @@ namespace aly {
 		A = A.transpose();
 		std::cout << "At=\n" << A << std::endl;
 		return true;
-		MeshListNeighborTable vertTable;
+		MeshNeighborTable vertTable;
 		Mesh mesh;
 		mesh.load(AlloyDefaultContext()->getFullPath("models/monkey.ply"));
 		CreateOrderedVertexNeighborTable(mesh, vertTable);
@@ -889,6 +1362,157 @@ namespace aly {
 		});
 		return true;
 	}
+	bool SANITY_CHECK_SPARSE_CHOLESKY() {
+		const int N = 150;
+		std::mt19937 rng(90321);
+		std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+		//Symmetric pattern of a 10x15 grid Laplacian plus random long range couplings. Diagonal dominance keeps every pivot away from zero.
+		auto makeMatrix = [&](bool definite, bool extra) {
+			SparseMat<double> A(N, N);
+			auto couple = [&](int i, int j) {
+				double w = uniform(rng);
+				A[i][j] = w;
+				A[j][i] = w;
+			};
+			for (int i = 0; i < N; i++) {
+				if (i % 10 != 9)
+					couple(i, i + 1);
+				if (i + 10 < N)
+					couple(i, i + 10);
+			}
+			for (int n = 0; n < N / 5; n++) {
+				int i = (int) (rng() % N), j = (int) (rng() % N);
+				if (i != j)
+					couple(i, j);
+			}
+			if (extra) {
+				couple(0, N - 1);
+			}
+			for (int i = 0; i < N; i++) {
+				double sum = 1.0;
+				for (const auto& pr : A[i]) {
+					if ((int) pr.first != i)
+						sum += std::abs(pr.second);
+				}
+				A[i][i] = (definite || i % 3 != 0) ? sum : -sum;
+			}
+			return A;
+		};
+		//Reference solution of (A+shift*I)x=b by dense Gaussian elimination with partial pivoting.
+		auto denseSolve = [&](const SparseMat<double>& A, double shift, const Vec<double>& b) {
+			std::vector<std::vector<double>> M(N, std::vector<double>(N + 1, 0.0));
+			for (int i = 0; i < N; i++) {
+				for (const auto& pr : A[i]) {
+					M[i][pr.first] = pr.second;
+				}
+				M[i][i] += shift;
+				M[i][N] = b[i];
+			}
+			for (int k = 0; k < N; k++) {
+				int p = k;
+				for (int i = k + 1; i < N; i++) {
+					if (std::abs(M[i][k]) > std::abs(M[p][k]))
+						p = i;
+				}
+				std::swap(M[k], M[p]);
+				for (int i = k + 1; i < N; i++) {
+					double f = M[i][k] / M[k][k];
+					for (int j = k; j <= N; j++) {
+						M[i][j] -= f * M[k][j];
+					}
+				}
+			}
+			Vec<double> x(N);
+			for (int i = N - 1; i >= 0; i--) {
+				double sum = M[i][N];
+				for (int j = i + 1; j < N; j++) {
+					sum -= M[i][j] * x[j];
+				}
+				x[i] = sum / M[i][i];
+			}
+			return x;
+		};
+		auto compare = [&](const std::string& name, const SparseLDLT<double>& solver, const SparseMat<double>& A, double shift) {
+			Vec<double> b(N);
+			for (int i = 0; i < N; i++) {
+				b[i] = uniform(rng);
+			}
+			Vec<double> x = solver.solve(b);
+			Vec<double> ref = denseSolve(A, shift, b);
+			double err = 0.0, mag = 0.0;
+			for (int i = 0; i < N; i++) {
+				err = std::max(err, std::abs(x[i] - ref[i]));
+				mag = std::max(mag, std::abs(ref[i]));
+			}
+			std::cout << name << " error " << err << " fill " << solver.nonZeros() << std::endl;
+			if (!(err <= 1E-10 * std::max(1.0, mag))) {
+				throw std::runtime_error(MakeString() << name << " solution differs from dense solve by " << err);
+			}
+		};
+		SparseMat<double> spd = makeMatrix(true, false);
+		SparseCholesky<double> cholesky;
+		SparseLDLT<double> ldlt;
+		if (!cholesky.compute(spd) || !ldlt.compute(spd)) {
+			throw std::runtime_error("Sparse factorization failed on a positive definite matrix.");
+		}
+		compare("Cholesky SPD", cholesky, spd, 0.0);
+		compare("LDLT SPD", ldlt, spd, 0.0);
+		for (double d : ldlt.diagonal()) {
+			if (d <= 0.0)
+				throw std::runtime_error(MakeString() << "LDLT pivot " << d << " of a positive definite matrix is not positive.");
+		}
+		//Only the upper triangle is read, so dropping the lower triangle gives the same factors.
+		SparseMat<double> upper(N, N);
+		for (int i = 0; i < N; i++) {
+			for (const auto& pr : spd[i]) {
+				if ((int) pr.first >= i)
+					upper[i][pr.first] = pr.second;
+			}
+		}
+		SparseLDLT<double> upperLDLT(upper);
+		if (!upperLDLT.isFactored() || upperLDLT.diagonal() != ldlt.diagonal()) {
+			throw std::runtime_error("Sparse factorization of the upper triangle does not match the full matrix.");
+		}
+		SparseMat<double> indefinite = makeMatrix(false, false);
+		SparseCholesky<double> rejected;
+		if (rejected.compute(indefinite) || rejected.isFactored()) {
+			throw std::runtime_error("Sparse Cholesky accepted an indefinite matrix.");
+		}
+		if (!ldlt.compute(indefinite)) {
+			throw std::runtime_error("Sparse LDLT failed on an indefinite matrix.");
+		}
+		compare("LDLT indefinite", ldlt, indefinite, 0.0);
+		int negative = 0;
+		for (double d : ldlt.diagonal()) {
+			if (d < 0.0)
+				negative++;
+		}
+		if (negative != N / 3) {
+			throw std::runtime_error(MakeString() << "LDLT has " << negative << " negative pivots, but the matrix has " << N / 3 << " negative eigenvalues.");
+		}
+		//New values on the same pattern reuse the ordering. A shift is added to the diagonal.
+		std::vector<int> perm = cholesky.permutation();
+		SparseMat<double> values = spd;
+		for (int i = 0; i < N; i++) {
+			for (auto& pr : values[i]) {
+				if ((int) pr.first > i) {
+					pr.second *= 0.5;
+					values[pr.first][i] = pr.second;
+				}
+			}
+		}
+		if (!cholesky.matchesPattern(values) || !cholesky.compute(values, 2.5) || cholesky.permutation() != perm) {
+			throw std::runtime_error("Sparse Cholesky did not reuse its analysis for a matrix with the same pattern.");
+		}
+		compare("Cholesky shifted", cholesky, values, 2.5);
+		//A new entry changes the pattern, so the matrix is analyzed again.
+		SparseMat<double> extra = makeMatrix(true, true);
+		if (cholesky.matchesPattern(extra) || !cholesky.compute(extra)) {
+			throw std::runtime_error("Sparse Cholesky did not detect a changed pattern.");
+		}
+		compare("Cholesky new pattern", cholesky, extra, 0.0);
+		return true;
+	}
 	bool SANITY_CHECK_MATH() {
 		try {
 			int3 d3(1,2,3);
@@ -1100,6 +1724,15 @@ namespace aly {
 		aly::WriteImageToFile("sfmarket_rgba_hdr.png", srcRGBAf);
 		aly::WriteImageToFile("sfmarket_rgb2_hdr.png", srcRGBf);
 		aly::WriteImageToFile("sfmarket_r_hdr.png", srcAf);
+
+		ImageRGBf rawRGBf;
+		WriteImageToRawFile("sfmarket_rgb.xml", srcRGBf);
+		ReadImageFromRawFile("sfmarket_rgb.xml", rawRGBf);
+		MappedImage<float, 3, ImageType::FLOAT> mappedRGBf("sfmarket_rgb.xml");
+		if (rawRGBf.width != srcRGBf.width || rawRGBf.height != srcRGBf.height
+				|| mappedRGBf(11, 7) != srcRGBf(11, 7)) {
+			throw std::runtime_error("Raw image round trip failed.");
+		}
 		return true;
 	}
 	bool SANITY_CHECK_IMAGE() {
@@ -1179,6 +1812,238 @@ namespace aly {
 		return true;
 	}
 
+	bool SANITY_CHECK_ISO_SURFACE() {
+		//Sphere that is cut off by the top slice, so the last cell row emits triangles.
+		Volume1f vol(24, 20, 16);
+		for (int k = 0; k < vol.slices; k++) {
+			for (int j = 0; j < vol.cols; j++) {
+				for (int i = 0; i < vol.rows; i++) {
+					vol(i, j, k).x = length(float3(i - 11.3f, j - 9.6f, k - 13.2f)) - 6.7f;
+				}
+			}
+		}
+		IsoSurface isoSurf;
+		Mesh slabMesh, hashMesh;
+		isoSurf.setSlabParallel(true);
+		isoSurf.solve(vol, slabMesh, MeshType::Triangle, false, 0.0f);
+		isoSurf.setSlabParallel(false);
+		isoSurf.solve(vol, hashMesh, MeshType::Triangle, false, 0.0f);
+		//Compare triangles by vertex position, since the two paths number vertices differently.
+		auto triangleKeys = [](const Mesh& mesh) {
+			std::vector<std::array<int3, 3>> keys;
+			for (uint3 tri : mesh.triIndexes.data) {
+				std::array<int3, 3> key;
+				for (int n = 0; n < 3; n++) {
+					if (tri[n] >= mesh.vertexLocations.size()) {
+						throw std::runtime_error(MakeString() << "Iso-surface vertex index " << tri[n] << " out of range " << mesh.vertexLocations.size());
+					}
+					float3 pt = mesh.vertexLocations[tri[n]];
+					key[n] = int3((int)std::round(pt.x * 1024.0f), (int)std::round(pt.y * 1024.0f), (int)std::round(pt.z * 1024.0f));
+				}
+				std::rotate(key.begin(), std::min_element(key.begin(), key.end(), [](const int3& a, const int3& b) {
+					return std::make_tuple(a.x, a.y, a.z) < std::make_tuple(b.x, b.y, b.z);
+				}), key.end());
+				keys.push_back(key);
+			}
+			std::sort(keys.begin(), keys.end(), [](const std::array<int3, 3>& a, const std::array<int3, 3>& b) {
+				for (int n = 0; n < 3; n++) {
+					auto ta = std::make_tuple(a[n].x, a[n].y, a[n].z);
+					auto tb = std::make_tuple(b[n].x, b[n].y, b[n].z);
+					if (ta != tb) return ta < tb;
+				}
+				return false;
+			});
+			return keys;
+		};
+		std::cout << "Iso-surface slab mesh " << slabMesh.vertexLocations.size() << " / " << slabMesh.triIndexes.size() << ", hash mesh "
+			<< hashMesh.vertexLocations.size() << " / " << hashMesh.triIndexes.size() << std::endl;
+		if (slabMesh.vertexLocations.size() != hashMesh.vertexLocations.size() || triangleKeys(slabMesh) != triangleKeys(hashMesh)) {
+			throw std::runtime_error("Slab-parallel iso-surface does not match hash table iso-surface.");
+		}
+		return true;
+	}
+	bool SANITY_CHECK_GRID_MAX_FLOW() {
+		//Random grids with sparse terminal weights, so some pixels are free and labels can tie.
+		struct GridEdge {
+			size_t a, b;
+			float fwd, rev;
+		};
+		auto cutCost = [](const std::vector<int>& labels, const std::vector<float>& srcCap, const std::vector<float>& sinkCap, const std::vector<GridEdge>& edges) {
+			double cost = 0.0;
+			for (size_t n = 0; n < labels.size(); n++) {
+				cost += (labels[n] == 0) ? sinkCap[n] : srcCap[n];
+			}
+			for (const GridEdge& e : edges) {
+				if (labels[e.a] == 0 && labels[e.b] == 1) {
+					cost += e.fwd;
+				} else if (labels[e.a] == 1 && labels[e.b] == 0) {
+					cost += e.rev;
+				}
+			}
+			return cost;
+		};
+		auto same = [](double a, double b) {
+			return std::abs(a - b) <= 1E-4 * std::max(1.0, std::abs(b));
+		};
+		const int dims[][4] = { { 23, 17, 1, 4 }, { 23, 17, 1, 8 }, { 11, 9, 7, 6 }, { 11, 9, 7, 26 } };
+		for (int trial = 0; trial < 12; trial++) {
+			int rows = dims[trial % 4][0], cols = dims[trial % 4][1], slices = dims[trial % 4][2], conn = dims[trial % 4][3];
+			GridMaxFlow grid;
+			if (slices == 1) {
+				grid.resize(rows, cols, conn);
+			} else {
+				grid.resize(rows, cols, slices, conn);
+			}
+			size_t N = grid.size();
+			std::vector<float> srcCap(N, 0.0f), sinkCap(N, 0.0f);
+			std::vector<GridEdge> edges;
+			MaxFlow ref;
+			ref.resize(N);
+			for (size_t n = 0; n < N; n++) {
+				float r = RandomUniform(0.0f, 1.0f);
+				if (r < 0.2f) {
+					srcCap[n] = RandomUniform(0.0f, 4.0f);
+				} else if (r < 0.4f) {
+					sinkCap[n] = RandomUniform(0.0f, 4.0f);
+				} else if (r < 0.5f) {
+					srcCap[n] = RandomUniform(0.0f, 4.0f);
+					sinkCap[n] = RandomUniform(0.0f, 4.0f);
+				}
+				grid.setTerminalCapacity(n, srcCap[n], sinkCap[n]);
+				ref.addNodeCapacity((int)n, srcCap[n], sinkCap[n]);
+			}
+			for (int k = 0; k < slices; k++) {
+				for (int j = 0; j < cols; j++) {
+					for (int i = 0; i < rows; i++) {
+						for (int dir = 0; dir < grid.getNeighborCount(); dir += 2) {
+							int3 d = grid.getNeighborOffset(dir);
+							int3 q(i + d.x, j + d.y, k + d.z);
+							if (q.x < 0 || q.y < 0 || q.z < 0 || q.x >= rows || q.y >= cols || q.z >= slices) {
+								continue;
+							}
+							GridEdge e;
+							e.a = grid.index(i, j, k);
+							e.b = grid.index(q.x, q.y, q.z);
+							e.fwd = RandomUniform(0.0f, 1.0f);
+							e.rev = (RandomUniform(0.0f, 1.0f) < 0.5f) ? e.fwd : RandomUniform(0.0f, 1.0f);
+							grid.setEdgeCapacity(i, j, k, dir, e.fwd, e.rev);
+							ref.addEdge((int)e.a, (int)e.b, e.fwd, e.rev);
+							edges.push_back(e);
+						}
+					}
+				}
+			}
+			double flow = grid.solve();
+			ref.solve(nullptr);
+			double refFlow = ref.getTotalFlow();
+			std::vector<int> labels(N), refLabels(N);
+			for (size_t n = 0; n < N; n++) {
+				labels[n] = grid.getLabel(n);
+				refLabels[n] = (ref.getNodes()[n].type == MaxFlow::NodeType::Source) ? 0 : 1;
+			}
+			double cost = cutCost(labels, srcCap, sinkCap, edges);
+			double refCost = cutCost(refLabels, srcCap, sinkCap, edges);
+			std::cout << "Grid max-flow " << rows << "x" << cols << "x" << slices << " [" << conn << "] flow " << flow << " cut " << cost
+				<< ", max-flow " << refFlow << " cut " << refCost << std::endl;
+			if (!same(flow, refFlow)) {
+				throw std::runtime_error(MakeString() << "Grid max-flow " << flow << " does not match max-flow " << refFlow << " for connectivity " << conn);
+			}
+			if (!same(cost, flow)) {
+				throw std::runtime_error(MakeString() << "Grid max-flow cut " << cost << " does not match its flow " << flow << " for connectivity " << conn);
+			}
+			if (!same(refCost, refFlow)) {
+				throw std::runtime_error(MakeString() << "Max-flow cut " << refCost << " does not match its flow " << refFlow << " for connectivity " << conn);
+			}
+			//The grid solver puts every pixel that cannot reach the sink on the source side, so the source tree must be labeled 0 and the sink tree 1.
+			for (size_t n = 0; n < N; n++) {
+				MaxFlow::NodeType type = ref.getNodes()[n].type;
+				if ((type == MaxFlow::NodeType::Source && labels[n] != 0) || (type == MaxFlow::NodeType::Sink && labels[n] != 1)) {
+					throw std::runtime_error(MakeString() << "Grid max-flow label " << labels[n] << " does not match max-flow " << type << " at " << n << " for connectivity " << conn);
+				}
+			}
+			if (conn == 4) {
+				FastMaxFlow fast(rows, cols);
+				for (int j = 0; j < cols; j++) {
+					for (int i = 0; i < rows; i++) {
+						fast.setTerminalCapacity(i, j, srcCap[grid.index(i, j)], sinkCap[grid.index(i, j)]);
+					}
+				}
+				for (const GridEdge& e : edges) {
+					int3 p = int3((int)(e.a % rows), (int)(e.a / rows), 0);
+					fast.setEdgeCapacity(p.x, p.y, (e.b == e.a + 1) ? 0 : 2, e.fwd, e.rev);
+				}
+				fast.solve(100000);
+				//Fast max-flow labels are not a minimum cut, so compare the flow that reached the sink instead.
+				double fastFlow = 0.0;
+				for (size_t n = 0; n < N; n++) {
+					fastFlow += sinkCap[n] - std::max(-fast.getFlow(n), 0.0f);
+				}
+				std::cout << "Fast max-flow " << fastFlow << std::endl;
+				if (!same(fastFlow, flow)) {
+					throw std::runtime_error(MakeString() << "Fast max-flow " << fastFlow << " does not match grid max-flow " << flow);
+				}
+			}
+		}
+		return true;
+	}
+	bool SANITY_CHECK_COMPUTE_GRAPH() {
+		for (int pass = 0; pass < 2; pass++) {
+			bool parallel = (pass == 1);
+			//source -> offset -> scale, plus an independent branch so the parallel path has more than one task.
+			ComputeGraph graph;
+			int runs[3] = { 0, 0, 0 };
+			bool fail = false;
+			ComputeNodePtr source = graph.add("source", 1, 1, [&](ComputeNode& node) {
+				runs[0]++;
+				node.setOutputValue(0, node.getInputValue<int>(0));
+			});
+			ComputeNodePtr offset = graph.add("offset", 1, 1, [&](ComputeNode& node) {
+				runs[1]++;
+				if (fail) {
+					throw std::runtime_error("offset failure");
+				}
+				node.setOutputValue(0, node.getInputValue<int>(0) + 1);
+			});
+			ComputeNodePtr scale = graph.add("scale", 1, 1, [&](ComputeNode& node) {
+				runs[2]++;
+				node.setOutputValue(0, 2 * node.getInputValue<int>(0));
+			});
+			graph.add("branch", 0, 1, [](ComputeNode& node) {
+				node.setOutputValue(0, 0);
+			});
+			graph.connect(source, 0, offset, 0);
+			graph.connect(offset, 0, scale, 0);
+			auto result = [&]() {
+				return scale->getOutput(0)->getValue<int>();
+			};
+			source->setInputValue(0, 3);
+			if (graph.evaluate(parallel) != 4 || result() != 8) {
+				throw std::runtime_error(MakeString() << "Compute graph evaluated to " << result() << " instead of 8.");
+			}
+			if (graph.evaluate(parallel) != 0) {
+				throw std::runtime_error("Compute graph re-evaluated clean nodes.");
+			}
+			//Only the source is dirty. The offset node runs because its source is stale, and throws once.
+			source->setInputValue(0, 5);
+			fail = true;
+			bool threw = false;
+			try {
+				graph.evaluate(parallel);
+			} catch (std::exception& e) {
+				threw = true;
+			}
+			if (!threw || !offset->isDirty() || !scale->isDirty() || runs[2] != 1) {
+				throw std::runtime_error("Compute graph did not keep a failed node and its dependents dirty.");
+			}
+			fail = false;
+			int offsetRuns = runs[1];
+			graph.evaluate(parallel);
+			if (runs[1] != offsetRuns + 1 || result() != 12) {
+				throw std::runtime_error(MakeString() << "Compute graph did not re-run a failed node, result is " << result() << " instead of 12.");
+			}
+		}
+		return true;
+	}
 #ifndef WIN32
 	bool SANITY_CHECK_FILE_IO() {
 		try {
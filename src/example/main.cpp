@@ -155,6 +155,13 @@ bool SANITY_CHECK() {
 	//SANITY_CHECK_XML();
 	//SANITY_CHECK_LBFGS();
 	//SANITY_CHECK_GMM();
+	//SANITY_CHECK_ISO_SURFACE();
+	//SANITY_CHECK_ACTIVE_CONTOUR_3D();
+	//SANITY_CHECK_GRID_MAX_FLOW();
+	//SANITY_CHECK_DENSE_KERNELS();
+	//SANITY_CHECK_SPARSE_CHOLESKY();
+	//SANITY_CHECK_COMPUTE_GRAPH();
+	//SANITY_CHECK_CONNECTED_COMPONENTS();
 	SANITY_CHECK_SVD();
 	return ret;
 }
@@ -51,33 +51,30 @@ FluidSimulation::FluidSimulation(const int2& dims, float voxelSize,
 	simulationDuration = 4.0f;
 }
 void FluidSimulation::computeParticleDensity(float maxDensity) {
+	const std::vector<float2>& location = particles.location;
+	const std::vector<ObjectType>& type = particles.type;
+	const std::vector<float>& mass = particles.mass;
+	float h = 4.0f * fluidParticleDiameter * fluidVoxelSize;
 	float scale = 1.0f / fluidVoxelSize;
 #pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		FluidParticlePtr& p = particles[n];
-		if (p->mObjectType == ObjectType::WALL) {
-			p->mDensity = 1.0;
+		if (type[n] == ObjectType::WALL) {
+			particles.density[n] = 1.0;
 			continue;
 		}
-		float2& pt = p->mLocation;
-		int i = clamp((int) (scale * p->mLocation[0]), 0, gridSize.x - 1);
-		int j = clamp((int) (scale * p->mLocation[1]), 0, gridSize.y - 1);
-		//Search in small region
-		std::vector<FluidParticle*> neighbors =
-				particleLocator->getNeigboringCellParticles(i, j, 1, 1);
+		float2 pt = location[n];
+		int i = clamp((int) (scale * pt[0]), 0, gridSize.x - 1);
+		int j = clamp((int) (scale * pt[1]), 0, gridSize.y - 1);
 		float wsum = 0.0;
 		//Density a function of how close particles are to their neighbors.
-		for (FluidParticle* np : neighbors) {
-			if (np->mObjectType == ObjectType::WALL)
-				continue;
-			float d2 = distanceSquared(np->mLocation, pt);
-			float w = np->mMass
-					* smoothKernel(d2,
-							4.0f * fluidParticleDiameter * fluidVoxelSize);
-			wsum += w;
-		}
+		particleLocator->forEachNeighboringCellParticle(i, j, 1, 1,
+				[&](uint32_t m) {
+					if (type[m] != ObjectType::WALL) {
+						wsum += mass[m] * smoothKernel(distanceSquared(location[m], pt), h);
+					}
+				});
 		//Estimate density in region using current particle configuration.
-		p->mDensity = wsum / maxDensity;
+		particles.density[n] = wsum / maxDensity;
 	}
 }
 void FluidSimulation::placeWalls() {
@@ -172,7 +169,6 @@ void FluidSimulation::repositionParticles(std::vector<int>& indices) {
 	// First Search for Deep Water
 	std::vector<int2> waters;
 	while (waters.size() < indices.size()) {
-#pragma omp parallel
 		for (int j = 0; j < labelImage.height; j++) {
 			for (int i = 0; i < labelImage.width; i++) {
 				if (i > 0
@@ -202,24 +198,23 @@ void FluidSimulation::repositionParticles(std::vector<int>& indices) {
 				}
 			}
 		}
+		if (waters.empty())
+			return;
 	}
-	if (waters.empty())
-		return;
 // Shuffle
 	shuffleCoordinates(waters);
 	for (int n = 0; n < indices.size(); n++) {
-		FluidParticlePtr& p = particles[indices[n]];
-		p->mLocation[0] = fluidVoxelSize
+		float2& pt = particles.location[indices[n]];
+		pt[0] = fluidVoxelSize
 				* (waters[n][0] + 0.25 + 0.5 * (rand() % 101) / 100);
-		p->mLocation[1] = fluidVoxelSize
+		pt[1] = fluidVoxelSize
 				* (waters[n][1] + 0.25 + 0.5 * (rand() % 101) / 100);
 	}
 	particleLocator->update(particles);
 	for (int n = 0; n < indices.size(); n++) {
-		FluidParticlePtr &p = particles[indices[n]];
 		float2 u(0.0f);
-		resampleParticles(p->mLocation, u, fluidVoxelSize);
-		p->mVelocity = u;
+		resampleParticles(particles.location[indices[n]], u, fluidVoxelSize);
+		particles.velocity[indices[n]] = u;
 	}
 }
 void FluidSimulation::addParticle(float2 pt, float2 center, ObjectType type) {
@@ -245,7 +240,6 @@ void FluidSimulation::addParticle(float2 pt, float2 center, ObjectType type) {
 		}
 	}
 	if (inside_obj) {
-		FluidParticle *p = new FluidParticle;
 		//float2 axis(((rand() % MAX_INT) / (MAX_INT - 1.0)) * 2.0f - 1.0f,((rand() % MAX_INT) / (MAX_INT - 1.0)) * 2.0f - 1.0f);
 		//axis=normalize(axis);
 		float ang = MAX_ANGLE * (rand() % MAX_INT) / (MAX_INT - 1.0);
@@ -254,17 +248,14 @@ void FluidSimulation::addParticle(float2 pt, float2 center, ObjectType type) {
 		R(1, 0) = std::sin(ang);
 		R(0, 1) = -std::sin(ang);
 		R(1, 1) = std::cos(ang);
+		float2 location;
 		if (inside_obj->mType == ObjectType::FLUID) {
-			p->mLocation = center + R * (pt - center);
+			location = center + R * (pt - center);
 		} else {
-			p->mLocation = pt;
+			location = pt;
 		}
-		p->mVelocity = float2(0.0);
-		p->mNormal = float2(0.0);
-		p->mDensity = 10.0;
-		p->mObjectType = inside_obj->mType;
-		p->mMass = 1.0;
-		particles.push_back(FluidParticlePtr(p));
+		particles.push_back(location, float2(0.0f), float2(0.0f),
+				inside_obj->mType, 1.0f, 10.0f);
 	}
 }
 bool FluidSimulation::init() {
@@ -278,18 +269,15 @@ bool FluidSimulation::init() {
 	float h = fluidParticleDiameter * fluidVoxelSize;
 	for (int j = 0; j < 10; j++) {
 		for (int i = 0; i < 10; i++) {
-			FluidParticle *p = new FluidParticle;
-			p->mLocation = float2((i + 0.5) * h, (j + 0.5) * h);
-			p->mObjectType = ObjectType::FLUID;
-			p->mMass = 1.0;
-			particles.push_back(std::unique_ptr<FluidParticle>(p));
+			particles.push_back(float2((i + 0.5) * h, (j + 0.5) * h), float2(0.0f),
+					float2(0.0f), ObjectType::FLUID, 1.0f, 0.0f);
 		}
 	}
 	particleLocator->update(particles);
 	computeParticleDensity(1.0f);
 	maxDensity = 0.0;
-	for (FluidParticlePtr& p : particles) {
-		maxDensity = max(maxDensity, p->mDensity);
+	for (float density : particles.density) {
+		maxDensity = max(maxDensity, density);
 	}
 	particles.clear();
 	float2 center;
@@ -325,23 +313,19 @@ bool FluidSimulation::init() {
 	particleLocator->markAsWater(labelImage, wallWeightImage, fluidParticleDiameter);
 // Remove Particles That Stuck On Wal Cells
 	float scale = 1.0f / fluidVoxelSize;
-	int eraseCount=0;
-	for (std::vector<FluidParticlePtr>::iterator iter = particles.begin();
-			iter != particles.end();) {
-		FluidParticlePtr& p = *iter;
-		if (p->mObjectType == ObjectType::WALL) {
-			iter++;
+	std::vector<char> stuck(particles.size(), 0);
+#pragma omp parallel for
+	for (int n = 0; n < (int) particles.size(); n++) {
+		if (particles.type[n] == ObjectType::WALL) {
 			continue;
 		}
-		int i = clamp((int) (scale * p->mLocation[0]), 0, gridSize.x - 1);
-		int j = clamp((int) (scale * p->mLocation[1]), 0, gridSize.y - 1);
+		int i = clamp((int) (scale * particles.location[n][0]), 0, gridSize.x - 1);
+		int j = clamp((int) (scale * particles.location[n][1]), 0, gridSize.y - 1);
 		if (labelImage(i, j).x == static_cast<char>(ObjectType::WALL)) {
-			iter = particles.erase(iter);
-			eraseCount++;
-		} else {
-			iter++;
+			stuck[n] = 1;
 		}
 	}
+	particles.erase(stuck);
 	computeWallNormals();
 	updateParticleVolume();
 	computeParticleDensity(maxDensity);
@@ -366,19 +350,15 @@ void FluidSimulation::pourWater(int limit, float maxDensity) {
 		for (float z = w + w / 2.0; z < 1.0 - w / 2.0; z += w) {
 			if (hypot(x - mPourPosition[0], z - mPourPosition[1])
 					< mPourRadius) {
-				FluidParticle *p = new FluidParticle;
-				p->mLocation = float2(x,
-						1.0 - wallThickness
-								- 2.5 * fluidParticleDiameter
-										* fluidVoxelSize);
-				p->mVelocity = float2(0.0,
-						-0.5 * fluidVoxelSize * fluidParticleDiameter
-								/ timeStep);
-				p->mNormal = float2(0.0);
-				p->mObjectType = ObjectType::FLUID;
-				p->mDensity = maxDensity;
-				p->mMass = 1.0;
-				particles.push_back(FluidParticlePtr(p));
+				particles.push_back(
+						float2(x,
+								1.0 - wallThickness
+										- 2.5 * fluidParticleDiameter
+												* fluidVoxelSize),
+						float2(0.0,
+								-0.5 * fluidVoxelSize * fluidParticleDiameter
+										/ timeStep), float2(0.0f),
+						ObjectType::FLUID, 1.0f, maxDensity);
 				cnt++;
 			}
 		}
@@ -387,12 +367,10 @@ void FluidSimulation::pourWater(int limit, float maxDensity) {
 void FluidSimulation::addExternalForce() {
 	float velocity = timeStep * GRAVITY;
 //Add gravity acceleration to all particles
-	int count = 0;
 #pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		if (particles[n]->mObjectType == ObjectType::FLUID) {
-			particles[n]->mVelocity[1] += velocity;
-			count++;
+		if (particles.type[n] == ObjectType::FLUID) {
+			particles.velocity[n][1] += velocity;
 		}
 	}
 }
@@ -404,13 +382,15 @@ float2 FluidSimulation::interpolate(const Image2f& img, float2 p) {
 	return u;
 }
 void FluidSimulation::advectParticles() {
+	std::vector<float2>& location = particles.location;
+	std::vector<float2>& velocity = particles.velocity;
+	const std::vector<ObjectType>& type = particles.type;
 // Advect Particle Through Grid
 #pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		FluidParticlePtr& p = particles[n];
-		if (p->mObjectType == ObjectType::FLUID) {
-			p->mLocation += ((float) timeStep)
-					* interpolate(contour.fluidParticles.velocityImage, p->mLocation);
+		if (type[n] == ObjectType::FLUID) {
+			location[n] += ((float) timeStep)
+					* interpolate(contour.fluidParticles.velocityImage, location[n]);
 		}
 	}
 //Update localization
@@ -423,68 +403,61 @@ void FluidSimulation::advectParticles() {
 //Correct particle locations
 #pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		FluidParticlePtr& p = particles[n];
-		if (p->mObjectType == ObjectType::FLUID) {
-			p->mLocation[0] = clamp(p->mLocation[0], r, mx - r);
-			p->mLocation[1] = clamp(p->mLocation[1], r, my - r);
-			int i = clamp((int) (p->mLocation[0] * scale), 0, gridSize.x - 1);
-			int j = clamp((int) (p->mLocation[1] * scale), 0, gridSize.y - 1);
-			std::vector<FluidParticle*> neighbors =
-					particleLocator->getNeigboringCellParticles(i, j, 1, 1);
-			for (int n = 0; n < neighbors.size(); n++) {
-				FluidParticle *np = neighbors[n];
-				if (np->mObjectType == ObjectType::WALL) {
-					float dist = distance(p->mLocation, np->mLocation);
-					if (dist < re) {
-						float2 normal = np->mNormal;
-						if (normal[0] == 0.0 && normal[1] == 0.0
-								&& normal[2] == 0.0 && dist) {
-							normal = (p->mLocation - np->mLocation) / dist;
+		if (type[n] == ObjectType::FLUID) {
+			float2& pt = location[n];
+			pt[0] = clamp(pt[0], r, mx - r);
+			pt[1] = clamp(pt[1], r, my - r);
+			int i = clamp((int) (pt[0] * scale), 0, gridSize.x - 1);
+			int j = clamp((int) (pt[1] * scale), 0, gridSize.y - 1);
+			particleLocator->forEachNeighboringCellParticle(i, j, 1, 1,
+					[&](uint32_t m) {
+						if (type[m] == ObjectType::WALL) {
+							float dist = distance(pt, location[m]);
+							if (dist < re) {
+								float2 normal = particles.normal[m];
+								if (normal[0] == 0.0 && normal[1] == 0.0 && dist) {
+									normal = (pt - location[m]) / dist;
+								}
+								pt += (re - dist) * normal;
+								float dotprod = dot(velocity[n], normal);
+								velocity[n] -= dotprod * normal;
+							}
 						}
-						p->mLocation += (re - dist) * normal;
-						float dotprod = dot(p->mVelocity, normal);
-						p->mVelocity -= dotprod * normal;
-					}
-				}
-			}
+					});
 		}
 	}
 
 // Remove Particles That Stuck On The Up-Down Wall Cells...
+	std::vector<char> removeIndicator(particles.size(), 0);
 #pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		FluidParticlePtr& p = particles[n];
-		p->mRemoveIndicator = false;
 		// Focus on Only Fluid Particle
-		if (p->mObjectType == ObjectType::FLUID) {
-			int i = clamp((int) (p->mLocation[0] * scale), 0, gridSize.x - 1);
-			int j = clamp((int) (p->mLocation[1] * scale), 0, gridSize.y - 1);
+		if (type[n] == ObjectType::FLUID) {
+			int i = clamp((int) (location[n][0] * scale), 0, gridSize.x - 1);
+			int j = clamp((int) (location[n][1] * scale), 0, gridSize.y - 1);
 			// If Stuck On Wall Cells Just Reposition
 			if (labelImage(i, j).x == static_cast<char>(ObjectType::WALL)) {
-				p->mRemoveIndicator = true;
+				removeIndicator[n] = 1;
 			}
-			i = clamp((int) (p->mLocation[0] * scale), 2, gridSize.x - 3);
-			j = clamp((int) (p->mLocation[1] * scale), 2, gridSize.y - 3);
-			if (p->mDensity < 0.04
+			i = clamp((int) (location[n][0] * scale), 2, gridSize.x - 3);
+			j = clamp((int) (location[n][1] * scale), 2, gridSize.y - 3);
+			if (particles.density[n] < 0.04
 					&& (labelImage(i, max(0, j - 1)).x
 							== static_cast<char>(ObjectType::WALL)
 							|| labelImage(i, min(gridSize.y - 1, j + 1)).x
 									== static_cast<char>(ObjectType::WALL))) {
 				// Put Into Reposition List
-				p->mRemoveIndicator = true;
+				removeIndicator[n] = 1;
 			}
 		}
 
 	}
 // Reposition If Necessary
 	std::vector<int> reposition_indices;
-	size_t n = 0;
-	for (FluidParticlePtr& p : particles) {
-		if (p->mRemoveIndicator) {
-			p->mRemoveIndicator = false;
+	for (int n = 0; n < (int) removeIndicator.size(); n++) {
+		if (removeIndicator[n]) {
 			reposition_indices.push_back(n);
 		}
-		n++;
 	}
 
 // Store Stuck Particle Number
@@ -500,8 +473,8 @@ void FluidSimulation::cleanup() {
 	particles.clear();
 }
 bool FluidSimulation::stepInternal() {
-//Rebuild location data structure
-	particleLocator->update(particles);
+//Rebuild location data structure and keep particles in cell order
+	particleLocator->sort(particles);
 //Compute density for each cell, capped by max density as pre-computed
 	computeParticleDensity(maxDensity);
 //Add external gravity force
@@ -582,7 +555,7 @@ void FluidSimulation::project() {
 					wallWeightImage, fluidParticleDiameter);
 		}
 	}
-	SolveLaplace2d(labelImage, laplacianImage, pessureImage, divergenceImage, fluidVoxelSize);
+	pressureStatus = SolveLaplace2d(labelImage, laplacianImage, pessureImage, divergenceImage, fluidVoxelSize);
 // Subtract Pressure Gradient
 #pragma omp parallel for
 	for (int j = 0; j < contour.fluidParticles.velocityImage.height; j++) {
@@ -711,11 +684,11 @@ void FluidSimulation::solvePicFlip() {
 	extrapolateVelocity();
 #pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		FluidParticlePtr& p = particles[n];
-		float2 currentVelocity = interpolate(contour.fluidParticles.velocityImage, p->mLocation);
-		float2 velocity = p->mVelocity + currentVelocity
-				- interpolate(lastVelocityImage, p->mLocation);
-		p->mVelocity = (1.0f - picFlipBlendWeight) * currentVelocity
+		float2 pt = particles.location[n];
+		float2 currentVelocity = interpolate(contour.fluidParticles.velocityImage, pt);
+		float2 velocity = particles.velocity[n] + currentVelocity
+				- interpolate(lastVelocityImage, pt);
+		particles.velocity[n] = (1.0f - picFlipBlendWeight) * currentVelocity
 				+ picFlipBlendWeight * velocity;
 	}
 }
@@ -725,11 +698,9 @@ void FluidSimulation::updateParticleVolume() {
 	contour.fluidParticles.velocities.clear();
 	contour.fluidParticles.radius = 0.5f * fluidParticleDiameter;
 	for (int n = 0; n < (int) particles.size(); n++) {
-		FluidParticle* p = particles[n].get();
-		if (p->mObjectType == ObjectType::FLUID) {
-			float2 l = p->mLocation / voxelSize;
-			contour.fluidParticles.particles.push_back(l);
-			contour.fluidParticles.velocities.push_back(p->mVelocity);
+		if (particles.type[n] == ObjectType::FLUID) {
+			contour.fluidParticles.particles.push_back(particles.location[n] / voxelSize);
+			contour.fluidParticles.velocities.push_back(particles.velocity[n]);
 		}
 	}
 	/*
@@ -814,33 +785,33 @@ void FluidSimulation::mapParticlesToGrid() {
 // Compute Mapping
 	int2 dims(contour.fluidParticles.velocityImage.width, contour.fluidParticles.velocityImage.height);
 	float scale = 1.0f / fluidVoxelSize;
+	const std::vector<float2>& location = particles.location;
+	const std::vector<float2>& velocity = particles.velocity;
+	const std::vector<ObjectType>& type = particles.type;
+	const std::vector<float>& mass = particles.mass;
 #pragma omp parallel for
 	for (int j = 0; j < contour.fluidParticles.velocityImage.height; j++) {
 		for (int i = 0; i < contour.fluidParticles.velocityImage.width; i++) {
-			// Variales for Particle Sorter
-			std::vector<FluidParticle*> neighbors;
 			// Map X Grids
 			if (j < dims[1]) {
 				float2 px(i, j + 0.5);
 				float sumw = 0.0;
 				float sumx = 0.0;
-				neighbors = particleLocator->getNeigboringWallParticles(i, j,
-						1, 2);
-				for (int n = 0; n < neighbors.size(); n++) {
-					FluidParticle *p = neighbors[n];
-					if (p->mObjectType == ObjectType::FLUID) {
-						float x = clamp(scale * p->mLocation[0], 0.0f,
-								(float) dims[0]);
-						float y = clamp(scale * p->mLocation[1], 0.0f,
-								(float) dims[1]);
-						float2 pos(x, y);
-						float w = p->mMass
-								* sharpKernel(distanceSquared(pos, px),
-										RELAXATION_KERNEL_WIDTH);
-						sumx += w * p->mVelocity[0];
-						sumw += w;
-					}
-				}
+				particleLocator->forEachNeighboringWallParticle(i, j, 1, 2,
+						[&](uint32_t m) {
+							if (type[m] == ObjectType::FLUID) {
+								float x = clamp(scale * location[m][0], 0.0f,
+										(float) dims[0]);
+								float y = clamp(scale * location[m][1], 0.0f,
+										(float) dims[1]);
+								float2 pos(x, y);
+								float w = mass[m]
+										* sharpKernel(distanceSquared(pos, px),
+												RELAXATION_KERNEL_WIDTH);
+								sumx += w * velocity[m][0];
+								sumw += w;
+							}
+						});
 				contour.fluidParticles.velocityImage(i, j, 0) = sumw ? sumx / sumw : 0.0;
 			}
 			// Map Y Grids
@@ -848,25 +819,21 @@ void FluidSimulation::mapParticlesToGrid() {
 				float2 py(i + 0.5, j);
 				float sumw = 0.0;
 				float sumy = 0.0;
-				neighbors = particleLocator->getNeigboringWallParticles(i, j,
-						2, 1);
-				for (int n = 0; n < neighbors.size(); n++) {
-					FluidParticle *p = neighbors[n];
-					if (p->mObjectType == ObjectType::FLUID) {
-						float x = clamp(scale * p->mLocation[0], 0.0f,
-								(float) dims[0]);
-						float y = clamp(scale * p->mLocation[1], 0.0f,
-								(float) dims[1]);
-						float z = clamp(scale * p->mLocation[2], 0.0f,
-								(float) dims[2]);
-						float2 pos(x, y);
-						float w = p->mMass
-								* sharpKernel(distanceSquared(pos, py),
-										RELAXATION_KERNEL_WIDTH);
-						sumy += w * p->mVelocity[1];
-						sumw += w;
-					}
-				}
+				particleLocator->forEachNeighboringWallParticle(i, j, 2, 1,
+						[&](uint32_t m) {
+							if (type[m] == ObjectType::FLUID) {
+								float x = clamp(scale * location[m][0], 0.0f,
+										(float) dims[0]);
+								float y = clamp(scale * location[m][1], 0.0f,
+										(float) dims[1]);
+								float2 pos(x, y);
+								float w = mass[m]
+										* sharpKernel(distanceSquared(pos, py),
+												RELAXATION_KERNEL_WIDTH);
+								sumy += w * velocity[m][1];
+								sumw += w;
+							}
+						});
 				contour.fluidParticles.velocityImage(i, j, 1) = sumw ? sumy / sumw : 0.0;
 			}
 		}
@@ -901,25 +868,27 @@ bool FluidSimulation::updateContour() {
 	return false;
 }
 void FluidSimulation::resampleParticles(float2& p, float2& u, float re) {
-// Variables for Neighboring Particles
-	std::vector<FluidParticle*> neighbors;
+	const std::vector<float2>& location = particles.location;
+	const std::vector<float2>& velocity = particles.velocity;
+	const std::vector<ObjectType>& type = particles.type;
+	const std::vector<float>& mass = particles.mass;
 	int2 cell_size = particleLocator->getGridSize();
 	float wsum = 0.0;
 	float2 save(u);
 	u[0] = u[1] = 0.0;
-	float scale = particleLocator->getVoxelSize();
+	float scale = 1.0f / particleLocator->getVoxelSize();
 	int i = clamp((int) (p[0] * scale), 0, cell_size[0] - 1);
 	int j = clamp((int) (p[1] * scale), 0, cell_size[1] - 1);
 // Gather Neighboring Particles
-	neighbors = particleLocator->getNeigboringCellParticles(i, j, 1, 1);
-	for (FluidParticle *np : neighbors) {
-		if (np->mObjectType == ObjectType::FLUID) {
-			float dist2 = distanceSquared(p, np->mLocation);
-			float w = np->mMass * sharpKernel(dist2, re);
-			u += w * np->mVelocity;
-			wsum += w;
-		}
-	}
+	particleLocator->forEachNeighboringCellParticle(i, j, 1, 1,
+			[&](uint32_t m) {
+				if (type[m] == ObjectType::FLUID) {
+					float dist2 = distanceSquared(p, location[m]);
+					float w = mass[m] * sharpKernel(dist2, re);
+					u += w * velocity[m];
+					wsum += w;
+				}
+			});
 	if (wsum) {
 		u /= wsum;
 	} else {
@@ -927,98 +896,96 @@ void FluidSimulation::resampleParticles(float2& p, float2& u, float re) {
 	}
 }
 
-void FluidSimulation::correctParticles(std::vector<FluidParticlePtr>& particles,
+void FluidSimulation::correctParticles(FluidParticleStore& particles,
 		float dt, float re) {
 // Variables for Neighboring Particles
 	int2 cell_size = particleLocator->getGridSize();
 	particleLocator->update(particles);
 	float scale = 1.0f / particleLocator->getVoxelSize();
+	const std::vector<float2>& location = particles.location;
+	const std::vector<ObjectType>& type = particles.type;
+	std::vector<float2> newLocation(particles.size());
+	std::vector<float2> newVelocity(particles.size());
 // Compute Pseudo Moved Point
 #pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		if (particles[n]->mObjectType == ObjectType::FLUID) {
-			FluidParticle *p = particles[n].get();
+		if (type[n] == ObjectType::FLUID) {
+			float2 pt = location[n];
 			float2 spring(0.0f);
-			int i = clamp((int) (p->mLocation[0] * scale), 0, cell_size[0] - 1);
-			int j = clamp((int) (p->mLocation[1] * scale), 0, cell_size[1] - 1);
-			std::vector<FluidParticle*> neighbors =
-					particleLocator->getNeigboringCellParticles(i, j, 1, 1);
-			for (int n = 0; n < neighbors.size(); n++) {
-				FluidParticle *np = neighbors[n];
-				if (p != np) {
-					float dist = distance(p->mLocation, np->mLocation);
-					float w = SPRING_STIFFNESS * np->mMass
-							* smoothKernel(dist * dist, re);
-					if (dist > 0.1 * re) {
-						spring += w * (p->mLocation - np->mLocation) / dist
-								* re;
-					} else {
-						if (np->mObjectType == ObjectType::FLUID) {
-							spring += 0.01f * re / dt * (rand() % 101) / 100.0f;
-						} else {
-							spring += 0.05f * re / dt * np->mNormal;
+			int i = clamp((int) (pt[0] * scale), 0, cell_size[0] - 1);
+			int j = clamp((int) (pt[1] * scale), 0, cell_size[1] - 1);
+			particleLocator->forEachNeighboringCellParticle(i, j, 1, 1,
+					[&](uint32_t m) {
+						if ((int) m != n) {
+							float dist = distance(pt, location[m]);
+							float w = SPRING_STIFFNESS * particles.mass[m]
+									* smoothKernel(dist * dist, re);
+							if (dist > 0.1 * re) {
+								spring += w * (pt - location[m]) / dist * re;
+							} else {
+								if (type[m] == ObjectType::FLUID) {
+									spring += 0.01f * re / dt * (rand() % 101) / 100.0f;
+								} else {
+									spring += 0.05f * re / dt * particles.normal[m];
+								}
+							}
 						}
-					}
-				}
-			}
-			p->mTmp[0] = p->mLocation + dt * spring;
+					});
+			newLocation[n] = pt + dt * spring;
 		}
 	}
 // Resample New Velocity
 #pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		if (particles[n]->mObjectType == ObjectType::FLUID) {
-			FluidParticle *p = particles[n].get();
-			p->mTmp[1] = p->mVelocity;
-			resampleParticles(p->mTmp[0], p->mTmp[1], re);
+		if (type[n] == ObjectType::FLUID) {
+			newVelocity[n] = particles.velocity[n];
+			resampleParticles(newLocation[n], newVelocity[n], re);
 		}
 	}
 
 // Update
 #pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		if (particles[n]->mObjectType == ObjectType::FLUID) {
-			FluidParticle *p = particles[n].get();
-			p->mLocation = p->mTmp[0];
-			p->mVelocity = p->mTmp[1];
+		if (type[n] == ObjectType::FLUID) {
+			particles.location[n] = newLocation[n];
+			particles.velocity[n] = newVelocity[n];
 		}
 	}
 }
 void FluidSimulation::mapGridToParticles() {
 #pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		FluidParticlePtr& p = particles[n];
-		p->mVelocity = interpolate(contour.fluidParticles.velocityImage, p->mLocation);
+		particles.velocity[n] = interpolate(contour.fluidParticles.velocityImage, particles.location[n]);
 	}
 }
-double FluidSimulation::implicit_func(std::vector<FluidParticle*>& neighbors,
-		float2& p, float radius, float voxelSize) {
-	double phi = 8.0f * radius;
+double FluidSimulation::implicit_func(float2& p, float radius) {
+	int2 cell_size = particleLocator->getGridSize();
 	float scale = 1.0f / particleLocator->getVoxelSize();
-	for (int m = 0; m < neighbors.size(); m++) {
-		FluidParticle &np = *neighbors[m];
-		double d = distance(np.mLocation, p) * scale;
-		if (np.mObjectType == ObjectType::WALL) {
-			if (d < radius)
-				return 4.5 * radius;
-			continue;
-		}
-		if (d < phi) {
-			phi = d;
+	int i = clamp((int) (p[0] * scale), 0, cell_size[0] - 1);
+	int j = clamp((int) (p[1] * scale), 0, cell_size[1] - 1);
+	const std::vector<uint32_t>& sorted = particleLocator->getSortedParticles();
+	double phi = 8.0f * radius;
+	for (int sj = std::max(j - 2, 0); sj <= std::min(j + 2, cell_size[1] - 1);
+			sj++) {
+		int i0 = std::max(i - 2, 0);
+		int i1 = std::min(i + 2, cell_size[0] - 1);
+		uint32_t start = particleLocator->getCellStart(i0 + sj * cell_size[0]);
+		uint32_t end = particleLocator->getCellStart(i1 + 1 + sj * cell_size[0]);
+		for (uint32_t k = start; k < end; k++) {
+			uint32_t m = sorted[k];
+			double d = distance(particles.location[m], p) * scale;
+			if (particles.type[m] == ObjectType::WALL) {
+				if (d < radius)
+					return 4.5 * radius;
+				continue;
+			}
+			if (d < phi) {
+				phi = d;
+			}
 		}
 	}
-//std::cout<<"IMPLICIT "<<phi<<" "<<density<<" "<<voxelSize<<std::endl;
 	return phi - radius;
 }
-double FluidSimulation::implicit_func(float2& p, float radius) {
-	int2 cell_size = particleLocator->getGridSize();
-	float scale = 1.0f / particleLocator->getVoxelSize();
-	std::vector<FluidParticle *> neighbors =
-			particleLocator->getNeigboringCellParticles(
-					clamp((int) (p[0] * scale), 0, cell_size[0] - 1),
-					clamp((int) (p[1] * scale), 0, cell_size[1] - 1), 2, 2);
-	return implicit_func(neighbors, p, radius, particleLocator->getVoxelSize());
-}
 void FluidSimulation::computeWallNormals() {
 // mParticleLocator Particles
 	particleLocator->update(particles);
@@ -1026,42 +993,41 @@ void FluidSimulation::computeWallNormals() {
 	float scale = 1.0f / fluidVoxelSize;
 	float mx = fluidVoxelSize * gridSize.x;
 	float my = fluidVoxelSize * gridSize.y;
+	const std::vector<float2>& location = particles.location;
 //#pragma omp parallel for
 	for (int n = 0; n < (int) particles.size(); n++) {
-		FluidParticlePtr& p = particles[n];
-		int i = clamp((int) (p->mLocation[0] * scale), 0, gridSize.x - 1);
-		int j = clamp((int) (p->mLocation[1] * scale), 0, gridSize.y - 1);
+		float2 pt = location[n];
+		float2& normal = particles.normal[n];
+		int i = clamp((int) (pt[0] * scale), 0, gridSize.x - 1);
+		int j = clamp((int) (pt[1] * scale), 0, gridSize.y - 1);
 		wallNormalImage(i, j) = float2(0.0f);
-		p->mNormal = float2(0.0);
-		if (p->mObjectType == ObjectType::WALL) {
-			if (p->mLocation[0] <= (mx + 0.1) * wallThickness) {
-				p->mNormal[0] = 1.0;
+		normal = float2(0.0);
+		if (particles.type[n] == ObjectType::WALL) {
+			if (pt[0] <= (mx + 0.1) * wallThickness) {
+				normal[0] = 1.0;
 			}
-			if (p->mLocation[0] >= mx - (mx - 0.1) * wallThickness) {
-				p->mNormal[0] = -1.0;
+			if (pt[0] >= mx - (mx - 0.1) * wallThickness) {
+				normal[0] = -1.0;
 			}
-			if (p->mLocation[1] <= (my + 0.1) * wallThickness) {
-				p->mNormal[1] = 1.0;
+			if (pt[1] <= (my + 0.1) * wallThickness) {
+				normal[1] = 1.0;
 			}
-			if (p->mLocation[1] >= my - (my - 0.1) * wallThickness) {
-				p->mNormal[1] = -1.0;
+			if (pt[1] >= my - (my - 0.1) * wallThickness) {
+				normal[1] = -1.0;
 			}
-			if (p->mNormal[0] == 0.0 && p->mNormal[1] == 0.0) {
-				std::vector<FluidParticle*> neighbors =
-						particleLocator->getNeigboringCellParticles(i, j, 3,
-								3);
-				for (int n = 0; n < (int) neighbors.size(); n++) {
-					FluidParticle *np = neighbors[n];
-					if (p.get() != np && np->mObjectType == ObjectType::WALL) {
-						float d = distance(p->mLocation, np->mLocation);
-						float w = 1.0 / d;
-						p->mNormal += w * (p->mLocation - np->mLocation) / d;
-					}
-				}
+			if (normal[0] == 0.0 && normal[1] == 0.0) {
+				particleLocator->forEachNeighboringCellParticle(i, j, 3, 3,
+						[&](uint32_t m) {
+							if ((int) m != n && particles.type[m] == ObjectType::WALL) {
+								float d = distance(pt, location[m]);
+								float w = 1.0 / d;
+								normal += w * (pt - location[m]) / d;
+							}
+						});
 			}
 		}
-		p->mNormal = normalize(p->mNormal);
-		wallNormalImage(i, j) = p->mNormal;
+		normal = normalize(normal);
+		wallNormalImage(i, j) = normal;
 	}
 
 	particleLocator->update(particles);
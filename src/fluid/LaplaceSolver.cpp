@@ -28,221 +28,213 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <vector>
 using namespace std;
 namespace aly {
-// Clamped Fetch
-static float x_ref(const Image1ub& A, const Image1f& L, const Image1f& x,
-		int fi, int fj, int i, int j) {
-	if (A(i, j).x == static_cast<char>(ObjectType::FLUID))
-		return x(i, j);
-	else if (A(i, j).x == static_cast<char>(ObjectType::WALL))
-		return x(fi, fj).x;
-	return L(i, j).x / std::min(1.0e-6f, L(fi, fj).x) * x(fi, fj).x;
-}
-
-// Ans = Ax
-static void compute_Ax(const Image1ub& A, const Image1f& L, const Image1f& x,
-		Image1f& ans, float voxelSize) {
-	float h2 = voxelSize * voxelSize;
-#pragma omp parallel for
-	for (int j = 0; j < A.height; j++) {
-		for (int i = 0; i < A.width; i++) {
-			if (A(i, j) == static_cast<char>(ObjectType::FLUID)) {
-				ans(i, j) = (4.0 * x(i, j)
-						- x_ref(A, L, x, i, j, i + 1, j)
-						- x_ref(A, L, x, i, j, i - 1, j)
-						- x_ref(A, L, x, i, j, i, j + 1)
-						- x_ref(A, L, x, i, j, i, j - 1)) / h2;
-			} else {
-				ans(i, j).x = 0.0;
+/*
+ Fluid-cell Poisson operator, assembled once per solve. Fluid cells are numbered in row-major
+ order. Each row stores its diagonal and the indices of its four neighbors, or -1 where the
+ neighbor is not fluid, so CG iterations never revisit cell labels or level set ratios.
+ The operator is scaled by h^2, which leaves the solution unchanged.
+ */
+struct LaplaceOperator2D {
+	std::vector<int> cells;
+	std::vector<double> diag;
+	std::vector<int4> neighbors; //left, right, bottom, top
+	std::vector<double> precon;
+	int size() const {
+		return (int) cells.size();
+	}
+	void build(const Image1ub& A, const Image1f& L) {
+		const char FLUID = static_cast<char>(ObjectType::FLUID);
+		const char AIR = static_cast<char>(ObjectType::AIR);
+		Image1i index(A.width, A.height);
+		cells.clear();
+		for (int j = 0; j < A.height; j++) {
+			for (int i = 0; i < A.width; i++) {
+				if (A(i, j).x == FLUID) {
+					index(i, j).x = (int) cells.size();
+					cells.push_back(i + j * A.width);
+				} else {
+					index(i, j).x = -1;
+				}
 			}
 		}
-	}
-}
-// ans = x^T * x
-static double product(const Image1ub& A, const Image1f& x, const Image1f& y) {
-	static double ans;
-	ans = 0.0;
-#pragma omp parallel for reduction(+:ans)
-	for (int j = 0; j < A.height; j++) {
-		for (int i = 0; i < A.width; i++) {
-			if (A(i, j).x == static_cast<char>(ObjectType::FLUID))
-				ans += x(i, j).x * y(i, j).x;
+		int N = size();
+		diag.resize(N);
+		neighbors.resize(N);
+#pragma omp parallel for
+		for (int n = 0; n < N; n++) {
+			int i = cells[n] % A.width;
+			int j = cells[n] / A.width;
+			int q[][2] = { { i - 1, j }, { i + 1, j }, { i, j - 1 }, { i, j + 1 } };
+			double d = 4.0;
+			int4 nbr(-1);
+			for (int m = 0; m < 4; m++) {
+				int qi = q[m][0];
+				int qj = q[m][1];
+				//Out of bounds samples clamp back onto this cell, which behaves like a wall.
+				if (qi < 0 || qi >= A.width || qj < 0 || qj >= A.height) {
+					d -= 1.0;
+				} else if (A(qi, qj).x == FLUID) {
+					nbr[m] = index(qi, qj).x;
+				} else if (A(qi, qj).x == AIR) {
+					//Ghost fluid pressure at the free surface
+					d -= L(qi, qj).x / std::min(1.0e-6f, L(i, j).x);
+				} else {
+					d -= 1.0;
+				}
+			}
+			diag[n] = d;
+			neighbors[n] = nbr;
 		}
 	}
-	return ans;
-}
-
-static void flipDivergence(Image1f& x) {
+	void multiply(const std::vector<double>& x, std::vector<double>& y) const {
+		int N = size();
 #pragma omp parallel for
-	for (int n = 0; n < (int) x.size(); n++) {
-		x[n].x = -x[n].x;
+		for (int n = 0; n < N; n++) {
+			const int4& nbr = neighbors[n];
+			double sum = diag[n] * x[n];
+			for (int m = 0; m < 4; m++) {
+				if (nbr[m] >= 0)
+					sum -= x[nbr[m]];
+			}
+			y[n] = sum;
+		}
 	}
-}
+	/*
+	 Modified incomplete Cholesky, MIC(0), with the safety threshold from
 
-// x <= y
-static void copy(Image1f& x, Image1f& y) {
-	x.set(y);
-}
-// Ans = x + a*y
-static void op(const Image1ub& A, const Image1f& x, const Image1f& y,
-		Image1f& ans, float a) {
-	Image1f tmp(x.width, x.height);
-#pragma omp parallel for
-	for (int j = 0; j < x.height; j++) {
-		for (int i = 0; i < x.width; i++) {
-			if (A(i, j).x == static_cast<char>(ObjectType::FLUID))
-				tmp(i, j).x = x(i, j).x + a * y(i, j).x;
-			else
-				tmp(i, j).x = 0.0;
+	 Bridson, R. (2015). Fluid simulation for computer graphics. CRC Press, Chapter 5.
+	 */
+	void buildPreconditioner() {
+		const double tau = 0.97;
+		const double sigma = 0.25;
+		int N = size();
+		precon.resize(N);
+		for (int n = 0; n < N; n++) {
+			int left = neighbors[n].x;
+			int bottom = neighbors[n].z;
+			double e = diag[n];
+			if (left >= 0) {
+				double p = precon[left];
+				//Off diagonal entries are -1, so A(left,n)^2=1.
+				e -= p * p;
+				if (neighbors[left].w >= 0)
+					e -= tau * p * p;
+			}
+			if (bottom >= 0) {
+				double p = precon[bottom];
+				e -= p * p;
+				if (neighbors[bottom].y >= 0)
+					e -= tau * p * p;
+			}
+			if (e < sigma * diag[n])
+				e = diag[n];
+			precon[n] = 1.0 / std::sqrt(e);
 		}
 	}
-	copy(ans, tmp);
-}
-
-// r = b - Ax
-static void residual(const Image1ub& A, const Image1f& L, const Image1f& x,const Image1f& b, Image1f& r, float voxelSize) {
-	r.resize(x.width, x.height);
-	compute_Ax(A, L, x, r, voxelSize);
-	op(A, b, r, r, -1.0);
-}
-static inline float square(float a) {
-	return a * a;
-}
-static float A_ref(const Image1ub& A, int i, int j, int qi, int qj) {
-	if (i < 0 || i > A.width - 1 || j < 0 || j > A.height - 1
-			|| A(i, j).x != static_cast<char>(ObjectType::FLUID))
-		return 0.0;
-	if (qi < 0 || qi > A.width - 1 || qj < 0 || qj > A.height - 1
-			|| A(qi, qj).x != static_cast<char>(ObjectType::FLUID))
-		return 0.0;
-	return -1.0;
-}
-static float A_diag(const Image1ub& A, const Image1f& L, int i, int j) {
-	float diag = 6.0;
-	if (A(i, j).x != static_cast<char>(ObjectType::FLUID))
-		return diag;
-	int q[][2] = { { i - 1, j }, { i + 1, j }, { i, j - 1 }, { i, j + 1 } };
-	for (int m = 0; m < 4; m++) {
-		int qi = q[m][0];
-		int qj = q[m][1];
-		if (qi < 0 || qi > A.width - 1 || qj < 0 || qj > A.height - 1
-				|| A(qi, qj).x == static_cast<char>(ObjectType::WALL))
-			diag -= 1.0;
-		else if (A(qi, qj).x == static_cast<char>(ObjectType::AIR)) {
-			diag -= L(qi, qj).x / std::min(1.0e-6f, L(i, j).x);
+	void applyPreconditioner(const std::vector<double>& r, std::vector<double>& q,
+			std::vector<double>& z) const {
+		int N = size();
+		//Solve L q = r
+		for (int n = 0; n < N; n++) {
+			double t = r[n];
+			int left = neighbors[n].x;
+			int bottom = neighbors[n].z;
+			if (left >= 0)
+				t += precon[left] * q[left];
+			if (bottom >= 0)
+				t += precon[bottom] * q[bottom];
+			q[n] = t * precon[n];
+		}
+		//Solve L^T z = q
+		for (int n = N - 1; n >= 0; n--) {
+			double t = q[n];
+			int right = neighbors[n].y;
+			int top = neighbors[n].w;
+			if (right >= 0)
+				t += precon[n] * z[right];
+			if (top >= 0)
+				t += precon[n] * z[top];
+			z[n] = t * precon[n];
 		}
 	}
-	return diag;
-}
-
-static double P_ref(const Image1d& P, const Image1ub& A, int i, int j) {
-	if (i < 0 || i > P.width - 1 || j < 0 || j > P.height - 1
-			|| A(i, j).x != static_cast<char>(ObjectType::FLUID))
-		return 0.0;
-	return P(i, j).x;
-}
-static float P_ref(const Image1f& P, const Image1ub& A, int i, int j) {
-	if (i < 0 || i > P.width - 1 || j < 0 || j > P.height - 1
-			|| A(i, j).x != static_cast<char>(ObjectType::FLUID))
-		return 0.0;
-	return P(i, j).x;
+};
+static double Dot(const std::vector<double>& x, const std::vector<double>& y) {
+	double ans = 0.0;
+	int N = (int) x.size();
+#pragma omp parallel for reduction(+:ans)
+	for (int n = 0; n < N; n++) {
+		ans += x[n] * y[n];
+	}
+	return ans;
 }
-static void buildPreconditioner(Image1d& P, const Image1f& L,
-		const Image1ub& A) {
-	double a = 0.25;
-	P.resize(A.width, A.height);
+LaplaceSolverStatus SolveLaplace2d(const Image1ub& A, const Image1f& L,
+		Image1f& x, const Image1f& b, float voxelSize, float tolerance,
+		int maxIterations) {
+	LaplaceSolverStatus status;
+	LaplaceOperator2D op;
+	op.build(A, L);
+	int N = op.size();
+	double h2 = (double) voxelSize * voxelSize;
+	std::vector<double> p(N), r(N), z(N), s(N), q(N);
 #pragma omp parallel for
-	for (int j = 0; j < A.height; j++) {
-		for (int i = 0; i < A.width; i++) {
-			if (A(i, j).x == static_cast<char>(ObjectType::FLUID)) {
-				double left = A_ref(A, i - 1, j, i, j) * P_ref(P, A, i - 1, j);
-				double bottom = A_ref(A, i, j - 1, i, j)
-						* P_ref(P, A, i, j - 1);
-				double diag = A_diag(A, L, i, j);
-				double e = diag - square(left) - square(bottom);
-				if (e < a * diag)
-					e = diag;
-				P(i, j).x = 1.0 / std::sqrt(e);
-			}
-		}
+	for (int n = 0; n < N; n++) {
+		p[n] = x[op.cells[n]].x;
 	}
-}
-
-static void applyPreconditioner(Image1f& z, const Image1f& r, const Image1d& P,
-		const Image1f& L, const Image1ub& A) {
-	Image1d q(P.width, P.height);
-	q.set(double1(0.0));
+	//r = h^2 b - A p, warm started from the previous pressure
+	op.multiply(p, z);
 #pragma omp parallel for
-	for (int j = 0; j < q.height; j++) {
-		for (int i = 0; i < q.width; i++) {
-			if (A(i, j).x == static_cast<char>(ObjectType::FLUID)) {
-				double left = A_ref(A, i - 1, j, i, j) * P_ref(P, A, i - 1, j)
-						* P_ref(q, A, i - 1, j);
-				double bottom = A_ref(A, i, j - 1, i, j) * P_ref(P, A, i, j - 1)
-						* P_ref(q, A, i, j - 1);
-				double t = r(i, j).x - left - bottom;
-				q(i, j).x = t * P(i, j);
-			}
-		}
+	for (int n = 0; n < N; n++) {
+		r[n] = h2 * b[op.cells[n]].x - z[n];
+	}
+	double bnorm = 0.0;
+#pragma omp parallel for reduction(+:bnorm)
+	for (int n = 0; n < N; n++) {
+		double val = h2 * b[op.cells[n]].x;
+		bnorm += val * val;
 	}
-// L^T z = q
-	for (int i = q.width - 1; i >= 0; i--) {
-		for (int j = q.height - 1; j >= 0; j--) {
-			if (A(i, j).x == static_cast<char>(ObjectType::FLUID)) {
-				double right = A_ref(A, i, j, i + 1, j) * P_ref(P, A, i, j)
-						* P_ref(z, A, i + 1, j);
-				double top = A_ref(A, i, j, i, j + 1) * P_ref(P, A, i, j)
-						* P_ref(z, A, i, j + 1);
-				double t = q(i, j).x - right - top;
-				z(i, j).x = t * P(i, j).x;
+	bnorm = std::sqrt(bnorm);
+	double rnorm = std::sqrt(Dot(r, r));
+	status.initialResidual = status.residual = rnorm;
+	double threshold = tolerance * std::max(bnorm, 1E-30);
+	if (maxIterations < 0)
+		maxIterations = std::max(N, 1);
+	if (N > 0 && rnorm > threshold) {
+		op.buildPreconditioner();
+		op.applyPreconditioner(r, q, z);
+		s = z;
+		double a = Dot(z, r);
+		for (int k = 0; k < maxIterations; k++) {
+			op.multiply(s, z);
+			double alpha = a / Dot(z, s);
+#pragma omp parallel for
+			for (int n = 0; n < N; n++) {
+				p[n] += alpha * s[n];
+				r[n] -= alpha * z[n];
+			}
+			status.iterations = k + 1;
+			status.residual = std::sqrt(Dot(r, r));
+			if (status.residual <= threshold)
+				break;
+			op.applyPreconditioner(r, q, z);
+			double a2 = Dot(z, r);
+			double beta = a2 / a;
+#pragma omp parallel for
+			for (int n = 0; n < N; n++) {
+				s[n] = z[n] + beta * s[n];
 			}
+			a = a2;
 		}
 	}
-}
-
-// Conjugate Gradient Method
-static void conjGrad(const Image1ub& A, const Image1d& P, const Image1f& L,
-		Image1f& x, const Image1f& b, float voxelSize) {
-// Pre-allocate Memory
-	Image1f r(x.width, x.height);
-	Image1f z(x.width, x.height);
-	Image1f s(x.width, x.height);
-	compute_Ax(A, L, x, z, voxelSize);                // z = applyA(x)
-	op(A, b, z, r, -1.0);                  // r = b-Ax
-	double error2_0 = product(A, r, r);    // error2_0 = r . r
-	applyPreconditioner(z, r, P, L, A);		// Apply Conditioner z = f(r)
-	copy(s, z);								// s = z
-	int V = x.width*x.height;
-	double eps = 1.0e-2 * (V);
-	double a = product(A, z, r);			// a = z . r
-	for (int k = 0; k < V; k++) {
-		if(error2_0==0)break;
-		compute_Ax(A, L, s, z, voxelSize);			// z = applyA(s)
-		double alpha = a / product(A, z, s);	// alpha = a/(z . s)
-		op(A, x, s, x, alpha);				// x = x + alpha*s
-		op(A, r, z, r, -alpha);			// r = r - alpha*z;
-		float error2 = product(A, r, r);	// error2 = r . r
-		error2_0 = fmax(error2_0, error2);
-		// Dump Progress
-		double rate = 1.0
-				- max(0.0, min(1.0, (error2 - eps) / (error2_0 - eps)));
-
-		//std::cout<<k<<") Error "<<error2<<"/"<<error2_0<<std::endl;
-		if (error2 <= eps&&k>=4)
-			break;
-		applyPreconditioner(z, r, P, L, A);	// Apply Conditioner z = f(r)
-		double a2 = product(A, z, r);		// a2 = z . r
-		double beta = a2 / a;                     // beta = a2 / a
-		op(A, z, s, s, beta);				// s = z + beta*s
-		a = a2;
+	status.converged = (status.residual <= threshold);
+	x.set(float1(0.0f));
+#pragma omp parallel for
+	for (int n = 0; n < N; n++) {
+		x[op.cells[n]].x = (float) p[n];
 	}
-}
-
-void SolveLaplace2d(const Image1ub& A, const Image1f& L, Image1f& x,const Image1f& b, float voxelSize) {
-	Image1d P;
-	buildPreconditioner(P, L, A);
-	conjGrad(A, P, L, x, b, voxelSize);
+	return status;
 }
 
 }
@@ -28,64 +28,89 @@
 using namespace std;
 namespace aly {
 ParticleLocator::ParticleLocator(int2 dims, float voxelSize) :
-		mVoxelSize(voxelSize), mGridSize(dims) {
-	cells.resize(dims.x * dims.y, FluidCell());
+		mVoxelSize(voxelSize), mGridSize(dims), particles(nullptr) {
+	cellStart.resize(dims.x * dims.y + 1, 0);
 }
 ParticleLocator::~ParticleLocator() {
 }
-
-void ParticleLocator::update(std::vector<FluidParticlePtr>& particles) {
-	// Clear All Cells
+/*
+ Parallel counting sort. Particles are split into at most MAX_BLOCKS fixed blocks that are
+ histogrammed independently, so the result is stable and does not depend on the thread count.
+ Capping the blocks keeps the per-block histograms at O(cells) regardless of the particle count.
+ */
+void ParticleLocator::update(const FluidParticleStore& store) {
+	const int BLOCK_SIZE = 8192;
+	const int MAX_BLOCKS = 8;
+	particles = &store;
+	int N = (int) store.size();
+	int cellCount = mGridSize.x * mGridSize.y;
+	int blocks = clamp((N + BLOCK_SIZE - 1) / BLOCK_SIZE, 1, MAX_BLOCKS);
+	int blockSize = (N + blocks - 1) / blocks;
+	particleCells.resize(N);
+	sortedParticles.resize(N);
+	blockCounts.assign((size_t) blocks * cellCount, 0);
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++) {
+		uint32_t* counts = &blockCounts[(size_t) b * cellCount];
+		int end = std::min(N, (b + 1) * blockSize);
+		for (int n = b * blockSize; n < end; n++) {
+			uint32_t cell = (uint32_t) getCellIndex(store.location[n]);
+			particleCells[n] = cell;
+			counts[cell]++;
+		}
+	}
 #pragma omp parallel for
-	for (int n = 0; n < (int) cells.size(); n++) {
-		cells[n].clear();
+	for (int c = 0; c < cellCount; c++) {
+		uint32_t sum = 0;
+		for (int b = 0; b < blocks; b++) {
+			sum += blockCounts[(size_t) b * cellCount + c];
+		}
+		cellStart[c + 1] = sum;
 	}
-	float scale = 1.0f / mVoxelSize;
-	// Store Into The Cells
-	for (FluidParticlePtr& p : particles) {
-		int i = clamp((int) (scale * p->mLocation[0]), 0, mGridSize[0] - 1);
-		int j = clamp((int) (scale * p->mLocation[1]), 0, mGridSize[1] - 1);
-		int k = clamp((int) (scale * p->mLocation[2]), 0, mGridSize[2] - 1);
-		getCell(i, j).push_back(p.get());
+	cellStart[0] = 0;
+	for (int c = 0; c < cellCount; c++) {
+		cellStart[c + 1] += cellStart[c];
 	}
-}
-
-FluidCell ParticleLocator::getNeigboringWallParticles(int i, int j, int w,
-		int h) {
-	FluidCell res;
-	for (int si = max(i - w, 0); si <= min(i + w - 1, mGridSize[0] - 1); si++) {
-		for (int sj = max(j - h, 0); sj <= min(j + h - 1, mGridSize[1] - 1);
-				sj++) {
-			for (FluidParticle* p : getCell(si, sj)) {
-				res.push_back(p);
-			}
+#pragma omp parallel for
+	for (int c = 0; c < cellCount; c++) {
+		uint32_t offset = cellStart[c];
+		for (int b = 0; b < blocks; b++) {
+			uint32_t& count = blockCounts[(size_t) b * cellCount + c];
+			uint32_t tmp = count;
+			count = offset;
+			offset += tmp;
 		}
 	}
-	return res;
-}
-
-FluidCell ParticleLocator::getNeigboringCellParticles(int i, int j, int w,
-		int h) {
-	FluidCell res;
-	for (int si = max(i - w, 0); si <= min(i + w, mGridSize[0] - 1); si++) {
-		for (int sj = max(j - h, 0); sj <= min(j + h, mGridSize[1] - 1); sj++) {
-			for (FluidParticle* p : getCell(si, sj)) {
-				res.push_back(p);
-			}
+#pragma omp parallel for
+	for (int b = 0; b < blocks; b++) {
+		uint32_t* offsets = &blockCounts[(size_t) b * cellCount];
+		int end = std::min(N, (b + 1) * blockSize);
+		for (int n = b * blockSize; n < end; n++) {
+			sortedParticles[offsets[particleCells[n]]++] = (uint32_t) n;
 		}
 	}
-	return res;
+}
+void ParticleLocator::sort(FluidParticleStore& store) {
+	update(store);
+	store.permute(sortedParticles);
+#pragma omp parallel for
+	for (int n = 0; n < (int) sortedParticles.size(); n++) {
+		sortedParticles[n] = (uint32_t) n;
+	}
 }
 size_t ParticleLocator::getParticleCount(int i, int j) const {
-	return getCell(i, j).size();
+	int cell = clamp(i, 0, mGridSize.x - 1) + clamp(j, 0, mGridSize.y - 1) * mGridSize.x;
+	return cellStart[cell + 1] - cellStart[cell];
 }
 
 float ParticleLocator::getLevelSetValue(int i, int j, Image1f& halfwall,
 		float density) {
 	float accm = 0.0;
-	for (FluidParticle* p : getCell(i, j)) {
-		if (p->mObjectType == ObjectType::FLUID) {
-			accm += p->mDensity;
+	int cell = clamp(i, 0, mGridSize.x - 1) + clamp(j, 0, mGridSize.y - 1) * mGridSize.x;
+	for (uint32_t k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+		uint32_t n = sortedParticles[k];
+		if (particles->type[n] == ObjectType::FLUID) {
+			accm += particles->density[n];
 		} else {
 			return 1.0;
 		}
@@ -100,8 +125,9 @@ void ParticleLocator::markAsWater(Image1ub& A, Image1f& halfwall,
 	for (int j = 0; j < A.height; j++) {
 		for (int i = 0; i < A.width; i++) {
 			A(i, j).x = static_cast<char>(ObjectType::AIR);
-			for (FluidParticle* p : getCell(i, j)) {
-				if (p->mObjectType == ObjectType::WALL) {
+			int cell = clamp(i, 0, mGridSize.x - 1) + clamp(j, 0, mGridSize.y - 1) * mGridSize.x;
+			for (uint32_t k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+				if (particles->type[sortedParticles[k]] == ObjectType::WALL) {
 					A(i, j) = static_cast<char>(ObjectType::WALL);
 					break;
 				}
@@ -114,10 +140,10 @@ void ParticleLocator::markAsWater(Image1ub& A, Image1f& halfwall,
 	}
 }
 void ParticleLocator::deleteAllParticles() {
-#pragma omp parallel for
-	for (int n = 0; n < (int) cells.size(); n++) {
-		cells[n].clear();
-	}
+	std::fill(cellStart.begin(), cellStart.end(), 0);
+	sortedParticles.clear();
+	particleCells.clear();
+	particles = nullptr;
 }
 
 }
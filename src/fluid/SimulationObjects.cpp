@@ -110,5 +110,72 @@ bool SphereObject::insideShell(float2& pt) {
 		return false;
 	}
 }
+void FluidParticleStore::clear() {
+	location.clear();
+	velocity.clear();
+	normal.clear();
+	type.clear();
+	mass.clear();
+	density.clear();
+}
+void FluidParticleStore::reserve(size_t n) {
+	location.reserve(n);
+	velocity.reserve(n);
+	normal.reserve(n);
+	type.reserve(n);
+	mass.reserve(n);
+	density.reserve(n);
+}
+void FluidParticleStore::push_back(const float2& pt, const float2& vel,
+		const float2& norm, ObjectType t, float m, float d) {
+	location.push_back(pt);
+	velocity.push_back(vel);
+	normal.push_back(norm);
+	type.push_back(t);
+	mass.push_back(m);
+	density.push_back(d);
+}
+void FluidParticleStore::erase(const std::vector<char>& remove) {
+	size_t count = 0;
+	for (size_t n = 0; n < size(); n++) {
+		if (remove[n])
+			continue;
+		if (count != n) {
+			location[count] = location[n];
+			velocity[count] = velocity[n];
+			normal[count] = normal[n];
+			type[count] = type[n];
+			mass[count] = mass[n];
+			density[count] = density[n];
+		}
+		count++;
+	}
+	location.resize(count);
+	velocity.resize(count);
+	normal.resize(count);
+	type.resize(count);
+	mass.resize(count);
+	density.resize(count);
+}
+template<class T> static void PermuteArray(std::vector<T>& data,
+		const std::vector<uint32_t>& order, std::vector<T>& buffer) {
+	buffer.resize(data.size());
+#pragma omp parallel for
+	for (int n = 0; n < (int) order.size(); n++) {
+		buffer[n] = data[order[n]];
+	}
+	data.swap(buffer);
+}
+void FluidParticleStore::permute(const std::vector<uint32_t>& order) {
+	std::vector<float2> buffer2;
+	PermuteArray(location, order, buffer2);
+	PermuteArray(velocity, order, buffer2);
+	PermuteArray(normal, order, buffer2);
+	std::vector<ObjectType> bufferType;
+	PermuteArray(type, order, bufferType);
+	std::vector<float> buffer1;
+	PermuteArray(mass, order, buffer1);
+	PermuteArray(density, order, buffer1);
+}
 }
 
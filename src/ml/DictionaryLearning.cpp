@@ -137,7 +137,7 @@ std::set<int> DictionaryLearning::optimizeFilters(int start) {
 		}
 	}
 	DenseMat<float> At = A.transpose();
-	DenseMat<float> AtA = At * A;
+	DenseMat<float> AtA = Gram(A);
 	double totalRes = 0.0f;
 	for (int n = 0; n < N; n++) {
 		AtB.setZero();
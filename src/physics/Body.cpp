@@ -82,7 +82,7 @@ namespace aly {
 					p->parentRegions.push_back(r->lp);
 				}
 			}
-
+			flatten();
 			calculateInvariants();
 			initializeCells();		// Cells help with rendering
 			updateCellPositions();
@@ -133,25 +133,24 @@ namespace aly {
 		void Body::calculateInvariants()
 		{
 
-			// Calculate perRegionMass
-			for (ParticlePtr particle : particles) {
-				particle->perRegionMass = particle->mass / particle->parentRegions.size();
-			}
-
-			// Calculate region properties
+			// Calculate perRegionMass and region properties
 			// Use fast summation
-			for (ParticlePtr p : particles) {
-				p->sumData.M(0, 0) = p->perRegionMass;
-				p->sumData.v = p->perRegionMass * p->x0;
-				//std::cout << "Particle Invariant " << p->sumData.v << " " << p->sumData.M(0, 0)<<std::endl;
+			std::vector<SumData>& particleSums = levelSums[0];
+#pragma omp parallel for
+			for (int i = 0; i < (int)particles.size(); i++) {
+				Particle* p = particles[i].get();
+				p->perRegionMass = p->mass / p->parentRegions.size();
+				particleSums[i].M(0, 0) = p->perRegionMass;
+				particleSums[i].v = p->perRegionMass * p->x0;
 			}
 			sumParticlesToRegions();
-			for (RegionPtr r : regions) {
-				r->M = r->sumData.M(0, 0);
-				r->Ex0 = r->sumData.v;
+			const std::vector<SumData>& regionSums = levelSums[SUM_LEVELS - 1];
+#pragma omp parallel for
+			for (int i = 0; i < (int)regions.size(); i++) {
+				Region* r = regions[i].get();
+				r->M = regionSums[i].M(0, 0);
+				r->Ex0 = regionSums[i].v;
 				r->c0 = r->Ex0 / r->M;
-				//std::cout << "Region " << r->Ex0<<" "<<r->c0 << " " <<r->M << std::endl;
-
 			}
 		}
 
@@ -339,26 +338,9 @@ namespace aly {
 			}
 		}
 		template <class T> void Remove(std::vector<std::shared_ptr<T>>& vecin, const T* t) {
-			for (auto iter = vecin.begin(); iter != vecin.end(); iter++) {
-				std::shared_ptr<T> val = *iter;
-				if (val.get() == t) {
-					vecin.erase(iter);
-					if (vecin.size() > 0) {
-						iter--;
-					}
-				}
-			}
-		}
-		template <class T> void Remove(std::list<std::shared_ptr<T>>& vecin, const T* t) {
-			for (auto iter = vecin.begin(); iter != vecin.end(); iter++) {
-				std::shared_ptr<T> val = *iter;
-				if (val.get() == t) {
-					vecin.erase(iter);
-					if (vecin.size() > 0) {
-						iter--;
-					}
-				}
-			}
+			vecin.erase(std::remove_if(vecin.begin(), vecin.end(), [t](const std::shared_ptr<T>& val) {
+				return val.get() == t;
+			}), vecin.end());
 		}
 
 		void Remove(std::vector<Summation*> &vec, const Summation *t)
@@ -535,6 +517,47 @@ namespace aly {
 					//  (though we should update it if we want to re-BFS regions)
 				}
 			}
+			flatten();
+		}
+		void Body::flatten()
+		{
+			std::vector<Summation*> levels[SUM_LEVELS];
+			for (ParticlePtr particle : particles) {
+				levels[0].push_back(particle.get());
+			}
+			for (int l = 0; l < 2; l++) {
+				for (SummationPtr sum : sums[l]) {
+					levels[l + 1].push_back(sum.get());
+				}
+			}
+			for (RegionPtr r : regions) {
+				levels[SUM_LEVELS - 1].push_back(r.get());
+			}
+			for (int l = 0; l < SUM_LEVELS; l++) {
+				for (int i = 0; i < (int)levels[l].size(); i++) {
+					levels[l][i]->index = i;
+				}
+			}
+			for (int l = 0; l < SUM_LEVELS; l++) {
+				const std::vector<Summation*>& level = levels[l];
+				levelSums[l].assign(level.size(), SumData());
+				childStart[l].resize(level.size() + 1);
+				parentStart[l].resize(level.size() + 1);
+				childIndex[l].clear();
+				parentIndex[l].clear();
+				childStart[l][0] = 0;
+				parentStart[l][0] = 0;
+				for (int i = 0; i < (int)level.size(); i++) {
+					for (Summation* child : level[i]->children) {
+						childIndex[l].push_back(child->index);
+					}
+					for (Summation* parent : level[i]->parents) {
+						parentIndex[l].push_back(parent->index);
+					}
+					childStart[l][i + 1] = (int)childIndex[l].size();
+					parentStart[l][i + 1] = (int)parentIndex[l].size();
+				}
+			}
 		}
 		void Body::shapeMatch()
 		{
@@ -546,21 +569,26 @@ namespace aly {
 			}
 
 			// Set each particle's sumData in preparation for calculating F(mixi) and F(mixi0T)
-			for (ParticlePtr particle : particles)
+			std::vector<SumData>& particleSums = levelSums[0];
+#pragma omp parallel for
+			for (int i = 0; i < (int)particles.size(); i++)
 			{
-				particle->sumData.v = particle->perRegionMass * particle->x;
-				particle->sumData.M = outerProd(particle->perRegionMass * particle->x, particle->x0);
+				Particle* particle = particles[i].get();
+				particleSums[i].v = particle->perRegionMass * particle->x;
+				particleSums[i].M = outerProd(particle->perRegionMass * particle->x, particle->x0);
 			}
 
 			// Calculate F(mixi) and F(mixi0T)
 			sumParticlesToRegions();
 
-			int count = 0;
 			// Shape match
-			for (RegionPtr r : regions)
+			std::vector<SumData>& regionSums = levelSums[SUM_LEVELS - 1];
+#pragma omp parallel for
+			for (int i = 0; i < (int)regions.size(); i++)
 			{
-				float3 Fmixi = r->sumData.v;
-				float3x3 Fmixi0T = r->sumData.M;
+				Region* r = regions[i].get();
+				float3 Fmixi = regionSums[i].v;
+				float3x3 Fmixi0T = regionSums[i].M;
 				r->c = (1.0f / r->M) * Fmixi;						// Eqn. 9
 				r->A = Fmixi0T - outerProd(r->M * r->c, r->c0);		// Enq. 11
 				r->R = FactorRotation(r->A);
@@ -575,23 +603,25 @@ namespace aly {
 				r->t = r->c - r->R * r->c0;
 
 				// Set the region's SumData in preparation for calculating F(Tr)
-				r->sumData.M = r->R;
-				r->sumData.v = r->t;
+				regionSums[i].M = r->R;
+				regionSums[i].v = r->t;
 			}
 
 			// Calculate F(Tr)
 			sumRegionsToParticles();
 
 			// Calculate goal positions for the particles
-			for (ParticlePtr particle : particles)
+#pragma omp parallel for
+			for (int i = 0; i < (int)particles.size(); i++)
 			{
+				Particle* particle = particles[i].get();
 				float invNumParentRegions = 1.0f / particle->parentRegions.size();
 
 				// Eqn. 12, split into rotation and translation
-				particle->g = (invNumParentRegions * particle->sumData.M) * particle->x0 + invNumParentRegions * particle->sumData.v;
+				particle->g = (invNumParentRegions * particleSums[i].M) * particle->x0 + invNumParentRegions * particleSums[i].v;
 
 				// Store just the rotational part too; it's useful for rendering
-				particle->R = invNumParentRegions * particle->sumData.M;
+				particle->R = invNumParentRegions * particleSums[i].M;
 			}
 		}
 
@@ -617,34 +647,42 @@ namespace aly {
 				return;
 
 			// Set the data needed to calculate F(mivi), F(mix~ivi) and F(mix~ix~iT)
-			for (ParticlePtr particle : particles)
+			std::vector<SumData>& particleSums = levelSums[0];
+#pragma omp parallel for
+			for (int i = 0; i < (int)particles.size(); i++)
 			{
+				Particle* particle = particles[i].get();
+				SumData& sumData = particleSums[i];
 				// This is for F(mivi)
-				particle->sumData.v = particle->perRegionMass * particle->v;
+				sumData.v = particle->perRegionMass * particle->v;
 
 				// This is for F(mix~ivi)
-				particle->sumData.M.x = cross(particle->x, particle->sumData.v);
+				sumData.M.x = cross(particle->x, sumData.v);
 
 				// This is for F(mix~ix~iT)
 				// We take advantage of the fact that this is a symmetric matrix to squeeze the data in the standard SumData
 				float3 x = particle->x;
-				particle->sumData.M(2, 1) = particle->perRegionMass * (x.z * x.z + x.y * x.y);
-				particle->sumData.M(0, 1) = particle->perRegionMass * (-x.x*x.y);
-				particle->sumData.M(0, 2) = particle->perRegionMass * (-x.x*x.z);
-				particle->sumData.M(1, 1) = particle->perRegionMass * (x.z*x.z + x.x*x.x);
-				particle->sumData.M(1, 2) = particle->perRegionMass * (-x.z*x.y);
-				particle->sumData.M(2, 2) = particle->perRegionMass * (x.y*x.y + x.x*x.x);
+				sumData.M(2, 1) = particle->perRegionMass * (x.z * x.z + x.y * x.y);
+				sumData.M(0, 1) = particle->perRegionMass * (-x.x*x.y);
+				sumData.M(0, 2) = particle->perRegionMass * (-x.x*x.z);
+				sumData.M(1, 1) = particle->perRegionMass * (x.z*x.z + x.x*x.x);
+				sumData.M(1, 2) = particle->perRegionMass * (-x.z*x.y);
+				sumData.M(2, 2) = particle->perRegionMass * (x.y*x.y + x.x*x.x);
 			}
 
 			sumParticlesToRegions();
-			for (RegionPtr region : regions)
+			std::vector<SumData>& regionSums = levelSums[SUM_LEVELS - 1];
+#pragma omp parallel for
+			for (int i = 0; i < (int)regions.size(); i++)
 			{
+				Region* region = regions[i].get();
+				SumData& sumData = regionSums[i];
 				float3 v = float3(0.0f);
 				float3 L = float3(0.0f);
 				float3x3 I;
 
 				// Rebuild the original symmetric matrix from the reduced data
-				const float3x3 &M = region->sumData.M;
+				const float3x3 &M = sumData.M;
 				float3x3 FmixixiT;
 				FmixixiT(0, 0) = M(2, 1);
 				FmixixiT(0, 1) = M(0, 1);
@@ -657,28 +695,30 @@ namespace aly {
 				FmixixiT(2, 2) = M(2, 2);
 
 				// Calculate v, L, I, w
-				v = (1.0f / region->M) * region->sumData.v;							// Eqn. 14
-				L = M.x - cross(region->c, region->sumData.v);
+				v = (1.0f / region->M) * sumData.v;							// Eqn. 14
+				L = M.x - cross(region->c, sumData.v);
 				I = FmixixiT - region->M * MrMatrix(region->c);
 
 				float3 w = inverse(I) * L;
 
 				// Set the data needed to apply this to the particles
-				region->sumData.v = v;
-				region->sumData.M.x = w;
-				region->sumData.M.y = cross(w, region->c);
+				sumData.v = v;
+				sumData.M.x = w;
+				sumData.M.y = cross(w, region->c);
 			}
 
 			sumRegionsToParticles();
 
 			// Apply calculated damping
-			for (ParticlePtr particle : particles)
+#pragma omp parallel for
+			for (int i = 0; i < (int)particles.size(); i++)
 			{
+				Particle* particle = particles[i].get();
 				if (particle->parentRegions.size() > 0)
 				{
-					float3 Fv = particle->sumData.v;
-					float3 Fw = particle->sumData.M.x;
-					float3 Fwc = particle->sumData.M.y;
+					float3 Fv = particleSums[i].v;
+					float3 Fw = particleSums[i].M.x;
+					float3 Fwc = particleSums[i].M.y;
 					float3 dv = (1.0f / particle->parentRegions.size()) * (Fv + cross(Fw, particle->x) - Fwc - (float)particle->parentRegions.size() * particle->v);
 					// Bleed off non-rigid motion
 					particle->v = particle->v + kRegionDamping * dv;
@@ -688,8 +728,10 @@ namespace aly {
 
 		void Body::calculateParticleVelocities(float h)
 		{
-			for (ParticlePtr particle : particles)
+#pragma omp parallel for
+			for (int i = 0; i < (int)particles.size(); i++)
 			{
+				Particle* particle = particles[i].get();
 				if (particle->parentRegions.size() == 0)
 				{
 					// We are just a lone particle flying about - no regions, so no goal position - so only account for fExt
@@ -709,8 +751,10 @@ namespace aly {
 
 		void Body::applyParticleVelocities(float h)
 		{
-			for (ParticlePtr particle : particles)
+#pragma omp parallel for
+			for (int i = 0; i < (int)particles.size(); i++)
 			{
+				Particle* particle = particles[i].get();
 				particle->x = particle->x + h * particle->v;		// Eqn. 2
 			}
 		}
@@ -723,35 +767,42 @@ namespace aly {
 			}
 		}
 
-		void Body::sumParticlesToRegions()
+		// Sums one level of the hierarchy from the adjacent level, following the CSR connections.
+		// Entries without connections keep their current value.
+		static void SumLevel(const std::vector<int>& start, const std::vector<int>& index, const std::vector<SumData>& src, std::vector<SumData>& dst)
 		{
-			for (SummationPtr bar : sums[0])
-			{
-				bar->SumFromChildren();
-			}
-			for (SummationPtr plate : sums[1])
+#pragma omp parallel for
+			for (int i = 0; i < (int)dst.size(); i++)
 			{
-				plate->SumFromChildren();
+				int begin = start[i];
+				int end = start[i + 1];
+				if (begin == end) continue;
+				SumData sum = src[index[begin]];
+				for (int k = begin + 1; k < end; k++)
+				{
+					const SumData& data = src[index[k]];
+					sum.v += data.v;
+					sum.M += data.M;
+				}
+				dst[i] = sum;
 			}
-			for (RegionPtr region : regions)
+		}
+
+		void Body::sumParticlesToRegions()
+		{
+			// Particles -> bars -> plates -> regions. Each level only reads the one below it.
+			for (int l = 1; l < SUM_LEVELS; l++)
 			{
-				region->SumFromChildren();
+				SumLevel(childStart[l], childIndex[l], levelSums[l - 1], levelSums[l]);
 			}
 		}
 
 		void Body::sumRegionsToParticles()
 		{
-			for (SummationPtr plate : sums[1])
-			{
-				plate->SumFromParents();
-			}
-			for (SummationPtr bar : sums[0])
-			{
-				bar->SumFromParents();
-			}
-			for (ParticlePtr particle : particles)
+			// Regions -> plates -> bars -> particles
+			for (int l = SUM_LEVELS - 2; l >= 0; l--)
 			{
-				particle->SumFromParents();
+				SumLevel(parentStart[l], parentIndex[l], levelSums[l + 1], levelSums[l]);
 			}
 		}
 	}
@@ -5,10 +5,8 @@
 namespace aly {
 	namespace softbody {
 
-		Summation::Summation() : lp(nullptr)
+		Summation::Summation() : lp(nullptr), minDim(0), maxDim(0), index(-1)
 		{
-			connections[0] = &children;
-			connections[1] = &parents;
 		}
 
 		std::vector<SummationPtr> Summation::GenerateChildSums(int childLevel)
@@ -127,49 +125,5 @@ namespace aly {
 
 			return nullptr;
 		}
-
-		void Summation::SumFromChildren()
-		{
-			PerformSummation(0);
-		}
-
-		void Summation::SumFromParents()
-		{
-			PerformSummation(1);
-		}
-
-		// Slightly optimized using MMX operations (sum 4 floats in one op)	// Actually, no, it's not. Problems with aligning the memory in this version.
-		void Summation::PerformSummation(int direction)
-		{
-			std::vector<Summation*> *sources = connections[direction];
-			if (sources->size() == 0)
-			{
-				return;
-			}
-			else if (sources->size() == 1)
-			{
-				sumData.v = (*sources)[0]->sumData.v;
-				sumData.M = (*sources)[0]->sumData.M;
-				//sumData.m1 = (*sources)[0]->sumData.m1;
-				//sumData.m2 = (*sources)[0]->sumData.m2;
-				//sumData.m3 = (*sources)[0]->sumData.m3;
-			}
-			else
-			{
-				sumData.v = (*sources)[0]->sumData.v + (*sources)[1]->sumData.v;
-				sumData.M = (*sources)[0]->sumData.M + (*sources)[1]->sumData.M;
-				//sumData.m1 = _mm_add_ps((*sources)[0]->sumData.m1, (*sources)[1]->sumData.m1);
-				//sumData.m2 = _mm_add_ps((*sources)[0]->sumData.m2, (*sources)[1]->sumData.m2);
-				//sumData.m3 = _mm_add_ps((*sources)[0]->sumData.m3, (*sources)[1]->sumData.m3);
-				for (unsigned int j = 2; j < sources->size(); j++)
-				{
-					sumData.v += (*sources)[j]->sumData.v;
-					sumData.M += (*sources)[j]->sumData.M;
-					//sumData.m1 = _mm_add_ps(sumData.m1, (*sources)[j]->sumData.m1);
-					//sumData.m2 = _mm_add_ps(sumData.m2, (*sources)[j]->sumData.m2);
-					//sumData.m3 = _mm_add_ps(sumData.m3, (*sources)[j]->sumData.m3);
-				}
-			}
-		}
 	}
 }
@@ -19,23 +19,298 @@
  * THE SOFTWARE.
  */
 #include "segmentation/ActiveContour3D.h"
+#include <algorithm>
+#include <cassert>
 
 namespace aly {
 
+float ActiveContour3D::getLevelSetValue(int i, int j, int k) const {
+	if (sparse) {
+		return sparseLevelSet.getLeafValue(clamp(i, 0, dimensions.x - 1),
+				clamp(j, 0, dimensions.y - 1), clamp(k, 0, dimensions.z - 1));
+	}
+	return levelSet(i, j, k).x;
+}
+float ActiveContour3D::getSwapLevelSetValue(int i, int j, int k) const {
+	if (sparse) {
+		return sparseSwapLevelSet.getLeafValue(clamp(i, 0, dimensions.x - 1),
+				clamp(j, 0, dimensions.y - 1), clamp(k, 0, dimensions.z - 1));
+	}
+	return swapLevelSet(i, j, k).x;
+}
+//Sparse writes only touch active voxels and their neighbors, whose tiles addElements() allocates first. Allocating here would race with the parallel callers.
+void ActiveContour3D::setLevelSetValue(int i, int j, int k, float val) {
+	if (sparse) {
+		bool stored = sparseLevelSet.setLeafValue(
+				clamp(i, 0, dimensions.x - 1), clamp(j, 0, dimensions.y - 1),
+				clamp(k, 0, dimensions.z - 1), val);
+		assert(stored);
+		(void) stored;
+	} else {
+		levelSet(i, j, k).x = val;
+	}
+}
+void ActiveContour3D::setSwapLevelSetValue(int i, int j, int k, float val) {
+	if (sparse) {
+		bool stored = sparseSwapLevelSet.setLeafValue(
+				clamp(i, 0, dimensions.x - 1), clamp(j, 0, dimensions.y - 1),
+				clamp(k, 0, dimensions.z - 1), val);
+		assert(stored);
+		(void) stored;
+	} else {
+		swapLevelSet(i, j, k).x = val;
+	}
+}
+float ActiveContour3D::getPressureValue(int i, int j, int k) const {
+	if (pressureImage.size() > 0) {
+		return pressureImage(i, j, k).x;
+	}
+	return sparsePressure.getMultiResolutionValue(i, j, k);
+}
+float3 ActiveContour3D::getVectorFieldValue(int i, int j, int k) const {
+	if (vecFieldImage.size() > 0) {
+		return vecFieldImage(i, j, k);
+	}
+	return sparseVecField.getMultiResolutionValue(i, j, k);
+}
+bool ActiveContour3D::hasPressure() const {
+	return (pressureImage.size() > 0 || sparsePressure.getNodeCount() > 0);
+}
+bool ActiveContour3D::hasVectorField() const {
+	return (vecFieldImage.size() > 0 || sparseVecField.getNodeCount() > 0);
+}
+static inline float ToTileValue(const float1& v) {
+	return v.x;
+}
+static inline float3 ToTileValue(const float3& v) {
+	return v;
+}
+//Copies a dense field into tiles. Tiles with a single value are stored once in their parent node.
+template<class T, int C> static void MakeSparseField(
+		const Volume<float, C, ImageType::FLOAT>& vol, EndlessGrid<T>& grid,
+		int rootSize, int tileSize) {
+	grid.reset( { rootSize, tileSize }, T(0.0f));
+	int3 dims = vol.dimensions();
+	int3 tiles = (dims + int3(tileSize - 1)) / int3(tileSize);
+	for (int tk = 0; tk < tiles.z; tk++) {
+		for (int tj = 0; tj < tiles.y; tj++) {
+			for (int ti = 0; ti < tiles.x; ti++) {
+				int3 origin = tileSize * int3(ti, tj, tk);
+				int3 end = aly::min(origin + int3(tileSize), dims);
+				T first = ToTileValue(vol(origin.x, origin.y, origin.z));
+				bool uniform = true;
+				for (int k = origin.z; k < end.z && uniform; k++) {
+					for (int j = origin.y; j < end.y && uniform; j++) {
+						for (int i = origin.x; i < end.x; i++) {
+							if (ToTileValue(vol(i, j, k)) != first) {
+								uniform = false;
+								break;
+							}
+						}
+					}
+				}
+				if (uniform) {
+					EndlessNode<T>* node = nullptr;
+					grid.getMultiResolutionValue(origin.x, origin.y, origin.z,
+							node) = first;
+					continue;
+				}
+				for (int k = origin.z; k < end.z; k++) {
+					for (int j = origin.y; j < end.y; j++) {
+						for (int i = origin.x; i < end.x; i++) {
+							grid.getLeafValue(i, j, k) = ToTileValue(
+									vol(i, j, k));
+						}
+					}
+				}
+			}
+		}
+	}
+}
+EndlessNodeFloat* ActiveContour3D::allocateTile(EndlessGridFloat& grid, int i,
+		int j, int k) {
+	grid.getLeafValue(i, j, k);
+	EndlessNodeFloat* leaf = nullptr;
+	float val;
+	const EndlessGridFloat& cgrid = grid;
+	cgrid.getLeafValue(i, j, k, leaf, val);
+	return leaf;
+}
+void ActiveContour3D::addSparseTile(int i, int j, int k, float val) {
+	EndlessNodeFloat* leaf = allocateTile(sparseLevelSet, i, j, k);
+	EndlessNodeFloat* swapLeaf = allocateTile(sparseSwapLevelSet, i, j, k);
+	int3 end = aly::min(int3(leaf->dim), dimensions - leaf->location);
+	for (int z = 0; z < end.z; z++) {
+		for (int y = 0; y < end.y; y++) {
+			for (int x = 0; x < end.x; x++) {
+				(*leaf)(x, y, z) = val;
+				(*swapLeaf)(x, y, z) = val;
+			}
+		}
+	}
+}
+void ActiveContour3D::initSparseLevelSet() {
+	const int T = SPARSE_TILE_SIZE;
+	const float bg = MAX_DISTANCE + 0.5f;
+	sparseLevelSet.reset( { SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, bg);
+	sparseSwapLevelSet.reset( { SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, bg);
+	if (initialLevelSet.size() == 0) {
+		//Restart from the band tiles kept by a previous init().
+		for (EndlessNodeFloat* seed : sparseInitialLevelSet.getLeafNodes()) {
+			int3 loc = seed->location;
+			allocateTile(sparseLevelSet, loc.x, loc.y, loc.z)->data = seed->data;
+			allocateTile(sparseSwapLevelSet, loc.x, loc.y, loc.z)->data =
+					seed->data;
+		}
+		return;
+	}
+	sparseInitialLevelSet.reset( { SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, bg);
+	int3 tiles = (dimensions + int3(T - 1)) / int3(T);
+	std::vector<uint8_t> bandTiles(tiles.x * tiles.y * tiles.z, 0);
+#pragma omp parallel for
+	for (int t = 0; t < (int) bandTiles.size(); t++) {
+		int3 origin = T
+				* int3(t % tiles.x, (t / tiles.x) % tiles.y,
+						t / (tiles.x * tiles.y));
+		int3 end = aly::min(origin + int3(T), dimensions);
+		for (int k = origin.z; k < end.z && !bandTiles[t]; k++) {
+			for (int j = origin.y; j < end.y && !bandTiles[t]; j++) {
+				for (int i = origin.x; i < end.x; i++) {
+					if (std::abs(initialLevelSet(i, j, k).x) <= MAX_DISTANCE) {
+						bandTiles[t] = 1;
+						break;
+					}
+				}
+			}
+		}
+	}
+	//Tiles without band voxels are never stored. They have uniform sign and are recreated by addElements() when the band reaches them.
+	for (int t = 0; t < (int) bandTiles.size(); t++) {
+		if (!bandTiles[t])
+			continue;
+		int3 origin = T
+				* int3(t % tiles.x, (t / tiles.x) % tiles.y,
+						t / (tiles.x * tiles.y));
+		EndlessNodeFloat* seed = allocateTile(sparseInitialLevelSet, origin.x,
+				origin.y, origin.z);
+		for (int k = 0; k < T; k++) {
+			for (int j = 0; j < T; j++) {
+				for (int i = 0; i < T; i++) {
+					int3 pos = origin + int3(i, j, k);
+					float val = bg;
+					if (pos.x < dimensions.x && pos.y < dimensions.y
+							&& pos.z < dimensions.z) {
+						val = clamp(initialLevelSet(pos.x, pos.y, pos.z).x,
+								-(maxLayers + 1.0f), (maxLayers + 1.0f));
+					}
+					(*seed)(i, j, k) = val;
+				}
+			}
+		}
+		allocateTile(sparseLevelSet, origin.x, origin.y, origin.z)->data =
+				seed->data;
+		allocateTile(sparseSwapLevelSet, origin.x, origin.y, origin.z)->data =
+				seed->data;
+	}
+	//The band tiles are all that is needed to restart, so the dense copy is released.
+	initialLevelSet.clear();
+}
+void ActiveContour3D::initSparseForces() {
+	if (pressureImage.size() > 0) {
+		MakeSparseField(pressureImage, sparsePressure, SPARSE_ROOT_SIZE,
+				SPARSE_TILE_SIZE);
+		pressureImage.clear();
+	}
+	if (vecFieldImage.size() > 0) {
+		MakeSparseField(vecFieldImage, sparseVecField, SPARSE_ROOT_SIZE,
+				SPARSE_TILE_SIZE);
+		vecFieldImage.clear();
+	}
+}
+void ActiveContour3D::rebuildSparseNarrowBand() {
+	std::list<EndlessNodeFloat*> leafList = sparseSwapLevelSet.getLeafNodes();
+	std::vector<EndlessNodeFloat*> leafs(leafList.begin(), leafList.end());
+	std::vector<std::vector<int3>> bands(leafs.size());
+#pragma omp parallel for
+	for (int t = 0; t < (int) leafs.size(); t++) {
+		EndlessNodeFloat* leaf = leafs[t];
+		int3 end = aly::min(int3(leaf->dim), dimensions - leaf->location);
+		for (int k = 0; k < end.z; k++) {
+			for (int j = 0; j < end.y; j++) {
+				for (int i = 0; i < end.x; i++) {
+					if (std::abs((*leaf)(i, j, k)) <= MAX_DISTANCE) {
+						bands[t].push_back(leaf->location + int3(i, j, k));
+					}
+				}
+			}
+		}
+	}
+	//Copy tiles that still hold band voxels into fresh grids and drop the rest.
+	const float bg = sparseLevelSet.getBackgroundValue();
+	EndlessGridFloat levelSetTiles( { SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, bg);
+	EndlessGridFloat swapLevelSetTiles( { SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE },
+			bg);
+	for (int t = 0; t < (int) leafs.size(); t++) {
+		if (bands[t].size() == 0)
+			continue;
+		int3 loc = leafs[t]->location;
+		EndlessNodeFloat* oldLeaf = nullptr;
+		float val;
+		sparseLevelSet.getLeafValue(loc.x, loc.y, loc.z, oldLeaf, val);
+		allocateTile(levelSetTiles, loc.x, loc.y, loc.z)->data = oldLeaf->data;
+		allocateTile(swapLevelSetTiles, loc.x, loc.y, loc.z)->data =
+				leafs[t]->data;
+		activeList.insert(activeList.end(), bands[t].begin(), bands[t].end());
+	}
+	sparseLevelSet.swap(levelSetTiles);
+	sparseSwapLevelSet.swap(swapLevelSetTiles);
+}
+void ActiveContour3D::pruneSparseTiles() {
+	//Keep the tiles that hold active voxels. The active list is left untouched so voxels update in the same order as in dense mode.
+	const float bg = sparseLevelSet.getBackgroundValue();
+	EndlessGridFloat levelSetTiles( { SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, bg);
+	EndlessGridFloat swapLevelSetTiles( { SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE },
+			bg);
+	for (int3 pos : activeList) {
+		EndlessNodeFloat* leaf = nullptr;
+		float val;
+		if (levelSetTiles.getLeafValue(pos.x, pos.y, pos.z, leaf, val))
+			continue;
+		EndlessNodeFloat* oldLeaf = nullptr;
+		EndlessNodeFloat* oldSwapLeaf = nullptr;
+		sparseLevelSet.getLeafValue(pos.x, pos.y, pos.z, oldLeaf, val);
+		sparseSwapLevelSet.getLeafValue(pos.x, pos.y, pos.z, oldSwapLeaf, val);
+		int3 loc = oldLeaf->location;
+		allocateTile(levelSetTiles, loc.x, loc.y, loc.z)->data = oldLeaf->data;
+		allocateTile(swapLevelSetTiles, loc.x, loc.y, loc.z)->data =
+				oldSwapLeaf->data;
+	}
+	sparseLevelSet.swap(levelSetTiles);
+	sparseSwapLevelSet.swap(swapLevelSetTiles);
+}
 void ActiveContour3D::rebuildNarrowBand() {
 	activeList.clear();
-	for (int band = 1; band <= maxLayers; band++) {
+	if (sparse) {
+		rebuildSparseNarrowBand();
+		//Match the scan order of the dense branch.
+		std::sort(activeList.begin(), activeList.end(),
+				[](const int3& a, const int3& b) {
+					return std::make_tuple(a.z, a.y, a.x) < std::make_tuple(b.z, b.y, b.x);
+				});
+	} else {
+		for (int band = 1; band <= maxLayers; band++) {
 #pragma omp parallel for
-		for (int i = 0; i < (int) activeList.size(); i++) {
-			int3 pos = activeList[i];
-			updateDistanceField(pos.x, pos.y, pos.z, band);
+			for (int i = 0; i < (int) activeList.size(); i++) {
+				int3 pos = activeList[i];
+				updateDistanceField(pos.x, pos.y, pos.z, band);
+			}
 		}
-	}
-	for (int k = 0; k < swapLevelSet.slices; k++) {
-		for (int j = 0; j < swapLevelSet.cols; j++) {
-			for (int i = 0; i < swapLevelSet.rows; i++) {
-				if (std::abs(swapLevelSet(i, j, k).x) <= MAX_DISTANCE) {
-					activeList.push_back(int3(i, j, k));
+		for (int k = 0; k < swapLevelSet.slices; k++) {
+			for (int j = 0; j < swapLevelSet.cols; j++) {
+				for (int i = 0; i < swapLevelSet.rows; i++) {
+					if (std::abs(swapLevelSet(i, j, k).x) <= MAX_DISTANCE) {
+						activeList.push_back(int3(i, j, k));
+					}
 				}
 			}
 		}
@@ -51,19 +326,19 @@ void ActiveContour3D::plugLevelSet(int i, int j, int k, size_t index) {
 	float v211;
 	float v112;
 	float v110;
-	v111 = levelSet(i, j, k);
+	v111 = getLevelSetValue(i, j, k);
 	float sgn = aly::sign(v111);
 	v111 = sgn * v111;
-	v011 = sgn * levelSet(i - 1, j, k);
-	v121 = sgn * levelSet(i, j + 1, k);
-	v101 = sgn * levelSet(i, j - 1, k);
-	v211 = sgn * levelSet(i + 1, j, k);
-	v110 = sgn * levelSet(i, j, k - 1);
-	v112 = sgn * levelSet(i, j, k + 1);
+	v011 = sgn * getLevelSetValue(i - 1, j, k);
+	v121 = sgn * getLevelSetValue(i, j + 1, k);
+	v101 = sgn * getLevelSetValue(i, j - 1, k);
+	v211 = sgn * getLevelSetValue(i + 1, j, k);
+	v110 = sgn * getLevelSetValue(i, j, k - 1);
+	v112 = sgn * getLevelSetValue(i, j, k + 1);
 	//if (v111 > 0 && v111 < 0.5f && v011 > 0 && v121 > 0 && v101 > 0 && v211 > 0 && v112 > 0 && v110 > 0) {
 	if (v111 <= 0 && v111 >= -0.5f && v011 < 0 && v121 < 0 && v101 < 0
 			&& v211 < 0 && v112 < 0 && v110 < 0) {
-		levelSet(i, j, k) = sgn * MAX_DISTANCE;
+		setLevelSetValue(i, j, k, sgn * MAX_DISTANCE);
 	}
 }
 void ActiveContour3D::cleanup() {
@@ -74,7 +349,15 @@ bool ActiveContour3D::updateSurface() {
 	if (requestUpdateSurface) {
 		std::lock_guard<std::mutex> lockMe(contourLock);
 		Mesh mesh;
-		isoSurface.solve(levelSet, activeList, mesh, MeshType::Triangle, true, 0.0f);
+		if (sparse) {
+			if (sparseLevelSet.getNodeCount() > 0) {
+				isoSurface.solve(sparseLevelSet, mesh, MeshType::Triangle, true,
+						0.0f);
+			}
+		} else {
+			isoSurface.solve(levelSet, activeList, mesh, MeshType::Triangle,
+					true, 0.0f);
+		}
 		mesh.updateVertexNormals(false, 4);
 		contour.vertexLocations = mesh.vertexLocations;
 		contour.vertexNormals = mesh.vertexNormals;
@@ -94,10 +377,21 @@ Volume1f& ActiveContour3D::getLevelSet() {
 const Volume1f& ActiveContour3D::getLevelSet() const {
 	return levelSet;
 }
+EndlessGridFloat& ActiveContour3D::getSparseLevelSet() {
+	return sparseLevelSet;
+}
+const EndlessGridFloat& ActiveContour3D::getSparseLevelSet() const {
+	return sparseLevelSet;
+}
 ActiveContour3D::ActiveContour3D(
 		const std::shared_ptr<ManifoldCache3D>& cache) :
 		Simulation("Active Contour 3D"), cache(cache), clampSpeed(false), requestUpdateSurface(
-				false) {
+				false), sparse(false), sparseLevelSet( { SPARSE_ROOT_SIZE,
+				SPARSE_TILE_SIZE }, MAX_DISTANCE + 0.5f), sparseSwapLevelSet( {
+				SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, MAX_DISTANCE + 0.5f), sparseInitialLevelSet(
+				{ SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, MAX_DISTANCE + 0.5f), sparsePressure(
+				{ SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, 0.0f), sparseVecField( {
+				SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, float3(0.0f)) {
 	advectionParam = Float(1.0f);
 	pressureParam = Float(0.0f);
 	targetPressureParam = Float(0.5f);
@@ -107,7 +401,12 @@ ActiveContour3D::ActiveContour3D(
 ActiveContour3D::ActiveContour3D(const std::string& name,
 		const std::shared_ptr<ManifoldCache3D>& cache) :
 		Simulation(name), cache(cache), clampSpeed(false), requestUpdateSurface(
-				false) {
+				false), sparse(false), sparseLevelSet( { SPARSE_ROOT_SIZE,
+				SPARSE_TILE_SIZE }, MAX_DISTANCE + 0.5f), sparseSwapLevelSet( {
+				SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, MAX_DISTANCE + 0.5f), sparseInitialLevelSet(
+				{ SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, MAX_DISTANCE + 0.5f), sparsePressure(
+				{ SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, 0.0f), sparseVecField( {
+				SPARSE_ROOT_SIZE, SPARSE_TILE_SIZE }, float3(0.0f)) {
 	advectionParam = Float(1.0f);
 	pressureParam = Float(0.0f);
 	targetPressureParam = Float(0.5f);
@@ -136,20 +435,32 @@ void ActiveContour3D::setup(const aly::ParameterPanePtr& pane) {
 }
 bool ActiveContour3D::init() {
 	int3 dims = initialLevelSet.dimensions();
+	if (sparse && initialLevelSet.size() == 0
+			&& sparseInitialLevelSet.getNodeCount() > 0) {
+		dims = dimensions;
+	}
 	if (dims.x == 0 || dims.y == 0 || dims.z == 0)
 		return false;
 	simulationDuration = std::max(std::max(dims.x, dims.y), dims.z) * 1.75f;
 	simulationIteration = 0;
 	simulationTime = 0;
 	timeStep = 1.0f;
-	levelSet.resize(dims.x, dims.y, dims.z);
-	swapLevelSet.resize(dims.x, dims.y, dims.z);
+	dimensions = dims;
+	if (sparse) {
+		levelSet.clear();
+		swapLevelSet.clear();
+		initSparseLevelSet();
+		initSparseForces();
+	} else {
+		levelSet.resize(dims.x, dims.y, dims.z);
+		swapLevelSet.resize(dims.x, dims.y, dims.z);
 #pragma omp parallel for
-	for (int i = 0; i < (int) initialLevelSet.size(); i++) {
-		float val = clamp(initialLevelSet[i], -(maxLayers + 1.0f),
-				(maxLayers + 1.0f));
-		levelSet[i] = val;
-		swapLevelSet[i] = val;
+		for (int i = 0; i < (int) initialLevelSet.size(); i++) {
+			float val = clamp(initialLevelSet[i], -(maxLayers + 1.0f),
+					(maxLayers + 1.0f));
+			levelSet[i] = val;
+			swapLevelSet[i] = val;
+		}
 	}
 	rebuildNarrowBand();
 	requestUpdateSurface = true;
@@ -164,30 +475,30 @@ bool ActiveContour3D::init() {
 }
 void ActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
 		size_t gid) {
-	float v111 = swapLevelSet(i, j, k).x;
+	float v111 = getSwapLevelSetValue(i, j, k);
 	float2 grad;
 	if (v111 > 0.5f || v111 < -0.5f) {
 		deltaLevelSet[gid] = 0;
 		return;
 	}
-	float v010 = swapLevelSet(i - 1, j, k - 1);
-	float v120 = swapLevelSet(i, j + 1, k - 1);
-	float v110 = swapLevelSet(i, j, k - 1);
-	float v100 = swapLevelSet(i, j - 1, k - 1);
-	float v210 = swapLevelSet(i + 1, j, k - 1);
-	float v001 = swapLevelSet(i - 1, j - 1, k);
-	float v011 = swapLevelSet(i - 1, j, k);
-	float v101 = swapLevelSet(i, j - 1, k);
-	float v211 = swapLevelSet(i + 1, j, k);
-	float v201 = swapLevelSet(i + 1, j - 1, k);
-	float v221 = swapLevelSet(i + 1, j + 1, k);
-	float v021 = swapLevelSet(i - 1, j + 1, k);
-	float v121 = swapLevelSet(i, j + 1, k);
-	float v012 = swapLevelSet(i - 1, j, k + 1);
-	float v122 = swapLevelSet(i, j + 1, k + 1);
-	float v112 = swapLevelSet(i, j, k + 1);
-	float v102 = swapLevelSet(i, j - 1, k + 1);
-	float v212 = swapLevelSet(i + 1, j, k + 1);
+	float v010 = getSwapLevelSetValue(i - 1, j, k - 1);
+	float v120 = getSwapLevelSetValue(i, j + 1, k - 1);
+	float v110 = getSwapLevelSetValue(i, j, k - 1);
+	float v100 = getSwapLevelSetValue(i, j - 1, k - 1);
+	float v210 = getSwapLevelSetValue(i + 1, j, k - 1);
+	float v001 = getSwapLevelSetValue(i - 1, j - 1, k);
+	float v011 = getSwapLevelSetValue(i - 1, j, k);
+	float v101 = getSwapLevelSetValue(i, j - 1, k);
+	float v211 = getSwapLevelSetValue(i + 1, j, k);
+	float v201 = getSwapLevelSetValue(i + 1, j - 1, k);
+	float v221 = getSwapLevelSetValue(i + 1, j + 1, k);
+	float v021 = getSwapLevelSetValue(i - 1, j + 1, k);
+	float v121 = getSwapLevelSetValue(i, j + 1, k);
+	float v012 = getSwapLevelSetValue(i - 1, j, k + 1);
+	float v122 = getSwapLevelSetValue(i, j + 1, k + 1);
+	float v112 = getSwapLevelSetValue(i, j, k + 1);
+	float v102 = getSwapLevelSetValue(i, j - 1, k + 1);
+	float v212 = getSwapLevelSetValue(i + 1, j, k + 1);
 
 	float DxNeg = v111 - v011;
 	float DxPos = v211 - v111;
@@ -248,7 +559,7 @@ void ActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
 	// Level set force should be the opposite sign of advection force so it
 	// moves in the direction of the force.
 
-	float3 vec = vecFieldImage(i, j, k);
+	float3 vec = getVectorFieldValue(i, j, k);
 	float forceX = advectionParam.toFloat() * vec.x;
 	float forceY = advectionParam.toFloat() * vec.y;
 	float forceZ = advectionParam.toFloat() * vec.z;
@@ -270,7 +581,7 @@ void ActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
 	} else if (forceZ < 0) {
 		advection += forceZ * DzPos;
 	}
-	float force = pressureParam.toFloat() * pressureImage(i, j, k).x;
+	float force = pressureParam.toFloat() * getPressureValue(i, j, k);
 	if (force > 0) {
 		pressure = -force * std::sqrt(GradientSqrPos);
 	} else if (force < 0) {
@@ -279,31 +590,31 @@ void ActiveContour3D::pressureAndAdvectionMotion(int i, int j, int k,
 	deltaLevelSet[gid] = -advection + kappa + pressure;
 }
 void ActiveContour3D::advectionMotion(int i, int j, int k, size_t gid) {
-	float v111 = swapLevelSet(i, j, k).x;
+	float v111 = getSwapLevelSetValue(i, j, k);
 	float2 grad;
 	if (v111 > 0.5f || v111 < -0.5f) {
 		deltaLevelSet[gid] = 0;
 		return;
 	}
 
-	float v010 = swapLevelSet(i - 1, j, k - 1);
-	float v120 = swapLevelSet(i, j + 1, k - 1);
-	float v110 = swapLevelSet(i, j, k - 1);
-	float v100 = swapLevelSet(i, j - 1, k - 1);
-	float v210 = swapLevelSet(i + 1, j, k - 1);
-	float v001 = swapLevelSet(i - 1, j - 1, k);
-	float v011 = swapLevelSet(i - 1, j, k);
-	float v101 = swapLevelSet(i, j - 1, k);
-	float v211 = swapLevelSet(i + 1, j, k);
-	float v201 = swapLevelSet(i + 1, j - 1, k);
-	float v221 = swapLevelSet(i + 1, j + 1, k);
-	float v021 = swapLevelSet(i - 1, j + 1, k);
-	float v121 = swapLevelSet(i, j + 1, k);
-	float v012 = swapLevelSet(i - 1, j, k + 1);
-	float v122 = swapLevelSet(i, j + 1, k + 1);
-	float v112 = swapLevelSet(i, j, k + 1);
-	float v102 = swapLevelSet(i, j - 1, k + 1);
-	float v212 = swapLevelSet(i + 1, j, k + 1);
+	float v010 = getSwapLevelSetValue(i - 1, j, k - 1);
+	float v120 = getSwapLevelSetValue(i, j + 1, k - 1);
+	float v110 = getSwapLevelSetValue(i, j, k - 1);
+	float v100 = getSwapLevelSetValue(i, j - 1, k - 1);
+	float v210 = getSwapLevelSetValue(i + 1, j, k - 1);
+	float v001 = getSwapLevelSetValue(i - 1, j - 1, k);
+	float v011 = getSwapLevelSetValue(i - 1, j, k);
+	float v101 = getSwapLevelSetValue(i, j - 1, k);
+	float v211 = getSwapLevelSetValue(i + 1, j, k);
+	float v201 = getSwapLevelSetValue(i + 1, j - 1, k);
+	float v221 = getSwapLevelSetValue(i + 1, j + 1, k);
+	float v021 = getSwapLevelSetValue(i - 1, j + 1, k);
+	float v121 = getSwapLevelSetValue(i, j + 1, k);
+	float v012 = getSwapLevelSetValue(i - 1, j, k + 1);
+	float v122 = getSwapLevelSetValue(i, j + 1, k + 1);
+	float v112 = getSwapLevelSetValue(i, j, k + 1);
+	float v102 = getSwapLevelSetValue(i, j - 1, k + 1);
+	float v212 = getSwapLevelSetValue(i + 1, j, k + 1);
 
 	float DxNeg = v111 - v011;
 	float DxPos = v211 - v111;
@@ -347,7 +658,7 @@ void ActiveContour3D::advectionMotion(int i, int j, int k, size_t gid) {
 	// Level set force should be the opposite sign of advection force so it
 	// moves in the direction of the force.
 
-	float3 vec = vecFieldImage(i, j, k);
+	float3 vec = getVectorFieldValue(i, j, k);
 	float forceX = advectionParam.toFloat() * vec.x;
 	float forceY = advectionParam.toFloat() * vec.y;
 	float forceZ = advectionParam.toFloat() * vec.z;
@@ -374,7 +685,7 @@ void ActiveContour3D::advectionMotion(int i, int j, int k, size_t gid) {
 void ActiveContour3D::applyForces(int i, int j, int k, size_t index,
 		float timeStep) {
 	float delta;
-	float old = swapLevelSet(i, j, k);
+	float old = getSwapLevelSetValue(i, j, k);
 	if (std::abs(old) > 0.5f)
 		return;
 	if (clampSpeed) {
@@ -383,20 +694,20 @@ void ActiveContour3D::applyForces(int i, int j, int k, size_t index,
 		delta = timeStep * deltaLevelSet[index];
 	}
 	old += delta;
-	levelSet(i, j, k) = float1(old);
+	setLevelSetValue(i, j, k, old);
 }
 
 int ActiveContour3D::deleteElements() {
 	std::vector<int3> newList;
 	for (int i = 0; i < (int) activeList.size(); i++) {
 		int3 pos = activeList[i];
-		float val = swapLevelSet(pos.x, pos.y, pos.z);
+		float val = getSwapLevelSetValue(pos.x, pos.y, pos.z);
 		if (std::abs(val) <= MAX_DISTANCE) {
 			newList.push_back(pos);
 		} else {
 			val = sign(val) * (MAX_DISTANCE + 0.5f);
-			levelSet(pos.x, pos.y, pos.z) = val;
-			swapLevelSet(pos.x, pos.y, pos.z) = val;
+			setLevelSetValue(pos.x, pos.y, pos.z, val);
+			setSwapLevelSetValue(pos.x, pos.y, pos.z, val);
 		}
 	}
 	int diff = (int) (activeList.size() - newList.size());
@@ -409,8 +720,8 @@ int ActiveContour3D::addElements() {
 	const int zNeighborhood[6] = { 0, 0, 0, 0, -1, 1 };
 	std::vector<int2> newList;
 	int sz = (int) activeList.size();
-	float INDICATOR = (float) std::max(std::max(levelSet.rows, levelSet.cols),
-			levelSet.slices);
+	float INDICATOR = (float) std::max(std::max(dimensions.x, dimensions.y),
+			dimensions.z);
 	for (int offset = 0; offset < 6; offset++) {
 		int xOff = xNeighborhood[offset];
 		int yOff = yNeighborhood[offset];
@@ -418,11 +729,21 @@ int ActiveContour3D::addElements() {
 		for (int n = 0; n < sz; n++) {
 			int3 pos = activeList[n];
 			int3 pos2 = int3(pos.x + xOff, pos.y + yOff, pos.z + zOff);
-			float val1 = std::abs(levelSet(pos.x, pos.y, pos.z));
-			float val2 = std::abs(levelSet(pos2.x, pos2.y, pos2.z));
+			float val1 = getLevelSetValue(pos.x, pos.y, pos.z);
+			if (sparse && std::abs(val1) <= MAX_DISTANCE - 1.0f
+					&& pos2.x >= 0 && pos2.y >= 0 && pos2.z >= 0
+					&& pos2.x < dimensions.x && pos2.y < dimensions.y
+					&& pos2.z < dimensions.z
+					&& sparseLevelSet.getLeafValuePtr(pos2.x, pos2.y, pos2.z)
+							== nullptr) {
+				addSparseTile(pos2.x, pos2.y, pos2.z,
+						aly::sign(val1) * (MAX_DISTANCE + 0.5f));
+			}
+			val1 = std::abs(val1);
+			float val2 = std::abs(getLevelSetValue(pos2.x, pos2.y, pos2.z));
 			if (val1 <= MAX_DISTANCE - 1.0f && val2 >= MAX_DISTANCE
 					&& val2 < INDICATOR) {
-				levelSet(pos2.x, pos2.y, pos2.z) = INDICATOR + offset;
+				setLevelSetValue(pos2.x, pos2.y, pos2.z, INDICATOR + offset);
 			}
 		}
 	}
@@ -433,45 +754,45 @@ int ActiveContour3D::addElements() {
 		for (int n = 0; n < sz; n++) {
 			int3 pos = activeList[n];
 			int3 pos2 = int3(pos.x + xOff, pos.y + yOff, pos.z + zOff);
-			float val1 = levelSet(pos.x, pos.y, pos.z);
-			float val2 = levelSet(pos2.x, pos2.y, pos2.z);
+			float val1 = getLevelSetValue(pos.x, pos.y, pos.z);
+			float val2 = getLevelSetValue(pos2.x, pos2.y, pos2.z);
 			if (std::abs(val1) <= MAX_DISTANCE - 1.0f
 					&& val2 == INDICATOR + offset) {
 				activeList.push_back(pos2);
-				val2 = swapLevelSet(pos2.x, pos2.y, pos2.z);
+				val2 = getSwapLevelSetValue(pos2.x, pos2.y, pos2.z);
 				val2 = aly::sign(val2) * MAX_DISTANCE;
-				swapLevelSet(pos2.x, pos2.y, pos2.z) = val2;
-				levelSet(pos2.x, pos2.y, pos2.z) = val2;
+				setSwapLevelSetValue(pos2.x, pos2.y, pos2.z, val2);
+				setLevelSetValue(pos2.x, pos2.y, pos2.z, val2);
 			}
 		}
 	}
 	return (int) (activeList.size() - sz);
 }
 void ActiveContour3D::pressureMotion(int i, int j, int k, size_t gid) {
-	float v111 = swapLevelSet(i, j, k).x;
+	float v111 = getSwapLevelSetValue(i, j, k);
 	float3 grad;
 	if (std::abs(v111) > 0.5f) {
 		deltaLevelSet[gid] = 0;
 		return;
 	}
-	float v010 = swapLevelSet(i - 1, j, k - 1).x;
-	float v120 = swapLevelSet(i, j + 1, k - 1).x;
-	float v110 = swapLevelSet(i, j, k - 1).x;
-	float v100 = swapLevelSet(i, j - 1, k - 1).x;
-	float v210 = swapLevelSet(i + 1, j, k - 1).x;
-	float v001 = swapLevelSet(i - 1, j - 1, k).x;
-	float v011 = swapLevelSet(i - 1, j, k).x;
-	float v101 = swapLevelSet(i, j - 1, k).x;
-	float v211 = swapLevelSet(i + 1, j, k).x;
-	float v201 = swapLevelSet(i + 1, j - 1, k).x;
-	float v221 = swapLevelSet(i + 1, j + 1, k).x;
-	float v021 = swapLevelSet(i - 1, j + 1, k).x;
-	float v121 = swapLevelSet(i, j + 1, k).x;
-	float v012 = swapLevelSet(i - 1, j, k + 1).x;
-	float v122 = swapLevelSet(i, j + 1, k + 1).x;
-	float v112 = swapLevelSet(i, j, k + 1).x;
-	float v102 = swapLevelSet(i, j - 1, k + 1).x;
-	float v212 = swapLevelSet(i + 1, j, k + 1).x;
+	float v010 = getSwapLevelSetValue(i - 1, j, k - 1);
+	float v120 = getSwapLevelSetValue(i, j + 1, k - 1);
+	float v110 = getSwapLevelSetValue(i, j, k - 1);
+	float v100 = getSwapLevelSetValue(i, j - 1, k - 1);
+	float v210 = getSwapLevelSetValue(i + 1, j, k - 1);
+	float v001 = getSwapLevelSetValue(i - 1, j - 1, k);
+	float v011 = getSwapLevelSetValue(i - 1, j, k);
+	float v101 = getSwapLevelSetValue(i, j - 1, k);
+	float v211 = getSwapLevelSetValue(i + 1, j, k);
+	float v201 = getSwapLevelSetValue(i + 1, j - 1, k);
+	float v221 = getSwapLevelSetValue(i + 1, j + 1, k);
+	float v021 = getSwapLevelSetValue(i - 1, j + 1, k);
+	float v121 = getSwapLevelSetValue(i, j + 1, k);
+	float v012 = getSwapLevelSetValue(i - 1, j, k + 1);
+	float v122 = getSwapLevelSetValue(i, j + 1, k + 1);
+	float v112 = getSwapLevelSetValue(i, j, k + 1);
+	float v102 = getSwapLevelSetValue(i, j - 1, k + 1);
+	float v212 = getSwapLevelSetValue(i + 1, j, k + 1);
 
 	float DxNeg = v111 - v011;
 	float DxPos = v211 - v111;
@@ -523,7 +844,7 @@ void ActiveContour3D::pressureMotion(int i, int j, int k, size_t gid) {
 	} else if (kappa > maxCurvatureForce) {
 		kappa = maxCurvatureForce;
 	}
-	float force = pressureParam.toFloat() * pressureImage(i, j, k).x;
+	float force = pressureParam.toFloat() * getPressureValue(i, j, k);
 	float pressure = 0;
 	if (force > 0) {
 		float GradientSqrPos = DxNegMax * DxNegMax + DxPosMin * DxPosMin
@@ -546,18 +867,18 @@ void ActiveContour3D::updateDistanceField(int i, int j, int k, int band) {
 	float v211;
 	float v110;
 	float v112;
-	float activeLevelSet = swapLevelSet(i, j, k).x;
+	float activeLevelSet = getSwapLevelSetValue(i, j, k);
 	if (std::abs(activeLevelSet) <= 0.5f) {
 		return;
 	}
-	v111 = levelSet(i, j, k);
+	v111 = getLevelSetValue(i, j, k);
 	float oldVal = v111;
-	v011 = levelSet(i - 1, j, k);
-	v121 = levelSet(i, j + 1, k);
-	v101 = levelSet(i, j - 1, k);
-	v211 = levelSet(i + 1, j, k);
-	v110 = levelSet(i, j, k - 1);
-	v112 = levelSet(i, j, k + 1);
+	v011 = getLevelSetValue(i - 1, j, k);
+	v121 = getLevelSetValue(i, j + 1, k);
+	v101 = getLevelSetValue(i, j - 1, k);
+	v211 = getLevelSetValue(i + 1, j, k);
+	v110 = getLevelSetValue(i, j, k - 1);
+	v112 = getLevelSetValue(i, j, k + 1);
 
 	if (v111 < -band + 0.5f) {
 		v111 = -(MAX_DISTANCE + 0.5f);
@@ -580,15 +901,15 @@ void ActiveContour3D::updateDistanceField(int i, int j, int k, int band) {
 	}
 
 	if (oldVal * v111 > 0) {
-		levelSet(i, j, k).x = v111;
+		setLevelSetValue(i, j, k, v111);
 	} else {
-		levelSet(i, j, k).x = oldVal;
+		setLevelSetValue(i, j, k, oldVal);
 	}
 }
 
 float ActiveContour3D::evolve(float maxStep) {
-	if (pressureImage.size() > 0) {
-		if (vecFieldImage.size() > 0) {
+	if (hasPressure()) {
+		if (hasVectorField()) {
 #pragma omp parallel for
 			for (int i = 0; i < (int) activeList.size(); i++) {
 				int3 pos = activeList[i];
@@ -601,7 +922,7 @@ float ActiveContour3D::evolve(float maxStep) {
 				pressureMotion(pos.x, pos.y, pos.z, i);
 			}
 		}
-	} else if (vecFieldImage.size() > 0) {
+	} else if (hasVectorField()) {
 #pragma omp parallel for
 		for (int i = 0; i < (int) activeList.size(); i++) {
 			int3 pos = activeList[i];
@@ -642,7 +963,7 @@ float ActiveContour3D::evolve(float maxStep) {
 #pragma omp parallel for
 	for (int i = 0; i < (int) activeList.size(); i++) {
 		int3 pos = activeList[i];
-		swapLevelSet(pos.x, pos.y, pos.z) = levelSet(pos.x, pos.y, pos.z);
+		setSwapLevelSetValue(pos.x, pos.y, pos.z, getLevelSetValue(pos.x, pos.y, pos.z));
 	}
 	deleteElements();
 	addElements();
@@ -661,6 +982,9 @@ bool ActiveContour3D::stepInternal() {
 	//WriteImageToRawFile(MakeDesktopFile(MakeString()<<"current_levelse"<<std::setw(4)<<std::setfill('0')<<mSimulationIteration<<".xml"),levelSet);
 	simulationTime += t;
 	simulationIteration++;
+	if (sparse) {
+		pruneSparseTiles();
+	}
 	if (cache.get() != nullptr) {
 		updateSurface();
 		contour.setFile(
@@ -691,4 +1015,76 @@ void ActiveContour3D::rescale(aly::Volume1f& pressureForce) {
 		}
 	}
 }
+bool SANITY_CHECK_ACTIVE_CONTOUR_3D() {
+	const int D = 32;
+	const float3 center(15.5f, 16.2f, 14.8f);
+	Volume1f initial(D, D, D);
+	Volume1f target(D, D, D);
+	Volume3f vecField(D, D, D);
+	for (int k = 0; k < D; k++) {
+		for (int j = 0; j < D; j++) {
+			for (int i = 0; i < D; i++) {
+				float3 d = float3((float) i, (float) j, (float) k) - center;
+				float r = length(d);
+				initial(i, j, k).x = r - 6.0f;
+				//Saturates inside and outside so some pressure tiles are uniform.
+				target(i, j, k).x = clamp(11.0f - r, 0.0f, 1.0f);
+				vecField(i, j, k) = 0.02f * float3(-d.y, d.x, 0.0f);
+			}
+		}
+	}
+	const int steps = 8;
+	ActiveContour3D dense;
+	dense.setInitialDistanceField(initial);
+	dense.setPressure(target, 0.5f, 0.5f);
+	dense.setVectorField(vecField, 0.2f);
+	if (!dense.init()) {
+		throw std::runtime_error("Dense active contour failed to initialize.");
+	}
+	for (int n = 0; n < steps; n++) {
+		dense.step();
+	}
+	ActiveContour3D sparse;
+	sparse.setSparse(true);
+	sparse.setInitialDistanceField(initial);
+	sparse.setPressure(target, 0.5f, 0.5f);
+	sparse.setVectorField(vecField, 0.2f);
+	//The second pass restarts from the band tiles kept after the dense seed is released.
+	for (int pass = 0; pass < 2; pass++) {
+		if (!sparse.init()) {
+			throw std::runtime_error(
+					MakeString() << "Sparse active contour failed to initialize on pass " << pass << ".");
+		}
+		if (sparse.getPressureImage().size() != 0) {
+			throw std::runtime_error("Sparse active contour kept the dense pressure image.");
+		}
+		for (int n = 0; n < steps; n++) {
+			sparse.step();
+		}
+		const Volume1f& denseLevelSet = dense.getLevelSet();
+		const EndlessGridFloat& sparseLevelSet = sparse.getSparseLevelSet();
+		size_t bandCount = 0;
+		for (int k = 0; k < D; k++) {
+			for (int j = 0; j < D; j++) {
+				for (int i = 0; i < D; i++) {
+					float d = denseLevelSet(i, j, k).x;
+					float s = sparseLevelSet.getLeafValue(i, j, k);
+					if (std::abs(d) > 3.5f && std::abs(s) > 3.5f)
+						continue;
+					bandCount++;
+					if (std::abs(d - s) > 1E-4f) {
+						throw std::runtime_error(
+								MakeString() << "Dense and sparse level sets differ at " << int3(i, j, k) << " on pass " << pass << ": " << d << " vs " << s);
+					}
+				}
+			}
+		}
+		size_t tileVoxels = sparseLevelSet.getLeafNodes().size() * 512;
+		if (bandCount == 0 || tileVoxels >= (size_t) D * D * D) {
+			throw std::runtime_error(
+					MakeString() << "Unexpected sparse band: " << bandCount << " band voxels in " << tileVoxels << " tile voxels.");
+		}
+	}
+	return true;
+}
 }
@@ -9,6 +9,7 @@
 #include <AlloySparseSolve.h>
 #include <AlloyLocator.h>
 #include <AlloyDelaunay.h>
+#include <AlloyConnectedComponents.h>
 #include "segmentation/MagicPixels.h"
 #include <queue>
 #include <set>
@@ -239,67 +240,12 @@ void MagicPixels::clusterCenterRefinement(Vector2f& pts, int offset,
 }
 int MagicPixels::computeConnectedComponents(const Image1i& labels,
 		Image1i& outLabels, std::vector<int> &compCounts) {
-	const int xShift[8] = { -1, 1, 0, 0, 1, -1, -1, 1 };
-	const int yShift[8] = { 0, 0, -1, 1, -1, 1, -1, 1 };
-	outLabels.resize(labels.width, labels.height);
-	outLabels.set(int1(-1));
-	std::list<int2> queue;
-	int2 pivot(0, 0);
-	int cc = 0;
-	int ccCount = 0;
-	int pivotLabel = 0;
-	compCounts.clear();
-	for (int j = 1; j < labels.height - 1; j++) {
-		for (int i = 1; i < labels.width - 1; i++) {
-			if (labels(i, j).x >= 0) {
-				pivot = int2(i, j);
-				break;
-			}
-		}
+	std::vector<ImageComponent> components;
+	LabelConnectedComponents(labels, -1, outLabels, components, 8);
+	compCounts.resize(components.size());
+	for (size_t i = 0; i < components.size(); i++) {
+		compCounts[i] = (int) components[i].size;
 	}
-	do {
-		queue.clear();
-		outLabels(pivot) = int1(cc);
-		pivotLabel = labels(pivot).x;
-		ccCount = 1;
-		queue.push_back(pivot);
-		while (queue.size() > 0) {
-			int2 v = queue.front();
-			queue.pop_front();
-			for (int s = 0; s < 8; s++) {
-				int2 nbr = int2(v.x + xShift[s], v.y + yShift[s]);
-				if (nbr.x >= 0 && nbr.y >= 0 && nbr.x < outLabels.width
-						&& nbr.y < outLabels.height) {
-					if (outLabels(nbr).x < 0 && labels(nbr).x == pivotLabel) {
-						outLabels(nbr).x = cc;
-						ccCount++;
-						queue.push_back(nbr);
-					}
-				}
-			}
-		}
-		compCounts.push_back(ccCount);
-		pivot = int2(-1, -1);
-		for (int t = 0; t < 16; t++) {
-			int i = RandomUniform(0, labels.width - 1);
-			int j = RandomUniform(0, labels.height - 1);
-			if (outLabels(i, j).x < 0 && labels(i, j).x >= 0) {
-				pivot = int2(i, j);
-				break;
-			}
-		}
-		if (pivot.x < 0) {
-			for (int j = 1; j < labels.height - 1; j++) {
-				for (int i = 1; i < labels.width - 1; i++) {
-					if (outLabels(i, j).x < 0 && labels(i, j).x >= 0) {
-						pivot = int2(i, j);
-						break;
-					}
-				}
-			}
-		}
-		cc++;
-	} while (pivot.x >= 0);
 	return (int) compCounts.size();
 }
 int MagicPixels::makeLabelsUnique(Image1i& outImage) {
@@ -182,38 +182,52 @@ void Manifold2D::updateNormals() {
 		normals[i / 2] = float2(-norm.y, norm.x);
 	}
 }
-void ReadContourFromFile(const std::string& file, Manifold2D& params) {
-	std::string ext = GetFileExtension(file);
+void ReadContourFromStream(std::istream& is, const std::string& ext,
+		Manifold2D& params) {
 	if (ext == "json") {
-		std::ifstream os(file);
-		cereal::JSONInputArchive archive(os);
+		cereal::JSONInputArchive archive(is);
 		archive(cereal::make_nvp("contour", params));
 	} else if (ext == "xml") {
-		std::ifstream os(file);
-		cereal::XMLInputArchive archive(os);
+		cereal::XMLInputArchive archive(is);
 		archive(cereal::make_nvp("contour", params));
 	} else {
-		std::ifstream os(file, std::ios::binary);
-		cereal::PortableBinaryInputArchive archive(os);
+		cereal::PortableBinaryInputArchive archive(is);
 		archive(cereal::make_nvp("contour", params));
 	}
 }
-void WriteContourToFile(const std::string& file, Manifold2D& params) {
-	params.setFile(file);
-	std::string ext = GetFileExtension(file);
+void WriteContourToStream(std::ostream& os, const std::string& ext,
+		Manifold2D& params) {
 	if (ext == "json") {
-		std::ofstream os(file);
 		cereal::JSONOutputArchive archive(os);
 		archive(cereal::make_nvp("contour", params));
 	} else if (ext == "xml") {
-		std::ofstream os(file);
 		cereal::XMLOutputArchive archive(os);
 		archive(cereal::make_nvp("contour", params));
 	} else {
-		std::ofstream os(file, std::ios::binary);
 		cereal::PortableBinaryOutputArchive archive(os);
 		archive(cereal::make_nvp("contour", params));
 	}
+}
+void ReadContourFromFile(const std::string& file, Manifold2D& params) {
+	std::string ext = GetFileExtension(file);
+	if (ext == "json" || ext == "xml") {
+		std::ifstream is(file);
+		ReadContourFromStream(is, ext, params);
+	} else {
+		std::ifstream is(file, std::ios::binary);
+		ReadContourFromStream(is, ext, params);
+	}
+}
+void WriteContourToFile(const std::string& file, Manifold2D& params) {
+	params.setFile(file);
+	std::string ext = GetFileExtension(file);
+	if (ext == "json" || ext == "xml") {
+		std::ofstream os(file);
+		WriteContourToStream(os, ext, params);
+	} else {
+		std::ofstream os(file, std::ios::binary);
+		WriteContourToStream(os, ext, params);
+	}
 	params.setFile(file);
 }
 
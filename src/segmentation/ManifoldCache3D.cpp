@@ -20,86 +20,332 @@
  */
 #include <segmentation/ManifoldCache3D.h>
 #include "AlloyFileUtil.h"
+#include <sstream>
+#include <iostream>
 namespace aly {
+void CacheElement3D::read(const std::shared_ptr<std::string>& data,
+		const std::vector<char>& packed, Manifold3D& out) const {
+	std::string ext = GetFileExtension(contourFile);
+	if (data.get() != nullptr) {
+		std::istringstream is(*data, std::ios::binary);
+		ReadContourFromStream(is, ext, out);
+	} else if (packed.size() > 0) {
+		std::vector<char> raw;
+		DecompressBinaryData(packed, raw);
+		std::istringstream is(std::string(raw.begin(), raw.end()),
+				std::ios::binary);
+		ReadContourFromStream(is, ext, out);
+	} else {
+		ReadContourFromFile(contourFile, out);
+	}
+}
 void CacheElement3D::load() {
-	std::lock_guard<std::mutex> lockMe(accessLock);
-	if (!loaded) {
-		contour.reset(new Manifold3D());
-		ReadContourFromFile(contourFile, *contour);
-		//std::cout << "Load: " << contour->getFile() << std::endl;
-		loaded = true;
+	TaskHandle task;
+	{
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		if (loaded) {
+			return;
+		}
+		if (staged.get() == nullptr && prefetchRequested
+				&& prefetchTask.get() != nullptr && !prefetchTask->isDone()
+				&& !prefetchTask->isCanceled()) {
+			task = prefetchTask;
+		}
+	}
+	//Join a prefetch that is already decoding this frame instead of decoding it twice.
+	if (task.get() != nullptr) {
+		AlloyDefaultWorkerPool().wait(task);
+	}
+	while (true) {
+		std::shared_ptr<std::string> data;
+		std::vector<char> packed;
+		uint64_t v;
+		{
+			std::lock_guard<std::mutex> lockMe(accessLock);
+			if (loaded) {
+				return;
+			}
+			if (staged.get() != nullptr) {
+				contour = staged;
+				staged.reset();
+				prefetchRequested = false;
+				loaded = true;
+				return;
+			}
+			data = pending;
+			if (data.get() == nullptr) {
+				packed = compressed;
+			}
+			v = version;
+		}
+		std::shared_ptr<Manifold3D> next(new Manifold3D());
+		read(data, packed, *next);
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		if (!loaded && version == v) {
+			//std::cout << "Load: " << next->getFile() << std::endl;
+			contour = next;
+			prefetchRequested = false;
+			loaded = true;
+			return;
+		}
 	}
 }
-void CacheElement3D::unload() {
+void CacheElement3D::unload(bool compress) {
 	std::lock_guard<std::mutex> lockMe(accessLock);
 	if (loaded) {
-		if (writeOnce) {
-			WriteContourToFile(contour->getFile(), *contour);
-			//std::cout<<"Unload: "<<contour->getFile()<<std::endl;
+		keepCompressed = compress;
+		if (writeOnce || (compress && compressed.size() == 0)) {
+			//Serialize here so the contour (and any GL state it owns) is released on the calling thread.
+			contour->setFile(contourFile);
+			std::ostringstream os(std::ios::binary);
+			WriteContourToStream(os, GetFileExtension(contourFile), *contour);
+			std::shared_ptr<std::string> data(new std::string(os.str()));
+			std::string file = contourFile;
+			bool write = writeOnce;
+			uint64_t v = version;
+			std::vector<TaskHandle> deps;
+			if (writeTask.get() != nullptr) {
+				deps.push_back(writeTask);
+			}
+			pending = data;
+			writeTask = AlloyDefaultWorkerPool().submit([this, data, file, write, v]() {
+				bool written = true;
+				if (write) {
+					try {
+						WriteBinaryFile(file, data->data(), data->size());
+					} catch (std::exception& e) {
+						std::cerr << "Cache write-back failed: " << e.what() << std::endl;
+						written = false;
+					}
+				}
+				bool pack;
+				{
+					std::lock_guard<std::mutex> lockMe(accessLock);
+					pack = keepCompressed && version == v;
+				}
+				std::vector<char> packed;
+				if (pack) {
+					CompressBinaryData(std::vector<char>(data->begin(), data->end()), packed);
+				}
+				std::lock_guard<std::mutex> lockMe(accessLock);
+				if (pack && keepCompressed && version == v) {
+					compressed.swap(packed);
+				}
+				//Keep the serialized copy resident if it never reached disk.
+				if (written && pending == data) {
+					pending.reset();
+				}
+			}, TaskPriority::Normal, deps);
+			//std::cout<<"Unload: "<<contourFile<<std::endl;
 			writeOnce = false;
 		}
 		contour.reset();
 		loaded = false;
 	}
 }
+void CacheElement3D::releaseCompressed() {
+	std::lock_guard<std::mutex> lockMe(accessLock);
+	keepCompressed = false;
+	std::vector<char>().swap(compressed);
+}
+void CacheElement3D::prefetch() {
+	std::shared_ptr<std::string> data;
+	std::vector<char> packed;
+	uint64_t v;
+	{
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		if (loaded || staged.get() != nullptr || !prefetchRequested) {
+			return;
+		}
+		data = pending;
+		if (data.get() == nullptr) {
+			packed = compressed;
+		}
+		v = version;
+	}
+	std::shared_ptr<Manifold3D> next(new Manifold3D());
+	try {
+		read(data, packed, *next);
+	} catch (std::exception& e) {
+		std::cerr << "Cache prefetch failed: " << e.what() << std::endl;
+		return;
+	}
+	std::lock_guard<std::mutex> lockMe(accessLock);
+	if (!loaded && prefetchRequested && version == v) {
+		staged = next;
+	}
+}
+void CacheElement3D::requestPrefetch() {
+	std::lock_guard<std::mutex> lockMe(accessLock);
+	if (loaded) {
+		return;
+	}
+	prefetchRequested = true;
+	if (staged.get() != nullptr
+			|| (prefetchTask.get() != nullptr && !prefetchTask->isDone()
+					&& !prefetchTask->isCanceled())) {
+		return;
+	}
+	prefetchTask = AlloyDefaultWorkerPool().submit([this]() {
+		prefetch();
+	}, TaskPriority::Low);
+}
+void CacheElement3D::cancelPrefetch() {
+	std::lock_guard<std::mutex> lockMe(accessLock);
+	prefetchRequested = false;
+	staged.reset();
+	if (prefetchTask.get() != nullptr) {
+		AlloyDefaultWorkerPool().cancel(prefetchTask);
+	}
+}
+void CacheElement3D::flush() {
+	TaskHandle task;
+	{
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		task = writeTask;
+	}
+	AlloyDefaultWorkerPool().wait(task);
+}
 void CacheElement3D::set(const Manifold3D& springl) {
+	std::lock_guard<std::mutex> lockMe(accessLock);
 	contour.reset(new Manifold3D());
 	*contour = springl;
 	contourFile = springl.getFile();
+	version++;
+	writeOnce = true;
+	keepCompressed = false;
+	prefetchRequested = false;
+	staged.reset();
+	pending.reset();
+	std::vector<char>().swap(compressed);
 	loaded = true;
 }
 std::shared_ptr<Manifold3D> CacheElement3D::getContour() {
 	load();
 	return contour;
 }
+void ManifoldCache3D::evict(std::vector<CacheVictim3D>& victims) {
+	while ((int) loadedList.size() >= maxElements) {
+		int frame = loadedList.begin()->second;
+		auto iter = cache.find(frame);
+		if (iter != cache.end()) {
+			victims.push_back(CacheVictim3D(frame, iter->second));
+		}
+		loadedList.erase(loadedList.begin());
+	}
+}
+void ManifoldCache3D::release(const std::vector<CacheVictim3D>& victims) {
+	if (victims.size() == 0) {
+		return;
+	}
+	bool compress;
+	{
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		compress = (maxCompressedElements > 0);
+	}
+	for (const CacheVictim3D& victim : victims) {
+		victim.second->unload(compress);
+	}
+	if (compress) {
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		for (const CacheVictim3D& victim : victims) {
+			compressedList.remove(victim.first);
+			compressedList.push_back(victim.first);
+		}
+		while ((int) compressedList.size() > maxCompressedElements) {
+			auto iter = cache.find(compressedList.front());
+			if (iter != cache.end()) {
+				iter->second->releaseCompressed();
+			}
+			compressedList.pop_front();
+		}
+	}
+}
 std::shared_ptr<CacheElement3D> ManifoldCache3D::set(int frame,
 		const Manifold3D& springl) {
-	std::lock_guard<std::mutex> lockMe(accessLock);
-	auto iter = cache.find(frame);
 	std::shared_ptr<CacheElement3D> elem;
-	if (iter != cache.end()) {
-		elem = iter->second;
-	} else {
-		elem = std::shared_ptr<CacheElement3D>(new CacheElement3D());
-		cache[frame] = elem;
+	{
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		auto iter = cache.find(frame);
+		if (iter != cache.end()) {
+			elem = iter->second;
+			compressedList.remove(frame);
+		} else {
+			elem = std::shared_ptr<CacheElement3D>(new CacheElement3D());
+			cache[frame] = elem;
+		}
 	}
 	elem->set(springl);
-	if (elem->isLoaded()) {
-		while ((int) loadedList.size() >= maxElements) {
-			cache[loadedList.begin()->second]->unload();
-			loadedList.erase(loadedList.begin());
-		}
+	std::vector<CacheVictim3D> victims;
+	{
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		evict(victims);
 		loadedList.insert(std::pair<uint64_t, int>(counter++, frame));
 	}
+	release(victims);
 	return elem;
 }
 int ManifoldCache3D::unload() {
-	int sz = (int)loadedList.size();
-	for(auto pr:loadedList){
-		cache[pr.second]->unload();
+	std::vector<CacheVictim3D> victims;
+	{
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		for (auto pr : loadedList) {
+			auto iter = cache.find(pr.second);
+			if (iter != cache.end()) {
+				victims.push_back(CacheVictim3D(pr.second, iter->second));
+			}
+		}
+		loadedList.clear();
 	}
-	loadedList.clear();
-	return sz;
+	release(victims);
+	return (int) victims.size();
 }
 std::shared_ptr<CacheElement3D> ManifoldCache3D::get(int frame) {
-	std::lock_guard<std::mutex> lockMe(accessLock);
-	auto iter = cache.find(frame);
-	if (iter != cache.end()) {
-		std::shared_ptr<CacheElement3D> elem = iter->second;
+	std::shared_ptr<CacheElement3D> elem;
+	std::vector<CacheVictim3D> victims;
+	{
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		auto iter = cache.find(frame);
+		if (iter == cache.end()) {
+			return std::shared_ptr<CacheElement3D>();
+		}
+		elem = iter->second;
 		if (!elem->isLoaded()) {
-			while ((int) loadedList.size() >= maxElements) {
-				cache[loadedList.begin()->second]->unload();
-				loadedList.erase(loadedList.begin());
-			}
-			elem->load();
+			evict(victims);
 			loadedList.insert(std::pair<uint64_t, int>(counter++, frame));
 		}
-		return elem;
-	} else {
-		return std::shared_ptr<CacheElement3D>();
+		//Decode neighbors in the background so scrubbing through frames does not stall on disk.
+		std::set<int> window;
+		for (int f = frame - prefetchRadius; f <= frame + prefetchRadius; f++) {
+			auto next = cache.find(f);
+			if (f != frame && next != cache.end() && !next->second->isLoaded()) {
+				window.insert(f);
+			}
+		}
+		for (int f : prefetchList) {
+			if (window.find(f) == window.end()) {
+				auto next = cache.find(f);
+				if (next != cache.end()) {
+					next->second->cancelPrefetch();
+				}
+			}
+		}
+		for (int f : window) {
+			cache[f]->requestPrefetch();
+		}
+		prefetchList = window;
 	}
+	//Serializing evicted frames and decoding this one are the slow parts, so neither holds the cache lock.
+	release(victims);
+	elem->load();
+	return elem;
 }
 CacheElement3D::~CacheElement3D() {
+	if (prefetchTask.get() != nullptr) {
+		AlloyDefaultWorkerPool().cancel(prefetchTask);
+		AlloyDefaultWorkerPool().wait(prefetchTask);
+	}
+	AlloyDefaultWorkerPool().wait(writeTask);
 	if (FileExists(contourFile)) {
 		RemoveFile(contourFile);
 		std::string imageFile = GetFileWithoutExtension(contourFile) + ".png";
@@ -107,11 +353,34 @@ CacheElement3D::~CacheElement3D() {
 			RemoveFile(imageFile);
 	}
 }
+void ManifoldCache3D::flush() {
+	std::vector<std::shared_ptr<CacheElement3D>> elems;
+	{
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		for (auto pr : cache) {
+			elems.push_back(pr.second);
+		}
+	}
+	for (std::shared_ptr<CacheElement3D>& elem : elems) {
+		elem->flush();
+	}
+}
 void ManifoldCache3D::clear() {
-	std::lock_guard<std::mutex> lockMe(accessLock);
-	counter = 0;
-	loadedList.clear();
-	cache.clear();
-
+	//Elements wait for their write-backs when destroyed, so they are released after the lock.
+	std::map<int, std::shared_ptr<CacheElement3D>> old;
+	{
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		for (int f : prefetchList) {
+			auto iter = cache.find(f);
+			if (iter != cache.end()) {
+				iter->second->cancelPrefetch();
+			}
+		}
+		counter = 0;
+		prefetchList.clear();
+		compressedList.clear();
+		loadedList.clear();
+		cache.swap(old);
+	}
 }
 }
@@ -480,8 +480,7 @@ void MultiIsoSurface::regularize(const EndlessGridFloatInt& grid, Mesh& mesh,
 	const int REGULARIZE_ITERATIONS = 3;
 	const float TRACE_THRESHOLD = 1E-5f;
 	std::vector<float3> tmpPoints(mesh.vertexLocations.size());
-	std::vector<std::unordered_set<uint32_t>> vertNbrs;
-	CreateVertexNeighborTable(mesh, vertNbrs);
+	const MeshNeighborTable& vertNbrs = mesh.getAdjacency().vertexNeighbors;
 	for (int c = 0; c < REGULARIZE_ITERATIONS; c++) {
 #pragma omp parallel for
 		for (int i = 0; i < (int) vertNbrs.size(); i++) {
@@ -526,8 +525,7 @@ void MultiIsoSurface::regularize(const float* data, Mesh& mesh, int label) {
 	const int REGULARIZE_ITERATIONS = 3;
 	const float TRACE_THRESHOLD = 1E-5f;
 	std::vector<float3> tmpPoints(mesh.vertexLocations.size());
-	std::vector<std::unordered_set<uint32_t>> vertNbrs;
-	CreateVertexNeighborTable(mesh, vertNbrs);
+	const MeshNeighborTable& vertNbrs = mesh.getAdjacency().vertexNeighbors;
 	for (int c = 0; c < REGULARIZE_ITERATIONS; c++) {
 #pragma omp parallel for
 		for (int i = 0; i < (int) vertNbrs.size(); i++) {
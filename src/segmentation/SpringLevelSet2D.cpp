@@ -196,26 +196,21 @@ namespace aly {
 		return pt;
 	}
 	void SpringLevelSet2D::updateNearestNeighbors(float maxDistance) {
-		matcher.reset(new Matcher2f(contour.points));
+		locator.setCellSize(maxDistance);
+		locator.build(contour.points);
+		std::vector<uint32_t> offsets;
+		std::vector<std::pair<size_t, float>> neighbors;
+		locator.neighbors(maxDistance, offsets, neighbors);
 		nearestNeighbors.clear();
 		nearestNeighbors.resize(contour.points.size(), std::list<uint32_t>());
 		int N = (int)contour.points.size();
+		//Points 2p and 2p+1 are the end points of springl p, so skip the other end (i^1).
 #pragma omp parallel for
-		for (int i = 0;i < N;i += 2) {
-			float2 pt0 = contour.points[i];
-			float2 pt1 = contour.points[i + 1];
-			std::vector<std::pair<size_t, float>> result;
-			matcher->closest(pt0, maxDistance, result);
-			for (auto pr : result) {
-				if ((int)pr.first != i&&(int)pr.first != i + 1) {
-					nearestNeighbors[i].push_back((uint32_t)pr.first);
-					break;
-				}
-			}
-			matcher->closest(pt1, maxDistance, result);
-			for (auto pr : result) {
-				if ((int)pr.first != i&&(int)pr.first != i + 1) {
-					nearestNeighbors[i + 1].push_back((uint32_t)pr.first);
+		for (int i = 0;i < N;i++) {
+			for (uint32_t k = offsets[i];k < offsets[i + 1];k++) {
+				int j = (int)neighbors[k].first;
+				if (j != (i ^ 1)) {
+					nearestNeighbors[i].push_back((uint32_t)j);
 					break;
 				}
 			}
@@ -264,7 +259,8 @@ namespace aly {
 		int invalid = 0;
 		do {
 			invalid = 0;
-			matcher.reset(new Matcher2f(oldPoints));
+			locator.setCellSize(maxDistance);
+			locator.build(oldPoints);
 			std::vector<int> retrack;
 			for (size_t i = 0;i < contour.particles.size();i++) {
 				if (std::isinf(contour.correspondence[i].x)) {
@@ -281,7 +277,7 @@ namespace aly {
 				std::vector<std::pair<size_t, float>> result;
 				float2 q1(std::numeric_limits<float>::infinity());
 				float2 q2(std::numeric_limits<float>::infinity());
-				matcher->closest(pt0, maxDistance, result);
+				locator.closest(pt0, maxDistance, result);
 				std::array<float2, 4> velocities;
 				for (auto pr : result) {
 					q1 = oldCorrespondences[pr.first / 2];
@@ -293,7 +289,7 @@ namespace aly {
 					}
 				}
 				result.clear();
-				matcher->closest(pt1, maxDistance, result);
+				locator.closest(pt1, maxDistance, result);
 				for (auto pr : result) {
 					q2 = oldCorrespondences[pr.first / 2];
 					if (!std::isinf(q2.x)) {
@@ -148,7 +148,7 @@ void Epnp::choose_control_points(void) {
 		for (int j = 0; j < 3; j++)
 			PW0(i, j) = pws[3 * i + j] - cws[0][j];
 
-	DenseMat<double> PW0tPW0 = PW0.transpose() * PW0;
+	DenseMat<double> PW0tPW0 = Gram(PW0);
 	DenseMat<double> U;
 	DenseMat<double> D;
 	DenseMat<double> Vt;
@@ -239,7 +239,7 @@ double Epnp::compute_pose(double R[3][3], double t[3]) {
 	for (int i = 0; i < number_of_correspondences; i++){
 		fill_M(M, 2 * i, alphas + 4 * i, us[2 * i], us[2 * i + 1]);
 	}
-	DenseMat<double> MtM = M.transpose() * M;
+	DenseMat<double> MtM = Gram(M);
 	DenseMat<double> U, D, Vt;
 	SVD(MtM, U, D, Vt);
 	DenseMat<double> Ut = U.transpose();
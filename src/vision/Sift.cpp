@@ -10,6 +10,7 @@
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
+#include <cstring>
 #include <AlloyImageProcessing.h>
 #include <omp.h>
 #include "vision/Sift.h"
@@ -107,15 +108,31 @@ void Sift::add(const Image1f& image, float has_sigma, float target_sigma) {
 	oct->gray[0]=base;
 	float const k = std::pow(2.0f, 1.0f / this->options.samplesPerOctave);
 	sigma = target_sigma;
+	/* Each blur depends on the previous one, but the convolutions are tiled across threads. */
 	for (int i = 1; i < this->options.samplesPerOctave + 3; ++i) {
 		/* Calculate the blur sigma the image will get. */
 		float sigmak = sigma * k;
 		float blur_sigma = std::sqrt(MATH_POW2(sigmak) - MATH_POW2(sigma));
-		aly::Smooth(base, oct->gray[i], blur_sigma);
-		oct->dog[i-1]=oct->gray[i] - base;
-		base = oct->gray[i];
+		aly::Smooth(oct->gray[i - 1], oct->gray[i], blur_sigma);
 		sigma = sigmak;
-		//WriteImageToFile(MakeString()<<GetDesktopDirectory()<<ALY_PATH_SEPARATOR<<"sift_dog"<<this->octaves.size()<<"_"<<i-1<<".xml",oct->dog[i-1]);
+	}
+	/* All DoG images of the octave in one parallel pass over (level, row). */
+	int const width = base.width;
+	int const height = base.height;
+	int const levels = (int) oct->dog.size();
+	for (int i = 0; i < levels; ++i) {
+		oct->dog[i].resize(width, height);
+	}
+#pragma omp parallel for
+	for (int t = 0; t < levels * height; ++t) {
+		int const i = t / height;
+		size_t const off = (size_t) (t % height) * width;
+		const float* a = oct->gray[i + 1].ptr() + off;
+		const float* b = oct->gray[i].ptr() + off;
+		float* d = oct->dog[i].ptr() + off;
+		for (int x = 0; x < width; ++x) {
+			d[x] = a[x] - b[x];
+		}
 	}
 }
 
@@ -124,38 +141,74 @@ void Sift::add(const Image1f& image, float has_sigma, float target_sigma) {
 void Sift::extremaDetection(void) {
 	/* Delete previous keypoints. */
 	this->keypoints.clear();
-	/* Detect keypoints in each octave... */
+	/*
+	 * Every octave contributes S scale samples, each compared against the DoG images above
+	 * and below. Rows of every sample are split into blocks that detect into their own
+	 * buffers, which are concatenated in order afterwards.
+	 */
+	const int ROW_BLOCK = 32;
+	struct Task {
+		const aly::Image1f* samples[3];
+		int octave;
+		int sample;
+		int y0, y1;
+	};
+	std::vector<Task> tasks;
 	for (std::size_t i = 0; i < this->octaves.size(); ++i) {
 		OctavePtr oct=this->octaves[i];
 		/* In each octave, take three subsequent DoG images and detect. */
 		for (int s = 0; s < (int) oct->dog.size() - 2; ++s) {
-			const aly::Image1f* samples[3] = { &oct->dog[s + 0], &oct->dog[s + 1],&oct->dog[s + 2] };
-			this->extremaDetection(samples,static_cast<int>(i) + this->options.minOctave, s);
+			int const h = oct->dog[s + 1].height;
+			for (int y = 1; y < h - 1; y += ROW_BLOCK) {
+				Task task;
+				task.samples[0] = &oct->dog[s + 0];
+				task.samples[1] = &oct->dog[s + 1];
+				task.samples[2] = &oct->dog[s + 2];
+				task.octave = static_cast<int>(i) + this->options.minOctave;
+				task.sample = s;
+				task.y0 = y;
+				task.y1 = std::min(h - 1, y + ROW_BLOCK);
+				tasks.push_back(task);
+			}
 		}
 	}
+	std::vector<Keypoints> buffers(tasks.size());
+#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < (int) tasks.size(); ++t) {
+		const Task& task = tasks[t];
+		this->extremaDetection(task.samples, task.octave, task.sample, task.y0, task.y1, buffers[t]);
+	}
+	size_t total = 0;
+	for (const Keypoints& buffer : buffers) {
+		total += buffer.size();
+	}
+	this->keypoints.reserve(total);
+	for (const Keypoints& buffer : buffers) {
+		this->keypoints.insert(this->keypoints.end(), buffer.begin(), buffer.end());
+	}
 }
 
 /* ---------------------------------------------------------------- */
 
-std::size_t Sift::extremaDetection(const aly::Image1f* s[3], int oi, int si) {
+std::size_t Sift::extremaDetection(const aly::Image1f* const s[3], int oi, int si, int y0, int y1, Keypoints& result) const {
 	int const w = s[1]->width;
-	int const h = s[1]->height;
 	const int noff[9] = { -1 - w, 0 - w, 1 - w, -1, 0, 1, -1 + w, 0 + w, 1 + w };
+	const float* layers[3] = { s[0]->ptr(), s[1]->ptr(), s[2]->ptr() };
 	int detected = 0;
-	int off = w;
-	for (int y = 1; y < h - 1; ++y, off += w){
+	int off = y0 * w;
+	for (int y = y0; y < y1; ++y, off += w){
 		for (int x = 1; x < w - 1; ++x) {
 			int idx = off + x;
 			bool largest = true;
 			bool smallest = true;
-			float center_value = (*s[1])[idx].x;
+			float center_value = layers[1][idx];
 			for (int l = 0; (largest || smallest) && l < 3; ++l)
 				for (int i = 0; (largest || smallest) && i < 9; ++i) {
 					if (l == 1 && i == 4) // Skip center pixel
 						continue;
-					if ((*s[l])[idx + noff[i]].x >= center_value)
+					if (layers[l][idx + noff[i]] >= center_value)
 						largest = false;
-					if ((*s[l])[idx + noff[i]].x <= center_value)
+					if (layers[l][idx + noff[i]] <= center_value)
 						smallest = false;
 				}
 
@@ -168,7 +221,7 @@ std::size_t Sift::extremaDetection(const aly::Image1f* s[3], int oi, int si) {
 			kp.x = static_cast<float>(x);
 			kp.y = static_cast<float>(y);
 			kp.sample = static_cast<float>(si);
-			this->keypoints.push_back(kp);
+			result.push_back(kp);
 			detected += 1;
 		}
 	}
@@ -184,9 +237,10 @@ void Sift::keypointLocalization(void) {
 	 * around the keypoint.
 	 */
 
-	int num_singular = 0;
-	int num_keypoints = 0; // Write iterator
-	for (std::size_t i = 0; i < this->keypoints.size(); ++i) {
+	/* Keypoints are localized independently and compacted in order afterwards. */
+	std::vector<char> accepted(this->keypoints.size(), 0);
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < (int) this->keypoints.size(); ++i) {
 		SiftKeypoint kp=this->keypoints[i];
 		OctavePtr oct=this->octaves[kp.octave - this->options.minOctave];
 		int sample = static_cast<int>(kp.sample);
@@ -234,7 +288,6 @@ void Sift::keypointLocalization(void) {
 				fy = b[1];
 				fs = b[2];
 			} catch (...) {
-				num_singular += 1;
 				fx = fy = fs = 0.0f; // FIXME: Handle this case?
 				break;
 			}
@@ -288,9 +341,16 @@ void Sift::keypointLocalization(void) {
 				|| kp.y > (float) (h - 1)) {
 			continue;
 		}
-		/* Keypoint is accepted, copy to write iter and advance. */
-		this->keypoints[num_keypoints] = kp;
-		num_keypoints += 1;
+		this->keypoints[i] = kp;
+		accepted[i] = 1;
+	}
+	/* Copy accepted keypoints to write iter and advance. */
+	int num_keypoints = 0; // Write iterator
+	for (std::size_t i = 0; i < this->keypoints.size(); ++i) {
+		if (accepted[i]) {
+			this->keypoints[num_keypoints] = this->keypoints[i];
+			num_keypoints += 1;
+		}
 	}
 	this->keypoints.erase(this->keypoints.begin()+num_keypoints,this->keypoints.end());//resize(num_keypoints);
 }
@@ -316,31 +376,40 @@ void Sift::descriptorGeneration(void) {
 	for(int n=0;n<(int)octaves.size();n++){
 		this->generateFeatureImages(octaves[n].get());
 	}
-	/* Walk over all keypoints and compute descriptors. */
-#pragma omp parallel for
-	for (int i = 0; i < this->keypoints.size(); ++i) {
-		const SiftKeypoint& kp=this->keypoints[i];
-		Octave* octave = this->octaves[kp.octave - this->options.minOctave].get();
+	/*
+	 * Walk over all keypoints and compute descriptors. Blocks of keypoints write to their
+	 * own buffers, so no locking is needed and the output order is deterministic.
+	 */
+	const int KEYPOINT_BLOCK = 64;
+	const int blocks = (int) ((this->keypoints.size() + KEYPOINT_BLOCK - 1) / KEYPOINT_BLOCK);
+	std::vector<SiftDescriptors> buffers(blocks);
+#pragma omp parallel for schedule(dynamic)
+	for (int b = 0; b < blocks; ++b) {
 		std::vector<float> orientations;
 		orientations.reserve(8);
-		this->orientationAssignment(kp, octave, orientations);
-		/* Feature vector extraction. */
-		for (std::size_t j = 0; j < orientations.size(); ++j) {
-			SiftDescriptor desc;
-			float const scale_factor = std::pow(2.0f, kp.octave);
-			desc.x = scale_factor * (kp.x + 0.5f) - 0.5f;
-			desc.y = scale_factor * (kp.y + 0.5f) - 0.5f;
-			desc.scale = this->keypointAbsoluteScale(kp);
-			desc.orientation = orientations[j];
-			//std::cout<<"Descriptor "<<desc.x<<" "<<desc.y<<" "<<desc.scale<<" "<<desc.orientation<<std::endl;
-			if (this->descriptorAssignment(kp, desc, octave)){
-#pragma omp critical
-				{
-					this->descriptors.push_back(desc);
+		int const end = std::min((int) this->keypoints.size(), (b + 1) * KEYPOINT_BLOCK);
+		for (int i = b * KEYPOINT_BLOCK; i < end; ++i) {
+			const SiftKeypoint& kp=this->keypoints[i];
+			Octave* octave = this->octaves[kp.octave - this->options.minOctave].get();
+			orientations.clear();
+			this->orientationAssignment(kp, octave, orientations);
+			/* Feature vector extraction. */
+			for (std::size_t j = 0; j < orientations.size(); ++j) {
+				SiftDescriptor desc;
+				float const scale_factor = std::pow(2.0f, kp.octave);
+				desc.x = scale_factor * (kp.x + 0.5f) - 0.5f;
+				desc.y = scale_factor * (kp.y + 0.5f) - 0.5f;
+				desc.scale = this->keypointAbsoluteScale(kp);
+				desc.orientation = orientations[j];
+				if (this->descriptorAssignment(kp, desc, octave)){
+					buffers[b].push_back(desc);
 				}
 			}
 		}
 	}
+	for (const SiftDescriptors& buffer : buffers) {
+		this->descriptors.insert(this->descriptors.end(), buffer.begin(), buffer.end());
+	}
 }
 
 /* ---------------------------------------------------------------- */
@@ -355,8 +424,9 @@ void Sift::generateFeatureImages(Octave* octave) {
 		aly::Image1f& img = octave->gray[i];
 		aly::Image1f& grad=octave->gradient[i];
 		aly::Image1f& ori=octave->orientation[i];
-		int image_iter = width + 1;
-		for (int y = 1; y < height - 1; ++y, image_iter += 2){
+#pragma omp parallel for
+		for (int y = 1; y < height - 1; ++y){
+			int image_iter = y * width + 1;
 			for (int x = 1; x < width - 1; ++x, ++image_iter) {
 				float m1x = img[image_iter - 1];
 				float p1x = img[image_iter + 1];
@@ -663,4 +733,127 @@ void Sift::loadLoweDescriptors(std::string const& filename,
 	in.close();
 }
 
+/* ---------------------------------------------------------------- */
+
+/**
+ * Descriptors copied into one contiguous N x 128 buffer, which serves as the
+ * nanoflann dataset adaptor for the kd-tree built over it.
+ */
+struct SiftMatcher::Index {
+	typedef nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<float, Index, float>, Index, 128, int> tree_t;
+	std::vector<float> data;
+	size_t count;
+	std::unique_ptr<tree_t> tree;
+	Index(const SiftDescriptors& descriptors, int leafSize) :
+			data(descriptors.size() * 128), count(descriptors.size()) {
+		for (size_t i = 0; i < count; i++) {
+			std::memcpy(&data[i * 128], &descriptors[i].data[0], 128 * sizeof(float));
+		}
+		tree.reset(new tree_t(128, *this, nanoflann::KDTreeSingleIndexAdaptorParams(std::max(1, leafSize))));
+		tree->buildIndex();
+	}
+	inline size_t kdtree_get_point_count() const {
+		return count;
+	}
+	inline float kdtree_distance(const float* p1, const size_t idx_p2, size_t size) const {
+		const float* p2 = &data[idx_p2 * 128];
+		float d = 0.0f;
+		for (size_t i = 0; i < size; i++) {
+			float diff = p1[i] - p2[i];
+			d += diff * diff;
+		}
+		return d;
+	}
+	inline float kdtree_get_pt(const size_t idx, int dim) const {
+		return data[idx * 128 + dim];
+	}
+	template<class BBOX> bool kdtree_get_bbox(BBOX &bb) const {
+		return false;
+	}
+};
+SiftMatcher::SiftMatcher(const SiftDescriptors& train, const SiftMatchOptions& options) :
+		index(new Index(train, options.leafSize)), options(options) {
+}
+size_t SiftMatcher::size() const {
+	return index->count;
+}
+int SiftMatcher::nearest(const SiftDescriptor& query, int* indexes, float* distancesSq, int k) const {
+	if (index->count == 0 || k <= 0)
+		return 0;
+	nanoflann::KNNResultSet<float, int> resultSet(k);
+	resultSet.init(indexes, distancesSq);
+	index->tree->findNeighbors(resultSet, &query.data[0], nanoflann::SearchParams(32, options.epsilon, true));
+	return static_cast<int>(resultSet.size());
+}
+void SiftMatcher::match(const SiftDescriptors& query, std::vector<SiftMatch>& matches) const {
+	const float ratioSq = options.ratio * options.ratio;
+	std::vector<SiftMatch> all(query.size());
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int q = 0; q < (int) query.size(); q++) {
+		int indexes[2];
+		float distances[2];
+		/* Ratio test needs a second neighbor; single-element train sets never match. */
+		if (nearest(query[q], indexes, distances, 2) == 2 && distances[0] < ratioSq * distances[1]) {
+			all[q] = SiftMatch(q, indexes[0], std::sqrt(distances[0]));
+		}
+	}
+	matches.clear();
+	for (const SiftMatch& m : all) {
+		if (m.query >= 0)
+			matches.push_back(m);
+	}
+}
+namespace detail {
+/* Removes matches whose train descriptor does not map back to the same query descriptor. */
+void CrossCheckSiftMatches(const SiftMatcher& reverse, const SiftDescriptors& train, std::vector<SiftMatch>& matches) {
+	std::vector<char> keep(matches.size(), 0);
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < (int) matches.size(); i++) {
+		int index;
+		float distance;
+		if (reverse.nearest(train[matches[i].train], &index, &distance, 1) == 1 && index == matches[i].query)
+			keep[i] = 1;
+	}
+	size_t n = 0;
+	for (size_t i = 0; i < matches.size(); i++) {
+		if (keep[i])
+			matches[n++] = matches[i];
+	}
+	matches.resize(n);
+}
+}
+void MatchSiftDescriptors(const SiftDescriptors& query, const SiftDescriptors& train, std::vector<SiftMatch>& matches,
+		const SiftMatchOptions& options) {
+	SiftMatcher matcher(train, options);
+	matcher.match(query, matches);
+	if (options.crossCheck) {
+		detail::CrossCheckSiftMatches(SiftMatcher(query, options), train, matches);
+	}
+}
+void MatchSiftDescriptors(const std::vector<SiftDescriptors>& sets, const std::vector<int2>& pairs,
+		std::vector<std::vector<SiftMatch>>& matches, const SiftMatchOptions& options) {
+	/* Build each needed index once, in parallel. */
+	std::vector<char> used(sets.size(), 0);
+	for (const int2& pair : pairs) {
+		if (pair.x < 0 || pair.y < 0 || pair.x >= (int) sets.size() || pair.y >= (int) sets.size())
+			throw std::runtime_error(MakeString() << "Invalid descriptor set pair " << pair << " for " << sets.size() << " sets.");
+		used[pair.y] = 1;
+		if (options.crossCheck)
+			used[pair.x] = 1;
+	}
+	std::vector<std::shared_ptr<SiftMatcher>> matchers(sets.size());
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int) sets.size(); i++) {
+		if (used[i])
+			matchers[i].reset(new SiftMatcher(sets[i], options));
+	}
+	matches.resize(pairs.size());
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int) pairs.size(); i++) {
+		const int2& pair = pairs[i];
+		matchers[pair.y]->match(sets[pair.x], matches[i]);
+		if (options.crossCheck)
+			detail::CrossCheckSiftMatches(*matchers[pair.x], sets[pair.y], matches[i]);
+	}
+}
 }